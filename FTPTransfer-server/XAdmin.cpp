@@ -0,0 +1,214 @@
+#include "XAdmin.h"
+#include "XMetrics.h"
+#include "XRateLimit.h"
+#include "testUtil.h"
+
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/buffer.h>
+#include <event2/keyvalq_struct.h>
+#include <map>
+#include <vector>
+
+using namespace std;
+
+#define XADMIN_TICK_MS 1000
+
+
+bool XAdmin::Start(event_base *base, const string &addr, int port){
+    if(port <= 0){
+        Logger::info("XAdmin::Start() -> admin port disabled");
+        return false;
+    }
+
+    http = evhttp_new(base);
+    if(!http){
+        Logger::error("XAdmin::Start() -> evhttp_new failed");
+        return false;
+    }
+    evhttp_set_allowed_methods(http, EVHTTP_REQ_GET | EVHTTP_REQ_HEAD | EVHTTP_REQ_POST);
+    evhttp_set_cb(http, "/metrics", MetricsCB, this);
+    evhttp_set_cb(http, "/ratelimit", RateLimitCB, this);
+    evhttp_set_gencb(http, NotFoundCB, this);
+    if(!evhttp_bind_socket_with_handle(http, addr.c_str(), port)){
+        Logger::error("XAdmin::Start() -> cannot bind ", addr, ":", port);
+        evhttp_free(http);
+        http = nullptr;
+        return false;
+    }
+
+    metric_bytes_rate = XMetrics::Get()->Register(XMETRIC_GAUGE, "ftp_transfer_bytes_per_second",
+                                                  "Data connection throughput over the last second");
+    metric_handshake_rate = XMetrics::Get()->Register(XMETRIC_GAUGE, "ftp_tls_handshakes_per_second",
+                                                      "Completed control TLS handshakes over the last second");
+    last_tick_us = XMetrics::NowUs();
+
+    tick = event_new(base, -1, EV_PERSIST, TickCB, this);
+    timeval tv = {XADMIN_TICK_MS / 1000, (XADMIN_TICK_MS % 1000) * 1000};
+    event_add(tick, &tv);
+
+    Logger::info("XAdmin::Start() -> metrics on http://", addr, ":", port, "/metrics");
+    return true;
+}
+
+
+void XAdmin::Stop(){
+    if(tick){
+        event_free(tick);
+        tick = nullptr;
+    }
+    if(http){
+        evhttp_free(http);
+        http = nullptr;
+    }
+}
+
+
+void XAdmin::TickCB(evutil_socket_t, short, void *arg){
+    ((XAdmin *)arg)->Tick();
+}
+
+
+void XAdmin::Tick(){
+    uint64_t now = XMetrics::NowUs();
+
+    // 由累计计数器的差值得到速率（指标在首次使用时才注册，所以每次都查找）
+    XMetrics *m = XMetrics::Get();
+    int64_t bytes = m->Sum(m->Find("ftp_transfer_bytes_total", "dir=\"retr\"")) +
+                    m->Sum(m->Find("ftp_transfer_bytes_total", "dir=\"stor\""));
+    int64_t handshakes = m->Sum(m->Find("ftp_tls_handshake_duration_us"));
+    double secs = (now - last_tick_us) / 1e6;
+    if(secs > 0){
+        XMetrics::Set(metric_bytes_rate, (int64_t)((bytes - last_bytes) / secs));
+        XMetrics::Set(metric_handshake_rate, (int64_t)((handshakes - last_handshakes) / secs));
+    }
+    last_tick_us = now;
+    last_bytes = bytes;
+    last_handshakes = handshakes;
+}
+
+
+// 把 le 标签拼到已有标签后面
+static string WithLabel(const string &labels, const string &extra){
+    if(labels.empty()) return "{" + extra + "}";
+    return "{" + labels + "," + extra + "}";
+}
+
+
+string XAdmin::RenderMetrics(){
+    vector<XMetricSample> samples;
+    XMetrics::Get()->Collect(samples);
+
+    // 同名指标（不同标签）归为一组，组按首次注册的顺序输出
+    vector<string> order;
+    map<string, vector<const XMetricSample *>> families;
+    for(auto &s : samples){
+        auto &f = families[s.name];
+        if(f.empty()) order.push_back(s.name);
+        f.push_back(&s);
+    }
+
+    string out;
+    out.reserve(16 * 1024);
+    char num[64];
+    for(auto &name : order){
+        auto &f = families[name];
+        const XMetricSample *first = f.front();
+        string family = name;
+        const char *type = "gauge";
+        if(first->type == XMETRIC_COUNTER){
+            type = "counter";
+            if(family.size() > 6 && family.compare(family.size() - 6, 6, "_total") == 0){
+                family.resize(family.size() - 6);
+            }
+        }
+        else if(first->type == XMETRIC_HISTOGRAM){
+            type = "histogram";
+        }
+        out += "# TYPE " + family + " " + type + "\n";
+        out += "# HELP " + family + " " + first->help + "\n";
+
+        for(auto *s : f){
+            string labels = s->labels.empty() ? "" : "{" + s->labels + "}";
+            if(s->type != XMETRIC_HISTOGRAM){
+                snprintf(num, sizeof(num), " %lld\n", (long long)s->value);
+                out += name + labels + num;
+                continue;
+            }
+
+            // 导出时把对数-线性分桶折叠为 4^k-1 边界（正好是内部桶的上界，计数精确），
+            // 样本全部落入后不再输出更大的边界
+            uint64_t total = 0;
+            for(uint64_t b : s->hist.buckets) total += b;
+            for(uint64_t pow = 1; pow <= (1ull << 48); pow <<= 2){
+                uint64_t le = pow - 1;
+                uint64_t n = s->hist.CountAtMost(le);
+                snprintf(num, sizeof(num), "le=\"%llu\"", (unsigned long long)le);
+                out += name + "_bucket" + WithLabel(s->labels, num);
+                snprintf(num, sizeof(num), " %llu\n", (unsigned long long)n);
+                out += num;
+                if(n == total) break;
+            }
+            snprintf(num, sizeof(num), " %llu\n", (unsigned long long)total);
+            out += name + "_bucket" + WithLabel(s->labels, "le=\"+Inf\"") + num;
+            out += name + "_count" + labels + num;
+            snprintf(num, sizeof(num), " %llu\n", (unsigned long long)s->hist.sum);
+            out += name + "_sum" + labels + num;
+        }
+    }
+    out += "# EOF\n";
+    return out;
+}
+
+
+void XAdmin::MetricsCB(evhttp_request *req, void *arg){
+    XAdmin *self = (XAdmin *)arg;
+    string body = self->RenderMetrics();
+
+    evbuffer *buf = evbuffer_new();
+    evbuffer_add(buf, body.data(), body.size());
+    evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type",
+                      "application/openmetrics-text; version=1.0.0; charset=utf-8");
+    evhttp_send_reply(req, HTTP_OK, "OK", buf);
+    evbuffer_free(buf);
+}
+
+
+// GET 返回当前带宽上限；POST /ratelimit?global=10M&session=1M&user=0 修改（字节/秒，可带 k/M/G，0 为不限）
+void XAdmin::RateLimitCB(evhttp_request *req, void *){
+    if(evhttp_request_get_command(req) == EVHTTP_REQ_POST){
+        static const char *keys[] = {"global", "session", "user"};
+        long long v[3] = {-1, -1, -1};
+        evkeyvalq params;
+        const char *query = evhttp_uri_get_query(evhttp_request_get_evhttp_uri(req));
+        if(!query || evhttp_parse_query_str(query, &params) != 0){
+            evhttp_send_error(req, HTTP_BADREQUEST, "Expected ?global=&session=&user=");
+            return;
+        }
+        bool ok = true;
+        for(int i = 0; i < 3; i++){
+            const char *value = evhttp_find_header(&params, keys[i]);
+            if(!value) continue;
+            v[i] = XRateLimit::ParseRate(value);
+            if(v[i] < 0) ok = false;
+        }
+        evhttp_clear_headers(&params);
+        if(!ok){
+            evhttp_send_error(req, HTTP_BADREQUEST, "Invalid rate");
+            return;
+        }
+        XRateLimit::Get()->SetRates(v[0], v[1], v[2]);
+    }
+
+    string body = XRateLimit::Get()->Describe();
+    evbuffer *buf = evbuffer_new();
+    evbuffer_add(buf, body.data(), body.size());
+    evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "text/plain; charset=utf-8");
+    evhttp_send_reply(req, HTTP_OK, "OK", buf);
+    evbuffer_free(buf);
+}
+
+
+void XAdmin::NotFoundCB(evhttp_request *req, void *){
+    evhttp_send_error(req, HTTP_NOTFOUND, "Not Found");
+}
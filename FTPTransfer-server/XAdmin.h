@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+#include <event2/util.h>
+
+struct event_base;
+struct event;
+struct evhttp;
+struct evhttp_request;
+
+/**
+ * @class XAdmin
+ * @brief 管理端口：以 OpenMetrics 文本格式提供 /metrics，并提供 /ratelimit 查看与调整带宽上限
+ *
+ * 运行在主线程的 event_base 上（与 accept 共用），不占用工作线程。
+ * 同时每秒根据计数器差值计算一次传输字节速率与 TLS 握手速率。
+ */
+class XAdmin{
+public:
+    static XAdmin* Get(){
+        static XAdmin instance;
+        return &instance;
+    }
+
+    // 在 base 上监听 addr:port，port <= 0 时不启动
+    bool Start(event_base *base, const std::string &addr, int port);
+
+    // 关闭监听与定时器，须在释放 base 之前调用
+    void Stop();
+
+    // 生成 OpenMetrics 文本
+    std::string RenderMetrics();
+
+private:
+    XAdmin(){}
+
+    static void MetricsCB(evhttp_request *req, void *arg);
+    static void RateLimitCB(evhttp_request *req, void *arg);
+    static void NotFoundCB(evhttp_request *req, void *arg);
+    static void TickCB(evutil_socket_t fd, short what, void *arg);
+    void Tick();
+
+    evhttp *http = nullptr;
+    event *tick = nullptr;
+
+    // 速率计算用的上一次采样
+    uint64_t last_tick_us = 0;
+    int64_t last_bytes = 0;
+    int64_t last_handshakes = 0;
+    int metric_bytes_rate = -1;
+    int metric_handshake_rate = -1;
+};
@@ -0,0 +1,170 @@
+#include "XAdmission.h"
+#include "XThreadPool.h"
+#include "XMetrics.h"
+#include "XConfig.h"
+#include "testUtil.h"
+
+#include <event2/event.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+using namespace std;
+
+#define XADMISSION_TICK_MS 100
+
+
+void XAdmission::Start(event_base *base){
+    XConfig *conf = XConfig::Get();
+    max_connections = conf->GetInt("max_connections", 0);
+    max_per_ip = conf->GetInt("max_connections_per_ip", 0);
+    accept_rate = (double)conf->GetInt("accept_rate", 0);
+    accept_burst = (double)conf->GetInt("accept_burst", (long long)accept_rate);
+    if(accept_burst < 1) accept_burst = 1;
+    overload_lag_us = (uint64_t)conf->GetInt("overload_lag_ms", 0) * 1000;
+    overload_rss = (uint64_t)conf->GetInt("overload_rss_mb", 0) * 1024 * 1024;
+    backlog = (int)conf->GetInt("listen_backlog", 128);
+    if(backlog <= 0) backlog = 128;
+
+    tokens = accept_burst;
+    tokens_us = XMetrics::NowUs();
+
+    XMetrics *m = XMetrics::Get();
+    for(int r = XADMIT_GLOBAL; r < XADMIT_RESULTS; r++){
+        metric_rejected[r] = m->Register(XMETRIC_COUNTER, "ftp_connections_rejected_total",
+                                         "Connections refused at accept time",
+                                         string("reason=\"") + ReasonName((XAdmitResult)r) + "\"");
+    }
+    metric_overloaded = m->Register(XMETRIC_GAUGE, "ftp_admission_overloaded",
+                                    "1 while new connections are shed because of loop lag or memory");
+    metric_rss = m->Register(XMETRIC_GAUGE, "ftp_process_resident_bytes", "Resident set size of the server");
+
+    tick = event_new(base, -1, EV_PERSIST, TickCB, this);
+    timeval tv = {XADMISSION_TICK_MS / 1000, (XADMISSION_TICK_MS % 1000) * 1000};
+    event_add(tick, &tv);
+
+    Logger::info("XAdmission::Start() -> max_connections ", max_connections, ", per ip ", max_per_ip,
+                 ", accept_rate ", accept_rate, "/s (burst ", accept_burst, "), overload lag ",
+                 overload_lag_us / 1000, "ms, rss ", overload_rss / (1024 * 1024), "MB, backlog ", backlog);
+}
+
+
+const char *XAdmission::ReasonName(XAdmitResult reason){
+    static const char *names[] = {"ok", "global", "per_ip", "rate", "overload"};
+    return reason >= 0 && reason < XADMIT_RESULTS ? names[reason] : "?";
+}
+
+
+void XAdmission::Stop(){
+    if(tick){
+        event_free(tick);
+        tick = nullptr;
+    }
+}
+
+
+uint64_t XAdmission::ResidentBytes(){
+    #if defined(__linux__)
+    // /proc/self/statm 第二列为常驻页数
+    FILE *f = fopen("/proc/self/statm", "r");
+    if(!f) return 0;
+    unsigned long long size = 0, resident = 0;
+    int n = fscanf(f, "%llu %llu", &size, &resident);
+    fclose(f);
+    if(n != 2) return 0;
+    return resident * (uint64_t)sysconf(_SC_PAGESIZE);
+    #elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if(task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) return 0;
+    return info.resident_size;
+    #else
+    return 0;
+    #endif
+}
+
+
+void XAdmission::TickCB(evutil_socket_t, short, void *arg){
+    ((XAdmission *)arg)->Tick();
+}
+
+
+void XAdmission::Tick(){
+    uint64_t lag = 0;
+    for(XThread *t : XThreadPool::Get()->Threads()){
+        lag = max(lag, t->LoopLagUs());
+    }
+    uint64_t rss = ResidentBytes();
+    XMetrics::Set(metric_rss, (int64_t)rss);
+
+    bool over = (overload_lag_us && lag >= overload_lag_us) || (overload_rss && rss >= overload_rss);
+    if(over != overloaded){
+        if(over) Logger::warning("XAdmission -> overloaded (loop lag ", lag / 1000, "ms, rss ",
+                                 rss / (1024 * 1024), "MB), shedding new connections");
+        else Logger::info("XAdmission -> load back to normal, accepting connections");
+        overloaded = over;
+        XMetrics::Set(metric_overloaded, over ? 1 : 0);
+    }
+}
+
+
+XAdmitResult XAdmission::Admit(const string &ip){
+    XAdmitResult result = XADMIT_OK;
+    if(overloaded){
+        result = XADMIT_OVERLOAD;
+    }
+    else if(accept_rate > 0){
+        uint64_t now = XMetrics::NowUs();
+        tokens = min(accept_burst, tokens + (now - tokens_us) / 1e6 * accept_rate);
+        tokens_us = now;
+        if(tokens < 1) result = XADMIT_RATE;
+        else tokens -= 1;
+    }
+
+    if(result == XADMIT_OK && max_connections > 0 && active.load(std::memory_order_relaxed) >= max_connections){
+        result = XADMIT_GLOBAL;
+    }
+    if(result == XADMIT_OK){
+        lock_guard<mutex> lock(per_ip_mutex);
+        long long &n = per_ip[ip];
+        if(max_per_ip > 0 && n >= max_per_ip){
+            result = XADMIT_PER_IP;
+        }
+        else{
+            n++;
+            active++;
+        }
+    }
+
+    if(result != XADMIT_OK) XMetrics::Add(metric_rejected[result], 1);
+    return result;
+}
+
+
+void XAdmission::Release(const string &ip){
+    active--;
+    lock_guard<mutex> lock(per_ip_mutex);
+    auto it = per_ip.find(ip);
+    if(it == per_ip.end()) return;
+    if(--it->second <= 0) per_ip.erase(it);
+}
+
+
+void XAdmission::Reject(evutil_socket_t fd, XAdmitResult reason){
+    static const char *msgs[] = {
+        "",
+        "421 Too many connections, try again later.\r\n",
+        "421 Too many connections from your address.\r\n",
+        "421 Connection rate exceeded, try again later.\r\n",
+        "421 Server busy, try again later.\r\n",
+    };
+    const char *msg = msgs[reason];
+    // 新连接的发送缓冲区是空的，一次 send 足够；失败也不重试
+    if(send(fd, msg, strlen(msg), 0) < 0){}
+    evutil_closesocket(fd);
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <stdint.h>
+#include <event2/util.h>
+
+struct event_base;
+struct event;
+
+// 准入检查结果
+enum XAdmitResult{
+    XADMIT_OK = 0,
+    XADMIT_GLOBAL,          // 总连接数达到上限
+    XADMIT_PER_IP,          // 单个 IP 的连接数达到上限
+    XADMIT_RATE,            // 超过 accept 速率（令牌桶）
+    XADMIT_OVERLOAD,        // 工作线程事件循环延迟或内存超过阈值
+    XADMIT_RESULTS
+};
+
+/**
+ * @class XAdmission
+ * @brief 连接准入控制，在 listen_cb 中决定是否接受新连接
+ *
+ * 依次检查过载状态、令牌桶速率、总连接数与单 IP 连接数，拒绝时直接在 socket 上
+ * 回一行 421 并关闭，不创建会话、不进入工作线程队列。
+ * 过载状态由主线程上的定时器每 XADMISSION_TICK_MS 采样一次（各工作线程最近一次心跳延迟的最大值、
+ * 进程常驻内存），accept 时只读一个标志。
+ * Admit 只在主线程调用；Release 在会话销毁时由工作线程调用。
+ */
+class XAdmission{
+public:
+    static XAdmission* Get(){
+        static XAdmission instance;
+        return &instance;
+    }
+
+    // 读取配置并在 base 上启动过载采样定时器（须在工作线程启动之后调用）
+    void Start(event_base *base);
+
+    // 关闭定时器，须在释放 base 之前调用
+    void Stop();
+
+    // 检查是否接受来自 ip 的连接，接受时计入连接数
+    XAdmitResult Admit(const std::string &ip);
+
+    // 会话结束，释放 Admit 计入的连接数
+    void Release(const std::string &ip);
+
+    // 拒绝连接：尽力写一行 421 后关闭 socket（非阻塞，写不进去就直接关闭）
+    static void Reject(evutil_socket_t fd, XAdmitResult reason);
+
+    // 拒绝原因的名字（日志与指标标签）
+    static const char *ReasonName(XAdmitResult reason);
+
+    // 进程常驻内存（字节），不支持的平台返回 0
+    static uint64_t ResidentBytes();
+
+    // 监听队列长度（listen_backlog）
+    int Backlog() const { return backlog; }
+
+private:
+    XAdmission(){}
+
+    static void TickCB(evutil_socket_t fd, short what, void *arg);
+    void Tick();
+
+    // 配置（0 表示不限制）
+    long long max_connections = 0;
+    long long max_per_ip = 0;
+    double accept_rate = 0;             // 每秒允许 accept 的连接数
+    double accept_burst = 0;            // 令牌桶容量
+    uint64_t overload_lag_us = 0;
+    uint64_t overload_rss = 0;
+    int backlog = 128;
+
+    // 令牌桶（只在主线程访问）
+    double tokens = 0;
+    uint64_t tokens_us = 0;
+
+    std::atomic<long long> active{0};
+    std::unordered_map<std::string, long long> per_ip;
+    std::mutex per_ip_mutex;
+    bool overloaded = false;
+
+    event *tick = nullptr;
+    int metric_rejected[XADMIT_RESULTS] = {-1};
+    int metric_overloaded = -1;
+    int metric_rss = -1;
+};
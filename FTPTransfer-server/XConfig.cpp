@@ -0,0 +1,94 @@
+#include "XConfig.h"
+#include "testUtil.h"
+
+#include <fstream>
+#include <strings.h>
+
+using namespace std;
+
+
+static string Trim(const string &s){
+    size_t b = s.find_first_not_of(" \t\r\n");
+    if(b == string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r\n");
+    return s.substr(b, e - b + 1);
+}
+
+
+bool XConfig::Load(const string &file){
+    ifstream in(file);
+    if(!in.is_open()){
+        Logger::info("XConfig::Load() -> ", file, " not found, using defaults");
+        return false;
+    }
+
+    lock_guard<mutex> lock(mtx);
+    string line;
+    int lineno = 0;
+    while(getline(in, line)){
+        lineno++;
+        size_t hash = line.find('#');
+        if(hash != string::npos) line = line.substr(0, hash);
+        line = Trim(line);
+        if(line.empty()) continue;
+
+        size_t eq = line.find('=');
+        if(eq == string::npos){
+            Logger::warning("XConfig::Load() -> ", file, ":", lineno, " missing '=', ignored");
+            continue;
+        }
+        values[Trim(line.substr(0, eq))] = Trim(line.substr(eq + 1));
+    }
+    Logger::info("XConfig::Load() -> loaded ", values.size(), " items from ", file);
+    return true;
+}
+
+
+string XConfig::GetString(const string &key, const string &def){
+    lock_guard<mutex> lock(mtx);
+    auto it = values.find(key);
+    return it == values.end() ? def : it->second;
+}
+
+
+long long XConfig::GetInt(const string &key, long long def){
+    string v = GetString(key);
+    if(v.empty()) return def;
+    char *end = nullptr;
+    long long n = strtoll(v.c_str(), &end, 0);
+    if(end == v.c_str()){
+        Logger::warning("XConfig::GetInt() -> invalid value for ", key, ": ", v);
+        return def;
+    }
+    // 支持 K/M/G 后缀
+    switch(*end){
+        case 'k': case 'K': n <<= 10; break;
+        case 'm': case 'M': n <<= 20; break;
+        case 'g': case 'G': n <<= 30; break;
+        default: break;
+    }
+    return n;
+}
+
+
+double XConfig::GetDouble(const string &key, double def){
+    string v = GetString(key);
+    if(v.empty()) return def;
+    char *end = nullptr;
+    double d = strtod(v.c_str(), &end);
+    return end == v.c_str() ? def : d;
+}
+
+
+bool XConfig::GetBool(const string &key, bool def){
+    string v = GetString(key);
+    if(v.empty()) return def;
+    return v == "1" || strcasecmp(v.c_str(), "true") == 0 ||
+           strcasecmp(v.c_str(), "yes") == 0 || strcasecmp(v.c_str(), "on") == 0;
+}
+
+
+void XConfig::Set(const string &key, const string &value){
+    lock_guard<mutex> lock(mtx);
+    values[key] = value;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * @class XConfig
+ * @brief 服务器配置
+ *
+ * 从工作目录下的 ftpSrv.conf 读取 "key = value" 形式的配置（# 开头为注释），
+ * 文件不存在时全部使用默认值。各模块在初始化时按需读取自己的配置项。
+ */
+class XConfig{
+public:
+    static XConfig* Get(){
+        static XConfig instance;
+        return &instance;
+    }
+
+    // 加载配置文件，文件不存在返回 false（不是错误）
+    bool Load(const std::string &file);
+
+    std::string GetString(const std::string &key, const std::string &def = "");
+    long long GetInt(const std::string &key, long long def = 0);
+    double GetDouble(const std::string &key, double def = 0);
+    bool GetBool(const std::string &key, bool def = false);
+
+    // 运行时修改配置项
+    void Set(const std::string &key, const std::string &value);
+
+private:
+    std::map<std::string, std::string> values;
+    std::mutex mtx;
+    XConfig(){};
+};
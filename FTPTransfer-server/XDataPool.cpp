@@ -0,0 +1,163 @@
+#include "XDataPool.h"
+#include "XMetrics.h"
+#include "testUtil.h"
+
+#include <event2/event.h>
+#include <event2/bufferevent.h>
+#include <event2/buffer.h>
+#include <string>
+
+#ifndef OPENSSL_NO_SSL_INCLUDES
+#include <openssl/ssl.h>
+#include <event2/bufferevent_ssl.h>
+extern SSL_CTX *ssl_ctx;
+#endif
+
+using namespace std;
+
+#define XDATAPOOL_TICK_MS 100           // 冷却周期：归还的对象至少等这么久才复用
+
+static thread_local XDataPool *current_pool = nullptr;
+
+
+XDataPool *XDataPool::Current(){
+    return current_pool;
+}
+
+
+void XDataPool::Bind(){
+    current_pool = this;
+}
+
+
+bool XDataPool::Setup(event_base *base, int worker, int capacity){
+    this->base = base;
+    this->capacity = capacity > 0 ? capacity : 0;
+
+    string label = "thread=\"" + to_string(worker) + "\"";
+    XMetrics *m = XMetrics::Get();
+    metric_idle_plain = m->Register(XMETRIC_GAUGE, "ftp_data_pool_idle", "Recycled data connection objects ready for reuse",
+                                    label + ",kind=\"plain\"");
+    metric_idle_tls = m->Register(XMETRIC_GAUGE, "ftp_data_pool_idle", "Recycled data connection objects ready for reuse",
+                                  label + ",kind=\"tls\"");
+    metric_reused = m->Register(XMETRIC_COUNTER, "ftp_data_pool_acquired_total", "Data connection objects handed out",
+                                label + ",result=\"reused\"");
+    metric_created = m->Register(XMETRIC_COUNTER, "ftp_data_pool_acquired_total", "Data connection objects handed out",
+                                 label + ",result=\"new\"");
+
+    if(!this->capacity) return true;
+    tick = event_new(base, -1, EV_PERSIST, TickCB, this);
+    timeval tv = {0, XDATAPOOL_TICK_MS * 1000};
+    return tick && event_add(tick, &tv) == 0;
+}
+
+
+void XDataPool::Stop(){
+    if(tick) event_free(tick);
+    tick = nullptr;
+    for(auto *list : {&plain_free, &plain_cooling}){
+        for(bufferevent *bev : *list) bufferevent_free(bev);
+        list->clear();
+    }
+    #ifndef OPENSSL_NO_SSL_INCLUDES
+    for(auto *list : {&ssl_free, &ssl_cooling}){
+        for(SSL *ssl : *list) SSL_free(ssl);
+        list->clear();
+    }
+    #endif
+    UpdateMetrics();
+}
+
+
+void XDataPool::TickCB(evutil_socket_t, short, void *arg){
+    XDataPool *p = (XDataPool *)arg;
+    // 上一个周期归还的对象到这里已冷却至少一个周期
+    p->plain_free.insert(p->plain_free.end(), p->plain_cooling.begin(), p->plain_cooling.end());
+    p->plain_cooling.clear();
+    p->ssl_free.insert(p->ssl_free.end(), p->ssl_cooling.begin(), p->ssl_cooling.end());
+    p->ssl_cooling.clear();
+    p->UpdateMetrics();
+}
+
+
+void XDataPool::UpdateMetrics(){
+    XMetrics::Set(metric_idle_plain, (int64_t)plain_free.size());
+    XMetrics::Set(metric_idle_tls, (int64_t)ssl_free.size());
+}
+
+
+bufferevent *XDataPool::Acquire(evutil_socket_t fd, bool tls){
+    #ifndef OPENSSL_NO_SSL_INCLUDES
+    if(tls){
+        SSL *ssl;
+        if(!ssl_free.empty()){
+            ssl = ssl_free.back();
+            ssl_free.pop_back();
+            XMetrics::Add(metric_reused, 1);
+        }
+        else{
+            ssl = SSL_new(ssl_ctx);
+            if(!ssl){
+                Logger::error("XDataPool::Acquire() -> SSL_new failed for data connection");
+                return nullptr;
+            }
+            XMetrics::Add(metric_created, 1);
+        }
+        // 在FTP over TLS中，无论PORT还是PASV，数据连接的SSL角色都与控制连接相同（服务器端）
+        SSL_set_accept_state(ssl);
+        // 不带 BEV_OPT_CLOSE_ON_FREE：SSL 对象与 socket 由 Release 处理
+        bufferevent *bev = bufferevent_openssl_socket_new(base, fd, ssl, BUFFEREVENT_SSL_ACCEPTING, 0);
+        if(!bev) SSL_free(ssl);
+        UpdateMetrics();
+        return bev;
+    }
+    #endif
+
+    if(!plain_free.empty()){
+        bufferevent *bev = plain_free.back();
+        plain_free.pop_back();
+        if(fd >= 0) bufferevent_setfd(bev, fd);
+        XMetrics::Add(metric_reused, 1);
+        UpdateMetrics();
+        return bev;
+    }
+    XMetrics::Add(metric_created, 1);
+    return bufferevent_socket_new(base, fd, BEV_OPT_CLOSE_ON_FREE);
+}
+
+
+void XDataPool::Release(bufferevent *bev, bool reusable){
+    if(!bev) return;
+    bufferevent_setcb(bev, nullptr, nullptr, nullptr, nullptr);
+    bufferevent_disable(bev, EV_READ | EV_WRITE);
+    evutil_socket_t fd = bufferevent_getfd(bev);
+
+    #ifndef OPENSSL_NO_SSL_INCLUDES
+    SSL *ssl = bufferevent_openssl_get_ssl(bev);
+    if(ssl){
+        bufferevent_free(bev);
+        if(fd >= 0) evutil_closesocket(fd);
+        // 卸下旧 socket 的 BIO，否则下次以 fd=-1 创建时 libevent 会从 BIO 里取回已关闭的 fd
+        SSL_set_bio(ssl, nullptr, nullptr);
+        if(reusable && ssl_free.size() + ssl_cooling.size() < capacity && SSL_clear(ssl) == 1){
+            ssl_cooling.push_back(ssl);
+        }
+        else{
+            SSL_free(ssl);
+        }
+        return;
+    }
+    #endif
+
+    if(!reusable || plain_free.size() + plain_cooling.size() >= capacity){
+        bufferevent_free(bev);      // BEV_OPT_CLOSE_ON_FREE 关闭 socket
+        return;
+    }
+    bufferevent_setfd(bev, -1);
+    if(fd >= 0) evutil_closesocket(fd);
+    evbuffer *input = bufferevent_get_input(bev);
+    evbuffer *output = bufferevent_get_output(bev);
+    evbuffer_drain(input, evbuffer_get_length(input));
+    evbuffer_drain(output, evbuffer_get_length(output));
+    plain_cooling.push_back(bev);
+}
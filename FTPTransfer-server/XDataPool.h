@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <event2/util.h>
+
+struct event_base;
+struct event;
+struct bufferevent;
+typedef struct ssl_st SSL;
+
+/**
+ * @class XDataPool
+ * @brief 每个工作线程一组可复用的数据连接对象
+ *
+ * 明文连接复用整个 bufferevent：归还时关闭 socket、bufferevent_setfd(-1)、清空输入输出缓冲区，
+ * 下次 bufferevent_setfd（PASV）或 bufferevent_socket_connect（PORT）接上新的 socket。
+ * TLS 连接复用 SSL 对象：归还时卸下 BIO 并 SSL_clear，下次包进新的 openssl bufferevent
+ * （openssl bufferevent 本身不支持更换 socket，只能重建）。
+ * 只有建立成功的连接才回收（连接失败或握手失败的对象状态不确定，直接释放）。
+ * 归还的对象先冷却一个 XDATAPOOL_TICK_MS 周期再复用，确保 libevent 为旧连接排队的延迟回调已经执行完。
+ * 只在所属工作线程中使用，不加锁。
+ */
+class XDataPool{
+public:
+    // 当前线程的对象池，不在工作线程中时为 nullptr
+    static XDataPool *Current();
+
+    // capacity 为每类对象的最大缓存数，0 表示不缓存（XThread::Setup 中调用）
+    bool Setup(event_base *base, int worker, int capacity);
+
+    // 绑定到当前线程（XThread::Main 开始时调用）
+    void Bind();
+
+    // 释放缓存的全部对象（XThread::Main 退出前调用）
+    void Stop();
+
+    // 取一个数据连接：fd 为 -1 时用于 bufferevent_socket_connect（PORT），否则包装已接受的连接（PASV）
+    // tls 为 true 时返回服务器端（ACCEPTING）的 openssl bufferevent
+    bufferevent *Acquire(evutil_socket_t fd, bool tls);
+
+    // 归还并关闭 socket；reusable 为 false（未建立连接、出错）时直接释放
+    void Release(bufferevent *bev, bool reusable);
+
+private:
+    static void TickCB(evutil_socket_t fd, short what, void *arg);
+    void UpdateMetrics();
+
+    event_base *base = nullptr;
+    event *tick = nullptr;
+    size_t capacity = 0;
+    std::vector<bufferevent *> plain_free, plain_cooling;
+    std::vector<SSL *> ssl_free, ssl_cooling;
+
+    int metric_idle_plain = -1;
+    int metric_idle_tls = -1;
+    int metric_reused = -1;
+    int metric_created = -1;
+};
@@ -0,0 +1,254 @@
+#include "XDirCache.h"
+#include "testUtil.h"
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#ifdef __APPLE__
+#define ST_MTIM(st) ((st).st_mtimespec)
+#else
+#define ST_MTIM(st) ((st).st_mtim)
+#endif
+
+using namespace std;
+
+
+XDirCache::XDirCache(){
+#ifdef __linux__
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotify_fd < 0){
+        Logger::warning("XDirCache::XDirCache() -> inotify_init1 failed, fallback to mtime check: ", strerror(errno));
+        return;
+    }
+    if(pipe(stop_fds)){
+        Logger::warning("XDirCache::XDirCache() -> pipe failed, fallback to mtime check");
+        close(inotify_fd);
+        inotify_fd = -1;
+        return;
+    }
+    watcher = new std::thread(&XDirCache::WatchLoop, this);
+#endif
+}
+
+
+XDirCache::~XDirCache(){
+    if(watcher){
+        if(write(stop_fds[1], "s", 1) <= 0){
+            Logger::error("XDirCache::~XDirCache() -> write stop pipe failed");
+        }
+        if(watcher->joinable()) watcher->join();
+        delete watcher;
+        watcher = nullptr;
+    }
+    if(stop_fds[0] >= 0) close(stop_fds[0]);
+    if(stop_fds[1] >= 0) close(stop_fds[1]);
+    if(inotify_fd >= 0) close(inotify_fd);
+}
+
+
+// 去掉重复和末尾的 '/'，保证 "a//b/" 与 "a/b" 命中同一条目
+string XDirCache::Normalize(const string &dir){
+    string out;
+    out.reserve(dir.size());
+    for(char c : dir){
+        if(c == '/' && !out.empty() && out.back() == '/') continue;
+        out += c;
+    }
+    if(out.size() > 1 && out.back() == '/') out.pop_back();
+    return out;
+}
+
+
+shared_ptr<const string> XDirCache::Lookup(const string &dir, const string &variant){
+    string d = Normalize(dir);
+    string key = d + '\n' + variant;
+
+    // stat 放在锁外，避免慢文件系统阻塞其他线程
+    struct stat st;
+    if(stat(d.c_str(), &st) != 0){
+        Invalidate(d);
+        return nullptr;
+    }
+
+    lock_guard<mutex> lock(mtx);
+    auto it = index.find(key);
+    if(it == index.end()) return nullptr;
+
+    Entry &e = *it->second;
+    bool stale = e.ino != st.st_ino
+              || e.mtime.tv_sec != ST_MTIM(st).tv_sec
+              || e.mtime.tv_nsec != ST_MTIM(st).tv_nsec;
+    auto dw = dirs.find(d);
+    if(!stale && (dw == dirs.end() || dw->second.wd < 0)){
+        stale = time(nullptr) - e.stored_at > max_age;
+    }
+    if(stale){
+        Logger::debug("XDirCache::Lookup() -> stale entry: ", d);
+        EraseLocked(it->second);
+        return nullptr;
+    }
+
+    // 移到 LRU 头部
+    lru.splice(lru.begin(), lru, it->second);
+    return e.data;
+}
+
+
+shared_ptr<const string> XDirCache::Store(const string &dir, string data, const string &variant){
+    auto shared = make_shared<const string>(std::move(data));
+    string d = Normalize(dir);
+
+    struct stat st;
+    if(stat(d.c_str(), &st) != 0 || shared->size() > max_bytes){
+        return shared;
+    }
+    // 目录在本秒内刚被修改过：列表可能是修改前枚举的，mtime 却已是修改后的，不缓存
+    if(ST_MTIM(st).tv_sec >= time(nullptr) - 1){
+        return shared;
+    }
+
+    lock_guard<mutex> lock(mtx);
+    string key = d + '\n' + variant;
+    auto old = index.find(key);
+    if(old != index.end()) EraseLocked(old->second);
+
+    Entry e;
+    e.key = key;
+    e.dir = d;
+    e.data = shared;
+    e.mtime = ST_MTIM(st);
+    e.ino = st.st_ino;
+    e.stored_at = time(nullptr);
+    lru.push_front(std::move(e));
+    index[key] = lru.begin();
+    bytes += shared->size();
+
+    auto dw = dirs.find(d);
+    if(dw == dirs.end()){
+        dirs[d].keys.push_back(key);
+        Watch(d);
+    }
+    else{
+        dw->second.keys.push_back(key);
+    }
+
+    // 超出容量时从尾部淘汰
+    while(!lru.empty() && (bytes > max_bytes || lru.size() > max_entries)){
+        EraseLocked(std::prev(lru.end()));
+    }
+    return shared;
+}
+
+
+void XDirCache::Invalidate(const string &dir){
+    lock_guard<mutex> lock(mtx);
+    InvalidateLocked(Normalize(dir));
+}
+
+
+void XDirCache::SetCapacity(size_t max_bytes, size_t max_entries){
+    lock_guard<mutex> lock(mtx);
+    this->max_bytes = max_bytes;
+    this->max_entries = max_entries;
+    while(!lru.empty() && (bytes > max_bytes || lru.size() > max_entries)){
+        EraseLocked(std::prev(lru.end()));
+    }
+}
+
+
+void XDirCache::InvalidateLocked(const string &dir){
+    auto dw = dirs.find(dir);
+    if(dw == dirs.end()) return;
+    // EraseLocked 会修改 keys，先拷贝一份
+    vector<string> keys = dw->second.keys;
+    for(auto &k : keys){
+        auto it = index.find(k);
+        if(it != index.end()) EraseLocked(it->second);
+    }
+}
+
+
+// 删除条目；目录下没有剩余条目时同时移除 inotify 监听
+void XDirCache::EraseLocked(list<Entry>::iterator it){
+    bytes -= it->data->size();
+    index.erase(it->key);
+
+    auto dw = dirs.find(it->dir);
+    if(dw != dirs.end()){
+        auto &keys = dw->second.keys;
+        keys.erase(std::remove(keys.begin(), keys.end(), it->key), keys.end());
+        if(keys.empty()){
+#ifdef __linux__
+            if(dw->second.wd >= 0){
+                inotify_rm_watch(inotify_fd, dw->second.wd);
+                wd_dirs.erase(dw->second.wd);
+            }
+#endif
+            dirs.erase(dw);
+        }
+    }
+    lru.erase(it);
+}
+
+
+void XDirCache::Watch(const string &dir){
+#ifdef __linux__
+    if(inotify_fd < 0) return;
+    int wd = inotify_add_watch(inotify_fd, dir.c_str(),
+        IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+        IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if(wd < 0){
+        if(Logger::Enabled<XLOG_DEBUG>()){
+            Logger::debug("XDirCache::Watch() -> inotify_add_watch failed: ", dir, " ", strerror(errno));
+        }
+        return;
+    }
+    dirs[dir].wd = wd;
+    wd_dirs[wd] = dir;
+#endif
+}
+
+
+// 后台线程：阻塞等待 inotify 事件，收到后使对应目录的缓存失效
+void XDirCache::WatchLoop(){
+#ifdef __linux__
+    Logger::info("XDirCache::WatchLoop() -> inotify watcher started");
+    alignas(struct inotify_event) char buf[16 * 1024];
+    while(true){
+        struct pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_fds[0], POLLIN, 0}};
+        if(poll(fds, 2, -1) < 0){
+            if(errno == EINTR) continue;
+            Logger::error("XDirCache::WatchLoop() -> poll failed: ", strerror(errno));
+            return;
+        }
+        if(fds[1].revents) return;
+
+        ssize_t len = read(inotify_fd, buf, sizeof(buf));
+        if(len <= 0) continue;
+
+        lock_guard<mutex> lock(mtx);
+        for(char *p = buf; p < buf + len; ){
+            struct inotify_event *ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if(ev->mask & IN_Q_OVERFLOW){
+                // 事件队列溢出，无法确定哪些目录变化，全部清空
+                Logger::warning("XDirCache::WatchLoop() -> inotify queue overflow, flush all");
+                while(!lru.empty()) EraseLocked(lru.begin());
+                continue;
+            }
+            auto it = wd_dirs.find(ev->wd);
+            if(it == wd_dirs.end()) continue;
+            string dir = it->second;      // InvalidateLocked 可能删除 wd_dirs 中的条目
+            InvalidateLocked(dir);
+        }
+    }
+#endif
+}
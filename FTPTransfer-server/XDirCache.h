@@ -0,0 +1,93 @@
+#pragma once
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+#include <sys/types.h>
+#include <time.h>
+
+/**
+ * @class XDirCache
+ * @brief 全局共享的目录列表缓存
+ *
+ * 以目录绝对路径为键缓存格式化好的列表文本（LIST 的 ls -la 输出等），
+ * 所有工作线程共享。缓存按字节数和条目数做 LRU 淘汰。
+ *
+ * 失效机制：
+ * 1. Linux 下对每个被缓存的目录注册 inotify 监听，目录内有增删改时由后台线程立即失效
+ * 2. 每次命中时再 stat 一次目录，mtime/inode 变化则视为失效（inotify 不可用或监听失败时的兜底）
+ * 3. 没有 inotify 时额外按 max_age 过期，避免子文件内容变化（不改目录 mtime）导致列表长期陈旧
+ *
+ * 缓存的数据以 shared_ptr<const string> 返回，调用方可直接作为 evbuffer 引用发送而无需拷贝。
+ */
+class XDirCache{
+public:
+    static XDirCache* Get(){
+        static XDirCache c;
+        return &c;
+    }
+
+    /**
+     * @brief 查询缓存
+     * @param dir 目录绝对路径（用于 stat 校验和 inotify 监听）
+     * @param variant 同一目录的不同格式（例如 "LIST"），空串表示默认格式
+     * @return 命中返回列表数据，未命中或已失效返回 nullptr
+     */
+    std::shared_ptr<const std::string> Lookup(const std::string &dir, const std::string &variant = "");
+
+    /**
+     * @brief 写入缓存
+     * @param dir 目录绝对路径
+     * @param data 格式化好的列表数据
+     * @param variant 格式标识，与 Lookup 对应
+     * @return 可直接发送的共享数据（即使因超出容量未被缓存也会返回）
+     */
+    std::shared_ptr<const std::string> Store(const std::string &dir, std::string data, const std::string &variant = "");
+
+    // 使某个目录下的所有缓存条目失效
+    void Invalidate(const std::string &dir);
+
+    // 设置缓存容量上限
+    void SetCapacity(size_t max_bytes, size_t max_entries);
+
+    ~XDirCache();
+
+private:
+    struct Entry{
+        std::string key;                              // 缓存键：目录 + '\n' + variant
+        std::string dir;                              // 规范化后的目录路径
+        std::shared_ptr<const std::string> data;      // 列表数据
+        struct timespec mtime;                        // 缓存时目录的 mtime
+        ino_t ino = 0;                                // 缓存时目录的 inode
+        time_t stored_at = 0;                         // 写入时间（无 inotify 时用于过期）
+    };
+
+    struct DirWatch{
+        int wd = -1;                                  // inotify 监听描述符
+        std::vector<std::string> keys;                // 该目录下的缓存键
+    };
+
+    XDirCache();
+    static std::string Normalize(const std::string &dir);
+    void EraseLocked(std::list<Entry>::iterator it);
+    void InvalidateLocked(const std::string &dir);
+    void Watch(const std::string &dir);
+    void WatchLoop();
+
+    std::mutex mtx;
+    std::list<Entry> lru;                                                   // 头部为最近使用
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;      // 键 -> LRU 节点
+    std::unordered_map<std::string, DirWatch> dirs;                         // 目录 -> 监听信息
+    std::unordered_map<int, std::string> wd_dirs;                           // inotify wd -> 目录
+    size_t bytes = 0;
+    size_t max_bytes = 16 * 1024 * 1024;
+    size_t max_entries = 1024;
+    time_t max_age = 5;                                                     // 无 inotify 时的最长缓存秒数
+
+    int inotify_fd = -1;
+    int stop_fds[2] = {-1, -1};
+    std::thread *watcher = nullptr;
+};
@@ -0,0 +1,73 @@
+#include "XDirWalker.h"
+#include "testUtil.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+// 读取已打开的目录流并关闭它
+static void ReadAll(DIR *d, vector<XDirEntry> &out){
+    // 相对目录fd做fstatat，内核无需每次重新解析完整路径
+    int dfd = dirfd(d);
+    struct dirent *de;
+    while((de = readdir(d)) != nullptr){
+        XDirEntry e;
+        e.name = de->d_name;
+        if(fstatat(dfd, de->d_name, &e.st, AT_SYMLINK_NOFOLLOW) != 0){
+            // 枚举与 stat 之间文件被删除，跳过
+            continue;
+        }
+        out.push_back(std::move(e));
+    }
+    closedir(d);
+}
+
+
+bool XDirWalker::ReadDir(const string &dir, vector<XDirEntry> &out){
+    DIR *d = opendir(dir.c_str());
+    if(!d){
+        if(Logger::Enabled<XLOG_DEBUG>()){
+            Logger::debug("XDirWalker::ReadDir() -> opendir failed: ", dir, " ", strerror(errno));
+        }
+        return false;
+    }
+    ReadAll(d, out);
+    return true;
+}
+
+
+bool XDirWalker::ReadDirAt(int dir_fd, vector<XDirEntry> &out){
+    // O_PATH 的 fd 不能直接 fdopendir，相对它重新打开 "."，同时不动调用者的 fd
+    int fd = openat(dir_fd, ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0){
+        Logger::debug("XDirWalker::ReadDirAt() -> openat failed: ", strerror(errno));
+        return false;
+    }
+    DIR *d = fdopendir(fd);
+    if(!d){
+        int err = errno;
+        close(fd);
+        errno = err;
+        return false;
+    }
+    ReadAll(d, out);
+    return true;
+}
+
+
+bool XDirWalker::Stat(const string &path, XDirEntry &entry){
+    if(lstat(path.c_str(), &entry.st) != 0){
+        return false;
+    }
+    string p = path;
+    while(p.size() > 1 && p.back() == '/') p.pop_back();
+    size_t pos = p.rfind('/');
+    entry.name = (pos == string::npos) ? p : p.substr(pos + 1);
+    if(entry.name.empty()) entry.name = "/";
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/**
+ * @brief 目录项：文件名 + lstat 结果
+ */
+struct XDirEntry{
+    std::string name;      // 文件名（不含路径）
+    struct stat st;        // 文件状态（不跟随符号链接）
+};
+
+/**
+ * @class XDirWalker
+ * @brief 原生目录枚举（opendir/readdir + fstatat），替代 popen("ls") 的方式
+ *
+ * 不经过 shell，没有命令注入风险，也省去了 fork/exec 与文本解析的开销。
+ */
+class XDirWalker{
+public:
+    /**
+     * @brief 枚举目录内容
+     * @param dir 目录绝对路径
+     * @param out 输出的目录项（包含 "." 和 ".."），顺序与 readdir 一致
+     * @return 成功返回 true；失败返回 false，errno 保留 opendir 的错误码
+     */
+    static bool ReadDir(const std::string &dir, std::vector<XDirEntry> &out);
+
+    /**
+     * @brief 枚举已打开目录的内容（例如 XVfs::OpenDir 返回的 fd），不再按路径解析
+     * @param dir_fd 目录 fd（可以是 O_PATH），调用者保留所有权
+     * @param out 输出的目录项（包含 "." 和 ".."），顺序与 readdir 一致
+     * @return 成功返回 true；失败返回 false，errno 有效
+     */
+    static bool ReadDirAt(int dir_fd, std::vector<XDirEntry> &out);
+
+    /**
+     * @brief 获取单个路径的状态
+     * @param path 文件或目录的绝对路径
+     * @param entry 输出，name 为路径最后一段
+     * @return 成功返回 true；失败返回 false，errno 有效
+     */
+    static bool Stat(const std::string &path, XDirEntry &entry);
+};
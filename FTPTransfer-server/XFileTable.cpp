@@ -0,0 +1,84 @@
+#include "XFileTable.h"
+#include "XHashIndex.h"
+#include "XMetrics.h"
+#include "XVfs.h"
+#include "testUtil.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+using namespace std;
+
+#define XFILE_SWEEP_EVERY 256          // 每打开多少次清理一次已关闭的条目
+
+static XMetricFamily opens_total(XMETRIC_COUNTER, "ftp_file_table_opens_total",
+                                 "Download file opens by whether an open fd was shared", "result");
+
+static int OpenMetric(){
+    static int id = XMetrics::Get()->Register(XMETRIC_GAUGE, "ftp_file_table_open",
+                                              "Files held open for downloads");
+    return id;
+}
+
+
+XOpenFile::~XOpenFile(){
+    if(fd >= 0){
+        close(fd);
+        XMetrics::Add(OpenMetric(), -1);
+    }
+}
+
+
+XFileTable* XFileTable::Get(){
+    static XFileTable table;
+    return &table;
+}
+
+
+shared_ptr<XOpenFile> XFileTable::Open(XVfs &vfs, const string &vpath, int &err){
+    struct stat st;
+    if(!vfs.Stat(vpath, st, err)) return nullptr;
+    if(!S_ISREG(st.st_mode)){
+        err = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+        return nullptr;
+    }
+    pair<uint64_t, uint64_t> key((uint64_t)st.st_dev, (uint64_t)st.st_ino);
+    {
+        lock_guard<mutex> lock(table_mutex);
+        auto it = files.find(key);
+        shared_ptr<XOpenFile> f = it != files.end() ? it->second.lock() : nullptr;
+        if(f && XHashIndex::SameContent(st, f->st)){
+            XMetrics::Add(opens_total.Id("shared"), 1);
+            return f;
+        }
+    }
+
+    // 打开与 fstat 不持锁；两个线程同时打开同一文件时后登记的覆盖前者，前者随其传输结束关闭
+    shared_ptr<XOpenFile> f = make_shared<XOpenFile>();
+    f->fd = vfs.Open(vpath, O_RDONLY, 0, err);
+    if(f->fd < 0) return nullptr;
+    XMetrics::Add(OpenMetric(), 1);
+    if(fstat(f->fd, &f->st) != 0){
+        err = errno;
+        return nullptr;
+    }
+    if(!S_ISREG(f->st.st_mode)){
+        err = EINVAL;
+        return nullptr;
+    }
+    XMetrics::Add(opens_total.Id("opened"), 1);
+
+    lock_guard<mutex> lock(table_mutex);
+    files[make_pair((uint64_t)f->st.st_dev, (uint64_t)f->st.st_ino)] = f;
+    if(++opens % XFILE_SWEEP_EVERY == 0) Sweep();
+    return f;
+}
+
+
+void XFileTable::Sweep(){
+    for(auto it = files.begin(); it != files.end();){
+        if(it->second.expired()) it = files.erase(it);
+        else ++it;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <stdint.h>
+#include <sys/stat.h>
+
+class XVfs;
+
+// 共享的只读文件：最后一个引用释放时关闭 fd
+struct XOpenFile{
+    int fd = -1;
+    struct stat st;
+    ~XOpenFile();
+};
+
+/**
+ * @class XFileTable
+ * @brief 下载文件的共享 fd 表
+ *
+ * 同一文件内容（dev, inode, 大小, mtime 相同）的并发下载共用一个只读 fd，
+ * 各自用 pread / sendfile 按偏移读取，互不影响文件位置；多条数据连接分段（RANG）下载一个大文件时只打开一次。
+ * 文件内容变化后新的下载打开新 fd，旧 fd 在原有传输结束后关闭。各工作线程共用，由一把互斥锁保护。
+ */
+class XFileTable{
+public:
+    static XFileTable* Get();
+
+    // 打开会话中的虚拟路径 vpath（只接受普通文件）；失败返回 nullptr，err 为 errno（不是普通文件时为 EISDIR / EINVAL）
+    std::shared_ptr<XOpenFile> Open(XVfs &vfs, const std::string &vpath, int &err);
+
+private:
+    XFileTable(){}
+    void Sweep();
+
+    std::mutex table_mutex;
+    std::map<std::pair<uint64_t, uint64_t>, std::weak_ptr<XOpenFile>> files;   // (dev, inode) -> 打开的文件
+    unsigned opens = 0;
+};
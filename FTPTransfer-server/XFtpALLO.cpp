@@ -0,0 +1,24 @@
+#include "XFtpALLO.h"
+#include "testUtil.h"
+#include <cstdlib>
+
+using namespace std;
+
+void XFtpALLO::Parse(string cmd, string msg){
+    Logger::debug("XFtpALLO::Parse() -> msg: ", msg);
+
+    string param = msg.size() > 5 ? msg.substr(5) : "";
+    while(!param.empty() && (param.back() == '\r' || param.back() == '\n' || param.back() == ' ')){
+        param.pop_back();
+    }
+    // 记录长度（R <n>）只对记录结构的文件有意义，忽略
+    string size = param.substr(0, param.find(' '));
+    char *endptr;
+    long long n = strtoll(size.c_str(), &endptr, 10);
+    if(size.empty() || *endptr != '\0' || n < 0){
+        ResCMD("501 Syntax error in parameters or arguments.\r\n");
+        return;
+    }
+    cmdTask->SetAllocSize(n);
+    ResCMD("200 ALLO " + to_string(n) + " bytes noted.\r\n");
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "XFtpTask.h"
+
+/**
+ * @class XFtpALLO
+ * @brief ALLO <大小> [R <记录长度>]：声明下一次 STOR / APPE / STOU 的大小
+ *
+ * STOR 时为文件大小，APPE / STOU 时为本次写入的字节数，打开文件后按此预留磁盘块。
+ * 分段并行上传（RANG + STOR）新建文件时必须先 ALLO，按声明的大小预分配 name.part 并判断何时收齐。
+ */
+class XFtpALLO : public XFtpTask{
+public:
+    virtual void Parse(std::string cmd, std::string msg);
+};
@@ -1,5 +1,6 @@
 // XFtpAUTH.cpp
 #include "XFtpAUTH.h"
+#include "XMetrics.h"
 #include "testUtil.h"
 #include <event2/bufferevent.h>
 
@@ -42,6 +43,8 @@ void XFtpAUTH::Parse(string cmd, string msg){
 #ifndef OPENSSL_NO_SSL_INCLUDES
 bool XFtpAUTH::InitSSL(){
     Logger::info("XFtpAUTH::InitSSL() -> Starting SSL handshake");
+    Logger::trace(XTRACE_TLS_BEGIN, cmdTask->sessionId);
+    cmdTask->tlsStartUs = XMetrics::NowUs();
     if(!ssl_ctx){ // 确保ssl_ctx是外部定义的全局或可访问的SSL_CTX*
         Logger::error("XFtpAUTH::InitSSL() -> SSL context not initialized");
         return false;
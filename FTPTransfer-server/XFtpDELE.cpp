@@ -0,0 +1,91 @@
+#include "XFtpDELE.h"
+#include "XQuota.h"
+#include "testUtil.h"
+#include <errno.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// 失败时的应答
+static string FileError(int err){
+    if(err == ENOENT) return "550 File not found.\r\n";
+    if(err == EACCES || err == EPERM) return "550 Permission denied.\r\n";
+    if(err == EISDIR) return "550 Is a directory.\r\n";
+    if(err == ENOTEMPTY || err == EEXIST) return "550 Directory not empty.\r\n";
+    if(err == EINVAL || err == EBUSY) return "553 Requested action not taken.\r\n";
+    return "550 Requested action not taken.\r\n";
+}
+
+
+void XFtpDELE::Parse(string cmd, string msg){
+    Logger::debug("XFtpDELE::Parse() -> msg: ", msg);
+
+    size_t pos = msg.find(' ');
+    string name = pos == string::npos ? "" : msg.substr(pos + 1);
+    while(!name.empty() && (name.back() == '\r' || name.back() == '\n')) name.pop_back();
+    if(name.empty()){
+        if(cmd == "RNTO") renameFrom.clear();
+        ResCMD("501 Syntax error in parameters or arguments.\r\n");
+        return;
+    }
+    string vpath = XVfs::Normalize(cmdTask->curDir, name);
+    XVfs &vfs = cmdTask->vfs;
+    struct stat st;
+    int err = 0;
+
+    // 都按链接本身：删除、改名符号链接不影响它指向的文件，用量只算普通文件（与 XQuota 的遍历一致）
+    if(cmd == "DELE"){
+        if(!vfs.Lstat(vpath, st, err)){
+            ResCMD(FileError(err));
+            return;
+        }
+        if(S_ISDIR(st.st_mode)){
+            ResCMD(FileError(EISDIR));
+            return;
+        }
+        if(!vfs.Unlink(vpath, err)){
+            Logger::warning("XFtpDELE::Parse() -> cannot delete ", vfs.RealPath(vpath), ", ", strerror(err));
+            ResCMD(FileError(err));
+            return;
+        }
+        if(S_ISREG(st.st_mode)) XQuota::Get()->Charge(cmdTask->user, vfs.RealPath(vpath), -(long long)st.st_size, -1);
+        Logger::info("XFtpDELE::Parse() -> deleted ", vfs.RealPath(vpath));
+        ResCMD("250 File deleted.\r\n");
+    }
+    else if(cmd == "RNFR"){
+        if(!vfs.Lstat(vpath, st, err)){
+            renameFrom.clear();
+            ResCMD(FileError(err));
+            return;
+        }
+        renameFrom = vpath;
+        ResCMD("350 Ready for RNTO.\r\n");
+    }
+    else if(cmd == "RNTO"){
+        if(renameFrom.empty()){
+            ResCMD("503 Bad sequence of commands.\r\n");
+            return;
+        }
+        string from = renameFrom;
+        renameFrom.clear();
+        // 覆盖已有的普通文件时，被替换的文件从用量中扣除
+        struct stat old, src;
+        bool replaced = vfs.Lstat(vpath, old, err) && S_ISREG(old.st_mode);
+        bool moved = vfs.Lstat(from, src, err) && S_ISREG(src.st_mode);
+        if(!vfs.Rename(from, vpath, err)){
+            Logger::warning("XFtpDELE::Parse() -> cannot rename ", vfs.RealPath(from), " to ", vfs.RealPath(vpath),
+                            ", ", strerror(err));
+            ResCMD(FileError(err));
+            return;
+        }
+        if(replaced && from != vpath) XQuota::Get()->Charge(cmdTask->user, vfs.RealPath(vpath), -(long long)old.st_size, -1);
+        // 普通文件换了目录：总量不变，但重建用量期间两个目录可能一个已读一个未读，按移出与移入分别记
+        // （整个目录改名不跟踪，偏差在下次重建用量时纠正）
+        if(moved && from != vpath && from.substr(0, from.rfind('/')) != vpath.substr(0, vpath.rfind('/'))){
+            XQuota::Get()->Charge(cmdTask->user, vfs.RealPath(from), -(long long)src.st_size, -1);
+            XQuota::Get()->Charge(cmdTask->user, vfs.RealPath(vpath), src.st_size, 1);
+        }
+        Logger::info("XFtpDELE::Parse() -> renamed ", vfs.RealPath(from), " to ", vfs.RealPath(vpath));
+        ResCMD("250 Rename successful.\r\n");
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "XFtpTask.h"
+
+/**
+ * @class XFtpDELE
+ * @brief DELE <文件>：删除文件；RNFR <原名> + RNTO <新名>：改名
+ *
+ * 都经会话的 XVfs 在根目录之下进行。删除与覆盖目标的改名完成后从用户的配额用量中扣除（XQuota）。
+ */
+class XFtpDELE : public XFtpTask{
+public:
+    virtual void Parse(std::string cmd, std::string msg);
+
+private:
+    std::string renameFrom;              // RNFR 记下的虚拟路径，RNTO 之后清空
+};
@@ -0,0 +1,125 @@
+#include "XFtpFEAT.h"
+#include "XFtpLIST.h"
+#include "XFtpHASH.h"
+#include "XFtpMODE.h"
+#include "XZStream.h"
+#include "testUtil.h"
+#include <algorithm>
+#include <vector>
+#include <stdlib.h>
+
+using namespace std;
+
+void XFtpFEAT::Parse(string cmd, string msg){
+    Logger::debug("XFtpFEAT::Parse() -> cmd: ", cmd, " msg: ", msg);
+
+    if(cmd == "FEAT"){
+        string res = "211-Features:\r\n";
+        res += " MLST " + XFtpLIST::FeatFacts(cmdTask->mlstFacts) + "\r\n";
+        res += " SIZE\r\n";
+        res += " REST STREAM\r\n";
+        res += " RANG STREAM\r\n";
+        res += " HASH " + XFtpHASH::FeatAlgos(cmdTask->hashAlgo) + "\r\n";
+        res += " XCRC\r\n";
+        res += " XMD5\r\n";
+        res += " XSHA1\r\n";
+        res += " XSHA256\r\n";
+        res += " XSHA512\r\n";
+        res += " EPRT\r\n";
+        res += " EPSV\r\n";
+        if(XFtpMODE::ZEnabled()) res += " MODE Z\r\n";
+        #ifndef OPENSSL_NO_SSL_INCLUDES
+        res += " AUTH TLS\r\n";
+        res += " PBSZ\r\n";
+        res += " PROT\r\n";
+        #endif
+        res += " UTF8\r\n";
+        res += "211 End\r\n";
+        ResCMD(res);
+        return;
+    }
+
+    // OPTS <命令> [参数]
+    string param = msg.size() > 5 ? msg.substr(5) : "";
+    while(!param.empty() && (param.back() == '\r' || param.back() == '\n')){
+        param.pop_back();
+    }
+    size_t space_pos = param.find(' ');
+    string name = param.substr(0, space_pos);
+    string value = (space_pos == string::npos) ? "" : param.substr(space_pos + 1);
+    std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+
+    if(name == "MLST"){
+        // 不带参数表示不输出任何事实
+        cmdTask->mlstFacts = XFtpLIST::ParseFacts(value);
+        ResCMD("200 MLST OPTS " + XFtpLIST::FactList(cmdTask->mlstFacts) + "\r\n");
+    }
+    else if(name == "HASH"){
+        // 不带参数查询当前算法
+        if(!value.empty()){
+            int algo = XFtpHASH::ParseAlgo(value);
+            if(algo < 0){
+                ResCMD("501 Unknown algorithm.\r\n");
+                return;
+            }
+            cmdTask->hashAlgo = algo;
+        }
+        ResCMD("200 " + string(XFtpHASH::AlgoName(cmdTask->hashAlgo)) + "\r\n");
+    }
+    else if(name == "MODE"){
+        // OPTS MODE Z [ENGINE <deflate|zstd>] [LEVEL <n>]，LEVEL 0 表示自适应；不带参数查询当前设置
+        vector<string> args;
+        size_t i = 0;
+        while(i < value.size()){
+            size_t j = value.find(' ', i);
+            if(j == string::npos) j = value.size();
+            if(j > i) args.push_back(value.substr(i, j - i));
+            i = j + 1;
+        }
+        if(args.empty() || (args[0] != "Z" && args[0] != "z") || args.size() % 2 == 0){
+            ResCMD("501 Syntax error in parameters or arguments.\r\n");
+            return;
+        }
+        int engine = cmdTask->zEngine;
+        int level = cmdTask->zLevel;
+        for(size_t k = 1; k + 1 < args.size(); k += 2){
+            string key = args[k];
+            std::transform(key.begin(), key.end(), key.begin(), ::toupper);
+            if(key == "ENGINE"){
+                engine = XZStream::ParseEngine(args[k + 1]);
+                if(engine < 0 || !XZStream::Available(engine)){
+                    ResCMD("501 Unsupported compression engine.\r\n");
+                    return;
+                }
+            }
+            else if(key == "LEVEL"){
+                const string &v = args[k + 1];
+                if(v.empty() || v.size() > 2 || v.find_first_not_of("0123456789") != string::npos){
+                    ResCMD("501 Invalid compression level.\r\n");
+                    return;
+                }
+                level = atoi(v.c_str());
+            }
+            else{
+                ResCMD("501 Option not understood.\r\n");
+                return;
+            }
+        }
+        if(level > XZStream::MaxLevel(engine)){
+            ResCMD("501 Invalid compression level.\r\n");
+            return;
+        }
+        cmdTask->zEngine = engine;
+        cmdTask->zLevel = level;
+        // 未指定时显示配置的默认级别（超出当前算法上限时按上限压缩）
+        if(level < 0) level = min(XFtpMODE::DefaultLevel(), XZStream::MaxLevel(engine));
+        ResCMD("200 MODE Z ENGINE " + string(XZStream::EngineName(engine)) + " LEVEL " +
+               (level ? to_string(level) : string("auto")) + "\r\n");
+    }
+    else if(name == "UTF8"){
+        ResCMD("200 Always in UTF8 mode.\r\n");
+    }
+    else{
+        ResCMD("501 Option not understood.\r\n");
+    }
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "XFtpTask.h"
+#include <string>
+
+// FEAT（RFC 2389）列出扩展特性；OPTS 设置命令选项（目前支持 OPTS MLST / OPTS UTF8）
+class XFtpFEAT : public XFtpTask{
+public:
+    virtual void Parse(std::string cmd, std::string msg);
+};
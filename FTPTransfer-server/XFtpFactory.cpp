@@ -3,36 +3,72 @@
 #include "XFtpUSER.h"
 #include "XFtpLIST.h"
 #include "XFtpPORT.h"
+#include "XFtpPASV.h"
 #include "XFtpRETR.h"
 #include "XFtpSTOR.h"
 #include "XFtpPASS.h"
 #include "XFtpTYPE.h"
+#include "XFtpMODE.h"
 #include "XFtpAUTH.h"
 #include "XFtpPBSZ.h"
 #include "XFtpPROT.h"
 #include "XFtpREST.h"
+#include "XFtpALLO.h"
 #include "XFtpSIZE.h"
 #include "XFtpQUIT.h"
+#include "XFtpFEAT.h"
+#include "XFtpSITE.h"
+#include "XFtpHASH.h"
+#include "XFtpDELE.h"
 #include "testUtil.h"
 #include <memory>           // 智能指针
+#include <atomic>
 
 std::shared_ptr<XFtpServerCMD> XFtpFactory::CreateTask(){
     Logger::debug("XFtpFactory::CreateTask()");
     // XFtpServerCMD *cmd = new XFtpServerCMD();
     std::shared_ptr<XFtpServerCMD> cmd = std::make_shared<XFtpServerCMD>();
+    static std::atomic<uint32_t> next_session{1};
+    cmd->sessionId = next_session.fetch_add(1, std::memory_order_relaxed);
 
     cmd->Reg("USER", new XFtpUSER());
-    cmd->Reg("PORT", new XFtpPORT());
+    XFtpTask *xftpport = new XFtpPORT();
+    cmd->Reg("PORT", xftpport);
+    cmd->Reg("EPRT", xftpport);
+    XFtpTask *xftppasv = new XFtpPASV();
+    cmd->Reg("PASV", xftppasv);
+    cmd->Reg("EPSV", xftppasv);
     cmd->Reg("RETR", new XFtpRETR());
-    cmd->Reg("STOR", new XFtpSTOR());
+    XFtpTask *xftpstor = new XFtpSTOR();
+    cmd->Reg("STOR", xftpstor);
+    cmd->Reg("APPE", xftpstor);
+    cmd->Reg("STOU", xftpstor);
     cmd->Reg("PASS", new XFtpPASS());
     cmd->Reg("TYPE", new XFtpTYPE());
+    cmd->Reg("MODE", new XFtpMODE());
 
     XFtpTask *xftplist = new XFtpLIST();
     cmd->Reg("LIST", xftplist);
     cmd->Reg("PWD", xftplist);
     cmd->Reg("CWD", xftplist);
     cmd->Reg("CDUP", xftplist);
+    cmd->Reg("MLSD", xftplist);
+    cmd->Reg("MLST", xftplist);
+
+    XFtpTask *xftpfeat = new XFtpFEAT();
+    cmd->Reg("FEAT", xftpfeat);
+    cmd->Reg("OPTS", xftpfeat);
+
+    cmd->Reg("SITE", new XFtpSITE());
+
+    // 文件摘要
+    XFtpTask *xftphash = new XFtpHASH();
+    cmd->Reg("HASH", xftphash);
+    cmd->Reg("XCRC", xftphash);
+    cmd->Reg("XMD5", xftphash);
+    cmd->Reg("XSHA1", xftphash);
+    cmd->Reg("XSHA256", xftphash);
+    cmd->Reg("XSHA512", xftphash);
 
     // SSL相关命令注册
     #ifndef OPENSSL_NO_SSL_INCLUDES
@@ -42,9 +78,18 @@ std::shared_ptr<XFtpServerCMD> XFtpFactory::CreateTask(){
     #endif
 
     // 断点续传命令注册
-    cmd->Reg("REST", new XFtpREST());
+    XFtpTask *xftprest = new XFtpREST();
+    cmd->Reg("REST", xftprest);
+    cmd->Reg("RANG", xftprest);
+    cmd->Reg("ALLO", new XFtpALLO());
     cmd->Reg("SIZE", new XFtpSIZE());
 
+    // 删除与改名
+    XFtpTask *xftpdele = new XFtpDELE();
+    cmd->Reg("DELE", xftpdele);
+    cmd->Reg("RNFR", xftpdele);
+    cmd->Reg("RNTO", xftpdele);
+
     cmd->Reg("QUIT", new XFtpQUIT());     // 注册 QUIT 命令
 
     return cmd;
@@ -0,0 +1,400 @@
+#include "XFtpHASH.h"
+#include "XFtpServerCMD.h"
+#include "XThread.h"
+#include "XIOPool.h"
+#include "XMetrics.h"
+#include "XHashIndex.h"
+#include "testUtil.h"
+
+#include <openssl/evp.h>
+#include <zlib.h>
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+#define HASH_CHUNK_SIZE (1024 * 1024)     // 每次 pread 的大小
+
+static const char *algos[XHASH_ALGOS] = {"CRC32", "MD5", "SHA-1", "SHA-256", "SHA-512"};
+
+static XMetricFamily hash_bytes(XMETRIC_COUNTER, "ftp_hash_bytes_total", "Bytes digested by HASH/XCRC/XMD5/XSHA*", "algo");
+static XMetricFamily hash_duration(XMETRIC_HISTOGRAM, "ftp_hash_duration_us", "Time to digest one file range", "algo");
+
+
+/**
+ * 一次摘要计算的共享状态
+ * cancelled 由两边访问，其余字段在提交前写好、完成后只在所属 XThread 中读
+ */
+struct XHashJob{
+    string path;                          // 绝对路径
+    string vpath;                         // 应答中的路径（相对根目录）
+    int algo = XHASH_SHA256;
+    bool draft = false;                   // HASH（213 应答）或 X* 命令（250 应答）
+    off_t start = 0;
+    off_t end = -1;
+    XThread *thread = nullptr;
+    XFtpHASH *owner = nullptr;
+    atomic<bool> cancelled{false};
+
+    string digest;                        // 结果（空表示失败，err 为应答）
+    string err;
+    uint64_t duration_us = 0;
+};
+
+
+int XFtpHASH::ParseAlgo(const string &name){
+    string n = name;
+    std::transform(n.begin(), n.end(), n.begin(), ::toupper);
+    for(int i = 0; i < XHASH_ALGOS; i++){
+        if(n == algos[i]) return i;
+    }
+    return -1;
+}
+
+
+const char *XFtpHASH::AlgoName(int algo){
+    return (algo >= 0 && algo < XHASH_ALGOS) ? algos[algo] : "";
+}
+
+
+string XFtpHASH::FeatAlgos(int selected){
+    string s;
+    for(int i = 0; i < XHASH_ALGOS; i++){
+        if(i) s += ";";
+        s += algos[i];
+        if(i == selected) s += "*";
+    }
+    return s;
+}
+
+
+static const EVP_MD *Digest(int algo){
+    switch(algo){
+        case XHASH_MD5: return EVP_md5();
+        case XHASH_SHA1: return EVP_sha1();
+        case XHASH_SHA256: return EVP_sha256();
+        case XHASH_SHA512: return EVP_sha512();
+    }
+    return nullptr;
+}
+
+
+bool XDigest::Init(int a){
+    Reset();
+    if(a < 0 || a >= XHASH_ALGOS) return false;
+    if(a == XHASH_CRC32){
+        crc = crc32(0L, Z_NULL, 0);
+    }
+    else{
+        ctx = EVP_MD_CTX_new();
+        if(!ctx || EVP_DigestInit_ex(ctx, Digest(a), nullptr) != 1){
+            Reset();
+            return false;
+        }
+    }
+    algo = a;
+    return true;
+}
+
+
+void XDigest::Update(const void *data, size_t len){
+    if(ctx){
+        EVP_DigestUpdate(ctx, data, len);
+        return;
+    }
+    // zlib 的长度参数是 uInt，大块分段
+    const Bytef *p = (const Bytef *)data;
+    while(len > 0){
+        uInt n = (uInt)min<size_t>(len, 1u << 30);
+        crc = crc32(crc, p, n);
+        p += n;
+        len -= n;
+    }
+}
+
+
+unsigned XDigest::Final(unsigned char *out){
+    unsigned len = 0;
+    if(ctx){
+        EVP_DigestFinal_ex(ctx, out, &len);
+    }
+    else if(algo == XHASH_CRC32){
+        for(int i = 0; i < 4; i++) out[i] = (unsigned char)(crc >> (24 - 8 * i));
+        len = 4;
+    }
+    Reset();
+    return len;
+}
+
+
+void XDigest::Reset(){
+    EVP_MD_CTX_free(ctx);
+    ctx = nullptr;
+    algo = -1;
+}
+
+
+string XDigest::Hex(int algo, const unsigned char *digest, unsigned len){
+    const char *fmt = algo == XHASH_CRC32 ? "%02X" : "%02x";
+    string hex;
+    char tmp[3];
+    for(unsigned i = 0; i < len; i++){
+        snprintf(tmp, sizeof(tmp), fmt, digest[i]);
+        hex += tmp;
+    }
+    return hex;
+}
+
+
+string XFtpHASH::Compute(const string &path, int algo, off_t start, off_t &end,
+                         const atomic<bool> *cancelled, string &err){
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        err = "550 File not found or inaccessible.\r\n";
+        return "";
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)){
+        close(fd);
+        err = "550 Not a regular file.\r\n";
+        return "";
+    }
+    if(end < 0 || end > st.st_size) end = st.st_size;
+    if(start > end){
+        close(fd);
+        err = "554 Requested range exceeds file size.\r\n";
+        return "";
+    }
+
+    // 整个文件：先查索引（按 dev/inode/大小/mtime，内容变了就不会命中）
+    unsigned char out[EVP_MAX_MD_SIZE];
+    unsigned len = 0;
+    bool whole = start == 0 && end == st.st_size;
+    if(whole && XHashIndex::Get()->Lookup(st, algo, out, len)){
+        close(fd);
+        return XDigest::Hex(algo, out, len);
+    }
+
+    #ifdef __linux__
+    posix_fadvise(fd, start, end - start, POSIX_FADV_SEQUENTIAL);
+    #endif
+
+    // 每个 XIOPool 线程一块读缓冲区，复用
+    static thread_local vector<unsigned char> buf(HASH_CHUNK_SIZE);
+    XDigest digest;
+    if(!digest.Init(algo)){
+        close(fd);
+        err = "451 Local error in processing.\r\n";
+        return "";
+    }
+
+    off_t pos = start;
+    while(pos < end){
+        if((cancelled && cancelled->load(std::memory_order_relaxed)) || XIOPool::Get()->Stopping()){
+            err = "451 Hash cancelled.\r\n";
+            break;
+        }
+        size_t want = (size_t)min<off_t>(end - pos, HASH_CHUNK_SIZE);
+        ssize_t n = pread(fd, buf.data(), want, pos);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0){
+            err = "451 Read error.\r\n";        // 文件在计算过程中被截断也算读错误
+            break;
+        }
+        digest.Update(buf.data(), n);
+        pos += n;
+    }
+    if(!err.empty()){
+        close(fd);
+        return "";
+    }
+    len = digest.Final(out);
+
+    // 计算期间文件没有变化才记入索引
+    struct stat after;
+    if(whole && fstat(fd, &after) == 0 && XHashIndex::SameContent(st, after)){
+        XHashIndex::Get()->Store(after, algo, out, len);
+    }
+    close(fd);
+    return XDigest::Hex(algo, out, len);
+}
+
+
+// 参数中的路径与可选的两个数字（XCRC "name with spaces" 0 100 或 XCRC name 0 100）
+static void SplitArgs(const string &param, XVfs &vfs, const string &dir, string &name, vector<off_t> &nums){
+    nums.clear();
+    string rest;
+    if(!param.empty() && param[0] == '"'){
+        size_t q = param.find('"', 1);
+        name = param.substr(1, q == string::npos ? string::npos : q - 1);
+        rest = q == string::npos ? "" : param.substr(q + 1);
+    }
+    else{
+        // 未加引号：整个参数是存在的文件名就不拆；否则末尾最多两个数字视为范围
+        name = param;
+        struct stat st;
+        int err = 0;
+        if(vfs.Stat(XVfs::Normalize(dir, param), st, err)) return;
+        for(int i = 0; i < 2; i++){
+            size_t sp = name.find_last_of(' ');
+            if(sp == string::npos) break;
+            string tok = name.substr(sp + 1);
+            if(tok.empty() || tok.find_first_not_of("0123456789") != string::npos) break;
+            rest = tok + " " + rest;
+            name = name.substr(0, sp);
+        }
+    }
+    size_t i = 0;
+    while(i < rest.size()){
+        while(i < rest.size() && rest[i] == ' ') i++;
+        size_t j = rest.find(' ', i);
+        string tok = rest.substr(i, j == string::npos ? string::npos : j - i);
+        if(!tok.empty()) nums.push_back(strtoll(tok.c_str(), nullptr, 10));
+        if(j == string::npos) break;
+        i = j;
+    }
+}
+
+
+void XFtpHASH::Parse(string cmd, string msg){
+    Logger::debug("XFtpHASH::Parse() -> msg: ", msg);
+
+    string param = msg.size() > cmd.size() + 1 ? msg.substr(cmd.size() + 1) : "";
+    while(!param.empty() && (param.back() == '\r' || param.back() == '\n')){
+        param.pop_back();
+    }
+    if(param.empty()){
+        ResCMD("501 Syntax error in parameters or arguments.\r\n");
+        return;
+    }
+    if(job){
+        ResCMD("450 Another hash is in progress.\r\n");
+        return;
+    }
+
+    // 相对当前目录的虚拟路径
+    string dir = cmdTask->curDir;
+    if(!dir.empty() && dir.back() != '/') dir += "/";
+
+    // REST 只作用于下一条命令
+    off_t rest = cmdTask->GetFileOffset();
+    cmdTask->SetFileOffset(0);
+
+    if(cmd == "HASH"){
+        string vpath = param[0] == '/' ? param : dir + param;
+        int algo = cmdTask->hashAlgo;
+        Start(algo, vpath, rest, -1, true);
+        return;
+    }
+
+    int algo = cmd == "XCRC" ? XHASH_CRC32 : cmd == "XMD5" ? XHASH_MD5 : cmd == "XSHA1" ? XHASH_SHA1 :
+               cmd == "XSHA256" ? XHASH_SHA256 : XHASH_SHA512;
+    string name;
+    vector<off_t> nums;
+    SplitArgs(param, cmdTask->vfs, dir, name, nums);
+    if(name.empty() || nums.size() > 2){
+        ResCMD("501 Syntax error in parameters or arguments.\r\n");
+        return;
+    }
+    off_t start = nums.size() > 0 ? nums[0] : rest;
+    off_t end = (nums.size() > 1 && nums[1] > 0) ? nums[1] : -1;
+    Start(algo, name[0] == '/' ? name : dir + name, start, end, false);
+}
+
+
+void XFtpHASH::Start(int algo, const string &vpath, off_t start, off_t end, bool draft){
+    XFtpServerCMD *cmd = static_cast<XFtpServerCMD*>(cmdTask);
+    if(!cmd->thread){
+        ResCMD("451 Local error in processing.\r\n");
+        return;
+    }
+    // 摘要在 XIOPool 中按路径名计算：先在根目录之下解析一次，.. 与指向根目录之外的符号链接在这里拒绝
+    string norm = XVfs::Normalize("/", vpath);
+    struct stat st;
+    int err = 0;
+    if(!cmdTask->vfs.Stat(norm, st, err) && err == EACCES){
+        ResCMD("550 Permission denied.\r\n");
+        return;
+    }
+
+    job = make_shared<XHashJob>();
+    job->path = cmdTask->vfs.RealPath(norm);
+    job->vpath = vpath;
+    job->algo = algo;
+    job->draft = draft;
+    job->start = start;
+    job->end = end;
+    job->thread = cmd->thread;
+    job->owner = this;
+    Logger::info("XFtpHASH::Start() -> ", AlgoName(algo), " ", job->path, " from ", start);
+
+    cmd->hashPending = true;
+
+    auto j = job;
+    XIOPool::Get()->Submit([j]{
+        uint64_t t0 = XMetrics::NowUs();
+        j->digest = Compute(j->path, j->algo, j->start, j->end, &j->cancelled, j->err);
+        j->duration_us = XMetrics::NowUs() - t0;
+        j->thread->Post([j]{
+            if(j->owner) j->owner->OnDone(j);
+        });
+    });
+}
+
+
+void XFtpHASH::OnDone(shared_ptr<XHashJob> j){
+    if(j != job) return;
+    job.reset();
+    j->owner = nullptr;
+    Reply(j);
+    // 计算期间收到的命令
+    XFtpServerCMD *session = static_cast<XFtpServerCMD*>(cmdTask);
+    session->hashPending = false;
+    session->ProcessCommands();
+}
+
+
+void XFtpHASH::Reply(const shared_ptr<XHashJob> &j){
+    if(j->digest.empty()){
+        ResCMD(j->err);
+        return;
+    }
+    const char *name = AlgoName(j->algo);
+    XMetrics::Add(hash_bytes.Id(name), j->end - j->start);
+    XMetrics::Observe(hash_duration.Id(name), j->duration_us);
+    Logger::info("XFtpHASH::OnDone() -> ", name, " ", j->path, " ", j->end - j->start, " bytes in ",
+                 j->duration_us, "us");
+
+    if(j->draft){
+        ResCMD("213 " + string(name) + " " + to_string(j->start) + "-" + to_string(j->end) + " " +
+               j->digest + " " + j->vpath + "\r\n");
+    }
+    else{
+        ResCMD("250 " + j->digest + "\r\n");
+    }
+}
+
+
+void XFtpHASH::Cancel(){
+    if(!job) return;
+    job->cancelled = true;
+    job->owner = nullptr;
+    job.reset();
+}
+
+
+void XFtpHASH::ClosePORT(){
+    Cancel();
+    XFtpTask::ClosePORT();
+}
+
+
+XFtpHASH::~XFtpHASH(){
+    Cancel();
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "XFtpTask.h"
+#include <string>
+#include <memory>
+
+struct XHashJob;
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+/**
+ * @class XDigest
+ * @brief 单个算法的流式摘要（EVP 或 zlib CRC-32），HASH 计算与 STOR 边收边算共用
+ */
+class XDigest{
+public:
+    XDigest(){}
+    XDigest(const XDigest &) = delete;
+    XDigest &operator=(const XDigest &) = delete;
+    ~XDigest(){ Reset(); }
+
+    bool Init(int algo);
+    void Update(const void *data, size_t len);
+    // 写出摘要原始字节（out 至少 64 字节），返回长度；之后需重新 Init
+    unsigned Final(unsigned char *out);
+    void Reset();
+
+    bool Active() const { return algo >= 0; }
+    int Algo() const { return algo; }
+
+    // 十六进制表示：CRC-32 为 8 位大写，其余小写
+    static string Hex(int algo, const unsigned char *digest, unsigned len);
+
+private:
+    int algo = -1;
+    EVP_MD_CTX *ctx = nullptr;
+    unsigned long crc = 0;
+};
+
+/**
+ * @class XFtpHASH
+ * @brief 服务器端文件摘要：HASH（draft-bryan-ftpext-hash）与 XCRC / XMD5 / XSHA1 / XSHA256 / XSHA512
+ *
+ * HASH <path>：用 OPTS HASH 选定的算法（默认 SHA-256），范围从 REST 偏移量到文件末尾，
+ *   应答 213 <算法> <起始>-<结束> <摘要> <路径>。
+ * XCRC / XMD5 / XSHA* <path> [起始 [结束]]：范围为 [起始, 结束)，结束为 0 或省略表示到文件末尾，
+ *   省略起始时使用 REST 偏移量；应答 250 <摘要>（CRC 为 8 位大写十六进制）。
+ * 读文件与计算在 XIOPool 中进行，结果通过 XThread::Post 回到本线程再应答，不阻塞事件循环；
+ * 计算期间控制连接暂停处理后续命令（同 PASS），应答不会与后面命令的应答交错。
+ * 摘要由 OpenSSL EVP 计算（运行时按 CPU 选择 SHA-NI / ARMv8 等指令实现），CRC-32 用 zlib。
+ * 整个文件的摘要记入 XHashIndex，文件内容不变时再次查询直接命中。
+ */
+class XFtpHASH : public XFtpTask{
+public:
+    virtual void Parse(string cmd, string msg);
+    virtual void ClosePORT();
+    virtual ~XFtpHASH();
+
+    // 由 XIOPool 线程通过 XThread::Post 在本线程调用
+    void OnDone(std::shared_ptr<XHashJob> job);
+
+    // 算法名（HASH 命令使用的名字，如 "SHA-256"），不区分大小写；未知返回 -1
+    static int ParseAlgo(const string &name);
+    static const char *AlgoName(int algo);
+
+    // FEAT 中的 HASH 行参数：全部算法，当前选中的带 *
+    static string FeatAlgos(int selected);
+
+    // 计算文件 [start, end) 的摘要（end 为 -1 表示到文件末尾），阻塞，在 XIOPool 线程中调用
+    // 成功返回十六进制摘要并把实际的结束位置写回 end；失败返回空串并写 err（FTP 应答）
+    static string Compute(const string &path, int algo, off_t start, off_t &end,
+                          const std::atomic<bool> *cancelled, string &err);
+
+private:
+    void Start(int algo, const string &vpath, off_t start, off_t end, bool draft);
+    void Reply(const std::shared_ptr<XHashJob> &j);
+    void Cancel();
+
+    std::shared_ptr<XHashJob> job;        // 当前进行中的计算
+};
@@ -3,7 +3,18 @@
 #include <event2/event.h>
 #include <event2/buffer.h>
 #include <sys/stat.h> 
+#include <unistd.h>
+#include <time.h>
+#include <strings.h>
+#include <limits.h>
+#include <pwd.h>
+#include <grp.h>
+#include <algorithm>
+#include <map>
 #include "testUtil.h"
+#include "XDirCache.h"
+#include "XDirWalker.h"
+#include "XMetrics.h"
 
 // OpenSSL相关头文件
 #ifndef OPENSSL_NO_SSL_INCLUDES
@@ -15,20 +26,24 @@ extern SSL_CTX *ssl_ctx;               // 声明外部SSL上下文变量
 
 using namespace std;
 
+// 目录枚举耗时（只统计缓存未命中时的实际枚举）与缓存命中情况
+static XMetricFamily list_duration(XMETRIC_HISTOGRAM, "ftp_list_duration_us",
+                                   "Directory enumeration time in microseconds", "cmd");
+static XMetricFamily list_cache(XMETRIC_COUNTER, "ftp_list_cache_total", "Directory listing cache lookups", "result");
 
 
 void XFtpLIST::Write(bufferevent* bev) {
     Logger::debug("XFtpLIST::Write()");
     
-    static bool data_queued = false;
-    
     if(!data_queued) {
         // 第一次：发送数据
         int result = Send(listdata);
         if(result <= 0){
             if(result == 0){
                 Logger::info("XFtpLIST::Write() -> Data queued for sending");
+                TransferBytes(listdata->size());
                 data_queued = true;
+                FinishSend();               // MODE Z 的流结尾随列表一起排队
                 
                 // 关键：不要在这里发送 226
                 // 等待下一次 Write() 回调来检查缓冲区
@@ -48,8 +63,8 @@ void XFtpLIST::Write(bufferevent* bev) {
         // 缓冲区已空，传输完成
         Logger::info("XFtpLIST::Write() -> Buffer empty, transfer complete");
         ResCMD("226 Transfer complete\r\n");
+        EndTransfer(true);
         ClosePORT();
-        data_queued = false; // 重置状态
         Logger::info("XFtpLIST::Write() close connection");
     } else {
         // 缓冲区还有数据，继续等待
@@ -59,8 +74,14 @@ void XFtpLIST::Write(bufferevent* bev) {
 }
 
 
+void XFtpLIST::ClosePORT(){
+    data_queued = false;
+    XFtpTask::ClosePORT();
+}
+
+
 void XFtpLIST::Event(bufferevent* bev, short events) {
-    Logger::debug("XFtpLIST::Event() events: " + std::to_string(events));
+    Logger::debug("XFtpLIST::Event() events: ", events);
     // 检查是否是连接建立和错误同时发生
     #ifndef OPENSSL_NO_SSL_INCLUDES
         // 检查是否是SSL握手完成事件
@@ -72,12 +93,6 @@ void XFtpLIST::Event(bufferevent* bev, short events) {
                 SSL *ssl = bufferevent_openssl_get_ssl(bev);
                 if(ssl && SSL_is_init_finished(ssl)){
                     Logger::info("XFtpLIST::Event() -> SSL ready, starting data transfer");
-                    // 连接建立成功，设置传输阶段的超时
-                    // 列表：类似下载，主要关注写超时
-                    timeval write_timeout = {60, 0};    // 发送目录列表超时60秒
-                    timeval read_timeout = {30, 0};     // 读取超时30秒
-                    bufferevent_set_timeouts(bev, &read_timeout, &write_timeout);
-                    
                     // 开始发送数据
                     bufferevent_trigger(bev, EV_WRITE, 0);
                 }
@@ -116,7 +131,7 @@ void XFtpLIST::Event(bufferevent* bev, short events) {
                     while ((ssl_err = ERR_get_error()) != 0) {
                         char err_buf[256];
                         ERR_error_string_n(ssl_err, err_buf, sizeof(err_buf));
-                        Logger::error("SSL Error: " + std::string(err_buf));
+                        Logger::error("SSL Error: ", err_buf);
                     }
                 }
             } else {
@@ -134,7 +149,7 @@ void XFtpLIST::Event(bufferevent* bev, short events) {
         // 获取错误信息
         int err = EVUTIL_SOCKET_ERROR();
         std::string err_str = evutil_socket_error_to_string(err);
-        Logger::error("XFtpLIST::Event() -> Socket error: " + err_str);
+        Logger::error("XFtpLIST::Event() -> Socket error: ", err_str);
         
         // 关键修正：正确检查 EINPROGRESS
         // 比较错误码
@@ -150,6 +165,11 @@ void XFtpLIST::Event(bufferevent* bev, short events) {
         
         // 如果是真正的错误，才关闭连接
         Logger::error("XFtpLIST::Event() -> Real connection error, closing.");
+        if(!DataConnected()){
+            // PORT 模式的连接被拒绝等：客户端已收到 150，需要一个结果码
+            ResCMD("425 Can't build data connection.\r\n");
+            EndTransfer(false, 425);
+        }
         ClosePORT();
         Logger::info("XFtpLIST::Event() close connection");
         return;
@@ -167,7 +187,7 @@ void XFtpLIST::Event(bufferevent* bev, short events) {
     #ifndef OPENSSL_NO_SSL_INCLUDES
         else if (events & 0x4000) { // 有些libevent版本用这个标志表示SSL握手完成
             Logger::info("XFtpLIST::Event() -> SSL handshake completed event");
-            if (listdata.empty()) {
+            if (!listdata || listdata->empty()) {
                 Logger::debug("XFtpLIST::Event() -> No data to send yet");
             } else {
                 bufferevent_trigger(bev, EV_WRITE, 0);
@@ -179,72 +199,263 @@ void XFtpLIST::Event(bufferevent* bev, short events) {
 
 
 
-// 函数作用：获取指定路径的目录列表数据，通过执行系统ls命令并捕获输出
-// 参数：path - 要列出内容的目录路径
-// 返回值：包含目录详细列表的字符串（类似ls -l格式）
-// 安全警告：直接使用popen执行系统命令存在安全风险，特别是当path来自不可信输入时
-string XFtpLIST::GetListData(string path){
-    Logger::debug("XFtpLIST::GetListData()");
-    // 安全性检查
-    if(path.find("rm") != string::npos){
-        Logger::warning("XFtpLIST::GetListData() path is not safe");
-        ResCMD("550 Not allowed.\r\n");
-        return "";
+// ls -l 风格的权限串，例如 "drwxr-xr-x"
+static string ModeString(mode_t mode){
+    char m[11];
+    if(S_ISDIR(mode))       m[0] = 'd';
+    else if(S_ISLNK(mode))  m[0] = 'l';
+    else if(S_ISCHR(mode))  m[0] = 'c';
+    else if(S_ISBLK(mode))  m[0] = 'b';
+    else if(S_ISFIFO(mode)) m[0] = 'p';
+    else if(S_ISSOCK(mode)) m[0] = 's';
+    else                    m[0] = '-';
+    static const char rwx[] = "rwxrwxrwx";
+    for(int i = 0; i < 9; i++){
+        m[i + 1] = (mode & (0400 >> i)) ? rwx[i] : '-';
     }
-    
-    // 初始化返回数据为空字符串
-    string data = "";
-    
-    // 构建系统命令："ls -l [path]"
-    string cmd = "ls -la ";
-    cmd += path;  // 直接将路径拼接到命令中，存在安全风险
-    Logger::debug("XFtpLIST::GetListData() cmd: ", cmd);
-    
-    // 使用popen执行系统命令并获取输出
-    // popen()会创建一个管道，fork一个子进程，然后执行shell命令
-    // "r"表示从命令输出读取数据
-    FILE *f = popen(cmd.c_str(), "r");
-    
-    // 检查命令执行是否成功
-    if (f == nullptr){
-        Logger::warning("XFtpLIST::GetListData() popen failed");
-        return data;  // 返回空字符串表示失败
+    if(mode & S_ISUID) m[3] = (mode & S_IXUSR) ? 's' : 'S';
+    if(mode & S_ISGID) m[6] = (mode & S_IXGRP) ? 's' : 'S';
+    if(mode & S_ISVTX) m[9] = (mode & S_IXOTH) ? 't' : 'T';
+    m[10] = '\0';
+    return m;
+}
+
+
+// uid/gid 转名字，查不到时用数字；同一次列表内缓存，避免每项都查 NSS
+static const string &OwnerName(uid_t uid, map<uid_t, string> &names){
+    auto it = names.find(uid);
+    if(it != names.end()) return it->second;
+    struct passwd pw, *res = nullptr;
+    char buf[1024];
+    string name = (getpwuid_r(uid, &pw, buf, sizeof(buf), &res) == 0 && res) ? res->pw_name : to_string(uid);
+    return names.emplace(uid, std::move(name)).first->second;
+}
+
+static const string &GroupName(gid_t gid, map<gid_t, string> &names){
+    auto it = names.find(gid);
+    if(it != names.end()) return it->second;
+    struct group gr, *res = nullptr;
+    char buf[1024];
+    string name = (getgrgid_r(gid, &gr, buf, sizeof(buf), &res) == 0 && res) ? res->gr_name : to_string(gid);
+    return names.emplace(gid, std::move(name)).first->second;
+}
+
+
+// 使用原生目录枚举生成 LIST 数据（ls -la 格式），不经过 shell，目录名里的 ; $() 等只是普通字符
+string XFtpLIST::GetLISTData(int dir_fd, bool &ok){
+    vector<XDirEntry> entries;
+    ok = XDirWalker::ReadDirAt(dir_fd, entries);
+    string data;
+    if(!ok) return data;
+
+    sort(entries.begin(), entries.end(), [](const XDirEntry &a, const XDirEntry &b){
+        return a.name < b.name;
+    });
+
+    // 先算各列宽度，与 ls 一样右对齐数字列、左对齐属主列
+    map<uid_t, string> users;
+    map<gid_t, string> groups;
+    long long blocks = 0;
+    size_t w_link = 1, w_user = 1, w_group = 1, w_size = 1;
+    for(auto &e : entries){
+        blocks += (long long)e.st.st_blocks;
+        w_link = max(w_link, to_string((unsigned long)e.st.st_nlink).size());
+        w_user = max(w_user, OwnerName(e.st.st_uid, users).size());
+        w_group = max(w_group, GroupName(e.st.st_gid, groups).size());
+        w_size = max(w_size, to_string((long long)e.st.st_size).size());
     }
 
-    // 缓冲区用于读取命令输出
-    char buf[1024] = {0};
-    
-    // 循环读取命令输出
-    while (true){
-        // 每次读取最多1023字节（留1字节给字符串结束符）
-        int len = fread(buf, 1, sizeof(buf) - 1, f);
-        
-        // 读取结束或出错时跳出循环
-        if(len <= 0) break;
-        
-        // 确保字符串正确终止
-        buf[len] = '\0';
-        
-        // 将读取到的数据追加到结果字符串
-        data += buf;
+    // 半年以内的显示时间，否则显示年份
+    time_t now = time(nullptr);
+    const time_t half_year = 365 * 24 * 3600 / 2;
+
+    data.reserve(entries.size() * 80);
+    data += "total " + to_string(blocks / 2) + "\r\n";
+    char line[512];
+    char date[32];
+    for(auto &e : entries){
+        struct tm tm;
+        localtime_r(&e.st.st_mtime, &tm);
+        bool recent = e.st.st_mtime <= now && now - e.st.st_mtime < half_year;
+        strftime(date, sizeof(date), recent ? "%b %e %H:%M" : "%b %e  %Y", &tm);
+        snprintf(line, sizeof(line), "%s %*lu %-*s %-*s %*lld %s ",
+                 ModeString(e.st.st_mode).c_str(),
+                 (int)w_link, (unsigned long)e.st.st_nlink,
+                 (int)w_user, OwnerName(e.st.st_uid, users).c_str(),
+                 (int)w_group, GroupName(e.st.st_gid, groups).c_str(),
+                 (int)w_size, (long long)e.st.st_size, date);
+        data += line;
+        data += e.name;
+        if(S_ISLNK(e.st.st_mode)){
+            char target[PATH_MAX];
+            ssize_t n = readlinkat(dir_fd, e.name.c_str(), target, sizeof(target));
+            if(n > 0){
+                data += " -> ";
+                data.append(target, n);
+            }
+        }
+        data += "\r\n";
     }
-    
-    // 关闭命令管道，等待子进程结束
-    pclose(f);
-    
-    // 返回收集到的目录列表数据
     return data;
 }
 
 
 
+// 事实名称表，顺序与 Fact 位一致
+static const char *fact_names[] = {"type", "size", "modify", "perm", "unique", "UNIX.mode"};
+static const int fact_count = sizeof(fact_names) / sizeof(fact_names[0]);
+
+
+unsigned int XFtpLIST::ParseFacts(const string &list){
+    unsigned int facts = 0;
+    size_t start = 0;
+    while(start < list.size()){
+        size_t end = list.find(';', start);
+        if(end == string::npos) end = list.size();
+        string name = list.substr(start, end - start);
+        for(int i = 0; i < fact_count; i++){
+            if(strcasecmp(name.c_str(), fact_names[i]) == 0) facts |= 1u << i;
+        }
+        start = end + 1;
+    }
+    return facts;
+}
+
+
+string XFtpLIST::FeatFacts(unsigned int selected){
+    string res;
+    for(int i = 0; i < fact_count; i++){
+        res += fact_names[i];
+        if(selected & (1u << i)) res += "*";
+        res += ";";
+    }
+    return res;
+}
+
+
+string XFtpLIST::FactList(unsigned int facts){
+    string res;
+    for(int i = 0; i < fact_count; i++){
+        if(facts & (1u << i)){
+            res += fact_names[i];
+            res += ";";
+        }
+    }
+    return res;
+}
+
+
+// 按进程的有效用户判断 mode 中的 r/w/x 位（bit: 4/2/1）
+static bool Permitted(const struct stat &st, int bit){
+    uid_t uid = geteuid();
+    if(uid == 0){
+        return bit != 1 || (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH));
+    }
+    if(st.st_uid == uid) return st.st_mode & (bit << 6);
+    if(st.st_gid == getegid()) return st.st_mode & (bit << 3);
+    return st.st_mode & bit;
+}
+
+
+// 生成一行 MLSD/MLST 事实（不含文件名），例如 "type=file;size=6;modify=20261019102600;"
+// parent_writable：所在目录是否可写（可写时即使文件本身只读也能被 STOR 覆盖）
+string XFtpLIST::FormatFacts(const XDirEntry &e, unsigned int facts, bool parent_writable){
+    const struct stat &st = e.st;
+    bool is_dir = S_ISDIR(st.st_mode);
+    char buf[64];
+    string res;
+
+    if(facts & FACT_TYPE){
+        res += "type=";
+        if(e.name == ".")           res += "cdir";
+        else if(e.name == "..")     res += "pdir";
+        else if(is_dir)             res += "dir";
+        else if(S_ISREG(st.st_mode)) res += "file";
+        else if(S_ISLNK(st.st_mode)) res += "OS.unix=slink";
+        else                        res += "OS.unix=other";
+        res += ";";
+    }
+    if((facts & FACT_SIZE) && !is_dir){
+        res += "size=" + to_string((long long)st.st_size) + ";";
+    }
+    if(facts & FACT_MODIFY){
+        struct tm tm;
+        gmtime_r(&st.st_mtime, &tm);
+        strftime(buf, sizeof(buf), "%Y%m%d%H%M%S", &tm);
+        res += "modify=";
+        res += buf;
+        res += ";";
+    }
+    if(facts & FACT_PERM){
+        // 只声明本服务器支持的操作：文件 r(RETR)/w(STOR)，目录 e(CWD)/l(LIST)/c(STOR)
+        res += "perm=";
+        if(is_dir){
+            if(Permitted(st, 1)) res += "e";
+            if(Permitted(st, 4)) res += "l";
+            if(Permitted(st, 2)) res += "c";
+        }
+        else{
+            if(Permitted(st, 4)) res += "r";
+            if(Permitted(st, 2) || (parent_writable && !S_ISLNK(st.st_mode))) res += "w";
+        }
+        res += ";";
+    }
+    if(facts & FACT_UNIQUE){
+        snprintf(buf, sizeof(buf), "unique=%llxU%llx;",
+                 (unsigned long long)st.st_dev, (unsigned long long)st.st_ino);
+        res += buf;
+    }
+    if(facts & FACT_UNIX_MODE){
+        snprintf(buf, sizeof(buf), "UNIX.mode=0%o;", (unsigned int)(st.st_mode & 07777));
+        res += buf;
+    }
+    return res;
+}
+
+
+// 使用原生目录枚举生成 MLSD 数据，每行 "facts name\r\n"
+string XFtpLIST::GetMLSDData(int dir_fd, unsigned int facts, bool &ok){
+    vector<XDirEntry> entries;
+    ok = XDirWalker::ReadDirAt(dir_fd, entries);
+    string data;
+    if(!ok) return data;
+
+    bool dir_writable = false;
+    for(auto &e : entries){
+        if(e.name == ".") dir_writable = Permitted(e.st, 2);
+    }
+    data.reserve(entries.size() * 96);
+    for(auto &e : entries){
+        data += FormatFacts(e, facts, dir_writable);
+        data += " ";
+        data += e.name;
+        data += "\r\n";
+    }
+    return data;
+}
+
+
+// 由命令参数（"MLSD [path]\r\n"）得到规范化的虚拟路径，规则与 CWD 一致
+string XFtpLIST::ResolvePath(const string &msg){
+    string arg = "";
+    size_t space_pos = msg.find(' ');
+    if(space_pos != string::npos){
+        arg = msg.substr(space_pos + 1);
+        while(!arg.empty() && (arg.back() == '\r' || arg.back() == '\n')){
+            arg.pop_back();
+        }
+    }
+    return XVfs::Normalize(cmdTask->curDir, arg);
+}
+
+
+
 // 函数作用：解析和处理多个FTP目录相关命令（PWD、LIST、CWD、CDUP）
 // 参数：
 //   cmd - FTP命令字（"PWD"、"LIST"、"CWD"、"CDUP"）
 //   msg - 完整的FTP命令字符串（包含命令和参数）
 // 注意：这个类名为XFtpLIST，但实际处理多个目录相关命令，设计上存在责任混淆
 void XFtpLIST::Parse(string cmd, string msg){
-    cout << endl;
     Logger::debug("XFtpLIST::Parse()");
     Logger::debug("XFtpLIST::Parse() msg: ", msg);
     
@@ -260,25 +471,107 @@ void XFtpLIST::Parse(string cmd, string msg){
     }
     // LIST命令：列出目录内容
     else if (cmd == "LIST"){
-        // 构建完整路径：根目录 + 当前目录
-        string path = "";
-        if(cmdTask->curDir[0] != '/'){ // 如果当前目录不以/开头
-            path = cmdTask->curDir;
+        // 真实路径只作为缓存的键；枚举通过会话 vfs 打开的目录 fd 进行，符号链接出不了根目录
+        string vpath = XVfs::Normalize(cmdTask->curDir, "");
+        string path = cmdTask->vfs.RealPath(vpath);
+        Logger::debug("XFtpLIST::Parse() path: ", path);
+        
+        // 获取目录列表数据：优先使用缓存，未命中时再枚举并写入缓存
+        listdata = XDirCache::Get()->Lookup(path);
+        bool hit = (bool)listdata;
+        if(hit){
+            Logger::debug("XFtpLIST::Parse() -> dir cache hit: ", path);
         }
         else{
-            path = cmdTask->curDir.substr(1);
+            bool ok = false;
+            uint64_t start = XMetrics::NowUs();
+            string data;
+            int err = 0;
+            int dfd = cmdTask->vfs.OpenDir(vpath, err);
+            if(dfd >= 0){
+                data = GetLISTData(dfd, ok);
+                close(dfd);
+            }
+            XMetrics::Observe(list_duration.Id("LIST"), XMetrics::NowUs() - start);
+            if(!ok){
+                ResCMD("550 Failed to read directory.\r\n");
+                return;
+            }
+            listdata = XDirCache::Get()->Store(path, std::move(data));
         }
-        path = cmdTask->rootDir + path; // 拼接根目录和当前目录
-        Logger::debug("XFtpLIST::Parse() path: ", path);
-        
-        // 获取目录列表数据
-        listdata = GetListData(path);
+        Logger::trace(XTRACE_LIST_END, cmdTask->sessionId, listdata->size(), hit);
+        XMetrics::Add(list_cache.Id(hit ? "hit" : "miss"), 1);
         
         // 发送开始传输响应
         ResCMD("150 Here comes the directory listing.\r\n");
+        data_queued = false;
+        BeginTransfer(XFTP_XFER_LIST, path);
         // 建立数据连接
         ConnectoPORT();
     }
+    // MLSD命令：机器可读的目录列表（RFC 3659），通过数据连接发送
+    else if (cmd == "MLSD"){
+        string vpath = ResolvePath(msg);
+        string path = cmdTask->vfs.RealPath(vpath);
+        unsigned int facts = cmdTask->mlstFacts;
+        string variant = "MLSD:" + to_string(facts);
+        Logger::debug("XFtpLIST::Parse() MLSD path: ", path);
+
+        struct stat s_buf;
+        int err = 0;
+        if(!cmdTask->vfs.Stat(vpath, s_buf, err)){
+            ResCMD("550 No such directory.\r\n");
+            return;
+        }
+        if(!S_ISDIR(s_buf.st_mode)){
+            ResCMD("501 Not a directory.\r\n");
+            return;
+        }
+
+        listdata = XDirCache::Get()->Lookup(path, variant);
+        bool hit = (bool)listdata;
+        if(!hit){
+            bool ok = false;
+            uint64_t start = XMetrics::NowUs();
+            string data;
+            int dfd = cmdTask->vfs.OpenDir(vpath, err);
+            if(dfd >= 0){
+                data = GetMLSDData(dfd, facts, ok);
+                close(dfd);
+            }
+            XMetrics::Observe(list_duration.Id("MLSD"), XMetrics::NowUs() - start);
+            if(!ok){
+                ResCMD("550 Failed to read directory.\r\n");
+                return;
+            }
+            listdata = XDirCache::Get()->Store(path, std::move(data), variant);
+        }
+        Logger::trace(XTRACE_LIST_END, cmdTask->sessionId, listdata->size(), hit);
+        XMetrics::Add(list_cache.Id(hit ? "hit" : "miss"), 1);
+
+        ResCMD("150 Here comes the directory listing.\r\n");
+        data_queued = false;
+        BeginTransfer(XFTP_XFER_LIST, path, "MLSD");
+        ConnectoPORT();
+    }
+    // MLST命令：单个对象的事实，直接在控制连接上返回
+    else if (cmd == "MLST"){
+        string vpath = ResolvePath(msg);
+        XDirEntry e;
+        struct stat s_buf;
+        int err = 0;
+        if(!cmdTask->vfs.Stat(vpath, s_buf, err) || !cmdTask->vfs.Lstat(vpath, e.st, err)){
+            ResCMD("550 No such file or directory.\r\n");
+            return;
+        }
+        // MLST 返回的是对象本身，不是目录的 cdir 项
+        e.name = vpath;
+
+        resmsg = "250- Listing " + vpath + "\r\n";
+        resmsg += " " + FormatFacts(e, cmdTask->mlstFacts, false) + " " + vpath + "\r\n";
+        resmsg += "250 End.\r\n";
+        ResCMD(resmsg);
+    }
     // CWD命令：改变工作目录
     else if (cmd == "CWD"){
         Logger::debug("XFtpLIST::Parse() CWD");
@@ -304,52 +597,8 @@ void XFtpLIST::Parse(string cmd, string msg){
             return;
         }
         
-        // 获取当前目录
-        string curDir = cmdTask->curDir;
-        
-        // 处理绝对路径和相对路径
-        if(path[0] == '/'){  // 绝对路径
-            curDir = path;
-        }
-        else{  // 相对路径
-            // 确保当前目录以/结尾
-            if(curDir != "/" && curDir[curDir.size() - 1] != '/'){
-                curDir += "/";
-            }
-            curDir += path + "/";
-        }
-        
-        // 确保目录路径以/结尾
-        if(curDir[curDir.size() - 1] != '/'){
-            curDir += "/";
-        }
-        path = cmdTask->rootDir + curDir;
-        Logger::debug("XFtpLIST::Parse() curDir1: ", curDir);
-        Logger::debug("XFtpLIST::Parse() path: ", path);
-        // 检查目录是否存在
-        struct stat s_buf;                    // 定义文件状态结构体
-        int result = stat(path.c_str(), &s_buf);         // 获取目录状态信息
-        if (result != 0) {
-            if (errno == ENOENT) {
-                ResCMD("550 Directory does not exist.\r\n");
-            } else if (errno == EACCES) {
-                ResCMD("550 Permission denied.\r\n");
-            } else if (errno == ENOTDIR) {
-                ResCMD("550 Not a directory.\r\n");
-            } else {
-                ResCMD("550 Failed to change directory.\r\n");
-            }
-            return;
-        }
-
-        // 如果是目录，则更新当前目录
-        if(S_ISDIR(s_buf.st_mode)){           // 判断是否为目录
-            cmdTask->curDir = curDir;         // 更新当前目录
-            ResCMD("250 Directory successfully changed.\r\n");  // 发送成功响应
-        }
-        else{                                 // 不是目录或不存在
-            ResCMD("501 Failed to change directory: Directory is not exist.\r\n");  // 发送失败响应
-        }
+        // 规范化后相对根目录打开，.. 与符号链接都出不了根目录
+        ChangeDir(XVfs::Normalize(cmdTask->curDir, path));
     }
     // CDUP命令：返回上级目录
     else if(cmd == "CDUP"){
@@ -357,35 +606,32 @@ void XFtpLIST::Parse(string cmd, string msg){
         Logger::info("XFtpLIST::Parse() msg:", msg);
         Logger::info("XFtpLIST::Parse() cmdTask->curDir:", cmdTask->curDir);
 
-        if(cmdTask->curDir == "/"){
+        if(XVfs::Normalize(cmdTask->curDir, "") == "/"){
             ResCMD("550 Failed to change directory: No parent directory.\r\n");
             return;
         }
 
-        // 获取当前目录
-        string path = cmdTask->curDir;
-        
-        // 去除末尾的斜杠（如果有）
-        if(path[path.size() - 1] == '/'){
-            path = path.substr(0, path.size() - 1);
-        }
-        
-        // 找到最后一个斜杠的位置
-        int pos = path.rfind("/");
-        
-        // 提取上级目录路径
-        path = path.substr(0, pos);
-        
-        // 更新当前目录
-        cmdTask->curDir = path;
-        
-        // 确保目录路径以/结尾
-        if(cmdTask->curDir[cmdTask->curDir.size() - 1] != '/'){
-            cmdTask->curDir += "/";
-        }
-        
-        // 发送成功响应
-        ResCMD("250 Directory successfully changed.\r\n");
+        ChangeDir(XVfs::Normalize(cmdTask->curDir, ".."));
     }
 }
 
+
+// 切换到虚拟目录 vpath：打开成功后当前目录更新为 "vpath/"
+void XFtpLIST::ChangeDir(const string &vpath){
+    Logger::debug("XFtpLIST::ChangeDir() -> ", vpath);
+    int err = 0;
+    if(!cmdTask->vfs.Chdir(vpath, err)){
+        if(err == ENOENT){
+            ResCMD("550 Directory does not exist.\r\n");
+        } else if(err == EACCES){
+            ResCMD("550 Permission denied.\r\n");
+        } else if(err == ENOTDIR){
+            ResCMD("550 Not a directory.\r\n");
+        } else {
+            ResCMD("550 Failed to change directory.\r\n");
+        }
+        return;
+    }
+    cmdTask->curDir = vpath == "/" ? vpath : vpath + "/";
+    ResCMD("250 Directory successfully changed.\r\n");
+}
@@ -1,14 +1,45 @@
 #pragma once
 #include "XFtpTask.h"
 #include <string>
+#include <memory>
 using namespace std;
 
+struct XDirEntry;
+
 class XFtpLIST : public XFtpTask{
 public:
+    // RFC 3659 MLSD/MLST 事实（Fact）位定义，与 XFTP_MLST_DEFAULT_FACTS 对应
+    enum Fact{
+        FACT_TYPE      = 1 << 0,
+        FACT_SIZE      = 1 << 1,
+        FACT_MODIFY    = 1 << 2,
+        FACT_PERM      = 1 << 3,
+        FACT_UNIQUE    = 1 << 4,
+        FACT_UNIX_MODE = 1 << 5,
+    };
+
+    // 解析 "type;size;" 形式的事实列表，未知事实忽略
+    static unsigned int ParseFacts(const string &list);
+
+    // 生成 FEAT 中的 MLST 行内容，已选中的事实后带 '*'
+    static string FeatFacts(unsigned int selected);
+
+    // 生成已选中事实的列表，例如 "type;size;"（OPTS MLST 的回显）
+    static string FactList(unsigned int facts);
+
+    // 生成一行 MLSD/MLST 事实（不含文件名）
+    static string FormatFacts(const XDirEntry &e, unsigned int facts, bool parent_writable);
+
     virtual void Parse(string, string);       // 命令解析入口
     virtual void Event(bufferevent*, short);  // 事件回调函数
     virtual void Write(bufferevent*);         // 写入回调函数
+    virtual void ClosePORT();                 // 关闭数据连接并重置发送状态
+protected:
+    string ResolvePath(const string &msg);    // 由命令参数得到规范化的虚拟路径（见 XVfs::Normalize）
 private:
-    string GetListData(string path);
-    string listdata;                          // 文件列表数据
+    void ChangeDir(const string &vpath);      // CWD / CDUP
+    string GetLISTData(int dir_fd, bool &ok);  // dir_fd 来自 XVfs::OpenDir，下同
+    string GetMLSDData(int dir_fd, unsigned int facts, bool &ok);
+    std::shared_ptr<const string> listdata;   // 文件列表数据（可能与XDirCache共享）
+    bool data_queued = false;                 // 列表已全部排入数据连接，等输出缓冲区清空后应答 226
 };
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "XFtpMODE.h"
+#include "XConfig.h"
+#include "testUtil.h"
+#include <algorithm>
+
+using namespace std;
+
+
+bool XFtpMODE::ZEnabled(){
+    static bool enabled = XConfig::Get()->GetBool("mode_z", true);
+    return enabled;
+}
+
+
+int XFtpMODE::DefaultLevel(){
+    static int level = std::max(0, (int)XConfig::Get()->GetInt("mode_z_level", 0));
+    return level;
+}
+
+
+void XFtpMODE::Parse(string cmd, string msg){
+    Logger::debug("XFtpMODE::Parse() -> msg: ", msg);
+
+    string mode = msg.size() > 5 ? msg.substr(5) : "";
+    mode.erase(mode.find_last_not_of("\r\n ") + 1);
+    for(auto &c : mode) c = toupper(c);
+
+    if(mode == "S"){
+        cmdTask->modeZ = false;
+        ResCMD("200 Mode set to S.\r\n");
+    }
+    else if(mode == "Z"){
+        if(!ZEnabled()){
+            ResCMD("504 MODE Z disabled.\r\n");
+            return;
+        }
+        cmdTask->modeZ = true;
+        ResCMD("200 Mode set to Z.\r\n");
+    }
+    else if(mode == "B" || mode == "C"){
+        ResCMD("504 Command not implemented for that parameter.\r\n");
+    }
+    else{
+        ResCMD("501 Syntax error in parameters or arguments.\r\n");
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "XFtpTask.h"
+
+/**
+ * @class XFtpMODE
+ * @brief MODE S（流模式）与 MODE Z（数据连接内容压缩，draft-preston-ftpext-deflate）
+ *
+ * MODE Z 之后 RETR / STOR / LIST / MLSD / SITE TREE 的数据经过 XZStream，
+ * 算法与级别由 OPTS MODE Z ENGINE / LEVEL 设置（见 XFtpFEAT）；配置 mode_z = off 时拒绝。
+ */
+class XFtpMODE : public XFtpTask{
+public:
+    virtual void Parse(std::string cmd, std::string msg);
+
+    // 配置是否允许 MODE Z
+    static bool ZEnabled();
+
+    // 会话未用 OPTS MODE Z LEVEL 指定时的压缩级别（mode_z_level，0 表示自适应）
+    static int DefaultLevel();
+};
@@ -1,6 +1,117 @@
 #include "XFtpPASS.h"
+#include "XFtpServerCMD.h"
+#include "XUserStore.h"
+#include "XIOPool.h"
+#include "XThread.h"
+#include "XMetrics.h"
 #include "testUtil.h"
 
-void XFtpPASS::Parse(std::string cmd, std::string password){
-    ResCMD("200 Password\r\n");
-}
\ No newline at end of file
+#include <openssl/crypto.h>
+
+using namespace std;
+
+static XMetricFamily logins_total(XMETRIC_COUNTER, "ftp_logins_total",
+                                  "PASS attempts by outcome", "result");
+
+/**
+ * 一次口令校验的共享状态
+ * owner 在所属 XThread 中读写（会话关闭、处理器销毁时置空），其余字段提交前写好、完成后只在所属 XThread 中读
+ */
+struct XAuthJob{
+    XUserInfo user;                       // 提交前只有 name，在 XIOPool 中查表填入；用户不存在时 hash 为空
+    string password;
+    XThread *thread = nullptr;
+    XFtpPASS *owner = nullptr;
+    bool ok = false;
+    ~XAuthJob(){ if(!password.empty()) OPENSSL_cleanse(&password[0], password.size()); }
+};
+
+
+void XFtpPASS::Parse(string cmd, string msg){
+    XFtpServerCMD *session = static_cast<XFtpServerCMD*>(cmdTask);
+    if(session->loggedIn){
+        ResCMD("230 Already logged in.\r\n");
+        return;
+    }
+    if(session->user.empty()){
+        ResCMD("503 Login with USER first.\r\n");
+        return;
+    }
+
+    // 开放模式：不校验，根目录为 default_root
+    if(XUserStore::Get()->OpenMode()){
+        XMetrics::Add(logins_total.Id("open"), 1);
+        LoggedIn(XUserStore::Get()->DefaultRoot());
+        return;
+    }
+    if(!session->thread){
+        ResCMD("451 Local error in processing.\r\n");
+        return;
+    }
+
+    auto j = make_shared<XAuthJob>();
+    size_t pos = msg.find(' ');
+    j->password = pos == string::npos ? "" : msg.substr(pos + 1);
+    while(!j->password.empty() && (j->password.back() == '\r' || j->password.back() == '\n')) j->password.pop_back();
+    OPENSSL_cleanse(&msg[0], msg.size());
+    j->user.name = session->user;
+    j->thread = session->thread;
+    j->owner = this;
+    job = j;
+    session->authPending = true;
+
+    // 查用户表可能要 stat 并重新读取文件（持有用户表的锁），与散列一起放在 XIOPool 中
+    XIOPool::Get()->Submit([j]{
+        string name = j->user.name;
+        if(!XUserStore::Get()->Find(name, j->user)) j->user = XUserInfo{name, "", ""};
+        j->ok = XUserStore::Get()->Verify(j->user, j->password);
+        j->thread->Post([j]{
+            if(j->owner) j->owner->OnVerified(j);
+        });
+    });
+}
+
+
+void XFtpPASS::OnVerified(shared_ptr<XAuthJob> j){
+    // 已脱离的校验：会话可能已经释放，不能再碰 cmdTask
+    if(j != job || j->owner != this) return;
+    job.reset();
+    XFtpServerCMD *session = static_cast<XFtpServerCMD*>(cmdTask);
+    session->authPending = false;
+    XMetrics::Add(logins_total.Id(j->ok ? "ok" : "failed"), 1);
+    if(j->ok && session->user == j->user.name){
+        LoggedIn(j->user.root);
+    }
+    else{
+        Logger::warning("XFtpPASS::OnVerified() -> login failed for ", j->user.name, " from ", session->peer);
+        ResCMD("530 Login incorrect.\r\n");
+    }
+    // 校验期间收到的命令
+    session->ProcessCommands();
+}
+
+
+void XFtpPASS::LoggedIn(const string &root){
+    cmdTask->loggedIn = true;
+    // 用户表中的根目录或 default_root（不带结尾的 /），会话从根开始
+    cmdTask->rootDir = root;
+    cmdTask->curDir = "/";
+    cmdTask->vfs.SetRoot(cmdTask->rootDir);
+    Logger::info("XFtpPASS::LoggedIn() -> ", cmdTask->user, " root ", cmdTask->rootDir);
+    ResCMD("230 User logged in, proceed.\r\n");
+}
+
+
+void XFtpPASS::ClosePORT(){
+    // 控制连接关闭后 clearConnectedTasks 会释放会话，XIOPool 中的校验完成时不能再回调
+    if(job){
+        job->owner = nullptr;
+        job.reset();
+    }
+    XFtpTask::ClosePORT();
+}
+
+
+XFtpPASS::~XFtpPASS(){
+    if(job) job->owner = nullptr;
+}
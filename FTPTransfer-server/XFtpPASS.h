@@ -1,7 +1,27 @@
 #pragma once
 #include "XFtpTask.h"
+#include <memory>
 
+struct XAuthJob;
+
+/**
+ * @class XFtpPASS
+ * @brief PASS：按 XUserStore 的用户表校验口令，通过后会话切到该用户的根目录
+ *
+ * 查用户表与散列校验在 XIOPool 中进行，结果通过 XThread::Post 回到本线程再应答；校验期间控制连接暂停处理后续命令。
+ */
 class XFtpPASS : public XFtpTask{
 public:
     virtual void Parse(std::string, std::string);
-};
\ No newline at end of file
+    virtual ~XFtpPASS();
+
+    // 会话关闭：进行中的校验不再回到这个会话
+    virtual void ClosePORT();
+
+    // 由 XIOPool 线程通过 XThread::Post 在本线程调用
+    void OnVerified(std::shared_ptr<XAuthJob> job);
+
+private:
+    void LoggedIn(const std::string &root);
+    std::shared_ptr<XAuthJob> job;        // 进行中的校验
+};
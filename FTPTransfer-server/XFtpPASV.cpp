@@ -0,0 +1,89 @@
+#include "XFtpPASV.h"
+#include "XPasvPool.h"
+#include "XConfig.h"
+#include "XNetAddr.h"
+#include "testUtil.h"
+
+#include <event2/util.h>
+#include <netinet/in.h>
+#include <algorithm>
+#include <string>
+using namespace std;
+
+
+string XFtpPASV::AdvertisedAddress(){
+    if(!cmdTask->localIp.empty()) return cmdTask->localIp;
+
+    // NAT 后面需要配置对外地址，否则用客户端连进来的那个本地地址
+    static string configured = XConfig::Get()->GetString("pasv_address", "");
+    if(!configured.empty()){
+        cmdTask->localIp = configured;
+        return configured;
+    }
+    // 双栈监听下 IPv4 客户端看到的本端地址是 v4-mapped，还原后才能写进 227 应答
+    sockaddr_storage local, ss;
+    socklen_t len = sizeof(local);
+    string host;
+    if(getsockname(cmdTask->sock, (sockaddr *)&local, &len) == 0 && XNetAddr::Normalize((sockaddr *)&local, &ss)){
+        host = XNetAddr::Host((sockaddr *)&ss);
+    }
+    cmdTask->localIp = host;
+    return cmdTask->localIp;
+}
+
+
+void XFtpPASV::Parse(string cmd, string msg){
+    Logger::info("XFtpPASV::Parse() -> cmd: ", cmd);
+
+    // EPSV ALL：客户端声明之后只用 EPSV（RFC 2428）
+    string param = msg.size() > cmd.size() + 1 ? msg.substr(cmd.size() + 1) : "";
+    while(!param.empty() && (param.back() == '\r' || param.back() == '\n' || param.back() == ' ')){
+        param.pop_back();
+    }
+    std::transform(param.begin(), param.end(), param.begin(), ::toupper);
+    if(cmd == "EPSV" && param == "ALL"){
+        cmdTask->epsvAll = true;
+        ResCMD("200 EPSV ALL ok.\r\n");
+        return;
+    }
+    if(cmd == "EPSV" && !param.empty() && param != "1" && param != "2"){
+        ResCMD("522 Network protocol not supported, use (1,2)\r\n");
+        return;
+    }
+    if(cmd == "PASV" && cmdTask->epsvAll){
+        ResCMD("501 PASV not allowed after EPSV ALL.\r\n");
+        return;
+    }
+
+    // 重复的 PASV 归还之前的端口（以及已连入但未使用的数据连接）
+    cmdTask->ReleasePasv();
+
+    XPasvPool *pool = XPasvPool::Current();
+    XPasvPort *port = pool ? pool->Acquire(cmdTask) : nullptr;
+    if(!port){
+        Logger::warning("XFtpPASV::Parse() -> no passive port available");
+        ResCMD("425 Can't open passive connection.\r\n");
+        return;
+    }
+    cmdTask->pasvPort = port;
+    cmdTask->passive = true;
+
+    if(cmd == "EPSV"){
+        ResCMD("229 Entering Extended Passive Mode (|||" + to_string(port->port) + "|)\r\n");
+        return;
+    }
+
+    string addr = AdvertisedAddress();
+    in_addr a;
+    if(evutil_inet_pton(AF_INET, addr.c_str(), &a) != 1){
+        // IPv6 控制连接上的 PASV：227 只能表示 IPv4 地址，客户端应改用 EPSV
+        Logger::error("XFtpPASV::Parse() -> no IPv4 address to advertise: ", addr);
+        cmdTask->ReleasePasv();
+        cmdTask->passive = false;
+        ResCMD("425 Can't open passive connection.\r\n");
+        return;
+    }
+    std::replace(addr.begin(), addr.end(), '.', ',');
+    ResCMD("227 Entering Passive Mode (" + addr + "," + to_string(port->port / 256) + "," +
+           to_string(port->port % 256) + ")\r\n");
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include "XFtpTask.h"
+#include <string>
+using namespace std;
+
+// PASV / EPSV（RFC 2428，IPv4 与 IPv6）：从本线程的被动端口池中取一个端口，等待客户端连入
+class XFtpPASV : public XFtpTask{
+public:
+    void Parse(string cmd, string msg);
+
+private:
+    // PASV 应答中的 IPv4 地址：配置 pasv_address，否则为控制连接的本端地址
+    string AdvertisedAddress();
+};
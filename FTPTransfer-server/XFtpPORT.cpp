@@ -1,4 +1,5 @@
 #include "XFtpPORT.h"
+#include "XNetAddr.h"
 #include "testUtil.h"
 
 #include <iostream>
@@ -6,8 +7,15 @@
 using namespace std;
 
 void XFtpPORT::Parse(string cmd, string msg){
-    cout << endl;
     Logger::info("XFtpPORT::Parse() -> msg: ", msg);
+    if(cmdTask->epsvAll){
+        ResCMD("501 " + cmd + " not allowed after EPSV ALL.\r\n");
+        return;
+    }
+    if(cmd == "EPRT"){
+        ParseEPRT(msg);
+        return;
+    }
 
     // 1. 解析PORT命令
     // 格式：
@@ -36,20 +44,71 @@ void XFtpPORT::Parse(string cmd, string msg){
     }
 
     // 2. 构建IP和计算端口
-    ip = vals[0] + "." + vals[1] + "." + vals[2] + "." + vals[3];
-    port = atoi(vals[4].c_str()) * 256 + atoi(vals[5].c_str());
+    string ip = vals[0] + "." + vals[1] + "." + vals[2] + "." + vals[3];
+    int port = atoi(vals[4].c_str()) * 256 + atoi(vals[5].c_str());
 
     if(port < 1 || port > 65535){
-        Logger::error("Client specified port " + to_string(port) + 
-                " which may not be available");
+        Logger::error("Client specified port ", port, " which may not be available");
+        ResCMD("501 Syntax error in parameters or arguments.\r\n");
+        return;
+    }
+    SetDataAddr(ip, port, AF_INET, "200 Port command successful.\r\n");
+}
+
+
+void XFtpPORT::ParseEPRT(string msg){
+    // 格式（RFC 2428）：EPRT |协议|地址|端口|，协议 1 为 IPv4，2 为 IPv6；分隔符为参数的第一个字符
+    // 例如：EPRT |2|::1|50123|\r\n
+    string param = msg.size() > 5 ? msg.substr(5) : "";
+    while(!param.empty() && (param.back() == '\r' || param.back() == '\n' || param.back() == ' ')){
+        param.pop_back();
+    }
+    vector<string> fields;
+    if(param.size() > 1){
+        char d = param[0];
+        size_t start = 1, pos;
+        while((pos = param.find(d, start)) != string::npos){
+            fields.push_back(param.substr(start, pos - start));
+            start = pos + 1;
+        }
+    }
+    if(fields.size() != 3 || fields[2].empty() || fields[2].size() > 5 ||
+       fields[2].find_first_not_of("0123456789") != string::npos){
+        Logger::error("XFtpPORT::ParseEPRT() invalid EPRT command: ", param);
+        ResCMD("501 Syntax error in parameters or arguments.\r\n");
+        return;
+    }
+    int af;
+    if(fields[0] == "1") af = AF_INET;
+    else if(fields[0] == "2") af = AF_INET6;
+    else{
+        ResCMD("522 Network protocol not supported, use (1,2)\r\n");
+        return;
+    }
+    int port = atoi(fields[2].c_str());
+    if(port < 1 || port > 65535){
+        ResCMD("501 Syntax error in parameters or arguments.\r\n");
+        return;
+    }
+    SetDataAddr(fields[1], port, af, "200 EPRT command successful.\r\n");
+}
+
+
+void XFtpPORT::SetDataAddr(const string &host, int port, int af, const string &ok){
+    // 地址在这里解析一次，之后每次建立数据连接直接使用
+    sockaddr_storage ss;
+    socklen_t len = XNetAddr::Parse(host, port, af, &ss);
+    if(!len){
+        Logger::error("XFtpPORT::SetDataAddr() invalid address: ", host);
         ResCMD("501 Syntax error in parameters or arguments.\r\n");
         return;
     }
-    cmdTask->ip = ip;
-    cmdTask->port = port;
-    Logger::debug("XFtpPORT::Parse() ip: ", ip);
-    Logger::debug("XFtpPORT::Parse() port: ", port);
+    cmdTask->dataAddr = ss;
+    cmdTask->dataAddrLen = len;
+    // 切回主动模式，归还被动端口
+    cmdTask->passive = false;
+    cmdTask->ReleasePasv();
+    Logger::debug("XFtpPORT::SetDataAddr() ", host, " port: ", port);
 
-    // 3. 返回响应
-    ResCMD("200 Port command successful.\r\n");
+    ResCMD(ok);
 }
\ No newline at end of file
@@ -3,7 +3,14 @@
 #include <string>
 using namespace std;
 
+// PORT / EPRT：主动模式，记录客户端监听的地址
 class XFtpPORT : public XFtpTask{
 public:
     void Parse(string cmd, string msg);
-};
\ No newline at end of file
+
+private:
+    void ParseEPRT(string msg);
+
+    // 解析并保存数据连接地址，成功时回复 ok
+    void SetDataAddr(const string &host, int port, int af, const string &ok);
+};
@@ -2,6 +2,8 @@
 #include "testUtil.h"
 #include <string>
 #include <cstdlib>
+#include <climits>
+#include <errno.h>
 #include <sys/types.h>
 
 
@@ -9,6 +11,10 @@ using namespace std;
 
 void XFtpREST::Parse(string cmd, string msg){
     Logger::debug("XFtpREST::Parse() -> cmd: ", cmd, " msg: ", msg);
+    if(cmd == "RANG"){
+        ParseRange(msg);
+        return;
+    }
     // REST命令格式：REST <偏移量>
     // 例如：REST 1024\r\n
 
@@ -36,9 +42,10 @@ void XFtpREST::Parse(string cmd, string msg){
         return;
     }
 
-    // 3. 将偏移量保存到控制任务中
+    // 3. 将偏移量保存到控制任务中（REST 与 RANG 互斥，覆盖之前的范围）
     if(cmdTask) {
         cmdTask->SetFileOffset(offset);
+        cmdTask->SetRangeEnd(-1);
         Logger::debug("XFtpREST::Parse() -> Set file offset to ", offset);
         // 根据RFC 959，响应格式：350 Restarting at <offset>. Send STORE or RETRIEVE to initiate transfer
         ResCMD("350 Restarting at " + to_string(offset) + ". Send STORE or RETRIEVE to initiate transfer.\r\n");
@@ -46,4 +53,37 @@ void XFtpREST::Parse(string cmd, string msg){
         Logger::error("XFtpREST::Parse() -> cmdTask is null");
         ResCMD("550 Internal server error.\r\n");
     }
-}
\ No newline at end of file
+}
+
+
+void XFtpREST::ParseRange(const string &msg){
+    // RANG <起始> <结束>：字节范围（从 0 开始，含两端），只作用于下一次 RETR / STOR；起始大于结束（RANG 1 0）时取消范围
+    // 客户端可在多条控制连接上各自 RANG + RETR / STOR 同一文件的不同范围，并行下载或上传
+    string args = msg.size() > 4 ? msg.substr(4) : "";
+    while(!args.empty() && (args.back() == '\r' || args.back() == '\n' || args.back() == ' ')) args.pop_back();
+    char *endptr;
+    errno = 0;
+    long long start = strtoll(args.c_str(), &endptr, 10);
+    bool ok = endptr != args.c_str() && *endptr == ' ';
+    const char *p = endptr;
+    long long end = ok ? strtoll(p, &endptr, 10) : 0;
+    ok = ok && endptr != p && *endptr == '\0' && start >= 0 && end >= 0;
+    // strtoll 溢出时截到 LLONG_MAX；结束位置要 +1 存为不含的边界，LLONG_MAX 本身也不能接受
+    ok = ok && errno != ERANGE && end < LLONG_MAX;
+    if(!ok){
+        Logger::error("XFtpREST::ParseRange() -> Invalid range: ", args);
+        ResCMD("501 Syntax error in parameters or arguments.\r\n");
+        return;
+    }
+
+    if(start > end){
+        cmdTask->SetFileOffset(0);
+        cmdTask->SetRangeEnd(-1);
+        ResCMD("350 Restarting at 0. Range reset.\r\n");
+        return;
+    }
+    cmdTask->SetFileOffset(start);
+    cmdTask->SetRangeEnd(end + 1);
+    Logger::debug("XFtpREST::ParseRange() -> range ", start, "-", end);
+    ResCMD("350 Restarting at " + to_string(start) + ". Ending byte at " + to_string(end) + ".\r\n");
+}
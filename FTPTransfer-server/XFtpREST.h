@@ -5,4 +5,7 @@
 class XFtpREST : public XFtpTask {
 public:
     virtual void Parse(std::string cmd, std::string msg);
+
+private:
+    void ParseRange(const std::string &msg);
 };
\ No newline at end of file
@@ -1,10 +1,13 @@
 #include "XFtpRETR.h"
+#include "XPrecompress.h"
 #include "testUtil.h"
 #include <event2/bufferevent.h>
 #include <event2/buffer.h>
 #include <event2/event.h>
 #include <iostream>
 #include <string>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // OpenSSL相关头文件
 #ifndef OPENSSL_NO_SSL_INCLUDES
@@ -25,9 +28,9 @@ void XFtpRETR::Write(bufferevent *bev){
         return;
     }
     
-    // 1. 检查文件指针是否有效
-    if(!fp){
-        Logger::error("XFtpRETR::Write() fp is null");
+    // 1. 检查文件是否有效
+    if(!file){
+        Logger::error("XFtpRETR::Write() file is null");
         ResCMD("550 Cannot access file.\r\n");
         ClosePORT();
         return;
@@ -59,6 +62,8 @@ void XFtpRETR::Write(bufferevent *bev){
             // 文件已读完且缓冲区已空，传输完成
             Logger::info("XFtpRETR::Write() -> File transfer complete");
             ResCMD("226 Transfer complete.\r\n");
+            Logger::trace(XTRACE_RETR_END, cmdTask->sessionId, file_pos, 226);
+            EndTransfer(true);
             transfer_complete = true;
             ClosePORT();
         } else {
@@ -74,13 +79,25 @@ void XFtpRETR::Write(bufferevent *bev){
     if(file_read_error) {
         Logger::error("XFtpRETR::Write() -> File read error occurred earlier");
         ResCMD("550 File read error.\r\n");
+        EndTransfer(false, 550);
         ClosePORT();
         return;
     }
 
-    // 从文件读取数据（1MB块）
-    int len = fread(buf, 1, sizeof(buf), fp);
-    file_pos += len;    // 更新文件读取位置
+    if(segment){
+        SendSegment(bev);
+        return;
+    }
+
+    // 从文件读取数据（1MB块，不超过本次传输的范围）
+    size_t want = (size_t)min<off_t>(sizeof(buf), range_end - file_pos);
+    ssize_t len = 0;
+    if(want > 0){
+        do{
+            len = pread(file->fd, buf, want, file_pos);
+        }while(len < 0 && errno == EINTR);
+    }
+    if(len > 0) file_pos += len;    // 更新文件读取位置
     Logger::debug("XFtpRETR::Write() -> Read ", len, " bytes from file, total: ", file_pos);
 
     // 处理读取结果
@@ -88,15 +105,9 @@ void XFtpRETR::Write(bufferevent *bev){
         // 文件结束
         Logger::info("XFtpRETR::Write() -> End of file reached, total bytes: ", file_pos);
         file_eof = true;
-        
-        // 检查错误
-        if(ferror(fp)) {
-            int err = ferror(fp);
-            Logger::error("XFtpRETR::Write() -> File read error: ", err);
-            ResCMD("550 File read error.\r\n");
-            ClosePORT();
-            return;
-        }
+
+        // MODE Z：先写出压缩流结尾，发送完后再回 226
+        if(FinishSend()) return;
         
         // 文件正常结束，现在检查缓冲区是否为空
         struct evbuffer* output = bufferevent_get_output(bev);
@@ -104,6 +115,8 @@ void XFtpRETR::Write(bufferevent *bev){
             // 缓冲区已空，立即完成
             Logger::info("XFtpRETR::Write() -> Buffer empty, completing transfer");
             ResCMD("226 Transfer complete.\r\n");
+            Logger::trace(XTRACE_RETR_END, cmdTask->sessionId, file_pos, 226);
+            EndTransfer(true);
             transfer_complete = true;
             ClosePORT();
         } else {
@@ -116,16 +129,18 @@ void XFtpRETR::Write(bufferevent *bev){
     } 
     else if(len < 0){
         // 读取错误
-        int err = ferror(fp);
-        Logger::error("XFtpRETR::Write() -> fread failed, error: ", err);
+        Logger::error("XFtpRETR::Write() -> pread failed, error: ", strerror(errno));
         file_read_error = true;
         ResCMD("550 File read error.\r\n");
+        EndTransfer(false, 550);
         ClosePORT();
         return;
     }
 
     // 发送数据
-    Logger::info("XFtpRETR::Write() -> Sending ", len, " bytes");
+    Logger::debug("XFtpRETR::Write() -> Sending ", len, " bytes");
+    Logger::trace(XTRACE_RETR_CHUNK, cmdTask->sessionId, len, file_pos);
+    TransferBytes(len);
     int result = Send(buf, len);
     
     if(result < 0){
@@ -162,8 +177,66 @@ void XFtpRETR::Write(bufferevent *bev){
 
 
 
+void XFtpRETR::SendSegment(bufferevent *bev){
+    evbuffer *output = bufferevent_get_output(bev);
+    if(seg_pos == 0 && !seg_prefix.empty()){
+        evbuffer_add(output, seg_prefix.data(), seg_prefix.size());
+    }
+    // 与读文件路径一样每次追加 1MB，文件段由 libevent 用 sendfile（TLS 时 mmap）发送
+    off_t n = min<off_t>(sizeof(buf), seg_len - seg_pos);
+    if(n > 0 && evbuffer_add_file_segment(output, segment, seg_pos, n) != 0){
+        Logger::error("XFtpRETR::SendSegment() -> evbuffer_add_file_segment failed");
+        ResCMD("426 Connection closed; transfer aborted.\r\n");
+        ClosePORT();
+        return;
+    }
+    // 传输统计按原文件字节数计（预压缩版本按比例折算），与实时压缩时一致
+    off_t raw_len = range_end - range_start;
+    long raw = range_start + (seg_len ? (long)(raw_len * (double)(seg_pos + n) / seg_len) : raw_len);
+    TransferBytes(raw - file_pos);
+    Logger::trace(XTRACE_RETR_CHUNK, cmdTask->sessionId, (int)n, raw);
+    file_pos = raw;
+    seg_pos += n;
+    if(seg_pos < seg_len) return;
+
+    if(!seg_suffix.empty()) evbuffer_add(output, seg_suffix.data(), seg_suffix.size());
+    Logger::info("XFtpRETR::SendSegment() -> ", seg_len, " bytes queued");
+    evbuffer_file_segment_free(segment);
+    segment = nullptr;
+    file_eof = true;
+}
+
+
+// 文件段释放时（最后一段数据发送完）放开共享文件的引用
+static void SegmentCleanup(const evbuffer_file_segment *, int, void *arg){
+    delete (shared_ptr<XOpenFile> *)arg;
+}
+
+
+void XFtpRETR::ReleaseFile(){
+    // 已加入输出缓冲区的部分各自持有文件段的引用，发送完后才真正释放
+    if(segment) evbuffer_file_segment_free(segment);
+    segment = nullptr;
+    seg_len = seg_pos = 0;
+    seg_prefix.clear();
+    seg_suffix.clear();
+    file.reset();
+}
+
+
+void XFtpRETR::ClosePORT(){
+    ReleaseFile();
+    XFtpTask::ClosePORT();
+}
+
+
+XFtpRETR::~XFtpRETR(){
+    ReleaseFile();
+}
+
+
 void XFtpRETR::Event(bufferevent* bev, short events) {
-    Logger::debug("XFtpRETR::Event() events: " + std::to_string(events));
+    Logger::debug("XFtpRETR::Event() events: ", events);
     
     if (events & BEV_EVENT_CONNECTED) {
         Logger::info("XFtpRETR::Event() -> Connection established");
@@ -173,12 +246,6 @@ void XFtpRETR::Event(bufferevent* bev, short events) {
             SSL* ssl = bufferevent_openssl_get_ssl(bev);
             if(ssl && SSL_is_init_finished(ssl)) {
                 Logger::info("XFtpRETR::Event() -> SSL ready, starting transfer");
-                // 连接建立成功，设置传输阶段的超时
-                // 下载：主要关注写超时（发送数据），读超时可以设置短一些
-                timeval write_timeout = {300, 0};   // 发送数据超时300秒
-                timeval read_timeout = {30, 0};     // 读取响应超时30秒
-                bufferevent_set_timeouts(bev, &read_timeout, &write_timeout);
-
                 bufferevent_trigger(bev, EV_WRITE, 0);
             } else {
                 Logger::info("XFtpRETR::Event() -> SSL handshake in progress");
@@ -209,6 +276,10 @@ void XFtpRETR::Event(bufferevent* bev, short events) {
     }
     else if (events & BEV_EVENT_ERROR) {
         Logger::error("XFtpRETR::Event() BEV_EVENT_ERROR");
+        if(!DataConnected()){
+            ResCMD("425 Can't build data connection.\r\n");
+            EndTransfer(false, 425);
+        }
         ClosePORT();
     }
     else if (events & BEV_EVENT_TIMEOUT) {
@@ -226,29 +297,37 @@ void XFtpRETR::Parse(string cmd, string msg){
     ResetTransferState();
 
     // 1. 提取文件名, 去除文件名末尾的回车换行符
-    int pos = msg.rfind(" ") + 1;
+    int pos = msg.find(" ") + 1;
     string filename = msg.substr(pos);
     while (!filename.empty() && (filename.back() == '\r' || filename.back() == '\n')) {
         filename.pop_back();
     }
 
-    // 2. 构建完整文件路径
-    string path = cmdTask->rootDir + cmdTask->curDir + filename;
+    // 2. 规范化为虚拟路径（文件经会话的目录 fd 打开），真实路径用于预压缩查找与日志
+    string vpath = XVfs::Normalize(cmdTask->curDir, filename);
+    string path = cmdTask->vfs.RealPath(vpath);
     Logger::info("XFtpRETR::Parse() -> path: ", path);
 
-    // 3. 获取偏移量
+    // 3. 获取偏移量；RANG 指定的范围只作用于这一次传输
     off_t offset = cmdTask->GetFileOffset();
-    Logger::info("XFtpRETR::Parse() -> Starting download from offset: ", offset);
+    off_t end = cmdTask->GetRangeEnd();
+    if(end >= 0){
+        cmdTask->SetFileOffset(0);
+        cmdTask->SetRangeEnd(-1);
+    }
+    Logger::info("XFtpRETR::Parse() -> Starting download from offset: ", offset,
+                 end >= 0 ? ", range end: " + to_string(end) : "");
 
-    // 4. 打开文件（二进制读取模式）
-    fp = fopen(path.c_str(), "rb");  // 二进制流式传输
-    if (!fp) {
+    // 4. 打开文件（同一文件的并发下载共用一个只读 fd）
+    int err = 0;
+    file = XFileTable::Get()->Open(cmdTask->vfs, vpath, err);
+    if (!file) {
         // 检查具体错误类型
-        if (errno == ENOENT) {
+        if (err == ENOENT) {
             ResCMD("550 File not found.\r\n");
-        } else if (errno == EACCES) {
+        } else if (err == EACCES) {
             ResCMD("550 Permission denied.\r\n");
-        } else if (errno == EISDIR) {
+        } else if (err == EISDIR) {
             ResCMD("550 Is a directory.\r\n");
         } else {
             ResCMD("550 Cannot open file.\r\n");
@@ -256,40 +335,55 @@ void XFtpRETR::Parse(string cmd, string msg){
         return;
     }
 
-    // 6. 获取文件大小
-    fseeko(fp, 0, SEEK_END);        // 移动到文件末尾
-    off_t totalSize = ftello(fp);   // 获取文件大小
+    // 5. 获取文件大小
+    off_t totalSize = file->st.st_size;
     Logger::info("XFtpRETR::Parse() -> File size: ", totalSize, " bytes");
-
     file_size = totalSize;          // 保存文件大小用于调试
 
-    // 7. 偏移量处理
-    if (offset > 0) {   // 续传，移动文件指针到指定偏移位置
-        if(fseeko(fp, offset, SEEK_SET) != 0) { // 使用fseeko支持大文件，SEEK_SET表示从文件开头偏移，成功返回 0，失败返回 -1
-            Logger::error("XFtpRETR::Parse() -> fseeko64 failed, offset: ", offset, \
-                            " error: ", strerror(errno));
-            ResCMD("550 Cannot seek to specified offset.\r\n");
-            fclose(fp);
-            fp = nullptr;
-            return;
+    // 6. 传输范围：REST 到文件末尾，或 RANG 的 [start, end)（end 超出文件时截到末尾）
+    if (end >= 0 && offset >= totalSize) {
+        Logger::error("XFtpRETR::Parse() -> range ", offset, "-", end, " beyond file size ", totalSize);
+        ResCMD("554 Requested range not satisfiable.\r\n");
+        file.reset();
+        return;
+    }
+    range_start = offset;
+    range_end = end >= 0 ? min(end, totalSize) : totalSize;
+    if (range_end < range_start) range_end = range_start;
+    file_pos = offset;
+
+    // 7. 数据来源：MODE Z 整文件下载有预压缩版本时直接发送压缩数据；未启用 MODE Z 时按文件段零拷贝发送
+    XVariant v;
+    if (offset == 0 && end < 0) {
+        XPrecompress::Get()->Count(path, file->st);
+        if(cmdTask->modeZ && XPrecompress::Get()->Find(path, file->st, cmdTask->zEngine, v)){
+            segment = evbuffer_file_segment_new(v.fd, v.offset, v.length, EVBUF_FS_CLOSE_ON_FREE);
+            if(segment){
+                seg_len = v.length;
+                seg_prefix = v.prefix;
+                seg_suffix = v.suffix;
+                SkipZ();
+                Logger::info("XFtpRETR::Parse() -> serving precompressed ", v.file);
+            }
+            else{
+                close(v.fd);
+            }
         }
-        file_pos = offset; // 更新当前文件位置
-        Logger::info("XFtpRETR::Parse() -> File pointer moved to offset: ", offset);
     }
-    else if(offset == 0){
-        if(fseeko(fp, 0, SEEK_SET) != 0) {  // 因为前面获取大小时已经移动到文件末尾了，所以这里需要重新移动到文件开头
-            Logger::error("XFtpRETR::Parse() -> fseeko64 failed, offset: 0, error: ", strerror(errno));
-            ResCMD("550 Cannot seek to start of file.\r\n");
-            fclose(fp);
-            fp = nullptr;
-            return;
+    if (!cmdTask->modeZ && range_end > range_start) {
+        segment = evbuffer_file_segment_new(file->fd, range_start, range_end - range_start, 0);
+        if(segment){
+            seg_len = range_end - range_start;
+            evbuffer_file_segment_add_cleanup_cb(segment, SegmentCleanup, new shared_ptr<XOpenFile>(file));
         }
     }
 
     // 8. 发送开始传输响应
     // ResCMD("350 Restarting at " + to_string(offset) + " Bytes. Send STORE or RETRIEVE to initiate transfer.\r\n");
     ResCMD("150 File status okay; about to open data connection.\r\n");
+    Logger::trace(XTRACE_RETR_BEGIN, cmdTask->sessionId, offset, totalSize);
+    BeginTransfer(XFTP_XFER_RETR, path);
     transfer_complete = false;
-    // 5. 建立数据连接
+    // 9. 建立数据连接
     ConnectoPORT();
 }
\ No newline at end of file
@@ -1,12 +1,17 @@
 #pragma once
 #include "XFtpTask.h"
+#include "XFileTable.h"
 #include <string.h>
 
+struct evbuffer_file_segment;
+
 class XFtpRETR : public XFtpTask{
 public:
+    ~XFtpRETR();
     void Parse(std::string cmd, std::string msg);
     virtual void Event(bufferevent*, short);
     virtual void Write(bufferevent *);  // 数据连接写回调
+    virtual void ClosePORT();
 
     bool Init() {return true;};         // 初始化（空实现）
 
@@ -17,6 +22,7 @@ public:
         file_eof = false;
         file_read_error = false;
         file_pos = 0;
+        ReleaseFile();
     }
 
 private:
@@ -27,4 +33,19 @@ private:
     bool file_read_error = false;        // 文件读取错误
     long file_pos = 0;                   // 文件读取位置（用于调试）
     long file_size = 0;               // 文件大小（用于调试）
+
+    // 下载的文件（XFileTable 中共享的 fd，按偏移 pread / sendfile）与本次传输的范围 [range_start, range_end)
+    std::shared_ptr<XOpenFile> file;
+    off_t range_start = 0;
+    off_t range_end = 0;
+
+    // 不经过 zstream 的数据以文件段加入输出缓冲区（零拷贝）：未启用 MODE Z 时为文件的 [range_start, range_end)，
+    // MODE Z 命中预压缩版本（XPrecompress）时为压缩好的版本；MODE Z 实时压缩时为空，pread 到 buf 后交给压缩器
+    void SendSegment(bufferevent *bev);
+    void ReleaseFile();
+    evbuffer_file_segment *segment = nullptr;
+    off_t seg_len = 0;
+    off_t seg_pos = 0;
+    std::string seg_prefix;              // .gz 拼接时的 zlib 头
+    std::string seg_suffix;              // 以及 Adler-32
 };
\ No newline at end of file
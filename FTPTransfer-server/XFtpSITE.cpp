@@ -0,0 +1,334 @@
+#include "XFtpSITE.h"
+#include "XFtpServerCMD.h"
+#include "XThread.h"
+#include "XIOPool.h"
+#include "XDirWalker.h"
+#include "XUploadParts.h"
+#include "XQuota.h"
+#include "testUtil.h"
+
+#include <event2/bufferevent.h>
+#include <event2/buffer.h>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define TREE_MAX_RUNNERS   4                  // 单次遍历的最大并行度（另外至少给别的任务留一个 XIOPool 线程）
+#define TREE_CHUNK_SIZE    (64 * 1024)        // 每个数据块的大小
+#define TREE_HIGH_WATER    (4 * 1024 * 1024)  // 未写入数据连接的数据超过该值时 runner 暂停
+#define TREE_LOW_WATER     (1024 * 1024)      // 暂停后未写入的数据降到该值以下时重新提交 runner
+#define TREE_PUMP_MAX      (1024 * 1024)      // 每次写回调最多写入的字节数
+
+
+/**
+ * 一次 SITE TREE 遍历的共享状态
+ * mtx 保护的部分由遍历线程与事件循环共同访问，其余只在所属 XThread 中访问
+ */
+struct XTreeWalk{
+    string root;                          // 起始目录绝对路径
+    unsigned int facts = 0;               // 输出的 MLST 事实
+    XThread *thread = nullptr;            // 所属工作线程
+    int max_runners = 1;
+
+    mutex mtx;
+    deque<string> dirs;                   // 待遍历目录（相对 root，"" 为 root 本身）
+    int active = 0;                       // 已提交、尚未结束的 runner 任务数
+    bool stalled = false;                 // 有 runner 因背压结束，数据写出后由事件循环重新提交
+    size_t inflight = 0;                  // 已产生但尚未写入数据连接的字节数
+    atomic<bool> cancelled{false};
+
+    XFtpSITE *owner = nullptr;
+    deque<shared_ptr<const string>> chunks;
+    bool done = false;
+    long long entries = 0;
+};
+
+
+static void RunWalk(shared_ptr<XTreeWalk> w);
+
+
+// 队列里的目录比 runner 多时补提交（持有 w->mtx 时调用，返回要提交的个数，由调用者在锁外提交）
+static int Grow(XTreeWalk &w){
+    int n = (int)min<size_t>(w.max_runners - w.active, w.dirs.size() > (size_t)w.active ? w.dirs.size() - w.active : 0);
+    n = max(0, n);
+    w.active += n;
+    return n;
+}
+
+
+static void Submit(const shared_ptr<XTreeWalk> &w, int n){
+    for(int i = 0; i < n; i++) XIOPool::Get()->Submit([w]{ RunWalk(w); });
+}
+
+
+// 把数据块投递回事件循环；不在这里等待，背压由 RunWalk 取下一个目录前检查
+static void Emit(shared_ptr<XTreeWalk> w, string &chunk){
+    if(chunk.empty()) return;
+    {
+        lock_guard<mutex> lock(w->mtx);
+        w->inflight += chunk.size();
+    }
+    auto data = make_shared<const string>(std::move(chunk));
+    chunk.clear();
+    w->thread->Post([w, data]{
+        if(w->owner) w->owner->OnChunk(w, data);
+    });
+}
+
+
+// 遍历 runner：从共享队列取目录，枚举后把子目录放回队列。
+// 不在线程池里阻塞：队列空了就结束，子目录多了再补提交；未写出的数据过多时也结束，由 Pump 在数据写出后重新提交
+static void RunWalk(shared_ptr<XTreeWalk> w){
+    string chunk;
+    long long count = 0;
+    while(true){
+        string rel;
+        {
+            lock_guard<mutex> lock(w->mtx);
+            if(w->cancelled || XIOPool::Get()->Stopping() || w->dirs.empty()) break;
+            if(w->inflight > TREE_HIGH_WATER){
+                w->stalled = true;
+                break;
+            }
+            rel = std::move(w->dirs.front());
+            w->dirs.pop_front();
+        }
+
+        vector<XDirEntry> entries;
+        string abs = rel.empty() ? w->root : w->root + "/" + rel;
+        if(!XDirWalker::ReadDir(abs, entries)){
+            Logger::debug("XFtpSITE RunWalk() -> skip unreadable dir: ", abs);
+        }
+
+        // 一个目录的项已经整个读进内存，中途不停下，最多超出高水位一个目录的量
+        vector<string> subdirs;
+        for(auto &e : entries){
+            if(e.name == "." || e.name == "..") continue;
+            string path = rel.empty() ? e.name : rel + "/" + e.name;
+            chunk += XFtpLIST::FormatFacts(e, w->facts, false);
+            chunk += " ";
+            chunk += path;
+            chunk += "\r\n";
+            count++;
+            // lstat 结果，不会跟随指向目录的符号链接，避免环
+            if(S_ISDIR(e.st.st_mode)) subdirs.push_back(std::move(path));
+            if(chunk.size() >= TREE_CHUNK_SIZE) Emit(w, chunk);
+        }
+
+        int more = 0;
+        {
+            lock_guard<mutex> lock(w->mtx);
+            for(auto &d : subdirs) w->dirs.push_back(std::move(d));
+            more = Grow(*w);
+        }
+        Submit(w, more);
+    }
+    Emit(w, chunk);
+
+    // 最后一个结束且没有剩下的目录：遍历完成（因背压暂停时目录还在队列里）
+    bool last = false;
+    {
+        lock_guard<mutex> lock(w->mtx);
+        last = --w->active == 0 && w->dirs.empty() && !w->cancelled;
+    }
+    w->thread->Post([w, count, last]{
+        w->entries += count;
+        if(last && w->owner) w->owner->OnDone(w);
+    });
+}
+
+
+void XFtpSITE::Parse(string cmd, string msg){
+    Logger::debug("XFtpSITE::Parse() -> msg: ", msg);
+
+    // SITE <子命令> [参数]
+    string param = msg.size() > 5 ? msg.substr(5) : "";
+    while(!param.empty() && (param.back() == '\r' || param.back() == '\n')){
+        param.pop_back();
+    }
+    size_t space_pos = param.find(' ');
+    string sub = param.substr(0, space_pos);
+    std::transform(sub.begin(), sub.end(), sub.begin(), ::toupper);
+
+    if(sub == "TREE"){
+        Tree(param);
+    }
+    else if(sub == "RANGES"){
+        Ranges(param);
+    }
+    else if(sub == "QUOTA"){
+        Quota();
+    }
+    else{
+        ResCMD("504 SITE command not implemented.\r\n");
+    }
+}
+
+
+void XFtpSITE::Tree(const string &arg){
+    XFtpServerCMD *cmd = static_cast<XFtpServerCMD*>(cmdTask);
+    if(!cmd->thread){
+        ResCMD("451 Local error in processing.\r\n");
+        return;
+    }
+
+    string vpath = ResolvePath(arg);
+    string path = cmdTask->vfs.RealPath(vpath);
+    struct stat s_buf;
+    int err = 0;
+    if(!cmdTask->vfs.Stat(vpath, s_buf, err) || !S_ISDIR(s_buf.st_mode)){
+        ResCMD("550 No such directory.\r\n");
+        return;
+    }
+    Logger::info("XFtpSITE::Tree() -> path: ", path);
+
+    CancelWalk();
+    connected = false;
+
+    walk = make_shared<XTreeWalk>();
+    walk->root = path;
+    walk->facts = cmdTask->mlstFacts;
+    walk->thread = cmd->thread;
+    walk->owner = this;
+    walk->dirs.push_back("");
+
+    // 先提交一个 runner，目录多起来再补；慢速读取的客户端不会占住整个线程池
+    walk->max_runners = std::max(1, std::min(TREE_MAX_RUNNERS, XIOPool::Get()->Size() - 1));
+    walk->active = 1;
+    Submit(walk, 1);
+
+    ResCMD("150 Here comes the directory tree.\r\n");
+    ConnectoPORT();
+}
+
+
+void XFtpSITE::Ranges(const string &arg){
+    if(arg.find(' ') == string::npos){
+        ResCMD("501 Syntax: SITE RANGES <file>\r\n");
+        return;
+    }
+    string vpath = ResolvePath(arg);
+    string path = cmdTask->vfs.RealPath(vpath);
+    // 范围表经所在目录的 fd 读取，不越出根目录
+    int err = 0;
+    int dir_fd = vpath == "/" ? -1 : cmdTask->vfs.OpenDir(XVfs::Normalize(vpath, ".."), err);
+    off_t total = 0, received = 0;
+    string ranges;
+    bool found = dir_fd >= 0 &&
+                 XUploadParts::Get()->Describe(dir_fd, path, vpath.substr(vpath.rfind('/') + 1), total, received, ranges);
+    if(dir_fd >= 0) close(dir_fd);
+    if(!found){
+        ResCMD("550 No ranged upload in progress.\r\n");
+        return;
+    }
+    Logger::info("XFtpSITE::Ranges() -> ", path, " ", received, " of ", total, " bytes");
+    ResCMD("213 " + to_string(total) + " " + ranges + "\r\n");
+}
+
+
+void XFtpSITE::Quota(){
+    if(!XQuota::Get()->Enabled()){
+        ResCMD("550 Quotas are not enabled.\r\n");
+        return;
+    }
+    long long used[2], limit[2];
+    bool scanning = false;
+    XQuota::Get()->Usage(cmdTask->user, used, limit, scanning);
+    auto of = [](long long n){ return n > 0 ? to_string(n) : string("unlimited"); };
+    // 多行应答：用量、配额，重建期间的用量来自上次的日志
+    string res = "211-Quota for " + cmdTask->user + (scanning ? " (usage being rebuilt)" : "") + ":\r\n";
+    res += " Bytes: " + to_string(used[0]) + " of " + of(limit[0]) + "\r\n";
+    res += " Files: " + to_string(used[1]) + " of " + of(limit[1]) + "\r\n";
+    res += "211 End.\r\n";
+    ResCMD(res);
+}
+
+
+void XFtpSITE::OnChunk(shared_ptr<XTreeWalk> w, shared_ptr<const string> chunk){
+    if(w != walk) return;            // 已被新的遍历取代
+    if(!bev){
+        CancelWalk();                // 数据连接已关闭或建立失败
+        return;
+    }
+    w->chunks.push_back(std::move(chunk));
+    Pump();
+}
+
+
+void XFtpSITE::OnDone(shared_ptr<XTreeWalk> w){
+    if(w != walk) return;
+    Logger::info("XFtpSITE::OnDone() -> walk finished, entries: ", w->entries);
+    w->done = true;
+    Pump();
+}
+
+
+void XFtpSITE::Pump(){
+    if(!walk || !bev || !connected) return;
+
+    // 输出缓冲区未清空时不追加，等待下一次写回调
+    struct evbuffer *output = bufferevent_get_output(bev);
+    if(evbuffer_get_length(output) > 0) return;
+
+    size_t moved = 0;
+    while(!walk->chunks.empty() && moved < TREE_PUMP_MAX){
+        auto chunk = walk->chunks.front();
+        walk->chunks.pop_front();
+        moved += chunk->size();
+        if(Send(chunk) < 0) return;  // Send 失败时已关闭连接
+    }
+    if(moved > 0){
+        int resume = 0;
+        {
+            lock_guard<mutex> lock(walk->mtx);
+            walk->inflight -= moved;
+            if(walk->stalled && walk->inflight <= TREE_LOW_WATER){
+                walk->stalled = false;
+                resume = Grow(*walk);
+            }
+        }
+        Submit(walk, resume);
+        return;
+    }
+
+    if(walk->done && walk->chunks.empty()){
+        if(FinishSend()) return;     // MODE Z 的流结尾发送完后再结束
+        Logger::info("XFtpSITE::Pump() -> tree transfer complete");
+        walk->owner = nullptr;
+        walk.reset();
+        ResCMD("226 Transfer complete.\r\n");
+        ClosePORT();
+    }
+}
+
+
+void XFtpSITE::Write(bufferevent *bev){
+    if(!DataReady()) return;
+    connected = true;
+    Pump();
+}
+
+
+void XFtpSITE::CancelWalk(){
+    if(!walk) return;
+    walk->cancelled = true;
+    walk->owner = nullptr;
+    walk.reset();
+}
+
+
+void XFtpSITE::ClosePORT(){
+    CancelWalk();
+    connected = false;
+    XFtpLIST::ClosePORT();
+}
+
+
+XFtpSITE::~XFtpSITE(){
+    CancelWalk();
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "XFtpLIST.h"
+#include <string>
+#include <memory>
+
+struct XTreeWalk;
+
+/**
+ * @class XFtpSITE
+ * @brief SITE 扩展命令
+ *
+ * SITE TREE [path]：递归列出整棵子树，一次数据连接流式返回 MLSD 格式的行，
+ * 文件名为相对起始目录的路径。遍历在 XIOPool 中由有限个并行 runner 完成，
+ * 不阻塞事件循环，runner 也不在线程池里等待（背压时结束，数据写出后重新提交）；数据连接事件处理沿用 XFtpLIST。
+ * SITE RANGES <file>：分段上传已收到的范围，"213 <总大小> <s-e,...>"（含两端，没有时为 "-"）。
+ * SITE QUOTA：当前用户的配额与用量（XQuota），211 多行应答。
+ */
+class XFtpSITE : public XFtpLIST{
+public:
+    virtual void Parse(string cmd, string msg);
+    virtual void Write(bufferevent *bev);
+    virtual void ClosePORT();
+    virtual ~XFtpSITE();
+
+    // 以下由遍历线程通过 XThread::Post 在本线程调用
+    void OnChunk(std::shared_ptr<XTreeWalk> w, std::shared_ptr<const string> chunk);
+    void OnDone(std::shared_ptr<XTreeWalk> w);
+
+private:
+    void Tree(const string &arg);
+    void Ranges(const string &arg);
+    void Quota();
+    void Pump();                          // 把已产生的数据块写入数据连接，全部完成后回复 226
+    void CancelWalk();
+
+    std::shared_ptr<XTreeWalk> walk;      // 当前进行中的遍历
+    bool connected = false;               // 数据连接是否可写
+};
@@ -14,18 +14,19 @@ void XFtpSIZE::Parse(string cmd, string msg){
     // 例如：SIZE report.txt\r\n
 
     // 1. 提取文件名, 去除文件名末尾的回车换行符
-    int pos = msg.rfind(" ") + 1;
+    int pos = msg.find(" ") + 1;
     string file_name = msg.substr(pos);
     while (!file_name.empty() && (file_name.back() == '\r' || file_name.back() == '\n')) {
         file_name.pop_back();
     }
 
-    // 2. 构建完整文件路径
-    string path = cmdTask->rootDir + cmdTask->curDir + file_name;
+    // 2. 规范化为虚拟路径
+    string path = XVfs::Normalize(cmdTask->curDir, file_name);
 
-    // 3. 获取文件大小
+    // 3. 获取文件大小（相对会话缓存的父目录 fd，不越出根目录）
     struct stat st;
-    if (stat(path.c_str(), &st) == 0) {
+    int err = 0;
+    if (cmdTask->vfs.Stat(path, st, err)) {
         // 文件存在，返回文件大小
         string size_str = to_string(st.st_size);
         Logger::debug("XFtpSIZE::Parse() -> File size of ", path, ": ", size_str, " bytes");
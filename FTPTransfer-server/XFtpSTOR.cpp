@@ -1,11 +1,26 @@
 #include "XFtpSTOR.h"
+#include "XHashIndex.h"
+#include "XConfig.h"
+#include "XIOPool.h"
+#include "XThread.h"
+#include "XFtpServerCMD.h"
+#include "XQuota.h"
+#include "XMetrics.h"
 #include "testUtil.h"
 #include <event2/bufferevent.h>
 #include <event2/event.h>
 #include <event2/buffer.h>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <sys/stat.h>               // for stat()
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <climits>
+#include <atomic>
+#include <mutex>
 
 // OpenSSL相关头文件
 #ifndef OPENSSL_NO_SSL_INCLUDES
@@ -17,6 +32,150 @@ extern SSL_CTX *ssl_ctx;               // 声明外部SSL上下文变量
 
 using namespace std;
 
+static XMetricFamily quota_rejects(XMETRIC_COUNTER, "ftp_quota_rejections_total",
+                                   "Uploads refused or cut off by the storage quota", "reason");
+
+
+// stor_hash_algos：逗号分隔的算法名，空表示上传时不计算
+static const vector<int> &StorHashAlgos(){
+    static vector<int> algos = []{
+        vector<int> v;
+        string list = XConfig::Get()->GetString("stor_hash_algos", "SHA-256");
+        size_t i = 0;
+        while(i <= list.size()){
+            size_t j = list.find(',', i);
+            if(j == string::npos) j = list.size();
+            string name = list.substr(i, j - i);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+            int algo = XFtpHASH::ParseAlgo(name);
+            if(algo >= 0 && std::find(v.begin(), v.end(), algo) == v.end()) v.push_back(algo);
+            else if(!name.empty() && algo < 0) Logger::warning("XFtpSTOR -> unknown stor_hash_algos entry: ", name);
+            i = j + 1;
+        }
+        return v;
+    }();
+    return algos;
+}
+
+
+void XFtpSTOR::StartDigests(){
+    if(!XHashIndex::Get()->Enabled()) return;
+    for(int algo : StorHashAlgos()) digests[algo].Init(algo);
+}
+
+
+void XFtpSTOR::StoreDigests(){
+    struct stat st;
+    bool ok = fp && fstat(fileno(fp), &st) == 0 && (size_t)st.st_size == bytes_received;
+    for(auto &d : digests){
+        if(!d.Active()) continue;
+        int algo = d.Algo();
+        unsigned char out[64];
+        unsigned len = d.Final(out);
+        if(ok) XHashIndex::Get()->Store(st, algo, out, len);
+    }
+}
+
+
+// 打开上传文件失败时的应答
+static string OpenError(int err){
+    if(err == EACCES || err == EPERM) return "550 Permission denied.\r\n";
+    if(err == ENOENT) return "550 Directory does not exist.\r\n";
+    if(err == ENOSPC || err == EDQUOT || err == EFBIG) return "552 Storage allocation exceeded.\r\n";
+    return "550 Cannot create file.\r\n";
+}
+
+
+// 经会话的目录 fd 打开 vpath 并包装为 FILE*；失败返回 nullptr，err 为 errno
+static FILE *OpenFile(XVfs &vfs, const string &vpath, int flags, const char *mode, int &err){
+    int fd = vfs.Open(vpath, flags, 0644, err);
+    if(fd < 0) return nullptr;
+    FILE *fp = fdopen(fd, mode);
+    if(!fp){
+        err = errno;
+        close(fd);
+    }
+    return fp;
+}
+
+
+// ALLO 声明了大小时预留 [offset, offset + len) 的磁盘块（不改变文件大小），空间不足在 150 之前就能报错，
+// 大文件也不会边写边零碎地分配；只有 Linux 有 FALLOC_FL_KEEP_SIZE，其余平台不预留
+static int Reserve(int fd, off_t offset, off_t len){
+    #ifdef __linux__
+    if(len > 0 && fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, len) != 0){
+        int err = errno;
+        if(err != EOPNOTSUPP && err != ENOSYS) return err;
+    }
+    #endif
+    return 0;
+}
+
+
+// 同一文件的 APPE 写入与释放预留互斥：释放时先取文件大小再截断，中间别的会话追加的数据会被截掉
+static mutex &AppendLock(ino_t ino){
+    static mutex locks[16];
+    return locks[ino % 16];
+}
+
+
+bool XFtpSTOR::WriteFile(const char *data, size_t len){
+    if(part){
+        // 分段上传：按偏移写入，不能越过 RANG 范围（否则会覆盖别的连接负责的部分）
+        if((off_t)(bytes_received + len) > part_len){
+            Logger::error("XFtpSTOR::WriteFile() -> data exceeds the range, ", bytes_received + len, " > ", part_len);
+            range_exceeded = true;
+            file_write_error = true;
+            return false;
+        }
+        off_t at = part_start + bytes_received;
+        size_t left = len;
+        const char *p = data;
+        while(left > 0){
+            ssize_t w = pwrite(part->fd, p, left, at);
+            if(w < 0 && errno == EINTR) continue;
+            if(w < 0){
+                Logger::error("XFtpSTOR::WriteFile() -> pwrite error: ", strerror(errno));
+                file_write_error = true;
+                return false;
+            }
+            p += w;
+            left -= w;
+            at += w;
+        }
+        bytes_received += len;
+        TransferBytes(len);
+        return true;
+    }
+
+    if(quota_end >= 0 && (off_t)(bytes_received + len) > quota_end){
+        Logger::warning("XFtpSTOR::WriteFile() -> ", charge_user, " exceeds the quota at ", bytes_received + len, " bytes");
+        XMetrics::Add(quota_rejects.Id("transfer"), 1);
+        quota_exceeded = true;
+        file_write_error = true;
+        return false;
+    }
+    unique_lock<mutex> append;
+    if(direct) append = unique_lock<mutex>(AppendLock(append_ino));
+    size_t written = fwrite(data, 1, len, fp);
+    if(written != len){
+        int err = ferror(fp);
+        Logger::error("XFtpSTOR::WriteFile() -> fwrite error: ", err,
+                     ", expected ", len, " bytes, wrote ", written);
+        file_write_error = true;
+        return false;
+    }
+    bytes_received += len;
+    Logger::debug("XFtpSTOR::WriteFile() -> wrote ", len, " bytes, total: ", bytes_received);
+    TransferBytes(len);
+    for(auto &d : digests){
+        if(d.Active()) d.Update(data, len);
+    }
+    return true;
+}
+
+
 void XFtpSTOR::Read(bufferevent *bev){
     Logger::debug("XFtpSTOR::Read() called, transfer_started=", transfer_started,
                   ", transfer_complete=", transfer_complete);
@@ -34,7 +193,7 @@ void XFtpSTOR::Read(bufferevent *bev){
     }
     
     // 1. 检查文件指针是否有效
-    if(!fp){
+    if(!fp && !part){
         Logger::error("XFtpSTOR::Read() fp is null");
         ResCMD("550 Cannot create file.\r\n");
         ClosePORT();
@@ -62,71 +221,114 @@ void XFtpSTOR::Read(bufferevent *bev){
         waiting_for_data = false;
     }
     
+    // APPE：数据从输入缓冲区直接写入文件
+    if(direct && !Inflater()){
+        ReadDirect(bev);
+        return;
+    }
+
     bool data_was_read = false;
+    XZStream *z = Inflater();
+    auto sink = [this](const char *p, size_t n){ return WriteFile(p, n); };
     
     // 循环读取直到缓冲区为空
     do {
-        // 获取输入缓冲区大小
-        struct evbuffer* input = bufferevent_get_input(bev);
-        if(!input) {
-            Logger::debug("XFtpSTOR::Read() -> No input buffer");
-            break;
-        }
-        
-        size_t available = evbuffer_get_length(input);
-        if(available == 0) {
-            Logger::debug("XFtpSTOR::Read() -> No data available");
-            break;
+        bool ok;
+        // MODE Z：上次解压到上限时留下的数据先解完，这期间不取新数据
+        if(z && z->Held()){
+            ok = z->Resume(sink);
+            data_was_read = true;
         }
+        else{
+            // 获取输入缓冲区大小
+            struct evbuffer* input = bufferevent_get_input(bev);
+            if(!input) {
+                Logger::debug("XFtpSTOR::Read() -> No input buffer");
+                break;
+            }
         
-        // 计算本次读取的大小（不超过缓冲区大小）
-        size_t to_read = std::min(available, sizeof(buf));
-        Logger::debug("XFtpSTOR::Read() -> ", available, " bytes available, reading ", to_read);
+            size_t available = evbuffer_get_length(input);
+            if(available == 0) {
+                Logger::debug("XFtpSTOR::Read() -> No data available");
+                break;
+            }
         
-        // 从数据连接读取数据
-        int len = bufferevent_read(bev, buf, to_read);
+            // 计算本次读取的大小（不超过缓冲区大小）
+            size_t to_read = std::min(available, sizeof(buf));
+            Logger::debug("XFtpSTOR::Read() -> ", available, " bytes available, reading ", to_read);
         
-        if(len == 0){
-            // 没有更多数据可读（非错误）
-            Logger::debug("XFtpSTOR::Read() -> bufferevent_read returned 0");
-            break;
-        }
+            // 从数据连接读取数据
+            int len = bufferevent_read(bev, buf, to_read);
         
-        if(len < 0){
-            // 读取错误
-            Logger::error("XFtpSTOR::Read() -> bufferevent_read error");
-            file_write_error = true;
-            ResCMD("426 Connection closed; transfer aborted.\r\n");
-            ClosePORT();
-            return;
-        }
-        
-        data_was_read = true;
+            if(len == 0){
+                // 没有更多数据可读（非错误）
+                Logger::debug("XFtpSTOR::Read() -> bufferevent_read returned 0");
+                break;
+            }
         
-        // 更新接收字节数
-        bytes_received += len;
-        Logger::info("XFtpSTOR::Read() -> Received ", len, " bytes, total: ", bytes_received);
+            if(len < 0){
+                // 读取错误
+                Logger::error("XFtpSTOR::Read() -> bufferevent_read error");
+                file_write_error = true;
+                ResCMD("426 Connection closed; transfer aborted.\r\n");
+                ClosePORT();
+                return;
+            }
         
-        // 将数据写入文件
-        size_t written = fwrite(buf, 1, len, fp);
-        if(written != (size_t)len){
-            // 写入错误
-            int err = ferror(fp);
-            Logger::error("XFtpSTOR::Read() -> fwrite error: ", err, 
-                         ", expected ", len, " bytes, wrote ", written);
-            file_write_error = true;
-            ResCMD("552 Storage allocation exceeded or disk full.\r\n");
+            data_was_read = true;
+            Logger::trace(XTRACE_STOR_CHUNK, cmdTask->sessionId, len, bytes_received + len);
+
+            // MODE Z：解压后写入文件，字节数按文件计
+            ok = z ? z->Write(buf, len, sink) : WriteFile(buf, len);
+        }
+        if(!ok){
+            int code = file_write_error ? 552 : 451;
+            if(range_exceeded){
+                ResCMD("552 Data exceeds the requested range.\r\n");
+            }
+            else if(quota_exceeded){
+                ResCMD("552 Disk quota exceeded.\r\n");
+            }
+            else if(file_write_error){
+                ResCMD("552 Storage allocation exceeded or disk full.\r\n");
+            }
+            else{
+                file_write_error = true;
+                ResCMD("451 Compressed data error; transfer aborted.\r\n");
+            }
+            EndTransfer(false, code);
             ClosePORT();
             return;
         }
         
         // 每接收1MB数据flush一次
-        if(bytes_received % (1024*1024) == 0) {
+        if(fp && bytes_received % (1024*1024) == 0) {
             fflush(fp);
             Logger::debug("XFtpSTOR::Read() -> Flushed at ", bytes_received, " bytes");
         }
         
     } while(false); // 只循环一次，避免阻塞事件循环
+
+    // 解压出的数据到上限：暂停从连接读取，让出事件循环，下一轮再继续
+    if(z && z->Held()){
+        if(!inflate_paused){
+            inflate_paused = true;
+            bufferevent_disable(bev, EV_READ);
+        }
+        bufferevent_trigger(bev, EV_READ, BEV_TRIG_DEFER_CALLBACKS | BEV_TRIG_IGNORE_WATERMARKS);
+        return;
+    }
+    if(inflate_paused){
+        inflate_paused = false;
+        bufferevent_enable(bev, EV_READ);
+    }
+    // 解压期间连接已关闭：输入缓冲区里的数据都处理完再结束
+    if(pending_events && evbuffer_get_length(bufferevent_get_input(bev)) == 0){
+        short events = pending_events;
+        pending_events = 0;
+        Event(bev, events);
+        return;
+    }
     
     // 如果读取了数据，立即检查是否还有更多数据
     if(data_was_read) {
@@ -140,7 +342,7 @@ void XFtpSTOR::Read(bufferevent *bev){
 
 
 void XFtpSTOR::Event(bufferevent* bev, short events) {
-    Logger::debug("XFtpSTOR::Event() events: " + std::to_string(events));
+    Logger::debug("XFtpSTOR::Event() events: ", events);
     
     // 安全检查
     if(!bev) {
@@ -170,6 +372,15 @@ void XFtpSTOR::Event(bufferevent* bev, short events) {
     }
     #endif
     
+    // MODE Z：连接已关闭但还有没解完的数据，等 Read 处理完再按这次的事件结束
+    XZStream *z = Inflater();
+    if((events & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) && z && !transfer_complete && !file_write_error &&
+       (z->Held() || evbuffer_get_length(bufferevent_get_input(bev)) > 0)){
+        pending_events = events;
+        bufferevent_trigger(bev, EV_READ, BEV_TRIG_DEFER_CALLBACKS | BEV_TRIG_IGNORE_WATERMARKS);
+        return;
+    }
+
     if (events & BEV_EVENT_CONNECTED) {
         Logger::info("XFtpSTOR::Event() BEV_EVENT_CONNECTED");
         
@@ -188,12 +399,6 @@ void XFtpSTOR::Event(bufferevent* bev, short events) {
         }
         #endif
         
-        // 连接建立成功，设置传输阶段的超时
-        // 上传：主要关注读超时（接收数据）
-        timeval read_timeout = {300, 0};    // 接收数据超时300秒
-        timeval write_timeout = {30, 0};    // 发送响应超时30秒
-        bufferevent_set_timeouts(bev, &read_timeout, &write_timeout);
-        
         Logger::info("XFtpSTOR::Event() -> Ready to receive data");
         
         // 立即触发读事件开始接收数据
@@ -204,6 +409,20 @@ void XFtpSTOR::Event(bufferevent* bev, short events) {
     else if (events & BEV_EVENT_EOF) {
         Logger::info("XFtpSTOR::Event() BEV_EVENT_EOF");
         
+        // MODE Z：连接关闭时压缩流必须已经结束，否则文件不完整
+        if(z && !transfer_complete && !file_write_error && !z->Finish(nullptr)){
+            Logger::warning("XFtpSTOR::Event() -> compressed stream truncated after ", bytes_received, " bytes");
+            ResCMD("451 Compressed data incomplete; transfer aborted.\r\n");
+            Logger::trace(XTRACE_STOR_END, cmdTask->sessionId, bytes_received, 451);
+            EndTransfer(false, 451);
+            transfer_complete = true;
+        }
+
+        if(part){
+            EndRange();
+            return;
+        }
+
         // 客户端关闭了连接，上传完成
         if(!transfer_complete && !file_write_error) {
             Logger::info("XFtpSTOR::Event() -> Client closed connection, upload complete");
@@ -218,18 +437,27 @@ void XFtpSTOR::Event(bufferevent* bev, short events) {
                 Logger::info("XFtpSTOR::Event() -> Final file size: ", current_pos, 
                             " bytes, total received: ", bytes_received);
                 
+                // 没用完的预留空间还给文件系统（截断会更新 mtime，要在记录摘要之前）
+                Unreserve();
+
                 // 检查文件大小是否合理
                 if(current_pos != bytes_received) {
                     Logger::warning("XFtpSTOR::Event() -> File size mismatch! File: ", 
                                    current_pos, ", Received: ", bytes_received);
                 }
+                // 数据已全部写入，此时的 mtime 就是索引键
+                StoreDigests();
             }
             
             // 发送成功响应
             ResCMD("226 Transfer complete.\r\n");
+            Logger::trace(XTRACE_STOR_END, cmdTask->sessionId, bytes_received, 226);
+            EndTransfer(true);
             transfer_complete = true;
         } else if(file_write_error) {
             ResCMD("550 File write error.\r\n");
+            Logger::trace(XTRACE_STOR_END, cmdTask->sessionId, bytes_received, 550);
+            EndTransfer(false, 550);
         }
 
         // 传输完成，重置偏移量
@@ -245,6 +473,11 @@ void XFtpSTOR::Event(bufferevent* bev, short events) {
     else if (events & (BEV_EVENT_ERROR | BEV_EVENT_EOF)) {
         // 同时发生错误和EOF的情况
         Logger::info("XFtpSTOR::Event() -> Connection closed with possible error");
+        // 分段上传：已写入的部分照常记录，并告诉客户端收到了多少
+        if(part){
+            EndRange();
+            return;
+        }
         
         if(!transfer_complete && !file_write_error) {
             // 检查是否已接收部分数据
@@ -336,28 +569,69 @@ void XFtpSTOR::Event(bufferevent* bev, short events) {
 
 void XFtpSTOR::Parse(string cmd, string msg){
     Logger::debug("XFtpSTOR::Parse() cmd: ", cmd, " msg: ", msg);
+    if(opening){
+        ResCMD("450 Previous range upload is still being prepared.\r\n");
+        return;
+    }
+    if(record){
+        ResCMD("450 Previous range is still being saved.\r\n");
+        return;
+    }
     
     // 重置传输状态
     ResetTransferState();
     
     // 1. 提取文件名, 去除文件名末尾的\r\n
-    int pos = msg.rfind(" ") + 1;
+    int pos = msg.find(" ") + 1;
     string filename = msg.substr(pos);
     while(!filename.empty() && (filename.back() == '\r' || filename.back() == '\n')){
         filename.pop_back();
     }
     
-    // 2. 构建完整文件路径
-    string path = cmdTask->rootDir + cmdTask->curDir + filename;
+    // 2. 规范化为虚拟路径（文件经会话的目录 fd 打开），真实路径用于分段上传与日志
+    string vpath = XVfs::Normalize(cmdTask->curDir, filename);
+    string path = cmdTask->vfs.RealPath(vpath);
     Logger::info("XFtpSTOR::Parse() path: ", path);
 
-    // 3. 获取偏移量
+    // 3. 获取偏移量；ALLO 声明的大小与 RANG 范围只作用于这一次传输
     off_t offset = cmdTask->GetFileOffset();
+    off_t alloc = cmdTask->GetAllocSize();
+    cmdTask->SetAllocSize(-1);
     Logger::info("XFtpSTOR::Parse() -> Starting upload with offset: ", offset);
+    if(cmd != "STOR" && (offset > 0 || cmdTask->GetRangeEnd() >= 0)){
+        cmdTask->SetFileOffset(0);
+        cmdTask->SetRangeEnd(-1);
+        ResCMD("503 REST and RANG cannot be used with " + cmd + ".\r\n");
+        return;
+    }
+    if(cmd == "APPE"){
+        ParseAppend(vpath, alloc);
+        return;
+    }
+    if(cmd == "STOU"){
+        // 参数可选，作为唯一文件名的前缀
+        ParseUnique(msg.find(' ') == string::npos ? "" : filename, alloc);
+        return;
+    }
+    if(cmdTask->GetRangeEnd() >= 0){
+        off_t end = cmdTask->GetRangeEnd();
+        cmdTask->SetFileOffset(0);
+        cmdTask->SetRangeEnd(-1);
+        // 新建分段上传时按 ALLO 声明的大小检查配额；用量在创建 name.part 时由 XUploadParts 记入，
+        // 继续进行中的上传（name.part 已在）不再检查
+        struct stat part;
+        int part_err = 0;
+        if(alloc >= 0 && !cmdTask->vfs.Lstat(vpath + ".part", part, part_err) && !CheckQuota(path, 0, true, alloc)) return;
+        charge = false;
+        quota_end = -1;
+        ParseRanged(vpath, offset, end, alloc);
+        return;
+    }
 
     // 4. 检查文件是否存在及其大小
     struct stat fileStat;
-    bool fileExists = (stat(path.c_str(), &fileStat) == 0);
+    int err = 0;
+    bool fileExists = cmdTask->vfs.Stat(vpath, fileStat, err);
     off_t existingSize = fileExists ? fileStat.st_size : 0;
     if(fileExists){
         if(offset != existingSize){
@@ -372,14 +646,16 @@ void XFtpSTOR::Parse(string cmd, string msg){
             Logger::info("XFtpSTOR::Parse() -> Existing file size: ", existingSize, " bytes");
         }
     }
+    // ALLO 声明的是文件大小，覆盖已有文件时只多占差额
+    if(!CheckQuota(path, existingSize, !fileExists, alloc >= 0 ? alloc - existingSize : 0)) return;
     
     // 5. 以二进制写模式打开文件
     if (offset == 0) {
         // 从头开始，创建新文件或覆盖
-        fp = fopen(path.c_str(), "wb");  // 二进制写入模式
+        fp = OpenFile(cmdTask->vfs, vpath, O_WRONLY | O_CREAT | O_TRUNC, "wb", err);  // 二进制写入模式
     } else {
         // 续传，以读写模式打开
-        fp = fopen(path.c_str(), "rb+");  // 二进制读写模式
+        fp = OpenFile(cmdTask->vfs, vpath, O_RDWR, "rb+", err);  // 二进制读写模式
         
         if (fp) {
             // 移动到偏移位置
@@ -402,28 +678,441 @@ void XFtpSTOR::Parse(string cmd, string msg){
         }
     }
     if(!fp){
-        int err = errno;
-        string error_msg;
-        
-        if(err == EACCES || err == EPERM){
-            error_msg = "550 Permission denied.\r\n";
-        } else if(err == ENOENT){
-            // 尝试创建目录
-            error_msg = "550 Directory does not exist.\r\n";
-        } else if(err == ENOSPC){
-            error_msg = "552 Storage allocation exceeded.\r\n";
-        } else {
-            error_msg = "550 Cannot create file.\r\n";
-        }
         Logger::error("XFtpSTOR::Parse() fopen failed: ", strerror(err));
-        ResCMD(error_msg);
+        ResCMD(OpenError(err));
         return;
     }
+    if(alloc > offset){
+        err = Reserve(fileno(fp), offset, alloc - offset);
+        if(err){
+            Logger::error("XFtpSTOR::Parse() -> cannot reserve ", alloc, " bytes: ", strerror(err));
+            ResCMD(OpenError(err));
+            Settle();
+            fclose(fp);
+            fp = nullptr;
+            return;
+        }
+        Reserved(alloc - offset);
+    }
+
+    // 续传时缺少前面部分的数据，只有从头上传才能边收边算整个文件的摘要
+    if(offset == 0) StartDigests();
 
     // 6. 发送响应及建立数据连接
     Logger::info("XFtpSTOR::Parse() -> Ready to receive file upload");
     ResCMD("150 Opening data connection for file transfer.\r\n");
+    Logger::trace(XTRACE_STOR_BEGIN, cmdTask->sessionId, offset);
+    BeginTransfer(XFTP_XFER_STOR, path);
     
     // 建立数据连接
     ConnectoPORT();
-}
\ No newline at end of file
+}
+
+
+void XFtpSTOR::ParseAppend(const string &vpath, off_t alloc){
+    // O_APPEND：每次写入都追加到当时的文件末尾，多个会话同时追加同一个日志也不会互相覆盖
+    string path = cmdTask->vfs.RealPath(vpath);
+    struct stat st;
+    int err = 0;
+    bool exists = cmdTask->vfs.Stat(vpath, st, err);
+    if(!CheckQuota(path, exists ? st.st_size : 0, !exists, max<off_t>(alloc, 0))) return;
+    int fd = cmdTask->vfs.Open(vpath, O_WRONLY | O_CREAT | O_APPEND, 0644, err);
+    if(fd < 0){
+        Logger::error("XFtpSTOR::ParseAppend() open failed: ", strerror(err));
+        ResCMD(OpenError(err));
+        return;
+    }
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)){
+        close(fd);
+        ResCMD("550 Not a regular file.\r\n");
+        return;
+    }
+    err = Reserve(fd, st.st_size, alloc);
+    if(err){
+        Logger::error("XFtpSTOR::ParseAppend() -> cannot reserve ", alloc, " bytes: ", strerror(err));
+        close(fd);
+        ResCMD(OpenError(err));
+        return;
+    }
+    // 直接写 fd，stdio 不缓冲（MODE Z 解压后的数据也经 fwrite 立即写入）
+    fp = fdopen(fd, "ab");
+    if(!fp){
+        close(fd);
+        ResCMD("451 Local error in processing.\r\n");
+        return;
+    }
+    setvbuf(fp, nullptr, _IONBF, 0);
+    direct = true;
+    append_ino = st.st_ino;
+    bytes_received = st.st_size;
+    // 追加的字节数记入用量，上限相对打开时的大小
+    if(quota_end >= 0) quota_end += st.st_size - charge_size;
+    charge_size = st.st_size;
+    if(alloc > 0) Reserved(alloc);
+    Logger::info("XFtpSTOR::ParseAppend() -> appending to ", path, " at ", st.st_size);
+
+    ResCMD("150 Opening data connection for append.\r\n");
+    Logger::trace(XTRACE_STOR_BEGIN, cmdTask->sessionId, st.st_size);
+    BeginTransfer(XFTP_XFER_STOR, path, "APPE");
+    ConnectoPORT();
+}
+
+
+void XFtpSTOR::ParseUnique(const string &prefix, off_t alloc){
+    // 名字由启动时间、进程号与进程内序号组成，本进程内不会重复；O_EXCL 兜底，被别人占用时换下一个序号，不扫描目录
+    static const string stamp = to_string(time(nullptr)) + "-" + to_string(getpid());
+    static std::atomic<unsigned long> seq{0};
+    if(!CheckQuota("", 0, true, max<off_t>(alloc, 0))) return;     // 路径在生成名字之后补上
+    string name, vpath;
+    int fd = -1, err = 0;
+    for(int i = 0; i < 8 && fd < 0; i++){
+        name = (prefix.empty() ? "stou" : prefix) + "." + stamp + "-" + to_string(++seq);
+        vpath = XVfs::Normalize(cmdTask->curDir, name);
+        fd = cmdTask->vfs.Open(vpath, O_WRONLY | O_CREAT | O_EXCL, 0644, err);
+        if(fd < 0 && err != EEXIST) break;
+    }
+    string path = cmdTask->vfs.RealPath(vpath);
+    charge_path = path;
+    if(fd < 0){
+        Logger::error("XFtpSTOR::ParseUnique() open failed: ", strerror(err));
+        ResCMD(err == EEXIST ? "450 Cannot create a unique file name.\r\n" : OpenError(err));
+        return;
+    }
+    err = Reserve(fd, 0, alloc);
+    if(err){
+        Logger::error("XFtpSTOR::ParseUnique() -> cannot reserve ", alloc, " bytes: ", strerror(err));
+        close(fd);
+        int e = 0;
+        cmdTask->vfs.Unlink(vpath, e);
+        ResCMD(OpenError(err));
+        return;
+    }
+    fp = fdopen(fd, "wb");
+    if(!fp){
+        close(fd);
+        int e = 0;
+        cmdTask->vfs.Unlink(vpath, e);
+        ResCMD("451 Local error in processing.\r\n");
+        return;
+    }
+    if(alloc > 0) Reserved(alloc);
+    Logger::info("XFtpSTOR::ParseUnique() -> ", path);
+    StartDigests();
+
+    // RFC 1123 4.1.2.9：150 应答中给出文件名
+    ResCMD("150 FILE: " + name + "\r\n");
+    Logger::trace(XTRACE_STOR_BEGIN, cmdTask->sessionId, 0);
+    BeginTransfer(XFTP_XFER_STOR, path, "STOU");
+    ConnectoPORT();
+}
+
+
+void XFtpSTOR::ReadDirect(bufferevent *bev){
+    // 以 writev 把输入缓冲区的各个块直接写入文件，不经过 buf 和 stdio 缓冲
+    struct evbuffer *input = bufferevent_get_input(bev);
+    size_t total = 0;
+    while(evbuffer_get_length(input) > 0){
+        ev_ssize_t most = -1;
+        if(quota_end >= 0){
+            if((off_t)bytes_received >= quota_end){
+                Logger::warning("XFtpSTOR::ReadDirect() -> ", charge_user, " exceeds the quota at ", bytes_received, " bytes");
+                XMetrics::Add(quota_rejects.Id("transfer"), 1);
+                quota_exceeded = true;
+                file_write_error = true;
+                ResCMD("552 Disk quota exceeded.\r\n");
+                EndTransfer(false, 552);
+                ClosePORT();
+                return;
+            }
+            most = quota_end - bytes_received;
+        }
+        int n;
+        {
+            lock_guard<mutex> append(AppendLock(append_ino));
+            n = evbuffer_write_atmost(input, fileno(fp), most);
+        }
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0){
+            int err = errno;
+            Logger::error("XFtpSTOR::ReadDirect() -> write error: ", strerror(err));
+            file_write_error = true;
+            bool full = err == ENOSPC || err == EDQUOT;
+            ResCMD(full ? "552 Storage allocation exceeded or disk full.\r\n"
+                        : "451 Local error in processing.\r\n");
+            EndTransfer(false, full ? 552 : 451);
+            ClosePORT();
+            return;
+        }
+        total += n;
+        bytes_received += n;
+        TransferBytes(n);
+    }
+    if(total > 0) Logger::trace(XTRACE_STOR_CHUNK, cmdTask->sessionId, total, bytes_received);
+}
+
+
+/**
+ * 分段上传开始时准备数据文件的共享状态
+ * owner 在所属 XThread 中读写（会话关闭、处理器销毁时置空），其余字段提交前写好、完成后只在所属 XThread 中读
+ */
+struct XPartOpen{
+    int dir_fd = -1;                      // 目标所在目录，任务结束时关闭
+    string path;
+    string name;
+    string user;
+    off_t start = 0;
+    off_t end = 0;
+    off_t total = -1;                     // ALLO 声明的大小
+    XThread *thread = nullptr;
+    XFtpSTOR *owner = nullptr;
+
+    std::shared_ptr<XPartFile> part;      // 失败时为空
+    string reply;
+    ~XPartOpen(){ if(dir_fd >= 0) close(dir_fd); }
+};
+
+
+/**
+ * 一个范围落盘记录的共享状态
+ * owner 在所属 XThread 中读写（会话关闭、处理器销毁时置空），其余字段提交前写好、完成后只在所属 XThread 中读
+ */
+struct XPartRecord{
+    std::shared_ptr<XPartFile> part;
+    off_t start = 0;
+    off_t end = 0;                        // 实际写入到的位置
+    off_t len = 0;                        // RANG 范围长度
+    off_t total = 0;
+    bool reply = false;                   // 完成后是否应答（出错时已经应答过）
+    XThread *thread = nullptr;
+    XFtpSTOR *owner = nullptr;
+
+    XPartResult result = XPART_FAILED;
+    off_t received = 0;
+    string err;
+};
+
+
+bool XFtpSTOR::CheckQuota(const string &path, off_t old_size, bool create, off_t need){
+    charge = false;
+    quota_end = -1;
+    if(!XQuota::Get()->Enabled()) return true;
+    long long bytes = 0, files = 0;
+    XQuota::Get()->Remaining(cmdTask->user, bytes, files);
+    if(create && files <= 0){
+        XMetrics::Add(quota_rejects.Id("files"), 1);
+        ResCMD("552 File count quota exceeded.\r\n");
+        return false;
+    }
+    // 已用完，或剩余的比 ALLO 声明的少：在 150 之前拒绝，一个字节都不收
+    if(bytes <= 0 || need > bytes){
+        XMetrics::Add(quota_rejects.Id("bytes"), 1);
+        ResCMD("552 Disk quota exceeded; " + to_string(max(0LL, bytes)) + " bytes left.\r\n");
+        return false;
+    }
+    if(bytes != LLONG_MAX) quota_end = old_size + bytes;
+    charge = true;
+    charge_user = cmdTask->user;
+    charge_path = path;
+    charge_size = old_size;
+    charge_new = create;
+    return true;
+}
+
+
+void XFtpSTOR::Reserved(off_t len){
+    reserved = true;
+    // 预留的块在文件末尾之后，大小里看不出来；持有期间也算作用量，反复 ALLO 之后断线不能绕过配额
+    if(charge && len > 0){
+        reserve_charged = len;
+        XQuota::Get()->Charge(charge_user, charge_path, len, 0);
+    }
+}
+
+
+void XFtpSTOR::Unreserve(){
+    if(!reserved || !fp) return;
+    reserved = false;
+    fflush(fp);
+    // 截到当前大小即释放末尾之后的块；APPE 与同一文件的其他追加互斥，取大小与截断之间不会有人写入
+    unique_lock<mutex> append;
+    if(direct) append = unique_lock<mutex>(AppendLock(append_ino));
+    struct stat st;
+    if(fstat(fileno(fp), &st) != 0 || ftruncate(fileno(fp), st.st_size) != 0){
+        Logger::warning("XFtpSTOR::Unreserve() -> cannot release reserved space: ", strerror(errno));
+    }
+}
+
+
+void XFtpSTOR::Settle(){
+    if(!fp) return;
+    // 出错、超时、中断与数据连接建立失败都走到这里，没用完的预留一并释放
+    Unreserve();
+    if(!charge) return;
+    charge = false;
+    // APPE 按本次追加的字节数（别的会话可能同时在追加），其余按关闭前的文件大小；预留时计入的部分扣回
+    long long size = bytes_received;
+    if(!direct){
+        fflush(fp);
+        struct stat st;
+        if(fstat(fileno(fp), &st) != 0) return;
+        size = st.st_size;
+    }
+    XQuota::Get()->Charge(charge_user, charge_path, size - charge_size - reserve_charged, charge_new ? 1 : 0);
+    reserve_charged = 0;
+}
+
+
+void XFtpSTOR::ParseRanged(const string &vpath, off_t start, off_t end, off_t total){
+    XFtpServerCMD *cmd = static_cast<XFtpServerCMD*>(cmdTask);
+    if(!cmd->thread){
+        ResCMD("451 Local error in processing.\r\n");
+        return;
+    }
+    if(vpath == "/"){
+        ResCMD("550 Cannot create file.\r\n");
+        return;
+    }
+    // 分段上传的几个文件都在目标所在的目录里，经会话解析好的目录 fd 按名字操作，不越出根目录
+    int err = 0;
+    auto o = make_shared<XPartOpen>();
+    o->dir_fd = cmdTask->vfs.OpenDir(XVfs::Normalize(vpath, ".."), err);
+    if(o->dir_fd < 0){
+        ResCMD(OpenError(err));
+        return;
+    }
+    o->path = cmdTask->vfs.RealPath(vpath);
+    o->name = vpath.substr(vpath.rfind('/') + 1);
+    o->user = cmdTask->user;
+    o->start = start;
+    o->end = end;
+    o->total = total;
+    o->thread = cmd->thread;
+    o->owner = this;
+    opening = o;
+
+    // 新建时预分配整个文件并写范围表，不在事件循环里做
+    XIOPool::Get()->Submit([o]{
+        o->part = XUploadParts::Get()->Open(o->dir_fd, o->path, o->name, o->total, o->user, o->reply);
+        close(o->dir_fd);
+        o->dir_fd = -1;
+        o->thread->Post([o]{
+            if(o->owner) o->owner->OnOpened(o);
+            else if(o->part) XUploadParts::Get()->Release(o->part);
+        });
+    });
+}
+
+
+void XFtpSTOR::OnOpened(shared_ptr<XPartOpen> o){
+    if(o != opening || o->owner != this) return;
+    opening.reset();
+    o->owner = nullptr;
+    if(!o->part){
+        ResCMD(o->reply);
+        return;
+    }
+    // total 在 Open 之后不再改变
+    if(o->end > o->part->total){
+        ResCMD("554 Range exceeds the file size (" + to_string(o->part->total) + " bytes).\r\n");
+        XUploadParts::Get()->Release(o->part);
+        return;
+    }
+    part = o->part;
+    part_start = o->start;
+    part_len = o->end - o->start;
+    part_thread = o->thread;
+    Logger::info("XFtpSTOR::OnOpened() -> ", o->path, " range ", o->start, "-", o->end - 1, " of ", part->total);
+
+    ResCMD("150 Opening data connection for range upload.\r\n");
+    Logger::trace(XTRACE_STOR_BEGIN, cmdTask->sessionId, o->start);
+    BeginTransfer(XFTP_XFER_STOR, o->path);
+    ConnectoPORT();
+}
+
+
+void XFtpSTOR::EndRange(){
+    // 落盘并记入范围表后再应答（解压出错时已经应答过，只记录写入的部分）
+    if(!transfer_complete){
+        bool whole = (off_t)bytes_received == part_len;
+        Logger::trace(XTRACE_STOR_END, cmdTask->sessionId, bytes_received, whole ? 226 : 451);
+        EndTransfer(whole, whole ? 226 : 451);
+    }
+    FinishRange(!transfer_complete);
+    transfer_complete = true;
+    cmdTask->SetFileOffset(0);
+    ClosePORT();
+}
+
+
+void XFtpSTOR::FinishRange(bool reply){
+    if(!part) return;
+    auto r = make_shared<XPartRecord>();
+    r->part = part;
+    r->start = part_start;
+    r->end = part_start + bytes_received;
+    r->len = part_len;
+    r->total = part->total;
+    r->reply = reply;
+    r->thread = part_thread;
+    r->owner = this;
+    part.reset();
+    record = r;
+
+    // fdatasync 可能很慢，不在事件循环里做
+    XIOPool::Get()->Submit([r]{
+        r->result = XUploadParts::Get()->Record(r->part, r->start, r->end, r->received, r->err);
+        r->part.reset();
+        r->thread->Post([r]{
+            if(r->owner) r->owner->OnRecorded(r);
+        });
+    });
+}
+
+
+void XFtpSTOR::OnRecorded(shared_ptr<XPartRecord> r){
+    if(r == record) record.reset();
+    r->owner = nullptr;
+    if(!r->reply) return;
+    off_t got = r->end - r->start;
+    if(r->result == XPART_FAILED){
+        Logger::error("XFtpSTOR::OnRecorded() -> cannot record range: ", r->err);
+        ResCMD("451 Cannot save range: " + r->err + ".\r\n");
+    }
+    else if(got < r->len){
+        ResCMD("451 Range incomplete; " + to_string(got) + " of " + to_string(r->len) + " bytes stored.\r\n");
+    }
+    else if(r->result == XPART_COMMITTED){
+        ResCMD("226 Transfer complete; file assembled.\r\n");
+    }
+    else{
+        ResCMD("226 Range stored; " + to_string(r->received) + " of " + to_string(r->total) + " bytes received.\r\n");
+    }
+}
+
+
+void XFtpSTOR::ClosePORT(){
+    // 出错或超时中断的范围：已写入的部分照样记录，重传时只需补缺的
+    FinishRange(false);
+    Settle();
+    XFtpTask::ClosePORT();
+}
+
+
+void XFtpSTOR::Detach(){
+    // 会话即将释放：还在 XIOPool 中的准备与落盘照常完成，但不再应答
+    if(opening){
+        opening->owner = nullptr;
+        opening.reset();
+    }
+    if(record){
+        record->owner = nullptr;
+        record.reset();
+    }
+}
+
+
+XFtpSTOR::~XFtpSTOR(){
+    FinishRange(false);
+    Settle();
+    Detach();
+}
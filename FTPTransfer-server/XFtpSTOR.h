@@ -1,11 +1,25 @@
 #pragma once
 #include "XFtpTask.h"
+#include "XFtpHASH.h"
+#include "XZStream.h"
+#include "XUploadParts.h"
+
+struct XPartRecord;
+struct XPartOpen;
+class XThread;
 
 class XFtpSTOR : public XFtpTask{
 public:
+    ~XFtpSTOR();
     void Read(bufferevent *);
     void Event(bufferevent *, short);
     void Parse(string, string);
+    virtual void ClosePORT();
+    virtual void Detach();
+
+    // 分段上传的数据文件已准备好、范围落盘记录完成（XIOPool 线程通过 XThread::Post 在本线程调用）
+    void OnOpened(std::shared_ptr<XPartOpen> o);
+    void OnRecorded(std::shared_ptr<XPartRecord> r);
 
     // 重置传输状态
     void ResetTransferState() {
@@ -14,6 +28,16 @@ public:
         file_write_error = false;
         bytes_received = 0;
         waiting_for_data = false;
+        inflate_paused = false;
+        pending_events = 0;
+        range_exceeded = false;
+        direct = false;
+        reserved = false;
+        reserve_charged = 0;
+        charge = false;
+        quota_end = -1;
+        quota_exceeded = false;
+        for(auto &d : digests) d.Reset();
     }
 
 private:
@@ -23,4 +47,50 @@ private:
     bool file_write_error = false;       // 文件写入错误
     size_t bytes_received = 0;           // 已接收字节数
     bool waiting_for_data = false;       // 正在等待数据
+    bool inflate_paused = false;         // MODE Z 解压到上限，暂停从连接读取
+    short pending_events = 0;            // MODE Z 还有数据没解完时收到的连接关闭事件
+
+    // 写入文件（MODE Z 时为解压后的数据）并更新摘要；失败时设置 file_write_error
+    bool WriteFile(const char *data, size_t len);
+
+    // APPE：O_APPEND 打开，数据不经过 buf 直接从输入缓冲区写入文件；STOU：生成唯一文件名后按 STOR 接收
+    void ParseAppend(const string &vpath, off_t alloc);
+    void ParseUnique(const string &prefix, off_t alloc);
+    void ReadDirect(bufferevent *bev);
+    bool direct = false;
+    bool reserved = false;                // 按 ALLO 预留了磁盘块
+    ino_t append_ino = 0;                 // APPE 的文件，与同一文件的其他追加互斥（见 AppendLock）
+    void Reserved(off_t len);             // 预留成功：在释放前计入配额用量
+    void Unreserve();                     // 把没用完的预留还给文件系统（截到当前大小）
+
+    // 配额（XQuota）：150 之前按剩余额度检查，接收时限制文件大小，关闭文件时把大小变化记入用量
+    bool CheckQuota(const string &path, off_t old_size, bool create, off_t need);
+    void Settle();
+    bool charge = false;                  // 关闭文件时记入用量
+    off_t reserve_charged = 0;            // 已计入用量的预留字节数，关闭时扣回
+    string charge_user;
+    string charge_path;                   // 文件的真实路径（重建用量期间判断遍历是否已算过它）
+    off_t charge_size = 0;                // 打开前的文件大小
+    bool charge_new = false;              // 新建的文件
+    off_t quota_end = -1;                 // 文件大小上限，-1 表示不限
+    bool quota_exceeded = false;
+
+    // 从头上传时边收边算 stor_hash_algos 中的摘要，完成后记入 XHashIndex
+    void StartDigests();
+    void StoreDigests();
+    XDigest digests[XHASH_ALGOS];
+
+    // 分段上传（ALLO + RANG + STOR）：本次按偏移写 name.part 的 [part_start, part_start + part_len)。
+    // 开始时在 XIOPool 中准备数据文件（预分配、写范围表），结束时在 XIOPool 中落盘并记入范围表（XUploadParts），
+    // 完成后再应答
+    void ParseRanged(const string &vpath, off_t start, off_t end, off_t total);
+    void EndRange();
+    void FinishRange(bool reply);
+    std::shared_ptr<XPartFile> part;
+    off_t part_start = 0;
+    off_t part_len = 0;
+    XThread *part_thread = nullptr;
+    bool range_exceeded = false;          // 收到的数据超出了 RANG 范围
+    std::shared_ptr<XPartOpen> opening;   // 正在准备的数据文件
+    std::shared_ptr<XPartRecord> record;  // 正在落盘记录的范围
 };
\ No newline at end of file
@@ -8,10 +8,26 @@
 using namespace std;                     // 使用std命名空间，简化代码编写
 
 #include "XFtpServerCMD.h"               // 包含FTP服务器命令调度器的类定义
+#include "XMetrics.h"                    // 指标统计
+#include "XWatchdog.h"                   // 卡顿检测
+#include "XAdmission.h"                  // 连接准入控制
 #include "testUtil.h"                    // 包含测试工具函数或调试辅助函数
 
 #define BUFS 4096                        // 定义缓冲区大小为4096字节，用于网络数据读写
 
+// 按命令字统计，未注册的命令统一计为 "unknown"，避免任意输入产生无限多的标签
+static XMetricFamily cmd_total(XMETRIC_COUNTER, "ftp_commands_total", "FTP commands received", "verb");
+static XMetricFamily cmd_duration(XMETRIC_HISTOGRAM, "ftp_command_duration_us",
+                                  "Time spent in the command handler in microseconds", "verb");
+
+static int TlsMetric(bool ok){
+    static int done = XMetrics::Get()->Register(XMETRIC_HISTOGRAM, "ftp_tls_handshake_duration_us",
+                                                "Control connection TLS handshake time in microseconds");
+    static int failed = XMetrics::Get()->Register(XMETRIC_COUNTER, "ftp_tls_handshake_failures_total",
+                                                  "Control connection TLS handshakes that failed");
+    return ok ? done : failed;
+}
+
 
 
 bool XFtpServerCMD::Init(){
@@ -23,16 +39,15 @@ bool XFtpServerCMD::Init(){
         return false;
     }
 
-    timeval t = {300, 0};
-    bufferevent_set_timeouts(bev, &t, 0);
-
     string msg = "220 FTP Server ready\r\n";
     bufferevent_write(bev, msg.c_str(), msg.size());
 
     this->cmdTask = this;
     this->bev = bev;
     Setcb(bev);
+    ArmTimeout(XFTP_TIMEOUT_IDLE);
 
+    Logger::trace(XTRACE_SESSION_OPEN, sessionId, thread ? thread->id : -1);
     Logger::info("XFtpServerCMD::Init() finished");
     return true;
 }
@@ -43,6 +58,10 @@ void XFtpServerCMD::Event(bufferevent *bev, short events){
     Logger::debug("XFtpServerCMD::Event()");
     if (events & BEV_EVENT_CONNECTED) {
         Logger::info("XFtpServerCMD::Event() BEV_EVENT_CONNECTED");
+        if(tlsStartUs){
+            XMetrics::Observe(TlsMetric(true), XMetrics::NowUs() - tlsStartUs);
+            tlsStartUs = 0;
+        }
         // 连接建立，可以开始发送数据（如果还没有开始的话）
         // 注意：在主动模式下，连接建立后可能已经发送了数据，所以这里可能不需要做任何事情
         return;
@@ -60,8 +79,20 @@ void XFtpServerCMD::Event(bufferevent *bev, short events){
         string msg = "421 Service closing control connection due to timeout.\r\n";
         bufferevent_write(bev, msg.c_str(), msg.size());
     }
-    // 关闭连接
+    if(tlsStartUs){
+        XMetrics::Add(TlsMetric(false), 1);
+        tlsStartUs = 0;
+    }
+
+    // 关闭连接：各命令处理器的数据连接与后台任务（目录遍历、摘要计算）一并结束，
+    // 之后不会再有结果回到这个会话
+    for(auto &pair : calls_map){
+        if(!pair.second) continue;
+        pair.second->ClosePORT();
+        pair.second->Detach();
+    }
     ClosePORT();
+    Logger::trace(XTRACE_SESSION_CLOSE, sessionId);
 
     // 延迟销毁连接，确保响应消息发送完成
     if(this->base){
@@ -82,7 +113,6 @@ void XFtpServerCMD::Event(bufferevent *bev, short events){
 
 
 void XFtpServerCMD::Read(bufferevent *bev){
-    cout << endl;
     Logger::info("XFtpServerCMD::Read() called");
  
     char buf[BUFS] = {0};
@@ -94,7 +124,7 @@ void XFtpServerCMD::Read(bufferevent *bev){
             Logger::info("XFtpServerCMD::Read() -> bufferevent_read EOF");
         }
         else {
-            perror("XFtpServerCMD::Read() -> bufferevent_read failed");
+            Logger::error("XFtpServerCMD::Read() -> bufferevent_read failed");
         }
         return;
     }
@@ -103,10 +133,24 @@ void XFtpServerCMD::Read(bufferevent *bev){
     read_buffer.append(buf, len);
     // Logger::debug("XFtpServerCMD::Read() -> Appended ", len, " bytes to buffer. Buffer now (raw): \"", 
     //                 read_buffer, "\"");
-    
+    ProcessCommands();
+}
+
+
+// 登录前允许的命令：登录本身、TLS 协商与不涉及文件系统的查询
+bool XFtpServerCMD::AllowedBeforeLogin(const std::string &type){
+    static const char *allowed[] = {"USER", "PASS", "AUTH", "PBSZ", "PROT", "FEAT", "OPTS", "QUIT"};
+    for(const char *a : allowed){
+        if(type == a) return true;
+    }
+    return false;
+}
+
+
+void XFtpServerCMD::ProcessCommands(){
     // 3. 循环处理缓冲区中所有完整的命令（以\r\n结尾）
     size_t start_pos = 0;
-    while (true) {
+    while (!authPending && !hashPending) {
         // 3.1 查找命令结束符 \r\n
         size_t crlf_pos = read_buffer.find("\r\n", start_pos);
         // Logger::debug("XFtpServerCMD::Read() -> Looking for \\r\\n from pos ", start_pos, ", found at: ", 
@@ -129,17 +173,30 @@ void XFtpServerCMD::Read(bufferevent *bev){
         }
         std::transform(type.begin(), type.end(), type.begin(), ::toupper);
         Logger::info("XFtpServerCMD::Read() -> Recv CMD: ", type);
+        if(XLog::TraceEnabled()){
+            int64_t verb = 0;
+            memcpy(&verb, type.data(), type.size() < 8 ? type.size() : 8);
+            Logger::trace(XTRACE_CMD, sessionId, verb);
+        }
         
         // 3.4 处理命令
         auto it = calls_map.find(type);
-        if (it != calls_map.end()) {
+        if (it != calls_map.end() && !loggedIn && !AllowedBeforeLogin(type)) {
+            ResCMD("530 Please login with USER and PASS.\r\n");
+            XMetrics::Add(cmd_total.Id(type), 1);
+        } else if (it != calls_map.end()) {
             XFtpTask *t = it->second;
             // Logger::debug("XFtpServerCMD::Read() -> Found handler for command: ", type);
             // 确保传递完整的FTP格式
+            uint64_t start = XMetrics::NowUs();
+            XCallbackScope::Tag("Parse", &typeid(*t));
             t->Parse(type, cmd_line + "\r\n");
+            XMetrics::Add(cmd_total.Id(type), 1);
+            XMetrics::Observe(cmd_duration.Id(type), XMetrics::NowUs() - start);
             // Logger::info("XFtpServerCMD::Read() -> curDir: ", curDir);
         } else {
             ResCMD("500 Command not understood\r\n");
+            XMetrics::Add(cmd_total.Id("unknown"), 1);
             Logger::warning("XFtpServerCMD::Read() -> Unknown CMD: ", type, ", available commands: ");
             // 打印所有可用命令以便调试
             for (const auto& pair : calls_map) {
@@ -169,7 +226,7 @@ void XFtpServerCMD::Read(bufferevent *bev){
 
 
 void XFtpServerCMD::Reg(std::string cmd, XFtpTask *call){
-    Logger::debug("XFtpServerCMD::Reg() -> cmd: " + cmd);
+    Logger::debug("XFtpServerCMD::Reg() -> cmd: ", cmd);
     if(!call){
         Logger::error("XFtpServerCMD::Reg() call is null");
         return;
@@ -217,4 +274,5 @@ XFtpServerCMD::~XFtpServerCMD(){
     //     bev = nullptr;
     // }
     ClosePORT();
+    if(admitted) XAdmission::Get()->Release(peer);
 }
\ No newline at end of file
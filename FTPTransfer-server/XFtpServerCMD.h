@@ -20,8 +20,16 @@ public:
     virtual ~XFtpServerCMD();
 
     XThread* thread = nullptr;                            // 命令服务器线程
+    bool admitted = false;                                // 已计入准入控制的连接数，销毁时释放
+
+    // 口令校验进行中时暂停处理后续命令（已收到的留在缓冲区），校验完成后由 XFtpPASS 恢复
+    bool authPending = false;
+    // 摘要计算进行中时同样暂停，应答按命令顺序发出；计算完成后由 XFtpHASH 恢复
+    bool hashPending = false;
+    void ProcessCommands();
 
 private:
+    static bool AllowedBeforeLogin(const std::string &type);
     std::map<std::string, XFtpTask*> calls_map;  // 命令注册表
     // std::map<XFtpTask*, int> callsDel_map;    // 任务删除标记表
     std::string read_buffer; // 新增：用于累积未处理完的数据
@@ -1,4 +1,15 @@
 #include "XFtpTask.h"
+#include "XMetrics.h"
+#include "XWatchdog.h"
+#include "XXferLog.h"
+#include "XConfig.h"
+#include "XPasvPool.h"
+#include "XNetAddr.h"
+#include "XDataPool.h"
+#include "XZStream.h"
+#include "XFtpMODE.h"
+#include "XFtpServerCMD.h"
+#include "XThread.h"
 #include "testUtil.h"
 
 #include <event2/event.h>       // libevent基础事件处理：提供事件循环、基本事件（信号、定时器、文件描述符事件）管理
@@ -14,9 +25,178 @@ extern SSL_CTX *ssl_ctx;               // 声明外部SSL上下文变量
 #endif
 
 #include <iostream>
+#include <string_view>
 #include <string.h>
 using namespace std;
 
+
+// 传输相关指标，按方向区分
+struct XFtpTransferMetrics{
+    int active[XFTP_XFER_DIRS];
+    int bytes[XFTP_XFER_DIRS];
+    int completed[XFTP_XFER_DIRS];
+    int aborted[XFTP_XFER_DIRS];
+    int duration[XFTP_XFER_DIRS];
+    int size[XFTP_XFER_DIRS];
+
+    XFtpTransferMetrics(){
+        static const char *dirs[] = {"dir=\"retr\"", "dir=\"stor\"", "dir=\"list\""};
+        XMetrics *m = XMetrics::Get();
+        for(int d = 0; d < XFTP_XFER_DIRS; d++){
+            active[d] = m->Register(XMETRIC_GAUGE, "ftp_transfers_active", "Data transfers in progress", dirs[d]);
+            bytes[d] = m->Register(XMETRIC_COUNTER, "ftp_transfer_bytes_total", "Bytes moved over data connections", dirs[d]);
+            completed[d] = m->Register(XMETRIC_COUNTER, "ftp_transfers_completed_total", "Transfers finished with 226", dirs[d]);
+            aborted[d] = m->Register(XMETRIC_COUNTER, "ftp_transfers_aborted_total", "Transfers closed before completion", dirs[d]);
+            duration[d] = m->Register(XMETRIC_HISTOGRAM, "ftp_transfer_duration_us", "Transfer duration in microseconds", dirs[d]);
+            size[d] = m->Register(XMETRIC_HISTOGRAM, "ftp_transfer_size_bytes", "Bytes per transfer", dirs[d]);
+        }
+    }
+};
+
+static XFtpTransferMetrics &TransferMetrics(){
+    static XFtpTransferMetrics m;
+    return m;
+}
+
+// 各类超时（毫秒），0 表示不超时；首次使用时读取配置
+static const uint64_t *Timeouts(){
+    static uint64_t ms[XFTP_TIMEOUT_CLASSES] = {
+        (uint64_t)XConfig::Get()->GetInt("idle_timeout", 300) * 1000,
+        (uint64_t)XConfig::Get()->GetInt("connect_timeout", 30) * 1000,
+        (uint64_t)XConfig::Get()->GetInt("transfer_timeout", 300) * 1000,
+        (uint64_t)XConfig::Get()->GetInt("list_timeout", 60) * 1000,
+    };
+    return ms;
+}
+
+static XMetricFamily timeouts_total(XMETRIC_COUNTER, "ftp_timeouts_total", "Connections closed by a timeout", "class");
+
+static XMetricFamily z_bytes(XMETRIC_COUNTER, "ftp_mode_z_bytes_total",
+                            "MODE Z bytes on the file side (raw) and on the data connection (wire)", "side");
+
+static int BufferedMetric(){
+    static int id = XMetrics::Get()->Register(XMETRIC_GAUGE, "ftp_data_buffered_bytes",
+                                              "Bytes queued in data connection output buffers");
+    return id;
+}
+
+
+void XFtpTask::OutputCB(evbuffer *, const evbuffer_cb_info *info, void *){
+    int64_t delta = (int64_t)info->n_added - (int64_t)info->n_deleted;
+    if(delta != 0) XMetrics::Add(BufferedMetric(), delta);
+}
+
+
+void XFtpTask::WatchOutput(){
+    if(!bev || out_cb) return;
+    out_cb = evbuffer_add_cb(bufferevent_get_output(bev), OutputCB, nullptr);
+}
+
+
+void XFtpTask::UnwatchOutput(){
+    if(!bev || !out_cb) return;
+    evbuffer *output = bufferevent_get_output(bev);
+    evbuffer_remove_cb_entry(output, out_cb);
+    out_cb = nullptr;
+    // 释放时仍在缓冲区中的数据不会再触发回调，在这里扣除
+    XMetrics::Add(BufferedMetric(), -(int64_t)evbuffer_get_length(output));
+}
+
+
+void XFtpTask::BeginTransfer(XFtpTransferDir dir, const string &path, const char *cmd){
+    if(xfer_dir >= 0) EndTransfer(false);
+    xfer_dir = dir;
+    xfer_path = path;
+    xfer_cmd = cmd;
+    xfer_start_us = XMetrics::NowUs();
+    xfer_bytes = 0;
+    XMetrics::Add(TransferMetrics().active[dir], 1);
+}
+
+
+void XFtpTask::TransferBytes(size_t n){
+    if(xfer_dir < 0) return;
+    xfer_bytes += n;
+    XMetrics::Add(TransferMetrics().bytes[xfer_dir], n);
+}
+
+
+void XFtpTask::EndTransfer(bool ok, int code){
+    if(xfer_dir < 0) return;
+    XFtpTransferMetrics &m = TransferMetrics();
+    uint64_t duration = XMetrics::NowUs() - xfer_start_us;
+    XMetrics::Add(m.active[xfer_dir], -1);
+    XMetrics::Add(ok ? m.completed[xfer_dir] : m.aborted[xfer_dir], 1);
+    XMetrics::Observe(m.duration[xfer_dir], duration);
+    XMetrics::Observe(m.size[xfer_dir], xfer_bytes);
+
+    if(XXferLog::Enabled()){
+        static const char *cmds[] = {"RETR", "STOR", "LIST"};
+        static const char dirs[] = {'o', 'i', 0};
+        XXferRecord r;
+        r.cmd = xfer_cmd ? xfer_cmd : cmds[xfer_dir];
+        r.direction = dirs[xfer_dir];
+        r.path = &xfer_path;
+        r.bytes = xfer_bytes;
+        r.duration_us = duration;
+        r.code = code ? code : (ok ? 226 : 426);
+        if(cmdTask){
+            r.session = cmdTask->sessionId;
+            r.user = &cmdTask->user;
+            r.peer = &cmdTask->peer;
+            r.tls = cmdTask->use_ssl;
+        }
+        XXferLog::Get()->Record(r);
+    }
+    xfer_dir = -1;
+}
+
+
+void XFtpTask::ArmTimeout(XFtpTimeoutClass c){
+    timeout_class = c;
+    timer.fn = TimeoutCB;
+    timer.arg = this;
+    uint64_t ms = Timeouts()[c];
+    XTimerWheel *wheel = XTimerWheel::Current();
+    if(!ms || !wheel){
+        XTimerWheel::Cancel(&timer);
+        return;
+    }
+    wheel->Arm(&timer, ms);
+}
+
+
+void XFtpTask::TouchTimeout(){
+    if(!timer.Armed()) return;
+    timer.wheel->Arm(&timer, Timeouts()[timeout_class]);
+}
+
+
+void XFtpTask::CancelTimeout(){
+    XTimerWheel::Cancel(&timer);
+    timeout_class = -1;
+}
+
+
+void XFtpTask::TimeoutCB(void *arg){
+    static const char *classes[] = {"idle", "connect", "transfer", "list"};
+    XFtpTask *t = (XFtpTask *)arg;
+    XCallbackScope scope(t->cmdTask ? t->cmdTask->sessionId : 0, "Timeout", &typeid(*t));
+    XMetrics::Add(timeouts_total.Id(classes[t->timeout_class]), 1);
+    short what = BEV_EVENT_TIMEOUT | (t->timeout_class == XFTP_TIMEOUT_IDLE ? BEV_EVENT_READING : 0);
+    t->timeout_class = -1;
+    if(t->bev){
+        t->Event(t->bev, what);
+    }
+    else if(t->cmdTask && t->cmdTask->pasvWaiting == t){
+        // 被动模式下客户端一直没有连入
+        t->ResCMD("425 Can't open data connection.\r\n");
+        t->EndTransfer(false, 425);
+        t->ClosePORT();
+    }
+}
+
+
 void XFtpTask::ResCMD(string msg){
 	if(!cmdTask || !cmdTask->bev){
         Logger::error("XFtpTaskResCMD(): cmdTask or cmdTask->bev is null");
@@ -26,7 +206,7 @@ void XFtpTask::ResCMD(string msg){
 		msg += "\r\n";
 	}
 	bufferevent_write(cmdTask->bev, msg.c_str(), msg.size());
-    Logger::info("XFtpTaskResCMD(): Send Response: ", msg.substr(0, msg.size() - 2));
+    Logger::info("XFtpTaskResCMD(): Send Response: ", std::string_view(msg).substr(0, msg.size() - 2));
 }
 
 void XFtpTask::Setcb(bufferevent *bev){
@@ -34,76 +214,125 @@ void XFtpTask::Setcb(bufferevent *bev){
     bufferevent_enable(bev, EV_READ | EV_WRITE);
 }
 
+// 数据连接是否走 TLS（PROT P 之后与控制连接相同）
+static bool DataTLS(XFtpTask *cmd){
+    #ifndef OPENSSL_NO_SSL_INCLUDES
+        return cmd->use_ssl && cmd->ssl;
+    #else
+        return false;
+    #endif
+}
+
+
+bufferevent *XFtpTask::NewDataBev(evutil_socket_t fd){
+    XDataPool *pool = XDataPool::Current();
+    if(!pool){
+        Logger::error("XFtpTask::NewDataBev() -> not on a worker thread");
+        return nullptr;
+    }
+    data_connected = false;
+    return pool->Acquire(fd, DataTLS(cmdTask));
+}
+
+
+void XFtpTask::FreeDataBev(){
+    if(!bev) return;
+    UnwatchOutput();
+    XRateLimit::Get()->Detach(rate_slot);
+    XDataPool *pool = XDataPool::Current();
+    if(pool) pool->Release(bev, data_connected);
+    else bufferevent_free(bev);
+    bev = nullptr;
+    data_connected = false;
+}
+
+
+void XFtpTask::StartData(){
+    Setcb(bev);
+    WatchOutput();
+    // 文件传输接入带宽整形（目录列表不限速）
+    if(xfer_dir == XFTP_XFER_RETR || xfer_dir == XFTP_XFER_STOR){
+        XRateLimit::Get()->Attach(rate_slot, bev, cmdTask->user);
+    }
+    ArmTimeout(XFTP_TIMEOUT_CONNECT);
+}
+
+
 void XFtpTask::ConnectoPORT(){
-    cout << endl;
     Logger::info("XFtpTask::ConnectoPORT()");
-    if(cmdTask->ip.empty() || cmdTask->port <= 0 || !cmdTask->base){
-        Logger::error("XFtpTask::ConnectoPORT() cmdTask no ready");
+    FreeDataBev();
+
+    if(!StartZ()){
+        ResCMD("451 Cannot initialize compression.\r\n");
+        EndTransfer(false, 451);
+        ClosePORT();
         return;
     }
-    if(bev){
-        bufferevent_free(bev);
-        bev = nullptr;
-    }
 
-    #ifndef OPENSSL_NO_SSL_INCLUDES
-        if(cmdTask->use_ssl && cmdTask->ssl){
-            // 为数据连接创建 SSL 对象
-            Logger::info("XFtpTask::ConnectoPORT() -> Creating SSL for data connection");
-            SSL *data_ssl = SSL_new(ssl_ctx);  // 需要访问全局 ssl_ctx
-            if(!data_ssl){
-                Logger::error("XFtpTask::ConnectoPORT() -> SSL_new failed for data connection");
+    if(cmdTask->passive){
+        // 被动模式：客户端可能先连入（连接暂存在 pasvFd），也可能在传输命令之后才连入
+        if(cmdTask->pasvFd < 0){
+            if(!cmdTask->pasvPort){
+                ResCMD("425 Use PORT or PASV first.\r\n");
+                EndTransfer(false, 425);
+                ClosePORT();
                 return;
             }
+            Logger::debug("XFtpTask::ConnectoPORT() -> waiting for passive connection on port ", cmdTask->pasvPort->port);
+            cmdTask->pasvWaiting = this;
+            ArmTimeout(XFTP_TIMEOUT_CONNECT);
+            return;
+        }
 
-        // 关键修改：设置为服务器模式（即使我们是TCP连接的发起方）
-        // 在FTP over TLS的PORT模式中，数据连接的SSL角色与控制连接相同
-        SSL_set_accept_state(data_ssl);  // 改为accept，而不是connect
-        Logger::info("XFtpTask::ConnectoPORT() -> SSL configured as server for data connection");
-
-            Logger::info("XFtpTask::ConnectoPORT() -> Start bev openssl socket new");
-            bev = bufferevent_openssl_socket_new(
-                cmdTask->base,
-                -1,  // 自动创建 socket
-                data_ssl,
-                BUFFEREVENT_SSL_ACCEPTING,  // ✅ 改为ACCEPTING状态
-                BEV_OPT_CLOSE_ON_FREE
-            );
-        } else {
-            bev = bufferevent_socket_new(cmdTask->base, -1, BEV_OPT_CLOSE_ON_FREE);
+        evutil_socket_t fd = cmdTask->pasvFd;
+        cmdTask->pasvFd = -1;
+        bev = NewDataBev(fd);
+        if(!bev){
+            Logger::error("XFtpTask::ConnectoPORT() -> bufferevent for passive connection failed");
+            evutil_closesocket(fd);
+            ResCMD("425 Can't open data connection.\r\n");
+            EndTransfer(false, 425);
+            ClosePORT();
+            return;
         }
-    #else
-        bev = bufferevent_socket_new(cmdTask->base, -1, BEV_OPT_CLOSE_ON_FREE);
-    #endif
+        StartData();
+        // 连接已建立：明文连接补发 CONNECTED，走与 PORT 模式相同的开始传输路径；TLS 连接在握手完成后由 libevent 发出
+        if(!DataTLS(cmdTask)){
+            bufferevent_trigger_event(bev, BEV_EVENT_CONNECTED, BEV_TRIG_DEFER_CALLBACKS);
+        }
+        return;
+    }
 
+    if(!cmdTask->dataAddrLen || !cmdTask->base){
+        Logger::error("XFtpTask::ConnectoPORT() cmdTask no ready");
+        ResCMD("425 Use PORT or PASV first.\r\n");
+        EndTransfer(false, 425);
+        ClosePORT();
+        return;
+    }
+
+    bev = NewDataBev(-1);
     if(!bev){
         Logger::error("XFtpTask::ConnectoPORT() -> bufferevent_socket_new error");
+        ResCMD("425 Can't open data connection.\r\n");
+        EndTransfer(false, 425);
+        ClosePORT();
         return;
     }else{
         Logger::info("XFtpTask::ConnectoPORT() -> bufferevent_socket_new success");
     }
 
-    sockaddr_in sin;
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_port = htons(cmdTask->port);
-    evutil_inet_pton(AF_INET, cmdTask->ip.c_str(), &sin.sin_addr);
-    Logger::debug("XFtpTask::ConnectoPORT() ip: ", cmdTask->ip, " port: ", cmdTask->port);
+    StartData();
 
-    Setcb(bev); 
-
-    timeval connect_phase_timeout = {30, 0};
-    bufferevent_set_timeouts(bev, &connect_phase_timeout, &connect_phase_timeout);
-
-    if(bufferevent_socket_connect(bev, (sockaddr*)&sin, sizeof(sin)) == -1){
+    if(bufferevent_socket_connect(bev, (sockaddr*)&cmdTask->dataAddr, cmdTask->dataAddrLen) == -1){
         int err = evutil_socket_geterror(bufferevent_getfd(bev));
         // EINPROGRESS 是正常的，非阻塞连接会立即返回这个
         if (err != EINPROGRESS && err != EWOULDBLOCK) {
             Logger::error("XFtpTask::ConnectoPORT() -> Connection failed: ", 
                          evutil_socket_error_to_string(err));
-            bufferevent_free(bev);
-            bev = nullptr;
             ResCMD("425 Can't build data connection.\r\n");
+            EndTransfer(false, 425);
+            ClosePORT();
         } else {
             Logger::info("XFtpTask::ConnectoPORT() -> Connection in progress (EINPROGRESS), waiting...");
         }
@@ -113,10 +342,79 @@ void XFtpTask::ConnectoPORT(){
 }
 
 
+static bool PasvPromiscuous(){
+    static bool on = XConfig::Get()->GetBool("pasv_promiscuous", false);
+    return on;
+}
+
+static int PasvRejectedMetric(){
+    static int id = XMetrics::Get()->Register(XMETRIC_COUNTER, "ftp_pasv_rejected_total",
+                                              "Passive data connections from an address other than the control connection's");
+    return id;
+}
+
+
+void XFtpTask::PasvAccept(evutil_socket_t fd, sockaddr *addr){
+    XCallbackScope scope(sessionId, "PasvAccept", &typeid(*this));
+    sockaddr_storage from;
+    XNetAddr::Normalize(addr, &from);
+    // 只接受控制连接对端的连接，防止别人抢占端口窃取数据（FTP bounce / 端口抢占）
+    if(!PasvPromiscuous() && !XNetAddr::SameHost((sockaddr *)&from, (sockaddr *)&peerAddr)){
+        Logger::warning("XFtpTask::PasvAccept() -> session ", sessionId, ": data connection from ",
+                        XNetAddr::Host((sockaddr *)&from), " does not match control connection ", peer, ", rejected");
+        XMetrics::Add(PasvRejectedMetric(), 1);
+        evutil_closesocket(fd);
+        return;
+    }
+
+    XPasvPool *pool = XPasvPool::Current();
+    if(pool) pool->Release(pasvPort);
+    pasvPort = nullptr;
+    if(pasvFd >= 0) evutil_closesocket(pasvFd);
+    pasvFd = fd;
+    Logger::debug("XFtpTask::PasvAccept() -> session ", sessionId, ": passive connection from ", XNetAddr::Host((sockaddr *)&from));
+
+    if(pasvWaiting){
+        XFtpTask *t = pasvWaiting;
+        pasvWaiting = nullptr;
+        t->ConnectoPORT();
+    }
+}
+
+
+void XFtpTask::ReleasePasv(){
+    XPasvPool *pool = XPasvPool::Current();
+    if(pool) pool->Release(pasvPort);
+    pasvPort = nullptr;
+    if(pasvFd >= 0) evutil_closesocket(pasvFd);
+    pasvFd = -1;
+}
+
+
 void XFtpTask::ClosePORT(){
 
     // 清理所有待处理事件
     ClearPendingEvents();
+    CancelTimeout();
+    EndTransfer(false);
+    if(z_active){
+        z_active = false;
+        XMetrics::Add(z_bytes.Id("raw"), zstream->RawBytes());
+        XMetrics::Add(z_bytes.Id("wire"), zstream->WireBytes());
+    }
+
+    if(cmdTask == this){
+        // 控制连接关闭：还在等被动连接的传输一并结束
+        if(pasvWaiting){
+            XFtpTask *t = pasvWaiting;
+            pasvWaiting = nullptr;
+            t->ClosePORT();
+        }
+        ReleasePasv();
+    }
+    else if(cmdTask && cmdTask->pasvWaiting == this){
+        cmdTask->pasvWaiting = nullptr;
+    }
     
     if(bev){
         // 对于上传，需要确保所有数据都已处理
@@ -129,8 +427,14 @@ void XFtpTask::ClosePORT(){
             }
         }
         
-        bufferevent_free(bev);
-        bev = nullptr;
+        if(cmdTask == this){
+            // 控制连接
+            bufferevent_free(bev);
+            bev = nullptr;
+        }
+        else{
+            FreeDataBev();
+        }
     }
     
     if (fp){
@@ -145,13 +449,7 @@ void XFtpTask::ClosePORT(){
 }
 
 
-int XFtpTask::Send(const char* data, size_t datasize){
-    if(datasize == 0) return 0;
-    if(!bev){
-        Logger::error("XFtpTask::Send() bev is null");
-        return -2;
-    }
-
+bool XFtpTask::DataReady(){
     #ifndef OPENSSL_NO_SSL_INCLUDES
         // 检查是否需要 SSL 握手
         if(cmdTask && cmdTask->use_ssl){
@@ -160,12 +458,23 @@ int XFtpTask::Send(const char* data, size_t datasize){
                 // SSL 连接已建立，可以发送数据
             } else {
                 Logger::debug("XFtpTask::Send() -> SSL not ready, waiting for handshake");
-                return 0;
+                return false;
             }
         }
     #endif
+    return true;
+}
 
 
+int XFtpTask::Send(const char* data, size_t datasize){
+    if(datasize == 0) return 0;
+    if(!bev){
+        Logger::error("XFtpTask::Send() bev is null");
+        return -2;
+    }
+    if(!DataReady()) return 0;
+    if(z_active) return ZSend(data, datasize);
+
     int result = bufferevent_write(bev, data, datasize);
     if(result == -1){
         // 发送失败
@@ -184,28 +493,126 @@ int XFtpTask::Send(const string &data){
 }
 
 
+int XFtpTask::Send(std::shared_ptr<const string> data){
+    if(!data || data->empty()) return 0;
+    if(!bev){
+        Logger::error("XFtpTask::Send() bev is null");
+        return -2;
+    }
+    if(!DataReady()) return 0;
+    // 压缩时输出是新数据，不能引用原缓冲区
+    if(z_active) return ZSend(data->data(), data->size());
+
+    // 引用计数随evbuffer一起持有，数据发送完毕后在清理回调中释放
+    auto *hold = new std::shared_ptr<const string>(data);
+    evbuffer_ref_cleanup_cb cleanup = [](const void *, size_t, void *arg){
+        delete (std::shared_ptr<const string> *)arg;
+    };
+    int result = evbuffer_add_reference(bufferevent_get_output(bev), data->data(), data->size(), cleanup, hold);
+    if(result == -1){
+        delete hold;
+        Logger::error("XFtpTask::Send() evbuffer_add_reference error");
+        ResCMD("426 Connection closed; transfer aborted.");
+        ClosePORT();
+    }
+    return result;
+}
+
+
+bool XFtpTask::StartZ(){
+    z_active = false;
+    bool skip = z_skip;
+    z_skip = false;
+    if(skip || !cmdTask || !cmdTask->modeZ) return true;
+    if(!zstream) zstream = new XZStream();
+    // 上传解压，其余（下载、目录列表）压缩
+    int level = cmdTask->zLevel >= 0 ? cmdTask->zLevel : XFtpMODE::DefaultLevel();
+    if(!zstream->Init(cmdTask->zEngine, xfer_dir != XFTP_XFER_STOR, level)){
+        Logger::error("XFtpTask::StartZ() -> cannot initialize ", XZStream::EngineName(cmdTask->zEngine));
+        return false;
+    }
+    z_active = true;
+    return true;
+}
+
+
+int XFtpTask::ZSend(const char *data, size_t datasize){
+    evbuffer *output = bufferevent_get_output(bev);
+    size_t before = evbuffer_get_length(output);
+    XThread *thread = static_cast<XFtpServerCMD*>(cmdTask)->thread;
+    bool ok = zstream->Write(data, datasize, [output](const char *p, size_t n){
+        return evbuffer_add(output, p, n) == 0;
+    }, thread ? thread->LoopLagUs() : 0);
+    if(!ok){
+        Logger::error("XFtpTask::ZSend() -> compression failed");
+        ResCMD("426 Connection closed; transfer aborted.\r\n");
+        ClosePORT();
+        return -1;
+    }
+    // 压缩器把数据留在内部、没有产生输出时不会有写回调，补一次让发送方继续
+    if(evbuffer_get_length(output) == before){
+        bufferevent_trigger(bev, EV_WRITE, BEV_TRIG_DEFER_CALLBACKS);
+    }
+    return 0;
+}
+
+
+bool XFtpTask::FinishSend(){
+    if(!z_active || !bev || !zstream->Compressing() || zstream->Finished()) return false;
+    evbuffer *output = bufferevent_get_output(bev);
+    if(!zstream->Finish([output](const char *p, size_t n){ return evbuffer_add(output, p, n) == 0; })){
+        Logger::error("XFtpTask::FinishSend() -> compression failed");
+        ResCMD("426 Connection closed; transfer aborted.\r\n");
+        ClosePORT();
+    }
+    return true;
+}
+
+
+XZStream *XFtpTask::Inflater(){
+    return (z_active && !zstream->Compressing()) ? zstream : nullptr;
+}
+
+
 void XFtpTask::EventCB(bufferevent *bev, short events, void *arg){
     XFtpTask *t = (XFtpTask*)arg;
+    XCallbackScope scope(t->cmdTask ? t->cmdTask->sessionId : 0, "Event", &typeid(*t));
+    // 数据连接建立后从连接超时切换到传输超时
+    if((events & BEV_EVENT_CONNECTED) && !(events & BEV_EVENT_ERROR) && t->cmdTask != t){
+        t->data_connected = true;
+    }
+    if((events & BEV_EVENT_CONNECTED) && t->cmdTask != t && t->timeout_class == XFTP_TIMEOUT_CONNECT){
+        t->ArmTimeout(t->xfer_dir == XFTP_XFER_LIST ? XFTP_TIMEOUT_LIST : XFTP_TIMEOUT_TRANSFER);
+    }
     t->Event(bev, events);
 }
 
 void XFtpTask::ReadCB(bufferevent *bev, void *arg){
     XFtpTask *t = (XFtpTask*)arg;
+    XCallbackScope scope(t->cmdTask ? t->cmdTask->sessionId : 0, "Read", &typeid(*t));
+    // 有活动就重新计时；数据连接上的活动同时让控制连接保持不空闲
+    t->TouchTimeout();
+    if(t->cmdTask && t->cmdTask != t) t->cmdTask->TouchTimeout();
     t->Read(bev);
 }
 
 void XFtpTask::WriteCB(bufferevent *bev, void *arg){
     XFtpTask *t = (XFtpTask*)arg;
+    XCallbackScope scope(t->cmdTask ? t->cmdTask->sessionId : 0, "Write", &typeid(*t));
+    t->TouchTimeout();
+    if(t->cmdTask && t->cmdTask != t) t->cmdTask->TouchTimeout();
     t->Write(bev);
 }
 
 
 XFtpTask::~XFtpTask(){
     ClosePORT();
+    delete zstream;
 }
 
 void XFtpTask::Event(bufferevent* bev, short events) {
-    Logger::debug("XFtpLIST::Event() events: " + std::to_string(events));
+    Logger::debug("XFtpTask::Event() events: ", events);
+    if(cmdTask) Logger::trace(XTRACE_DATA_EVENT, cmdTask->sessionId, events);
     // 检查是否是连接建立和错误同时发生
     if ((events & BEV_EVENT_CONNECTED) && (events & BEV_EVENT_ERROR)) {
         Logger::info("XFtpLIST::Event() -> CONNECTED+ERROR (likely SSL handshake in progress)");
@@ -236,7 +643,7 @@ void XFtpTask::Event(bufferevent* bev, short events) {
                     while ((ssl_err = ERR_get_error()) != 0) {
                         char err_buf[256];
                         ERR_error_string_n(ssl_err, err_buf, sizeof(err_buf));
-                        Logger::error("SSL Error: " + std::string(err_buf));
+                        Logger::error("SSL Error: ", err_buf);
                     }
                 }
             }
@@ -249,7 +656,7 @@ void XFtpTask::Event(bufferevent* bev, short events) {
         // 获取错误信息
         int err = EVUTIL_SOCKET_ERROR();
         std::string err_str = evutil_socket_error_to_string(err);
-        Logger::error("XFtpLIST::Event() -> Socket error: " + err_str);
+        Logger::error("XFtpLIST::Event() -> Socket error: ", err_str);
         
         // 关键修正：正确检查 EINPROGRESS
         // 比较错误码
@@ -1,22 +1,87 @@
 #pragma once
 #include <event2/bufferevent.h>
 #include "XTask.h"
+#include "XTimerWheel.h"
+#include "XRateLimit.h"
+#include "XPasvPool.h"
+#include "XVfs.h"
 #include <string>
 #include <vector>
+#include <memory>
 #include <sys/types.h>          // for off_t
+#include <sys/socket.h>         // for sockaddr_storage
+#include <stdint.h>
 using namespace std;
 
+// 传输方向，用于传输统计
+enum XFtpTransferDir{
+    XFTP_XFER_RETR = 0,
+    XFTP_XFER_STOR,
+    XFTP_XFER_LIST,
+    XFTP_XFER_DIRS
+};
+
+// 超时类别，各自的时长在配置文件中设置（见 XFtpTask.cpp 中的 Timeouts()）
+enum XFtpTimeoutClass{
+    XFTP_TIMEOUT_IDLE = 0,      // 控制连接等待下一条命令（idle_timeout）
+    XFTP_TIMEOUT_CONNECT,       // 数据连接建立（connect_timeout）
+    XFTP_TIMEOUT_TRANSFER,      // RETR/STOR 数据无进展（transfer_timeout）
+    XFTP_TIMEOUT_LIST,          // 目录列表发送无进展（list_timeout）
+    XFTP_TIMEOUT_CLASSES
+};
+
+// 文件摘要算法（HASH / XCRC / XMD5 / XSHA*，名字见 XFtpHASH.cpp）
+enum XHashAlgo{
+    XHASH_CRC32 = 0,
+    XHASH_MD5,
+    XHASH_SHA1,
+    XHASH_SHA256,
+    XHASH_SHA512,
+    XHASH_ALGOS
+};
+
+// MODE Z 压缩算法（OPTS MODE Z ENGINE 选择，名字见 XZStream.cpp）
+enum XZEngine{
+    XZ_DEFLATE = 0,
+    XZ_ZSTD,
+    XZ_ENGINES
+};
+
+// MLSD/MLST 默认输出的事实：type;size;modify;perm;unique;UNIX.mode;
+#define XFTP_MLST_DEFAULT_FACTS 0x3f
+
 struct bufferevent;
+class XZStream;
 
 class XFtpTask : public XTask
 {
 public:
     // FTP会话状态信息
-    string curDir = "Desktop/";             // 当前工作目录（客户端所在目录）
-    string rootDir = "/Users/ccy/";            // 根目录（限制用户访问的文件系统范围）
-    string ip = "";                  // 客户端IP地址（用于数据连接）
-    int port = 0;                    // 数据连接端口号（PORT模式使用）
+    string curDir = "/";             // 当前工作目录（虚拟路径，客户端所在目录）
+    string rootDir = "";             // 根目录（限制用户访问的文件系统范围，登录时由 XFtpPASS 设置）
+    XVfs vfs;                        // 根目录与当前目录的 fd 及路径解析缓存（登录时设置根目录，只在控制连接上使用）
+    sockaddr_storage dataAddr = {};  // PORT/EPRT 指定的数据连接地址（解析一次，连接时直接使用）
+    socklen_t dataAddrLen = 0;       // dataAddr 的长度，0 表示未设置
+    unsigned int mlstFacts = XFTP_MLST_DEFAULT_FACTS;   // MLSD/MLST 输出的事实集合（OPTS MLST 设置，位定义见 XFtpLIST）
+    int hashAlgo = XHASH_SHA256;     // HASH 命令使用的算法（OPTS HASH 设置）
+    bool modeZ = false;              // MODE Z：数据连接上的内容经过压缩
+    int zEngine = XZ_DEFLATE;        // MODE Z 的压缩算法（OPTS MODE Z ENGINE 设置）
+    int zLevel = -1;                 // MODE Z 的压缩级别，0 表示自适应，-1 表示用 mode_z_level（OPTS MODE Z LEVEL 设置）
     XFtpTask *cmdTask = nullptr;     // 指向控制连接的FTP任务对象（用于响应命令）
+    string user = "";                // 登录用户名（USER 命令设置，用于传输日志）
+    bool loggedIn = false;           // PASS 校验通过（登录前只接受 USER/PASS/AUTH 等少数命令）
+    string peer = "";                // 控制连接对端地址（用于传输日志）
+    sockaddr_storage peerAddr = {};  // 控制连接对端地址（v4-mapped 已还原为 IPv4，PASV 对端检查用）
+    uint32_t sessionId = 0;          // 会话编号（控制连接创建时分配，用于日志与跟踪记录）
+    uint64_t tlsStartUs = 0;         // 控制连接 TLS 握手开始时间（XMetrics::NowUs），0 表示未在握手
+
+    // 被动模式（PASV/EPSV）状态，只在控制连接上使用
+    bool passive = false;            // 数据连接由客户端连入
+    bool epsvAll = false;            // 收到 EPSV ALL 后拒绝 PORT/PASV
+    XPasvPort *pasvPort = nullptr;   // 占用的被动端口，客户端连入后归还
+    evutil_socket_t pasvFd = -1;     // 已连入、尚未被传输命令取走的数据连接
+    XFtpTask *pasvWaiting = nullptr; // 已收到传输命令、在等客户端连入的数据任务
+    string localIp = "";             // 控制连接的本端地址（PASV 应答用，首次使用时获取）
 
     // 解析FTP命令（纯虚函数，子类需实现具体命令解析）
     // 参数：cmd-命令字，param-命令参数
@@ -33,8 +98,18 @@ public:
     // 建立PORT模式数据连接（客户端监听，服务器主动连接）
     void ConnectoPORT();
 
-    // 关闭数据连接和释放相关资源
-    void ClosePORT();
+    // 被动端口上接受到连接（XPasvPool 调用，控制连接上执行）
+    void PasvAccept(evutil_socket_t fd, sockaddr *addr);
+
+    // 归还被动端口并关闭尚未使用的数据连接（控制连接上执行）
+    void ReleasePasv();
+
+    // 关闭数据连接和释放相关资源（子类可覆盖以取消进行中的后台任务）
+    virtual void ClosePORT();
+
+    // 会话关闭（控制连接断开，会话随后释放）：子类在这里让进行中的后台任务不再回到这个会话。
+    // 与 ClosePORT 不同，ClosePORT 在每次传输结束时都会调用，那时后台任务的结果还要应答
+    virtual void Detach() {}
 
     // 通过数据连接发送数据（字符串版本）
     // 参数：data-要发送的字符串数据
@@ -44,6 +119,10 @@ public:
     // 参数：data-数据指针，datasize-数据大小
     int Send(const char *data, size_t datasize);
 
+    // 通过数据连接发送共享数据（零拷贝版本，以evbuffer引用方式追加，发送完成前保持data存活）
+    // 参数：data-要发送的共享字符串（如目录列表缓存）
+    int Send(std::shared_ptr<const string> data);
+
     // 事件回调虚函数（子类可覆盖处理特定事件）
     // 参数：bev-触发事件的bufferevent，what-事件类型
     virtual void Event(bufferevent *bev, short what);
@@ -83,12 +162,64 @@ public:
     // 断点续传偏移量
     off_t transferOffset = 0;  // 当前传输的偏移量
     off_t fileOffset = 0;      // 文件内的偏移量（用于续传）
+    off_t rangeEnd = -1;       // RANG 指定的结束位置（不含），-1 表示到文件末尾；只作用于下一次传输
     
     // 设置和获取偏移量的方法
     void SetFileOffset(off_t offset) { fileOffset = offset; }
     off_t GetFileOffset() const { return fileOffset; }
+    void SetRangeEnd(off_t end) { rangeEnd = end; }
+    off_t GetRangeEnd() const { return rangeEnd; }
+
+    // ALLO 声明的大小，-1 表示未声明；只作用于下一次 STOR / APPE / STOU
+    off_t allocSize = -1;
+    void SetAllocSize(off_t size) { allocSize = size; }
+    off_t GetAllocSize() const { return allocSize; }
 
 protected:
+    // 为数据连接取一个 bufferevent（工作线程的 XDataPool）：fd 为 -1 时由 bufferevent_socket_connect 连接（PORT），否则包装已接受的连接（PASV）
+    bufferevent *NewDataBev(evutil_socket_t fd);
+
+    // 归还数据连接的 bufferevent（已建立过连接的对象回收复用）
+    void FreeDataBev();
+
+    // 数据连接 bufferevent 创建之后：设置回调、统计、带宽整形与连接超时
+    void StartData();
+
+    // 检查数据连接是否可以写入（SSL连接需等待握手完成）
+    bool DataReady();
+
+    // 数据连接是否已建立过（TLS 为握手完成）；为 false 时出错说明连接本身没有建起来，应答 425
+    bool DataConnected() const { return data_connected; }
+
+    // MODE Z：发送结束时写出压缩流结尾。返回 true 时调用方应先返回，等输出缓冲区清空后再应答 226
+    // （追加了流结尾，或者出错已关闭连接）；未压缩或已写过结尾时返回 false
+    bool FinishSend();
+
+    // MODE Z 上传时的解压器（本次传输未启用压缩时为 nullptr）
+    XZStream *Inflater();
+
+    // 本次传输的数据已经是压缩流（预压缩版本），ConnectoPORT 时不再启用 zstream
+    void SkipZ() { z_skip = true; }
+
+    // 传输统计：开始一次传输、累计字节、结束（ok=false 表示中断；ClosePORT 时未结束的传输按中断计）
+    // 结束时写一条传输日志；code 为返回给客户端的结果码，0 表示按 ok 取 226/426
+    // cmd 为日志中的命令名（APPE / STOU / MLSD 等），为空时取方向的默认名 RETR / STOR / LIST
+    void BeginTransfer(XFtpTransferDir dir, const string &path, const char *cmd = nullptr);
+    void TransferBytes(size_t n);
+    void EndTransfer(bool ok, int code = 0);
+
+    // 超时（工作线程的时间轮）：启动/切换类别、有活动时重新计时、取消
+    // 到期时以 BEV_EVENT_TIMEOUT 调用 Event()，与原来 bufferevent 超时的处理路径相同
+    void ArmTimeout(XFtpTimeoutClass c);
+    void TouchTimeout();
+    void CancelTimeout();
+    static void TimeoutCB(void *arg);
+
+    // 数据连接输出缓冲区占用统计（evbuffer 回调），释放 bev 前必须调用 UnwatchOutput
+    void WatchOutput();
+    void UnwatchOutput();
+    static void OutputCB(struct evbuffer *buf, const struct evbuffer_cb_info *info, void *arg);
+
     // 静态事件回调函数（libevent C风格回调）
     // 参数：bev-触发事件的bufferevent，what-事件类型，arg-用户数据（指向XFtpTask对象）
     static void EventCB(bufferevent *bev, short what, void *arg);
@@ -103,4 +234,21 @@ protected:
 
     // 文件指针（用于文件上传/下载操作时打开的文件）
     FILE *fp = 0;
+
+private:
+    int xfer_dir = -1;               // 进行中的传输方向，-1 表示无
+    uint64_t xfer_start_us = 0;
+    uint64_t xfer_bytes = 0;
+    string xfer_path;
+    const char *xfer_cmd = nullptr;
+    XTimer timer;
+    int timeout_class = -1;
+    bool data_connected = false;     // 数据连接已建立（TLS 为握手完成），归还时可复用
+    XRateSlot rate_slot;             // RETR/STOR 数据连接的带宽整形
+    XZStream *zstream = nullptr;     // MODE Z 压缩/解压上下文，随处理器复用
+    bool z_active = false;           // 本次传输经过 zstream
+    bool z_skip = false;
+    bool StartZ();
+    int ZSend(const char *data, size_t datasize);
+    struct evbuffer_cb_entry *out_cb = nullptr;
 };
\ No newline at end of file
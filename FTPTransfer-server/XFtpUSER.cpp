@@ -1,19 +1,39 @@
 #include "XFtpUSER.h"
+#include "XFtpServerCMD.h"
 #include "testUtil.h"
 
-void XFtpUSER::Parse(std::string cmd, std::string username){
-    // 1. 验证用户名格式
-    // 2. 检查用户名是否有效
-    // 3. 设置会话状态（等待PASS命令）
+bool XFtpUSER::is_valid_username(const std::string &name){
+    if(name.empty() || name.size() > 64) return false;
+    for(unsigned char c : name){
+        if(c <= ' ' || c == ':' || c == 0x7f) return false;
+    }
+    return true;
+}
+
+void XFtpUSER::Parse(std::string cmd, std::string msg){
+    // 1. 取出用户名（去掉命令字与行尾回车换行）
+    // 2. 检查用户名格式；用户是否存在到 PASS 时才判断，USER 的应答不暴露这一点
+    // 3. 重新 USER 会结束之前的登录，等待 PASS
     // 4. 发送响应：
     //    - 成功："331 User name okay, need password."
     //    - 失败："530 Invalid username."
+    size_t pos = msg.find(' ');
+    std::string name = pos == std::string::npos ? "" : msg.substr(pos + 1);
+    while(!name.empty() && (name.back() == '\r' || name.back() == '\n')) name.pop_back();
 
-    if (is_valid_username(username)){
+    XFtpServerCMD *session = static_cast<XFtpServerCMD*>(cmdTask);
+    if(session->authPending){
+        ResCMD("503 Login in progress.\r\n");
+        return;
+    }
+    session->loggedIn = false;
+    if (is_valid_username(name)){
+        // 记下用户名，用于 PASS 与传输日志
+        session->user = name;
         ResCMD("331 User name okay, need password.\r\n");
     }
     else{
+        session->user = "";
         ResCMD("530 Invalid username.\r\n");
     }
 }
-
@@ -4,5 +4,6 @@
 class XFtpUSER : public XFtpTask{
 public:
     virtual void Parse(std::string, std::string);
-    bool is_valid_username(std::string) {return true;};
-};
\ No newline at end of file
+    // 用户名：1～64 个可打印字符，不含 : 与空白（用户表以 : 分隔）
+    bool is_valid_username(const std::string &name);
+};
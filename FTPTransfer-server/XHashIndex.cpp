@@ -0,0 +1,184 @@
+#include "XHashIndex.h"
+#include "XMetrics.h"
+#include "testUtil.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+#define XHASH_INDEX_MAGIC 0x58484958u      // "XHIX"
+#define XHASH_INDEX_VERSION 1
+#define XHASH_INDEX_PROBE 8                // 线性探测窗口
+
+struct XHashIndexHeader{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint8_t reserved[48];                  // 补齐到 64 字节，条目按缓存行对齐
+};
+
+struct XHashIndexEntry{
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+    uint32_t algo;
+    uint32_t len;                          // 0 表示空槽
+    uint64_t check;                        // 以上字段与摘要的校验和
+    unsigned char digest[64];
+};
+
+static_assert(sizeof(XHashIndexHeader) == 64, "XHashIndexHeader size");
+static_assert(sizeof(XHashIndexEntry) == 112, "XHashIndexEntry size");
+
+
+int64_t XHashIndex::MtimeNs(const struct stat &st){
+    #ifdef __APPLE__
+    return (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+    #else
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    #endif
+}
+
+
+// FNV-1a，只用来识别写了一半的条目
+static uint64_t Check(const XHashIndexEntry &e){
+    uint64_t h = 14695981039346656037ull;
+    const unsigned char *p = (const unsigned char *)&e;
+    size_t n = offsetof(XHashIndexEntry, check);
+    for(size_t i = 0; i < n; i++) h = (h ^ p[i]) * 1099511628211ull;
+    for(uint32_t i = 0; i < e.len && i < sizeof(e.digest); i++) h = (h ^ e.digest[i]) * 1099511628211ull;
+    return h;
+}
+
+
+bool XHashIndex::SameContent(const struct stat &a, const struct stat &b){
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size && MtimeNs(a) == MtimeNs(b);
+}
+
+
+XHashIndex* XHashIndex::Get(){
+    static XHashIndex index;
+    return &index;
+}
+
+
+bool XHashIndex::Open(const string &file, int entries){
+    lock_guard<mutex> lock(index_mutex);
+    if(table || entries <= 0) return false;
+
+    fd = open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if(fd < 0){
+        Logger::error("XHashIndex::Open() -> cannot open ", file, ", ", strerror(errno));
+        return false;
+    }
+    // 两个进程同时写同一个表会互相覆盖，只允许一个
+    if(flock(fd, LOCK_EX | LOCK_NB) != 0){
+        Logger::error("XHashIndex::Open() -> ", file, " is in use by another process");
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    map_size = sizeof(XHashIndexHeader) + (size_t)entries * sizeof(XHashIndexEntry);
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != map_size;
+    if(fresh && (ftruncate(fd, 0) != 0 || ftruncate(fd, map_size) != 0)){
+        Logger::error("XHashIndex::Open() -> cannot size ", file, ", ", strerror(errno));
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    void *p = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED){
+        Logger::error("XHashIndex::Open() -> mmap ", file, " failed, ", strerror(errno));
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    header = (XHashIndexHeader *)p;
+    table = (XHashIndexEntry *)((char *)p + sizeof(XHashIndexHeader));
+    if(header->magic != XHASH_INDEX_MAGIC || header->version != XHASH_INDEX_VERSION ||
+       header->capacity != (uint64_t)entries){
+        memset(p, 0, map_size);
+        header->version = XHASH_INDEX_VERSION;
+        header->capacity = entries;
+        header->magic = XHASH_INDEX_MAGIC;
+        fresh = true;
+    }
+
+    metric_hit = XMetrics::Get()->Register(XMETRIC_COUNTER, "ftp_hash_index_lookups_total",
+                                           "Digest index lookups", "result=\"hit\"");
+    metric_miss = XMetrics::Get()->Register(XMETRIC_COUNTER, "ftp_hash_index_lookups_total",
+                                            "Digest index lookups", "result=\"miss\"");
+    Logger::info("XHashIndex::Open() -> ", file, ", ", entries, " entries", fresh ? " (new)" : "");
+    return true;
+}
+
+
+void XHashIndex::Close(){
+    lock_guard<mutex> lock(index_mutex);
+    if(header) munmap(header, map_size);
+    if(fd >= 0) close(fd);
+    header = nullptr;
+    table = nullptr;
+    fd = -1;
+}
+
+
+XHashIndexEntry *XHashIndex::Slot(uint64_t dev, uint64_t ino, int algo, bool for_store){
+    uint64_t cap = header->capacity;
+    uint64_t h = (dev * 0x9E3779B97F4A7C15ull) ^ (ino * 0xC2B2AE3D27D4EB4Full) ^ (uint64_t)algo;
+    h ^= h >> 29;
+    uint64_t home = h % cap;
+    XHashIndexEntry *empty = nullptr;
+    for(int i = 0; i < XHASH_INDEX_PROBE; i++){
+        XHashIndexEntry *e = &table[(home + i) % cap];
+        if(e->len == 0){
+            if(!empty) empty = e;
+            continue;
+        }
+        if(e->dev == dev && e->ino == ino && e->algo == (uint32_t)algo) return e;
+    }
+    if(!for_store) return nullptr;
+    return empty ? empty : &table[home];
+}
+
+
+bool XHashIndex::Lookup(const struct stat &st, int algo, unsigned char *out, unsigned &len){
+    if(!table) return false;
+    lock_guard<mutex> lock(index_mutex);
+    if(!table) return false;
+    XHashIndexEntry *e = Slot(st.st_dev, st.st_ino, algo, false);
+    bool hit = e && e->size == (int64_t)st.st_size && e->mtime_ns == MtimeNs(st) &&
+               e->len <= sizeof(e->digest) && e->check == Check(*e);
+    XMetrics::Add(hit ? metric_hit : metric_miss, 1);
+    if(!hit) return false;
+    memcpy(out, e->digest, e->len);
+    len = e->len;
+    return true;
+}
+
+
+void XHashIndex::Store(const struct stat &st, int algo, const unsigned char *digest, unsigned len){
+    if(!table || len == 0 || len > sizeof(XHashIndexEntry::digest)) return;
+    lock_guard<mutex> lock(index_mutex);
+    if(!table) return;
+    XHashIndexEntry e;
+    memset(&e, 0, sizeof(e));
+    e.dev = st.st_dev;
+    e.ino = st.st_ino;
+    e.size = st.st_size;
+    e.mtime_ns = MtimeNs(st);
+    e.algo = algo;
+    e.len = len;
+    memcpy(e.digest, digest, len);
+    e.check = Check(e);
+    *Slot(e.dev, e.ino, algo, true) = e;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <stdint.h>
+#include <sys/stat.h>
+
+struct XHashIndexHeader;
+struct XHashIndexEntry;
+
+/**
+ * @class XHashIndex
+ * @brief 持久化的文件摘要索引：同一文件内容的 HASH / XCRC / XMD5 / XSHA* 第二次起直接命中
+ *
+ * 索引是一个 mmap（MAP_SHARED）的定长表文件，键为 (dev, inode, 大小, mtime 纳秒, 算法)，
+ * 值为摘要原始字节；文件内容一变（大小或 mtime 变化）旧条目自然失效，无需显式删除。
+ * 开放寻址，探测窗口有限，窗口满时覆盖起始槽位；每个条目带校验和，崩溃时写了一半的条目读出时丢弃。
+ * 工作线程（STOR 完成）与 XIOPool 线程（摘要计算）都会访问，由一把互斥锁保护。
+ */
+class XHashIndex{
+public:
+    static XHashIndex* Get();
+
+    // 打开（不存在则创建）索引文件；entries 与文件中的容量不同时重建。失败时索引不启用
+    bool Open(const std::string &file, int entries);
+    void Close();
+
+    bool Enabled() const { return table != nullptr; }
+
+    // 查找 st 对应文件内容的摘要；命中返回 true 并写出摘要字节与长度（out 至少 64 字节）
+    bool Lookup(const struct stat &st, int algo, unsigned char *out, unsigned &len);
+
+    // 记录 st 对应文件内容的摘要
+    void Store(const struct stat &st, int algo, const unsigned char *digest, unsigned len);
+
+    // 两次 stat 是否对应同一份内容（索引键相同）
+    static bool SameContent(const struct stat &a, const struct stat &b);
+
+    // 纳秒精度的 mtime（macOS 为 st_mtimespec）
+    static int64_t MtimeNs(const struct stat &st);
+
+private:
+    XHashIndex(){}
+    XHashIndexEntry *Slot(uint64_t dev, uint64_t ino, int algo, bool for_store);
+
+    std::mutex index_mutex;
+    int fd = -1;
+    size_t map_size = 0;
+    XHashIndexHeader *header = nullptr;
+    XHashIndexEntry *table = nullptr;
+    int metric_hit = -1;
+    int metric_miss = -1;
+};
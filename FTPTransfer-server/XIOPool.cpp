@@ -0,0 +1,53 @@
+#include "XIOPool.h"
+#include "testUtil.h"
+
+#define XIOPOOL_DEFAULT_THREADS 4
+
+
+void XIOPool::Init(int threadNum){
+    std::lock_guard<std::mutex> lock(jobs_mutex);
+    if(!threads.empty()) return;
+    Logger::info("XIOPool::Init() threads: ", threadNum);
+    for(int i = 0; i < threadNum; i++){
+        threads.push_back(new std::thread(&XIOPool::Main, this));
+    }
+}
+
+
+void XIOPool::Submit(std::function<void()> job){
+    if(threads.empty()) Init(XIOPOOL_DEFAULT_THREADS);
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobs_cv.notify_one();
+}
+
+
+void XIOPool::Main(){
+    while(true){
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            jobs_cv.wait(lock, [this]{ return stop || !jobs.empty(); });
+            if(stop) return;       // 退出时丢弃尚未开始的任务
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+
+XIOPool::~XIOPool(){
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        stop = true;
+    }
+    jobs_cv.notify_all();
+    for(auto t : threads){
+        if(t->joinable()) t->join();
+        delete t;
+    }
+    threads.clear();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+/**
+ * @class XIOPool
+ * @brief 阻塞型任务线程池
+ *
+ * 工作线程(XThread)的事件循环不能执行阻塞调用（目录遍历、大文件读取、慢速KDF等），
+ * 这类任务提交到 XIOPool 执行，结果再通过 XThread::Post 投递回所属的事件循环。
+ */
+class XIOPool{
+public:
+    static XIOPool* Get(){
+        static XIOPool instance;
+        return &instance;
+    }
+
+    // 启动线程，只有第一次调用生效
+    void Init(int threadNum);
+
+    // 提交任务（线程安全）；未 Init 时自动以默认线程数启动
+    void Submit(std::function<void()> job);
+
+    // 线程数量
+    int Size() const { return (int)threads.size(); }
+
+    // 进程退出中：长时间运行的任务应轮询该标志并尽快返回
+    bool Stopping() const { return stop; }
+
+private:
+    void Main();
+
+    std::vector<std::thread*> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_cv;
+    std::atomic<bool> stop{false};
+
+    XIOPool(){};
+    ~XIOPool();
+};
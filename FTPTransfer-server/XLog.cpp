@@ -0,0 +1,335 @@
+#include "XLog.h"
+#include "XLogEvents.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <chrono>
+
+using namespace std;
+
+#define XLOG_BATCH_MAX (256 * 1024)      // 单次 write() 的最大字节数
+
+
+bool XLogRing::Push(const char *msg, uint32_t len){
+    // 单条记录不超过缓冲区的一半，避免永远写不进去
+    if(len > SIZE / 2 - 8) len = SIZE / 2 - 8;
+    uint32_t need = (4 + len + 3) & ~3u;
+
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint64_t t = tail.load(std::memory_order_acquire);
+    uint32_t pos = h & (SIZE - 1);
+    uint32_t contig = SIZE - pos;                     // 到缓冲区末尾的连续空间，4 字节对齐
+    uint64_t total = need + (contig < need ? contig : 0);
+    if(SIZE - (h - t) < total){
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if(contig < need){
+        memcpy(data + pos, &PAD, 4);
+        h += contig;
+        pos = 0;
+    }
+    memcpy(data + pos, &len, 4);
+    memcpy(data + pos + 4, msg, len);
+    head.store(h + need, std::memory_order_release);
+    return true;
+}
+
+
+void XLogRing::Drain(string &out){
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint64_t h = head.load(std::memory_order_acquire);
+    while(t < h){
+        uint32_t pos = t & (SIZE - 1);
+        uint32_t len;
+        memcpy(&len, data + pos, 4);
+        if(len == PAD){
+            t += SIZE - pos;
+            continue;
+        }
+        out.append(data + pos + 4, len);
+        t += (4 + len + 3) & ~3u;
+    }
+    tail.store(t, std::memory_order_release);
+}
+
+
+// 每个线程的缓冲区与格式化流
+// 有意不释放：exit() 时线程局部对象先于静态对象析构，而静态对象的析构函数里仍会写日志
+struct XLogLocal{
+    shared_ptr<XLogRing> ring;
+    shared_ptr<XLogRing> trace;           // 二进制跟踪记录
+    uint32_t thread = 0;                  // 跟踪记录中的线程序号
+    XLogStreamBuf sb;
+    ostream os{&sb};
+    time_t last_sec = 0;
+    char stamp[16] = {0};                 // "HH:MM:SS." 缓存，秒变化时才重新计算
+};
+static thread_local XLogLocal *local_log = nullptr;
+
+// 线程退出时把缓冲区标记为孤儿，由写线程读完后回收
+struct XLogLocalGuard{
+    ~XLogLocalGuard(){
+        if(!local_log) return;
+        if(local_log->ring) local_log->ring->orphaned = true;
+        if(local_log->trace) local_log->trace->orphaned = true;
+    }
+};
+static thread_local XLogLocalGuard local_guard;
+
+static XLogLocal &Local(){
+    if(!local_log){
+        local_log = new XLogLocal();
+        (void)&local_guard;               // 触发 guard 的构造，使其析构函数在线程退出时执行
+    }
+    return *local_log;
+}
+
+
+XLog* XLog::Get(){
+    // 不析构：其他单例的析构函数里仍可能写日志
+    static XLog *instance = new XLog();
+    return instance;
+}
+
+
+XLog::XLog(){
+    writer = new std::thread(&XLog::Main, this);
+    atexit([]{ XLog::Get()->Shutdown(); });
+}
+
+
+int XLog::ParseLevel(const string &name){
+    static const char *names[] = {"debug", "info", "warning", "error", "off"};
+    for(int i = 0; i <= XLOG_OFF; i++){
+        if(strcasecmp(name.c_str(), names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+
+XLogRing *XLog::LocalRing(){
+    XLogLocal &local = Local();
+    if(!local.ring){
+        local.ring = make_shared<XLogRing>();
+        lock_guard<mutex> lock(rings_mutex);
+        rings.push_back(local.ring);
+    }
+    return local.ring.get();
+}
+
+
+XLogRing *XLog::LocalTraceRing(){
+    XLogLocal &local = Local();
+    if(!local.trace){
+        local.trace = make_shared<XLogRing>();
+        local.thread = next_thread.fetch_add(1);
+        lock_guard<mutex> lock(rings_mutex);
+        trace_rings.push_back(local.trace);
+    }
+    return local.trace.get();
+}
+
+
+bool XLog::OpenTrace(const string &file){
+    int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd < 0) return false;
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size == 0){
+        XLogTraceFileHeader hdr;
+        memcpy(hdr.magic, XLOG_TRACE_MAGIC, sizeof(hdr.magic));
+        hdr.version = 1;
+        hdr.endian = 0x01020304;
+        if(write(fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr)){
+            close(fd);
+            return false;
+        }
+    }
+    {
+        lock_guard<mutex> lock(rings_mutex);
+        if(trace_fd >= 0) close(trace_fd);
+        trace_fd = fd;
+    }
+    trace_on = true;
+    return true;
+}
+
+
+void XLog::Trace(uint16_t event, uint32_t session, const int64_t *args, uint8_t argc){
+    if(sync) return;
+    XLogRing *ring = LocalTraceRing();
+
+    char rec[sizeof(XLogTraceRecord) + 8 * 255];
+    XLogTraceRecord *r = (XLogTraceRecord *)rec;
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    r->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    r->thread = Local().thread;
+    r->session = session;
+    r->event = event;
+    r->argc = argc;
+    r->reserved = 0;
+    memcpy(rec + sizeof(XLogTraceRecord), args, 8 * argc);
+    ring->Push(rec, sizeof(XLogTraceRecord) + 8 * argc);
+}
+
+
+ostream &XLog::Begin(){
+    XLogLocal &local = Local();
+    local.sb.Reset();
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    if(ts.tv_sec != local.last_sec){
+        struct tm tm;
+        localtime_r(&ts.tv_sec, &tm);
+        strftime(local.stamp, sizeof(local.stamp), "%H:%M:%S.", &tm);
+        local.last_sec = ts.tv_sec;
+    }
+    char ms[16];
+    snprintf(ms, sizeof(ms), "%03d ", (int)(ts.tv_nsec / 1000000));
+    local.os << local.stamp << ms;
+    return local.os;
+}
+
+
+void XLog::Commit(){
+    XLogLocal &local = Local();
+    size_t len = local.sb.Terminate();
+    if(sync){
+        // 已退出异步模式，直接同步写出
+        lock_guard<mutex> lock(sync_mutex);
+        if(write(STDOUT_FILENO, local.sb.Data(), len) < 0){}
+        return;
+    }
+    LocalRing()->Push(local.sb.Data(), (uint32_t)len);
+}
+
+
+size_t XLog::Collect(string &out){
+    vector<shared_ptr<XLogRing>> snapshot;
+    {
+        lock_guard<mutex> lock(rings_mutex);
+        snapshot = rings;
+    }
+
+    for(auto &r : snapshot){
+        r->Drain(out);
+        uint64_t lost = r->dropped.exchange(0, std::memory_order_relaxed);
+        if(lost > 0){
+            out += "[WARNING] XLog: " + to_string(lost) + " log records dropped (ring full)\n";
+        }
+    }
+
+    // 回收已退出线程的空缓冲区
+    lock_guard<mutex> lock(rings_mutex);
+    for(auto it = rings.begin(); it != rings.end(); ){
+        XLogRing *r = it->get();
+        if(r->orphaned && r->head.load() == r->tail.load()) it = rings.erase(it);
+        else ++it;
+    }
+    return out.size();
+}
+
+
+size_t XLog::CollectTrace(string &out){
+    vector<shared_ptr<XLogRing>> snapshot;
+    {
+        lock_guard<mutex> lock(rings_mutex);
+        snapshot = trace_rings;
+    }
+
+    uint64_t lost = 0;
+    for(auto &r : snapshot){
+        r->Drain(out);
+        lost += r->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    if(lost > 0){
+        string msg = "[WARNING] XLog: " + to_string(lost) + " trace records dropped (ring full)\n";
+        WriteOut(msg);
+    }
+
+    lock_guard<mutex> lock(rings_mutex);
+    for(auto it = trace_rings.begin(); it != trace_rings.end(); ){
+        XLogRing *r = it->get();
+        if(r->orphaned && r->head.load() == r->tail.load()) it = trace_rings.erase(it);
+        else ++it;
+    }
+    return out.size();
+}
+
+
+void XLog::WriteTrace(const string &out){
+    // 只有写线程（或退出时的 Shutdown）会调用，trace_fd 在 OpenTrace 之后不再变化
+    size_t off = 0;
+    while(off < out.size()){
+        ssize_t n = write(trace_fd, out.data() + off, out.size() - off);
+        if(n <= 0) break;
+        off += n;
+    }
+}
+
+
+void XLog::WriteOut(const string &out){
+    size_t off = 0;
+    while(off < out.size()){
+        ssize_t n = write(STDOUT_FILENO, out.data() + off, out.size() - off);
+        if(n <= 0) break;
+        off += n;
+    }
+}
+
+
+void XLog::Main(){
+    string out, trace;
+    out.reserve(XLOG_BATCH_MAX);
+    int idle = 0;
+    while(!stop){
+        out.clear();
+        trace.clear();
+        bool busy = false;
+        if(Collect(out) > 0){
+            WriteOut(out);
+            busy = true;
+        }
+        if(trace_on && CollectTrace(trace) > 0){
+            WriteTrace(trace);
+            busy = true;
+        }
+        if(busy){
+            idle = 0;
+        }
+        else if(idle < 10){
+            idle++;
+        }
+        // 有日志时 1ms 轮询一次，空闲时逐步退避到 20ms
+        std::this_thread::sleep_for(std::chrono::milliseconds(idle == 0 ? 1 : idle * 2));
+    }
+}
+
+
+void XLog::Shutdown(){
+    if(sync.exchange(true)) return;
+    stop = true;
+    if(writer){
+        if(writer->joinable()) writer->join();
+        delete writer;
+        writer = nullptr;
+    }
+    string out;
+    Collect(out);
+    if(trace_on){
+        string trace;
+        CollectTrace(trace);
+        WriteTrace(trace);
+    }
+    lock_guard<mutex> lock(sync_mutex);
+    WriteOut(out);
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ostream>
+#include <streambuf>
+#include <stdint.h>
+
+// 日志级别，数值越大越重要
+enum XLogLevel{
+    XLOG_DEBUG = 0,
+    XLOG_INFO,
+    XLOG_WARNING,
+    XLOG_ERROR,
+    XLOG_OFF,
+};
+
+// 编译期最低级别：低于它的 Logger 调用不再格式化与写入；实参仍在调用前求值，
+// 需要计算的实参用 Logger::Enabled<级别>() 先检查（见 testUtil.h）
+// 发布构建使用 make RELEASE=1（即 -DXLOG_MIN_LEVEL=XLOG_INFO）
+#ifndef XLOG_MIN_LEVEL
+#define XLOG_MIN_LEVEL XLOG_DEBUG
+#endif
+
+/**
+ * @brief 单生产者/单消费者无锁环形缓冲区
+ *
+ * 每个记录为 [uint32 长度][文本]，按 4 字节对齐；剩余连续空间不足时写入
+ * 填充标记跳回开头。生产者是所属线程，消费者是 XLog 的后台写线程。
+ */
+struct XLogRing{
+    static const uint32_t SIZE = 256 * 1024;     // 必须为 2 的幂
+    static const uint32_t PAD = 0xFFFFFFFF;      // 填充标记
+
+    std::atomic<uint64_t> head{0};               // 写位置（只由生产者修改）
+    std::atomic<uint64_t> tail{0};               // 读位置（只由消费者修改）
+    std::atomic<uint64_t> dropped{0};            // 缓冲区满时丢弃的记录数
+    std::atomic<bool> orphaned{false};           // 所属线程已退出
+    char data[SIZE];
+
+    // 生产者：写入一条记录，空间不足返回 false
+    bool Push(const char *msg, uint32_t len);
+
+    // 消费者：把所有可读记录追加到 out
+    void Drain(std::string &out);
+};
+
+/**
+ * @brief 固定大小的格式化缓冲，超出部分截断，格式化过程不分配内存
+ */
+class XLogStreamBuf : public std::streambuf{
+public:
+    XLogStreamBuf(){ Reset(); }
+    void Reset(){ setp(buf, buf + sizeof(buf) - 1); }
+    const char *Data() const { return pbase(); }
+    size_t Size() const { return pptr() - pbase(); }
+    // 在末尾（预留的最后一个字节内）补换行，返回含换行的长度
+    size_t Terminate(){ *pptr() = '\n'; return Size() + 1; }
+protected:
+    int overflow(int c) override { return c; }     // 缓冲已满，丢弃多余字符
+private:
+    char buf[4096];
+};
+
+/**
+ * @class XLog
+ * @brief 异步日志后端
+ *
+ * 各线程把格式化好的日志写入自己的 XLogRing（无锁、无系统调用），
+ * 后台线程定期收集所有环形缓冲区并以一次 write() 批量输出到标准输出。
+ * 级别检查在格式化之前进行，被关闭的级别只有一次原子读的开销。
+ * 进程退出时（atexit）停止后台线程并同步刷出剩余日志，之后的日志直接同步写出。
+ *
+ * 另有二进制跟踪日志（trace）：定长记录写入每个线程单独的环形缓冲区，不做任何格式化，
+ * 由后台线程写入 OpenTrace() 指定的文件，用 tools/xlogdump 离线解码。未打开文件时
+ * Trace() 只有一次原子读的开销。
+ */
+class XLog{
+public:
+    static XLog* Get();
+
+    static bool Enabled(int level){
+        return level >= min_level.load(std::memory_order_relaxed);
+    }
+
+    // 设置最低输出级别
+    static void SetLevel(int level){ min_level.store(level, std::memory_order_relaxed); }
+    static int GetLevel(){ return min_level.load(std::memory_order_relaxed); }
+
+    // 解析 "debug"/"info"/"warning"/"error"/"off"，无效返回 -1
+    static int ParseLevel(const std::string &name);
+
+    // 本线程的格式化流，已清空并写入时间戳前缀
+    std::ostream &Begin();
+
+    // 提交本线程流中的内容
+    void Commit();
+
+    // 同步刷出所有缓冲区（退出时调用，之后日志改为同步写出）
+    void Shutdown();
+
+    static bool TraceEnabled(){ return trace_on.load(std::memory_order_relaxed); }
+
+    // 打开二进制跟踪日志文件（追加写，新文件写入文件头），失败返回 false
+    bool OpenTrace(const std::string &file);
+
+    // 写入一条跟踪记录，event 见 XLogEvents.h
+    void Trace(uint16_t event, uint32_t session, const int64_t *args, uint8_t argc);
+
+private:
+    XLog();
+    XLogRing *LocalRing();
+    XLogRing *LocalTraceRing();
+    void Main();
+    size_t Collect(std::string &out);
+    size_t CollectTrace(std::string &out);
+    void WriteOut(const std::string &out);
+    void WriteTrace(const std::string &out);
+
+    static inline std::atomic<int> min_level{XLOG_INFO};
+    static inline std::atomic<bool> trace_on{false};
+
+    std::vector<std::shared_ptr<XLogRing>> rings;      // 所有线程的缓冲区
+    std::vector<std::shared_ptr<XLogRing>> trace_rings;
+    std::mutex rings_mutex;
+    int trace_fd = -1;
+    std::atomic<uint32_t> next_thread{1};              // 跟踪记录中的线程序号
+    std::atomic<bool> sync{false};                     // 已关闭异步写线程
+    std::mutex sync_mutex;                             // 同步模式下保证整行输出
+    std::atomic<bool> stop{false};
+    std::thread *writer = nullptr;
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+/**
+ * 二进制跟踪日志（trace）的事件定义，服务器与离线解码工具 tools/xlogdump 共用
+ *
+ * 文件格式：
+ *   文件头 XLogTraceFileHeader
+ *   记录   XLogTraceRecord + argc 个 int64 参数，依次排列
+ *
+ * 事件表：X(枚举名, 显示名, 参数说明)
+ * 参数说明以逗号分隔，每项 "名称:类型"，类型 d=十进制整数 x=十六进制 c=四字符命令名
+ */
+#define XLOG_TRACE_EVENTS(X)                                                   \
+    X(SESSION_OPEN,   "session.open",   "thread:d")                            \
+    X(SESSION_CLOSE,  "session.close",  "")                                    \
+    X(CMD,            "cmd",            "verb:c")                              \
+    X(DATA_EVENT,     "data.event",     "events:x")                            \
+    X(RETR_BEGIN,     "retr.begin",     "offset:d,size:d")                     \
+    X(RETR_CHUNK,     "retr.chunk",     "bytes:d,total:d")                     \
+    X(RETR_END,       "retr.end",       "bytes:d,code:d")                      \
+    X(STOR_BEGIN,     "stor.begin",     "offset:d")                            \
+    X(STOR_CHUNK,     "stor.chunk",     "bytes:d,total:d")                     \
+    X(STOR_END,       "stor.end",       "bytes:d,code:d")                      \
+    X(LIST_END,       "list.end",       "bytes:d,cache_hit:d")                 \
+    X(TLS_BEGIN,      "tls.begin",      "")
+
+enum XLogTraceEvent : uint16_t{
+#define XLOG_TRACE_ENUM(name, text, args) XTRACE_##name,
+    XLOG_TRACE_EVENTS(XLOG_TRACE_ENUM)
+#undef XLOG_TRACE_ENUM
+    XTRACE_EVENT_COUNT
+};
+
+#define XLOG_TRACE_MAGIC "XFTPTRC1"
+
+#pragma pack(push, 1)
+struct XLogTraceFileHeader{
+    char magic[8];             // XLOG_TRACE_MAGIC
+    uint32_t version;          // 当前为 1
+    uint32_t endian;           // 0x01020304，用于识别字节序
+};
+
+struct XLogTraceRecord{
+    uint64_t ts_ns;            // CLOCK_REALTIME 纳秒
+    uint32_t thread;           // 线程序号（XLog 内部分配）
+    uint32_t session;          // 会话 ID，0 表示与会话无关
+    uint16_t event;            // XLogTraceEvent
+    uint8_t argc;              // 随后的 int64 参数个数
+    uint8_t reserved;
+};
+#pragma pack(pop)
@@ -0,0 +1,212 @@
+#include "XMetrics.h"
+
+#include <chrono>
+
+using namespace std;
+
+
+int XHistogram::Index(uint64_t v){
+    if(v < (uint64_t)SUB_COUNT) return (int)v;
+    int e = 63 - __builtin_clzll(v);
+    if(e > MAX_EXP) return BUCKETS - 1;
+    int sub = (int)((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+    return (e - SUB_BITS + 1) * SUB_COUNT + sub;
+}
+
+
+uint64_t XHistogram::UpperBound(int i){
+    if(i < SUB_COUNT) return (uint64_t)i;
+    int e = i / SUB_COUNT + SUB_BITS - 1;
+    uint64_t sub = i % SUB_COUNT;
+    uint64_t width = 1ull << (e - SUB_BITS);
+    return ((SUB_COUNT + sub) << (e - SUB_BITS)) + width - 1;
+}
+
+
+void XHistogramSnapshot::Merge(const XHistogram &h){
+    for(int i = 0; i < XHistogram::BUCKETS; i++){
+        buckets[i] += h.buckets[i].load(std::memory_order_relaxed);
+    }
+    count += h.count.load(std::memory_order_relaxed);
+    sum += h.sum.load(std::memory_order_relaxed);
+}
+
+
+uint64_t XHistogramSnapshot::Quantile(double q) const{
+    // 各桶是分别读取的，count 可能与桶之和略有出入，以桶之和为准
+    uint64_t total = 0;
+    for(uint64_t b : buckets) total += b;
+    if(total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * total);
+    if(rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    for(int i = 0; i < XHistogram::BUCKETS; i++){
+        seen += buckets[i];
+        if(seen > rank) return XHistogram::UpperBound(i);
+    }
+    return XHistogram::UpperBound(XHistogram::BUCKETS - 1);
+}
+
+
+uint64_t XHistogramSnapshot::CountAtMost(uint64_t v) const{
+    uint64_t n = 0;
+    for(int i = 0; i < XHistogram::BUCKETS && XHistogram::UpperBound(i) <= v; i++){
+        n += buckets[i];
+    }
+    return n;
+}
+
+
+// 线程分片：数组定长，采集线程读取时不会遇到扩容
+struct XMetrics::Shard{
+    std::atomic<int64_t> values[MAX_METRICS];
+    std::atomic<XHistogram*> hists[MAX_METRICS];
+
+    Shard(){
+        for(int i = 0; i < MAX_METRICS; i++){
+            values[i].store(0, std::memory_order_relaxed);
+            hists[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    ~Shard(){
+        for(auto &h : hists) delete h.load();
+    }
+};
+
+
+XMetrics* XMetrics::Get(){
+    // 不析构：工作线程可能在静态对象析构后仍在记录
+    static XMetrics *instance = new XMetrics();
+    return instance;
+}
+
+
+XMetrics::Shard *XMetrics::LocalShard(){
+    static thread_local Shard *local = nullptr;
+    if(!local){
+        auto shard = make_shared<Shard>();
+        local = shard.get();
+        XMetrics *m = Get();
+        lock_guard<mutex> lock(m->mtx);
+        m->shards.push_back(shard);
+    }
+    return local;
+}
+
+
+int XMetrics::Register(XMetricType type, const string &name, const string &help, const string &labels){
+    string key = name + "{" + labels + "}";
+    lock_guard<mutex> lock(mtx);
+    auto it = index.find(key);
+    if(it != index.end()) return it->second;
+    if((int)infos.size() >= MAX_METRICS) return -1;
+
+    infos.push_back({type, name, help, labels});
+    int id = (int)infos.size() - 1;
+    index[key] = id;
+    return id;
+}
+
+
+void XMetrics::Add(int id, int64_t n){
+    if(id < 0) return;
+    auto &v = LocalShard()->values[id];
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+
+void XMetrics::Set(int id, int64_t v){
+    if(id < 0) return;
+    LocalShard()->values[id].store(v, std::memory_order_relaxed);
+}
+
+
+void XMetrics::Observe(int id, uint64_t v){
+    if(id < 0) return;
+    auto &slot = LocalShard()->hists[id];
+    XHistogram *h = slot.load(std::memory_order_relaxed);
+    if(!h){
+        h = new XHistogram();
+        slot.store(h, std::memory_order_release);
+    }
+    h->Record(v);
+}
+
+
+void XMetrics::Collect(vector<XMetricSample> &out){
+    vector<Info> info_copy;
+    vector<shared_ptr<Shard>> shard_copy;
+    {
+        lock_guard<mutex> lock(mtx);
+        info_copy = infos;
+        shard_copy = shards;
+    }
+
+    out.clear();
+    out.resize(info_copy.size());
+    for(size_t i = 0; i < info_copy.size(); i++){
+        XMetricSample &s = out[i];
+        s.name = info_copy[i].name;
+        s.help = info_copy[i].help;
+        s.labels = info_copy[i].labels;
+        s.type = info_copy[i].type;
+        for(auto &shard : shard_copy){
+            if(s.type == XMETRIC_HISTOGRAM){
+                XHistogram *h = shard->hists[i].load(std::memory_order_acquire);
+                if(h) s.hist.Merge(*h);
+            }
+            else{
+                s.value += shard->values[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+
+int XMetrics::Find(const string &name, const string &labels){
+    lock_guard<mutex> lock(mtx);
+    auto it = index.find(name + "{" + labels + "}");
+    return it == index.end() ? -1 : it->second;
+}
+
+
+int64_t XMetrics::Sum(int id){
+    if(id < 0) return 0;
+    vector<shared_ptr<Shard>> shard_copy;
+    XMetricType type;
+    {
+        lock_guard<mutex> lock(mtx);
+        if(id >= (int)infos.size()) return 0;
+        type = infos[id].type;
+        shard_copy = shards;
+    }
+    int64_t total = 0;
+    for(auto &shard : shard_copy){
+        if(type == XMETRIC_HISTOGRAM){
+            XHistogram *h = shard->hists[id].load(std::memory_order_acquire);
+            if(h) total += h->count.load(std::memory_order_relaxed);
+        }
+        else{
+            total += shard->values[id].load(std::memory_order_relaxed);
+        }
+    }
+    return total;
+}
+
+
+uint64_t XMetrics::NowUs(){
+    return chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+int XMetricFamily::Id(const string &value){
+    static thread_local unordered_map<const XMetricFamily*, unordered_map<string, int>> cache;
+    auto &ids = cache[this];
+    auto it = ids.find(value);
+    if(it != ids.end()) return it->second;
+
+    int id = XMetrics::Get()->Register(type, name, help, string(label) + "=\"" + value + "\"");
+    ids[value] = id;
+    return id;
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+enum XMetricType{
+    XMETRIC_COUNTER = 0,       // 单调递增
+    XMETRIC_GAUGE,             // 可增可减（各线程分片求和）
+    XMETRIC_HISTOGRAM,         // 分布（对数-线性分桶）
+};
+
+/**
+ * @brief HDR 风格的对数-线性直方图
+ *
+ * 小于 16 的值各占一个桶；之后每个 2 的幂区间再等分为 16 个子桶，
+ * 相对误差不超过 1/16。只由所属线程写入，写入用 relaxed 原子读改写（无 lock 前缀），
+ * 采集线程可随时读取。
+ */
+struct XHistogram{
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+    static const int MAX_EXP = 47;                                   // 超过 2^48 的值计入最后一个桶
+    static const int BUCKETS = (MAX_EXP - SUB_BITS + 2) * SUB_COUNT;
+
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+
+    XHistogram(){ for(auto &b : buckets) b.store(0, std::memory_order_relaxed); }
+
+    static int Index(uint64_t v);
+    // 桶 i 的上界（包含）
+    static uint64_t UpperBound(int i);
+
+    void Record(uint64_t v){
+        Bump(buckets[Index(v)], 1);
+        Bump(count, 1);
+        Bump(sum, v);
+    }
+
+private:
+    static void Bump(std::atomic<uint64_t> &a, uint64_t n){
+        a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+// 采集时合并后的直方图
+struct XHistogramSnapshot{
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(XHistogram::BUCKETS, 0);
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    void Merge(const XHistogram &h);
+    // 第 q（0~1）分位数的近似值（所在桶的上界）
+    uint64_t Quantile(double q) const;
+    // 不大于 v 的样本数
+    uint64_t CountAtMost(uint64_t v) const;
+};
+
+// 一个指标（名称 + 标签）采集时的合并结果
+struct XMetricSample{
+    std::string name;
+    std::string help;
+    std::string labels;          // 形如 verb="RETR"，可为空
+    XMetricType type;
+    int64_t value = 0;           // 计数器/仪表
+    XHistogramSnapshot hist;     // 直方图
+};
+
+/**
+ * @class XMetrics
+ * @brief 全局指标注册表
+ *
+ * 每个线程有自己的分片（Shard），热路径只写本线程分片，不产生共享缓存行；
+ * 采集（Collect）时才遍历所有分片求和。指标在首次使用时注册，得到的 id 在各分片中通用。
+ */
+class XMetrics{
+public:
+    static const int MAX_METRICS = 512;
+
+    static XMetrics* Get();
+
+    // 注册指标，同名同标签返回已有 id；超过上限返回 -1（之后对该 id 的操作被忽略）
+    int Register(XMetricType type, const std::string &name, const std::string &help,
+                 const std::string &labels = "");
+
+    // 计数器/仪表加 n（仪表可为负）
+    static void Add(int id, int64_t n = 1);
+
+    // 仪表直接设为 v；只适用于始终由同一个线程写入的指标（如每个工作线程自己的延迟）
+    static void Set(int id, int64_t v);
+
+    // 直方图记录一个样本
+    static void Observe(int id, uint64_t v);
+
+    // 合并所有线程分片，按注册顺序返回
+    void Collect(std::vector<XMetricSample> &out);
+
+    // 查找已注册的指标，不存在返回 -1
+    int Find(const std::string &name, const std::string &labels = "");
+
+    // 单个指标在所有分片上的合计（直方图返回样本数），比 Collect 轻量，用于定时计算速率
+    int64_t Sum(int id);
+
+    // 单调时钟，微秒
+    static uint64_t NowUs();
+
+private:
+    XMetrics(){}
+    struct Shard;
+    static Shard *LocalShard();
+
+    struct Info{
+        XMetricType type;
+        std::string name;
+        std::string help;
+        std::string labels;
+    };
+    std::mutex mtx;
+    std::vector<Info> infos;
+    std::unordered_map<std::string, int> index;          // name{labels} -> id
+    std::vector<std::shared_ptr<Shard>> shards;           // 线程退出后分片仍保留，累计值不丢失
+};
+
+/**
+ * @brief 按名字查找（必要时注册）指标 id，并在本线程缓存结果
+ *
+ * 用于标签取值在运行时才确定的场景（如按命令字统计），
+ * 同一线程内同一 key 只在第一次访问注册表的锁。
+ */
+class XMetricFamily{
+public:
+    XMetricFamily(XMetricType type, const char *name, const char *help, const char *label)
+        : type(type), name(name), help(help), label(label) {}
+
+    // 标签值为 value 的指标 id
+    int Id(const std::string &value);
+
+private:
+    XMetricType type;
+    const char *name;
+    const char *help;
+    const char *label;
+};
@@ -0,0 +1,122 @@
+#include "XNetAddr.h"
+
+#include <netinet/in.h>
+#include <string.h>
+#include <errno.h>
+
+using namespace std;
+
+
+socklen_t XNetAddr::Normalize(const sockaddr *in, sockaddr_storage *out){
+    memset(out, 0, sizeof(*out));
+    if(in->sa_family == AF_INET){
+        memcpy(out, in, sizeof(sockaddr_in));
+        return sizeof(sockaddr_in);
+    }
+    if(in->sa_family != AF_INET6) return 0;
+
+    const sockaddr_in6 *in6 = (const sockaddr_in6 *)in;
+    if(!IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)){
+        memcpy(out, in, sizeof(sockaddr_in6));
+        return sizeof(sockaddr_in6);
+    }
+    sockaddr_in *sin = (sockaddr_in *)out;
+    sin->sin_family = AF_INET;
+    sin->sin_port = in6->sin6_port;
+    memcpy(&sin->sin_addr, in6->sin6_addr.s6_addr + 12, 4);
+    return sizeof(sockaddr_in);
+}
+
+
+string XNetAddr::Host(const sockaddr *addr){
+    char host[INET6_ADDRSTRLEN] = {0};
+    if(addr->sa_family == AF_INET){
+        evutil_inet_ntop(AF_INET, &((const sockaddr_in *)addr)->sin_addr, host, sizeof(host));
+    }
+    else if(addr->sa_family == AF_INET6){
+        evutil_inet_ntop(AF_INET6, &((const sockaddr_in6 *)addr)->sin6_addr, host, sizeof(host));
+    }
+    return host;
+}
+
+
+int XNetAddr::Port(const sockaddr *addr){
+    if(addr->sa_family == AF_INET) return ntohs(((const sockaddr_in *)addr)->sin_port);
+    if(addr->sa_family == AF_INET6) return ntohs(((const sockaddr_in6 *)addr)->sin6_port);
+    return 0;
+}
+
+
+bool XNetAddr::SameHost(const sockaddr *a, const sockaddr *b){
+    if(a->sa_family != b->sa_family) return false;
+    if(a->sa_family == AF_INET){
+        return ((const sockaddr_in *)a)->sin_addr.s_addr == ((const sockaddr_in *)b)->sin_addr.s_addr;
+    }
+    if(a->sa_family == AF_INET6){
+        return memcmp(&((const sockaddr_in6 *)a)->sin6_addr, &((const sockaddr_in6 *)b)->sin6_addr,
+                      sizeof(in6_addr)) == 0;
+    }
+    return false;
+}
+
+
+socklen_t XNetAddr::Parse(const string &host, int port, int af, sockaddr_storage *out){
+    memset(out, 0, sizeof(*out));
+    if(port < 0 || port > 65535) return 0;
+    if(af == AF_INET || af == AF_UNSPEC){
+        sockaddr_in *sin = (sockaddr_in *)out;
+        if(evutil_inet_pton(AF_INET, host.c_str(), &sin->sin_addr) == 1){
+            sin->sin_family = AF_INET;
+            sin->sin_port = htons(port);
+            return sizeof(sockaddr_in);
+        }
+    }
+    if(af == AF_INET6 || af == AF_UNSPEC){
+        sockaddr_in6 *sin6 = (sockaddr_in6 *)out;
+        if(evutil_inet_pton(AF_INET6, host.c_str(), &sin6->sin6_addr) == 1){
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = htons(port);
+            return sizeof(sockaddr_in6);
+        }
+    }
+    return 0;
+}
+
+
+// 创建、绑定并监听，失败返回 -1（errno 保留）
+static evutil_socket_t BindListen(const sockaddr *addr, socklen_t len, int backlog){
+    evutil_socket_t fd = socket(addr->sa_family, SOCK_STREAM, 0);
+    if(fd < 0) return -1;
+    evutil_make_listen_socket_reuseable(fd);
+    evutil_make_socket_nonblocking(fd);
+    evutil_make_socket_closeonexec(fd);
+    if(addr->sa_family == AF_INET6){
+        // 明确关闭 V6ONLY，不依赖系统默认值（net.ipv6.bindv6only / net.inet6.ip6.v6only）
+        int off = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, (const char *)&off, sizeof(off));
+    }
+    if(bind(fd, addr, len) != 0 || listen(fd, backlog) != 0){
+        int err = errno;
+        evutil_closesocket(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+
+evutil_socket_t XNetAddr::Listen(const string &host, int port, int backlog){
+    sockaddr_storage ss;
+    socklen_t len;
+    if(!host.empty()){
+        len = Parse(host, port, AF_UNSPEC, &ss);
+        if(!len) return -1;
+        return BindListen((sockaddr *)&ss, len, backlog);
+    }
+
+    len = Parse("::", port, AF_INET6, &ss);
+    evutil_socket_t fd = BindListen((sockaddr *)&ss, len, backlog);
+    if(fd >= 0 || (errno != EAFNOSUPPORT && errno != EADDRNOTAVAIL)) return fd;
+    len = Parse("0.0.0.0", port, AF_INET, &ss);
+    return BindListen((sockaddr *)&ss, len, backlog);
+}
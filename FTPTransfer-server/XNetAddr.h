@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <sys/socket.h>
+#include <event2/util.h>
+
+/**
+ * @class XNetAddr
+ * @brief 套接字地址的小工具（IPv4 / IPv6 双栈）
+ *
+ * 监听 socket 为双栈的 AF_INET6，IPv4 客户端的地址以 v4-mapped 形式（::ffff:a.b.c.d）出现，
+ * 这里统一还原成 AF_INET，保证日志、按 IP 的准入计数与 PASV 的对端检查对同一个客户端看到的是同一个地址。
+ */
+class XNetAddr{
+public:
+    // 复制地址，v4-mapped 的 IPv6 地址还原为 IPv4；返回地址长度，不支持的协议族返回 0
+    static socklen_t Normalize(const sockaddr *in, sockaddr_storage *out);
+
+    // 地址的文本形式，不含端口
+    static std::string Host(const sockaddr *addr);
+
+    // 端口（主机字节序）
+    static int Port(const sockaddr *addr);
+
+    // 两个地址的主机部分是否相同（不比较端口，应先 Normalize）
+    static bool SameHost(const sockaddr *a, const sockaddr *b);
+
+    // 解析文本地址与端口；af 为 AF_UNSPEC 时自动识别。成功返回地址长度，失败返回 0
+    static socklen_t Parse(const std::string &host, int port, int af, sockaddr_storage *out);
+
+    // 创建监听 socket：地址为空时优先双栈 [::]，内核不支持 IPv6 时退回 0.0.0.0。失败返回 -1
+    static evutil_socket_t Listen(const std::string &host, int port, int backlog);
+};
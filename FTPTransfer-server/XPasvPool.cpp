@@ -0,0 +1,108 @@
+#include "XPasvPool.h"
+#include "XFtpTask.h"
+#include "XMetrics.h"
+#include "XNetAddr.h"
+#include "testUtil.h"
+
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <string>
+
+using namespace std;
+
+#define XPASV_BACKLOG 8             // 每个端口同一时刻只等一个数据连接
+
+static thread_local XPasvPool *current_pool = nullptr;
+
+
+XPasvPool *XPasvPool::Current(){
+    return current_pool;
+}
+
+
+void XPasvPool::Bind(){
+    current_pool = this;
+}
+
+
+bool XPasvPool::Setup(event_base *base, int first, int last, int worker, int workers){
+    metric_in_use = XMetrics::Get()->Register(XMETRIC_GAUGE, "ftp_pasv_ports_in_use",
+                                              "Passive-mode ports handed out and not yet connected",
+                                              "thread=\"" + to_string(worker) + "\"");
+    rng.seed((unsigned)(XMetrics::NowUs() + worker));
+    if(first <= 0 || last < first || workers <= 0) return true;
+
+    // 先按数量预留，listener 回调参数指向 ports 中的元素，之后不能再扩容
+    int count = 0;
+    for(int p = first + worker; p <= last; p += workers) count++;
+    ports.reserve(count);
+
+    int failed = 0;
+    for(int p = first + worker; p <= last; p += workers){
+        evutil_socket_t fd = XNetAddr::Listen("", p, XPASV_BACKLOG);     // 与控制连接一样双栈
+        if(fd < 0){
+            failed++;
+            continue;
+        }
+        ports.emplace_back();
+        XPasvPort &port = ports.back();
+        port.port = p;
+        port.index = (int)ports.size() - 1;
+        // backlog 为 0：socket 已在监听
+        port.listener = evconnlistener_new(base, AcceptCB, &port, LEV_OPT_CLOSE_ON_FREE, 0, fd);
+        if(!port.listener){
+            evutil_closesocket(fd);
+            ports.pop_back();
+            failed++;
+            continue;
+        }
+        free_list.push_back(port.index);
+    }
+
+    if(failed){
+        Logger::warning("XPasvPool::Setup() -> Thread_id ", worker, ": ", failed, " passive ports could not be bound");
+    }
+    Logger::info("XPasvPool::Setup() -> Thread_id ", worker, ": ", ports.size(), " passive ports");
+    return true;
+}
+
+
+void XPasvPool::Stop(){
+    for(auto &p : ports){
+        if(p.listener) evconnlistener_free(p.listener);
+        p.listener = nullptr;
+        p.owner = nullptr;
+    }
+    free_list.clear();
+}
+
+
+XPasvPort *XPasvPool::Acquire(XFtpTask *owner){
+    if(free_list.empty()) return nullptr;
+    size_t i = rng() % free_list.size();
+    std::swap(free_list[i], free_list.back());
+    XPasvPort *port = &ports[free_list.back()];
+    free_list.pop_back();
+    port->owner = owner;
+    XMetrics::Add(metric_in_use, 1);
+    return port;
+}
+
+
+void XPasvPool::Release(XPasvPort *port){
+    if(!port || !port->owner) return;
+    port->owner = nullptr;
+    free_list.push_back(port->index);
+    XMetrics::Add(metric_in_use, -1);
+}
+
+
+void XPasvPool::AcceptCB(evconnlistener *, evutil_socket_t fd, sockaddr *addr, int socklen, void *arg){
+    XPasvPort *port = (XPasvPort *)arg;
+    if(!port->owner){
+        // 没有会话在等这个端口（过期或扫描的连接）
+        evutil_closesocket(fd);
+        return;
+    }
+    port->owner->PasvAccept(fd, addr);
+}
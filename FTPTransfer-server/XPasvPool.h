@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+#include <random>
+#include <stdint.h>
+#include <event2/util.h>
+
+struct event_base;
+struct evconnlistener;
+struct sockaddr;
+class XFtpTask;
+
+/**
+ * @brief 被动模式的一个监听端口
+ */
+struct XPasvPort{
+    int port = 0;
+    int index = 0;                          // 在 XPasvPool::ports 中的下标
+    evconnlistener *listener = nullptr;
+    XFtpTask *owner = nullptr;              // 占用该端口的控制连接，nullptr 表示空闲
+};
+
+/**
+ * @class XPasvPool
+ * @brief 每个工作线程一组预先 bind/listen 好的被动模式端口
+ *
+ * 端口范围 [pasv_port_min, pasv_port_max] 按工作线程编号交错分配（第 i 个线程取 min+i, min+i+n, ...），
+ * 启动时全部绑定并挂到本线程的 event_base 上，PASV/EPSV 只是从空闲表中取一个下标，不做任何系统调用。
+ * 空闲表随机取出（与末尾交换后弹出），O(1) 且端口号不可预测。
+ * 空闲端口上到达的连接直接关闭；占用端口上到达的连接交给所属控制连接（XFtpTask::PasvAccept），
+ * 接受一个连接后端口立即归还。只在所属工作线程中使用，不加锁。
+ */
+class XPasvPool{
+public:
+    // 当前线程的端口池，不在工作线程中时为 nullptr
+    static XPasvPool *Current();
+
+    // 绑定本线程分到的端口（XThread::Setup 中调用）；端口范围为空时返回 true 且池为空
+    bool Setup(event_base *base, int first, int last, int worker, int workers);
+
+    // 绑定到当前线程（XThread::Main 开始时调用）
+    void Bind();
+
+    // 关闭所有监听（XThread::Main 退出前调用）
+    void Stop();
+
+    // 取一个空闲端口，池已空返回 nullptr
+    XPasvPort *Acquire(XFtpTask *owner);
+
+    // 归还端口
+    void Release(XPasvPort *port);
+
+    size_t Size() const { return ports.size(); }
+    size_t FreeCount() const { return free_list.size(); }
+
+private:
+    static void AcceptCB(evconnlistener *l, evutil_socket_t fd, sockaddr *addr, int socklen, void *arg);
+
+    std::vector<XPasvPort> ports;
+    std::vector<int> free_list;             // 空闲端口下标
+    std::minstd_rand rng;
+    int metric_in_use = -1;
+};
@@ -0,0 +1,401 @@
+#include "XPrecompress.h"
+#include "XHashIndex.h"
+#include "XZStream.h"
+#include "XFtpTask.h"
+#include "XIOPool.h"
+#include "XConfig.h"
+#include "XMetrics.h"
+#include "testUtil.h"
+
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+#define XPRE_MAX_KEYS 100000           // 计数表 / 校验和表上限，超过后清空重来
+#define XPRE_GZ_HEADER_MAX 4096        // gzip 头（含文件名、注释）最多读取的字节数
+#define XPRE_READ_CHUNK (1024 * 1024)
+#define XPRE_LEVEL_DEFLATE 6           // precompress_level = 0 时的级别：压缩比接近最高级别，耗时只是它的几分之一
+#define XPRE_LEVEL_ZSTD 9              // （zstd 19 比 9 慢十倍以上，大文件会长时间占着 XIOPool 的线程）
+
+static const char *cache_exts[XZ_ENGINES] = {".zz", ".zst"};      // 缓存目录中：zlib 流 / zstd 帧
+static const char *sibling_exts[XZ_ENGINES] = {".gz", ".zst"};
+
+static XMetricFamily lookups(XMETRIC_COUNTER, "ftp_precompress_lookups_total",
+                             "MODE Z whole-file downloads by where the compressed data came from", "source");
+static XMetricFamily jobs(XMETRIC_COUNTER, "ftp_precompress_jobs_total",
+                          "Background precompression jobs", "result");
+
+
+// 内容键：原文件变化（大小或 mtime）后旧版本自然失效
+static string Key(const struct stat &st){
+    return to_string((uint64_t)st.st_dev) + "-" + to_string((uint64_t)st.st_ino) + "-" +
+           to_string((int64_t)st.st_size) + "-" + to_string(XHashIndex::MtimeNs(st));
+}
+
+
+// 兄弟文件存在且不比原文件旧
+static bool Fresh(const string &file, const struct stat &st, struct stat *out = nullptr){
+    struct stat ss;
+    if(stat(file.c_str(), &ss) != 0 || !S_ISREG(ss.st_mode)) return false;
+    if(XHashIndex::MtimeNs(ss) < XHashIndex::MtimeNs(st)) return false;
+    if(out) *out = ss;
+    return true;
+}
+
+
+// gzip 头（RFC 1952）长度，不是单个 deflate 成员的 gzip 文件返回 0
+static size_t GzipHeader(const unsigned char *h, size_t n){
+    if(n < 10 || h[0] != 0x1f || h[1] != 0x8b || h[2] != 8 || (h[3] & 0xe0)) return 0;
+    int flags = h[3];
+    size_t pos = 10;
+    if(flags & 0x04){                  // FEXTRA
+        if(pos + 2 > n) return 0;
+        pos += 2 + (h[pos] | (h[pos + 1] << 8));
+    }
+    for(int bit : {0x08, 0x10}){       // FNAME、FCOMMENT，以 0 结尾
+        if(!(flags & bit)) continue;
+        while(pos < n && h[pos]) pos++;
+        pos++;
+    }
+    if(flags & 0x02) pos += 2;         // FHCRC
+    return pos < n ? pos : 0;
+}
+
+
+static bool WriteAll(int fd, const char *p, size_t n){
+    while(n > 0){
+        ssize_t w = write(fd, p, n);
+        if(w < 0){
+            if(errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= w;
+    }
+    return true;
+}
+
+
+XPrecompress* XPrecompress::Get(){
+    static XPrecompress pre;
+    return &pre;
+}
+
+
+void XPrecompress::Init(){
+    XConfig *c = XConfig::Get();
+    enabled = c->GetBool("precompress", true);
+    dir = c->GetString("precompress_dir");
+    threshold = c->GetInt("precompress_threshold", 100);
+    min_size = c->GetInt("precompress_min_size", 65536);
+    cache_max = c->GetInt("precompress_cache_max", 1024LL * 1024 * 1024);
+    level = (int)c->GetInt("precompress_level", 0);
+    if(!enabled) return;
+
+    while(dir.size() > 1 && dir.back() == '/') dir.pop_back();
+    if(!dir.empty() && mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST){
+        Logger::error("XPrecompress::Init() -> cannot create ", dir, ", ", strerror(errno), "; variants will not be generated");
+        dir.clear();
+    }
+    Logger::info("XPrecompress::Init() -> siblings on", dir.empty() ? "" : ", cache " + dir,
+                 dir.empty() ? "" : ", threshold " + to_string(threshold));
+}
+
+
+void XPrecompress::Count(const string &path, const struct stat &st){
+    if(!enabled || dir.empty() || threshold <= 0 || st.st_size < min_size) return;
+    string key = Key(st);
+    {
+        lock_guard<mutex> lock(pre_mutex);
+        if(counts.size() >= XPRE_MAX_KEYS && !counts.count(key)) counts.clear();
+        if(++counts[key] != threshold) return;
+    }
+    Schedule(path, st, true);
+}
+
+
+bool XPrecompress::Find(const string &path, const struct stat &st, int engine, XVariant &v){
+    if(!enabled || engine < 0 || engine >= XZ_ENGINES) return false;
+    string key = Key(st);
+
+    if(!dir.empty()){
+        string file = dir + "/" + key + cache_exts[engine];
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat cs;
+        if(fd >= 0 && fstat(fd, &cs) == 0 && S_ISREG(cs.st_mode)){
+            v.fd = fd;
+            v.offset = 0;
+            v.length = cs.st_size;
+            v.prefix.clear();
+            v.suffix.clear();
+            v.file = file;
+            XMetrics::Add(lookups.Id("cache"), 1);
+            return true;
+        }
+        if(fd >= 0) close(fd);
+    }
+
+    if(Sibling(path, st, engine, key, v)){
+        XMetrics::Add(lookups.Id("sibling"), 1);
+        return true;
+    }
+    XMetrics::Add(lookups.Id("none"), 1);
+    return false;
+}
+
+
+bool XPrecompress::Sibling(const string &path, const struct stat &st, int engine, const string &key, XVariant &v){
+    string file = path + sibling_exts[engine];
+    struct stat ss;
+    if(!Fresh(file, st, &ss)) return false;
+
+    Sums sum = {0, 0};
+    if(engine == XZ_DEFLATE && !FindSums(key, sum)){
+        // zlib 流结尾要原文件的 Adler-32，核对 .gz 要 CRC-32，后台算好之前先走实时压缩
+        Schedule(path, st, false);
+        return false;
+    }
+
+    int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) return false;
+    unsigned char head[XPRE_GZ_HEADER_MAX];
+    ssize_t n = pread(fd, head, sizeof(head), 0);
+
+    if(engine == XZ_ZSTD){
+        // 帧头里要记录原始大小且等于原文件大小，否则可能是别的内容或截断的文件
+        #ifdef HAVE_ZSTD
+        unsigned long long size = n > 0 ? ZSTD_getFrameContentSize(head, n) : ZSTD_CONTENTSIZE_ERROR;
+        #else
+        unsigned long long size = 0;
+        #endif
+        if(size != (unsigned long long)st.st_size){
+            Logger::warning("XPrecompress::Sibling() -> ", file, " is not a zstd frame of the file, ignored");
+            close(fd);
+            return false;
+        }
+        v.offset = 0;
+        v.length = ss.st_size;
+        v.prefix.clear();
+        v.suffix.clear();
+    }
+    else{
+        // gzip = 头 + deflate 数据 + CRC32 + ISIZE；zlib = 2 字节头 + 同样的 deflate 数据 + Adler-32（大端）
+        size_t hlen = n > 0 ? GzipHeader(head, n) : 0;
+        unsigned char tail[8];
+        if(!hlen || ss.st_size < (off_t)hlen + 8 || pread(fd, tail, 8, ss.st_size - 8) != 8 ||
+           (tail[0] | tail[1] << 8 | tail[2] << 16 | (uint32_t)tail[3] << 24) != sum.crc ||
+           (tail[4] | tail[5] << 8 | tail[6] << 16 | (uint32_t)tail[7] << 24) != (uint32_t)st.st_size){
+            Logger::warning("XPrecompress::Sibling() -> ", file, " is not a single-member gzip of the file, ignored");
+            close(fd);
+            return false;
+        }
+        v.offset = hlen;
+        v.length = ss.st_size - hlen - 8;
+        v.prefix = string("\x78\x9c", 2);
+        uint32_t adler = sum.adler;
+        char trailer[4] = {(char)(adler >> 24), (char)(adler >> 16), (char)(adler >> 8), (char)adler};
+        v.suffix.assign(trailer, 4);
+    }
+    v.fd = fd;
+    v.file = file;
+    return true;
+}
+
+
+bool XPrecompress::FindSums(const string &key, Sums &out){
+    lock_guard<mutex> lock(pre_mutex);
+    auto it = sums.find(key);
+    if(it == sums.end()) return false;
+    out = it->second;
+    return true;
+}
+
+
+void XPrecompress::Schedule(const string &path, const struct stat &st, bool generate){
+    string key = Key(st);
+    {
+        lock_guard<mutex> lock(pre_mutex);
+        if(pending.count(key)){
+            // 已排队的只算 Adler 的任务升级为生成任务
+            for(Job &j : queue){
+                if(Key(j.st) == key) j.generate = j.generate || generate;
+            }
+            return;
+        }
+        pending.insert(key);
+        queue.push_back({path, st, generate});
+        if(running) return;
+        running = true;
+    }
+    XIOPool::Get()->Submit([this]{ Drain(); });
+}
+
+
+void XPrecompress::Drain(){
+    while(true){
+        Job job;
+        {
+            lock_guard<mutex> lock(pre_mutex);
+            if(queue.empty() || XIOPool::Get()->Stopping()){
+                queue.clear();
+                pending.clear();
+                running = false;
+                return;
+            }
+            job = queue.front();
+            queue.pop_front();
+        }
+        Run(job);
+        lock_guard<mutex> lock(pre_mutex);
+        pending.erase(Key(job.st));
+    }
+}
+
+
+void XPrecompress::Run(const Job &job){
+    const struct stat &st = job.st;
+    string key = Key(st);
+    int fd = open(job.path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat now;
+    if(fd < 0 || fstat(fd, &now) != 0 || !XHashIndex::SameContent(st, now)){
+        if(fd >= 0) close(fd);
+        XMetrics::Add(jobs.Id("changed"), 1);
+        return;
+    }
+
+    struct Output{
+        string tmp;
+        string file;
+        int fd = -1;
+        unique_ptr<XZStream> z;
+    };
+    vector<Output> outs;
+    bool need_sums = false;
+    Sums known = {0, 0};
+    for(int e = 0; e < XZ_ENGINES; e++){
+        if(!XZStream::Available(e)) continue;
+        if(Fresh(job.path + sibling_exts[e], st)){
+            if(e == XZ_DEFLATE && !FindSums(key, known)) need_sums = true;
+            continue;
+        }
+        if(!job.generate || dir.empty()) continue;
+        Output o;
+        o.file = dir + "/" + key + cache_exts[e];
+        if(access(o.file.c_str(), F_OK) == 0) continue;
+        o.tmp = o.file + "." + to_string(getpid()) + ".tmp";
+        o.z.reset(new XZStream());
+        o.fd = open(o.tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        int lvl = level > 0 ? level : (e == XZ_ZSTD ? XPRE_LEVEL_ZSTD : XPRE_LEVEL_DEFLATE);
+        if(o.fd < 0 || !o.z->Init(e, true, lvl)){
+            Logger::error("XPrecompress::Run() -> cannot start ", XZStream::EngineName(e), " variant ", o.tmp);
+            if(o.fd >= 0){
+                close(o.fd);
+                unlink(o.tmp.c_str());
+            }
+            continue;
+        }
+        outs.push_back(std::move(o));
+    }
+    if(outs.empty() && !need_sums){
+        close(fd);
+        return;
+    }
+
+    // 一次读取同时喂给所有压缩器和校验和
+    uint64_t t0 = XMetrics::NowUs();
+    vector<char> buf(XPRE_READ_CHUNK);
+    uLong adler = adler32(0, Z_NULL, 0);
+    uLong crc = crc32(0, Z_NULL, 0);
+    bool ok = true;
+    while(ok){
+        if(XIOPool::Get()->Stopping()){
+            ok = false;
+            break;
+        }
+        ssize_t n = read(fd, buf.data(), buf.size());
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0){
+            Logger::error("XPrecompress::Run() -> read ", job.path, " failed, ", strerror(errno));
+            ok = false;
+            break;
+        }
+        if(n == 0) break;
+        if(need_sums){
+            adler = adler32(adler, (const Bytef *)buf.data(), (uInt)n);
+            crc = crc32(crc, (const Bytef *)buf.data(), (uInt)n);
+        }
+        for(Output &o : outs){
+            int ofd = o.fd;
+            if(!o.z->Write(buf.data(), n, [ofd](const char *p, size_t len){ return WriteAll(ofd, p, len); })) ok = false;
+        }
+    }
+    for(Output &o : outs){
+        int ofd = o.fd;
+        if(ok && !o.z->Finish([ofd](const char *p, size_t len){ return WriteAll(ofd, p, len); })) ok = false;
+    }
+    bool changed = fstat(fd, &now) != 0 || !XHashIndex::SameContent(st, now);
+    close(fd);
+
+    for(Output &o : outs){
+        bool done = close(o.fd) == 0 && ok && !changed && rename(o.tmp.c_str(), o.file.c_str()) == 0;
+        if(!done){
+            unlink(o.tmp.c_str());
+            continue;
+        }
+        Logger::info("XPrecompress::Run() -> ", job.path, ": ", XZStream::EngineName(o.z->Engine()), " ",
+                     o.z->RawBytes(), " -> ", o.z->WireBytes(), " bytes in ", (XMetrics::NowUs() - t0) / 1000, "ms");
+    }
+    if(ok && !changed && need_sums){
+        lock_guard<mutex> lock(pre_mutex);
+        if(sums.size() >= XPRE_MAX_KEYS) sums.clear();
+        sums[key] = {(uint32_t)adler, (uint32_t)crc};
+    }
+    XMetrics::Add(jobs.Id(changed ? "changed" : ok ? "ok" : "failed"), 1);
+    if(ok && !changed && !outs.empty()) Trim();
+}
+
+
+void XPrecompress::Trim(){
+    if(cache_max <= 0) return;
+    DIR *d = opendir(dir.c_str());
+    if(!d) return;
+    struct Item{
+        int64_t mtime;
+        off_t size;
+        string file;
+    };
+    vector<Item> items;
+    long long total = 0;
+    while(dirent *ent = readdir(d)){
+        string name = ent->d_name;
+        if(name[0] == '.' || (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0)) continue;
+        string file = dir + "/" + name;
+        struct stat st;
+        if(stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        items.push_back({XHashIndex::MtimeNs(st), st.st_size, file});
+        total += st.st_size;
+    }
+    closedir(d);
+    if(total <= cache_max) return;
+
+    // 先删最早生成的（原文件已变化的旧版本不会再被命中，也最早被淘汰）
+    sort(items.begin(), items.end(), [](const Item &a, const Item &b){ return a.mtime < b.mtime; });
+    for(const Item &it : items){
+        if(total <= cache_max) break;
+        if(unlink(it.file.c_str()) == 0){
+            total -= it.size;
+            Logger::debug("XPrecompress::Trim() -> removed ", it.file);
+        }
+    }
+}
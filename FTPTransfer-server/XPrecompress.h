@@ -0,0 +1,79 @@
+#pragma once
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// 可直接发送的预压缩版本：fd 中 [offset, offset + length) 一段，前后各补 prefix / suffix
+struct XVariant{
+    int fd = -1;
+    off_t offset = 0;
+    off_t length = 0;
+    std::string prefix;
+    std::string suffix;
+    std::string file;            // 版本文件路径（日志用）
+};
+
+/**
+ * @class XPrecompress
+ * @brief MODE Z 下载的预压缩版本：热门静态文件不再每次 RETR 都重新压缩
+ *
+ * 整文件 RETR 时依次查找：缓存目录（precompress_dir）中后台生成的版本，与文件同目录的兄弟文件
+ * （zstd 会话用 name.zst；deflate 会话用 name.gz，去掉 gzip 头尾、补上 zlib 头和 Adler-32 拼接成 zlib 流）。
+ * 版本按原文件的 (dev, inode, 大小, mtime) 命名或比较 mtime，原文件一变即失效。
+ * 整文件 RETR 按内容计数，达到 precompress_threshold 次后在 XIOPool 上生成缓存版本（同一时间只跑一个任务），
+ * 先写临时文件再 rename；.gz 的 Adler-32 需要读一遍原文件，第一次遇到时也交给后台计算。
+ * 兄弟文件不是服务端生成的，发送前核对它确实是原文件压缩出来的：.zst 帧头记录的原始大小等于原文件大小，
+ * .gz 结尾的 ISIZE 与 CRC-32 和原文件一致（CRC-32 与 Adler-32 一起在后台计算）。
+ */
+class XPrecompress{
+public:
+    static XPrecompress* Get();
+
+    // 读取配置，创建缓存目录（启动时调用一次）
+    void Init();
+
+    // 整文件 RETR：计数，达到阈值时提交后台生成任务
+    void Count(const std::string &path, const struct stat &st);
+
+    // 查找 path（内容为 st）在 engine 下的预压缩版本；找到返回 true，v.fd 由调用方关闭
+    bool Find(const std::string &path, const struct stat &st, int engine, XVariant &v);
+
+private:
+    XPrecompress(){}
+
+    struct Job{
+        std::string path;
+        struct stat st;
+        bool generate;           // false 时只计算 .gz 兄弟文件需要的校验和
+    };
+
+    void Schedule(const std::string &path, const struct stat &st, bool generate);
+    void Drain();
+    void Run(const Job &job);
+    void Trim();
+    bool Sibling(const std::string &path, const struct stat &st, int engine, const std::string &key, XVariant &v);
+    struct Sums{
+        uint32_t adler;          // 拼接 zlib 流结尾用
+        uint32_t crc;            // 核对 .gz 结尾的 CRC-32
+    };
+    bool FindSums(const std::string &key, Sums &sums);
+
+    bool enabled = false;
+    std::string dir;
+    long long threshold = 0;
+    long long min_size = 0;
+    long long cache_max = 0;
+    int level = 0;
+
+    std::mutex pre_mutex;
+    std::map<std::string, uint32_t> counts;      // 内容键 -> 整文件下载次数
+    std::map<std::string, Sums> sums;            // 内容键 -> 原文件的校验和
+    std::deque<Job> queue;
+    std::set<std::string> pending;               // 已排队或正在处理的内容键
+    bool running = false;
+};
@@ -0,0 +1,390 @@
+#include "XQuota.h"
+#include "XConfig.h"
+#include "XDirWalker.h"
+#include "XIOPool.h"
+#include "XRateLimit.h"
+#include "XUserStore.h"
+#include "testUtil.h"
+
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+#define XQUOTA_MAGIC          "XQUOTA"
+#define XQUOTA_VERSION        1
+#define XQUOTA_COMPACT_LINES  65536      // 日志超过这么多行时改写为快照
+
+
+// 后台重建用量：所有用户的目录放在一个队列里，几个任务一起取
+struct XQuota::Scan{
+    mutex mtx;
+    deque<pair<size_t, string>> dirs;    // (用户序号, 目录绝对路径)
+    vector<string> users;
+    vector<unordered_set<string>> passed;   // 各用户已读过的目录
+    vector<long long> bytes;
+    vector<long long> files;
+    int active = 0;                      // 已提交、尚未结束的任务数
+    int max_runners = 1;
+    chrono::steady_clock::time_point start;
+};
+
+
+XQuota* XQuota::Get(){
+    static XQuota quota;
+    return &quota;
+}
+
+
+// "/a/b/c" -> "/a/b"，"/c" -> "/"
+static string DirOf(const string &path){
+    size_t pos = path.rfind('/');
+    return pos == 0 || pos == string::npos ? "/" : path.substr(0, pos);
+}
+
+
+void XQuota::Init(){
+    if(XUserStore::Get()->OpenMode()) return;
+    LoadLimits();
+    if(default_bytes <= 0 && default_files <= 0 && overrides.empty()) return;
+    enabled = true;
+    journal = XConfig::Get()->GetString("quota_journal", "quota.journal");
+
+    // 读完改写为快照，之后追加
+    LoadJournal();
+    {
+        lock_guard<mutex> lock(mtx);
+        compact = true;
+    }
+    Flush();
+
+    vector<pair<string, string>> users;
+    for(auto &u : XUserStore::Get()->List()) users.emplace_back(u.name, u.root);
+    StartScan(users);
+    size_t n = 0;
+    {
+        lock_guard<mutex> lock(mtx);
+        started = true;
+        n = accounts.size();
+    }
+    Logger::info("XQuota::Init() -> quotas enabled, ", n, " accounts from ", journal,
+                 ", rebuilding usage of ", users.size(), " users");
+}
+
+
+void XQuota::LoadLimits(){
+    XConfig *c = XConfig::Get();
+    string quota = c->GetString("quota_bytes", "0");
+    default_bytes = XRateLimit::ParseRate(quota);
+    if(default_bytes < 0){
+        Logger::warning("XQuota::LoadLimits() -> invalid quota_bytes: ", quota, ", using 0 (unlimited)");
+        default_bytes = 0;
+    }
+    default_files = max(0LL, c->GetInt("quota_files", 0));
+    string file = c->GetString("quota_file");
+    if(file.empty()) return;
+    ifstream in(file);
+    if(!in){
+        Logger::error("XQuota::LoadLimits() -> cannot read ", file, ", ", strerror(errno));
+        return;
+    }
+    // 每行 "名字 字节数 文件数"，字节数可带 K/M/G 后缀，0 表示不限
+    string line;
+    int lineno = 0;
+    while(getline(in, line)){
+        lineno++;
+        istringstream ss(line);
+        string name, bytes;
+        long long files = -1;
+        if(!(ss >> name) || name[0] == '#') continue;
+        long long b = (ss >> bytes) ? XRateLimit::ParseRate(bytes) : -1;
+        if(b < 0 || !(ss >> files) || files < 0){
+            Logger::warning("XQuota::LoadLimits() -> ", file, ":", lineno, " malformed, skipped");
+            continue;
+        }
+        overrides[name] = make_pair(b, files);
+    }
+}
+
+
+XQuota::Account &XQuota::Find(const string &user){
+    auto it = accounts.find(user);
+    if(it != accounts.end()) return it->second;
+    Account &a = accounts[user];
+    auto o = overrides.find(user);
+    a.max_bytes = o != overrides.end() ? o->second.first : default_bytes;
+    a.max_files = o != overrides.end() ? o->second.second : default_files;
+    // 启动后才加入用户表的用户：查用户表要读文件，在 XIOPool 中查到根目录后单独遍历一次
+    if(started){
+        XIOPool::Get()->Submit([user]{
+            XUserInfo u;
+            if(XUserStore::Get()->Find(user, u)) Get()->StartScan({make_pair(u.name, u.root)});
+        });
+    }
+    return a;
+}
+
+
+void XQuota::LoadJournal(){
+    ifstream in(journal);
+    string line;
+    if(!in || !getline(in, line)) return;
+    char magic[8] = {0};
+    int version = 0;
+    if(sscanf(line.c_str(), "%7s %d", magic, &version) != 2 || strcmp(magic, XQUOTA_MAGIC) != 0 ||
+       version != XQUOTA_VERSION){
+        Logger::warning("XQuota::LoadJournal() -> ", journal, " has an unknown format, ignored");
+        return;
+    }
+    // 崩溃时最后一行可能不完整，格式不对的行跳过
+    lock_guard<mutex> lock(mtx);
+    while(getline(in, line)){
+        char op = 0;
+        char name[128];
+        long long bytes = 0, files = 0;
+        if(sscanf(line.c_str(), "%c %127s %lld %lld", &op, name, &bytes, &files) != 4) continue;
+        Account &a = Find(name);
+        if(op == '='){
+            a.bytes = bytes;
+            a.files = files;
+        }
+        else if(op == '+'){
+            a.bytes += bytes;
+            a.files += files;
+        }
+    }
+}
+
+
+void XQuota::Flush(){
+    lock_guard<mutex> jlock(journal_mtx);
+    string batch;
+    bool rewrite = false;
+    {
+        lock_guard<mutex> lock(mtx);
+        flush_pending = false;
+        rewrite = compact || journal_lines > XQUOTA_COMPACT_LINES;
+        compact = false;
+        if(rewrite){
+            // 快照已包含还没写入的行，这些行不再写
+            char line[256];
+            snprintf(line, sizeof(line), "%s %d\n", XQUOTA_MAGIC, XQUOTA_VERSION);
+            batch = line;
+            for(auto &a : accounts){
+                snprintf(line, sizeof(line), "= %s %lld %lld\n", a.first.c_str(), a.second.bytes, a.second.files);
+                batch += line;
+            }
+            journal_lines = accounts.size();
+            lines.clear();
+        }
+        else{
+            batch.swap(lines);
+        }
+    }
+    if(rewrite){
+        Rewrite(batch);
+        return;
+    }
+    // 不逐条落盘：日志只用于启动时尽快得到用量，启动后的遍历会重建准确的值
+    if(journal_fd >= 0 && !batch.empty() && write(journal_fd, batch.data(), batch.size()) != (ssize_t)batch.size()){
+        Logger::warning("XQuota::Flush() -> cannot write ", journal, ", ", strerror(errno));
+    }
+}
+
+
+void XQuota::Rewrite(const string &snapshot){
+    string tmp = journal + ".tmp";
+    FILE *out = fopen(tmp.c_str(), "w");
+    if(!out){
+        Logger::error("XQuota::Rewrite() -> cannot write ", tmp, ", ", strerror(errno));
+        return;
+    }
+    bool ok = fwrite(snapshot.data(), 1, snapshot.size(), out) == snapshot.size();
+    ok = ok && fflush(out) == 0 && fsync(fileno(out)) == 0;
+    if(fclose(out) != 0) ok = false;
+    if(!ok || rename(tmp.c_str(), journal.c_str()) != 0){
+        Logger::error("XQuota::Rewrite() -> cannot replace ", journal, ", ", strerror(errno));
+        unlink(tmp.c_str());
+        return;
+    }
+    if(journal_fd >= 0) close(journal_fd);
+    journal_fd = open(journal.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+}
+
+
+void XQuota::Remaining(const string &user, long long &bytes, long long &files){
+    lock_guard<mutex> lock(mtx);
+    Account &a = Find(user);
+    bytes = a.max_bytes > 0 ? a.max_bytes - a.bytes : LLONG_MAX;
+    files = a.max_files > 0 ? a.max_files - a.files : LLONG_MAX;
+}
+
+
+bool XQuota::Passed(Scan &s, size_t index, const string &path){
+    lock_guard<mutex> lock(s.mtx);
+    return s.passed[index].count(DirOf(path)) > 0;
+}
+
+
+void XQuota::Charge(const string &user, const string &path, long long bytes, long long files){
+    if(!enabled || (bytes == 0 && files == 0)) return;
+    lock_guard<mutex> lock(mtx);
+    Account &a = Find(user);
+    a.bytes += bytes;
+    a.files += files;
+    // 遍历已经读过这个目录：变化不在遍历结果里，另记；还没读到的目录遍历自己会看到
+    if(a.scanning && a.scan && Passed(*a.scan, a.scan_index, path)){
+        a.pending_bytes += bytes;
+        a.pending_files += files;
+    }
+    Logger::debug("XQuota::Charge() -> ", user, " ", bytes, " bytes ", files, " files, now ", a.bytes, " / ", a.files);
+
+    char line[256];
+    int n = snprintf(line, sizeof(line), "+ %s %lld %lld\n", user.c_str(), bytes, files);
+    if(n <= 0 || n >= (int)sizeof(line)) return;
+    lines.append(line, n);
+    journal_lines++;
+    if(!flush_pending){
+        flush_pending = true;
+        XIOPool::Get()->Submit([]{ Get()->Flush(); });
+    }
+}
+
+
+void XQuota::Usage(const string &user, long long used[2], long long limit[2], bool &scanning){
+    lock_guard<mutex> lock(mtx);
+    Account &a = Find(user);
+    used[0] = a.bytes;
+    used[1] = a.files;
+    limit[0] = a.max_bytes;
+    limit[1] = a.max_files;
+    scanning = a.scanning;
+}
+
+
+// 队列里的目录比任务多时补提交（持有 s.mtx 时调用，返回要提交的个数）
+template<class S>
+static int Grow(S &s){
+    size_t idle = s.dirs.size() > (size_t)s.active ? s.dirs.size() - s.active : 0;
+    int n = (int)min<size_t>(s.max_runners - s.active, idle);
+    s.active += n;
+    return n;
+}
+
+
+void XQuota::StartScan(const vector<pair<string, string>> &users){
+    if(users.empty()) return;
+    auto s = make_shared<Scan>();
+    for(size_t i = 0; i < users.size(); i++){
+        string root = users[i].second;
+        while(root.size() > 1 && root.back() == '/') root.pop_back();
+        s->users.push_back(users[i].first);
+        s->dirs.emplace_back(i, root.empty() ? "/" : root);
+    }
+    s->passed.resize(users.size());
+    s->bytes.assign(users.size(), 0);
+    s->files.assign(users.size(), 0);
+    s->start = chrono::steady_clock::now();
+    {
+        lock_guard<mutex> lock(mtx);
+        for(size_t i = 0; i < s->users.size(); i++){
+            Account &a = Find(s->users[i]);
+            a.scanning = true;
+            a.scan = s;
+            a.scan_index = i;
+            a.pending_bytes = 0;
+            a.pending_files = 0;
+        }
+    }
+    // 最多占 XIOPool 的一半线程，启动时的登录校验不用排队等遍历；任务不在线程池里等待，队列空了就结束
+    s->max_runners = max(1, XIOPool::Get()->Size() / 2);
+    int n = 0;
+    {
+        lock_guard<mutex> lock(s->mtx);
+        n = Grow(*s);
+    }
+    for(int i = 0; i < n; i++) XIOPool::Get()->Submit([s]{ RunScan(s); });
+}
+
+
+void XQuota::RunScan(shared_ptr<Scan> s){
+    while(true){
+        pair<size_t, string> dir;
+        {
+            lock_guard<mutex> lock(s->mtx);
+            if(XIOPool::Get()->Stopping() || s->dirs.empty()) break;
+            dir = std::move(s->dirs.front());
+            s->dirs.pop_front();
+        }
+
+        vector<XDirEntry> entries;
+        if(!XDirWalker::ReadDir(dir.second, entries)){
+            Logger::warning("XQuota::RunScan() -> cannot read ", dir.second, ", ", strerror(errno));
+        }
+        long long bytes = 0, files = 0;
+        vector<string> subdirs;
+        for(auto &e : entries){
+            if(e.name == "." || e.name == "..") continue;
+            // lstat 结果：符号链接不计也不跟随；分段上传的 name.part 与范围表在创建时就已记入，照常计算
+            if(S_ISDIR(e.st.st_mode)){
+                subdirs.push_back(dir.second == "/" ? "/" + e.name : dir.second + "/" + e.name);
+            }
+            else if(S_ISREG(e.st.st_mode)){
+                bytes += e.st.st_size;
+                files++;
+            }
+        }
+
+        int more = 0;
+        {
+            lock_guard<mutex> lock(s->mtx);
+            s->bytes[dir.first] += bytes;
+            s->files[dir.first] += files;
+            s->passed[dir.first].insert(dir.second);
+            for(auto &d : subdirs) s->dirs.emplace_back(dir.first, std::move(d));
+            more = Grow(*s);
+        }
+        for(int i = 0; i < more; i++) XIOPool::Get()->Submit([s]{ RunScan(s); });
+    }
+
+    bool last = false;
+    {
+        lock_guard<mutex> lock(s->mtx);
+        last = --s->active == 0 && s->dirs.empty();
+    }
+    if(last && !XIOPool::Get()->Stopping()) Get()->FinishScan(*s);
+}
+
+
+void XQuota::FinishScan(Scan &s){
+    {
+        lock_guard<mutex> lock(mtx);
+        for(size_t i = 0; i < s.users.size(); i++){
+            Account &a = Find(s.users[i]);
+            if(a.scan.get() != &s) continue;
+            if(a.bytes != s.bytes[i] + a.pending_bytes || a.files != s.files[i] + a.pending_files){
+                Logger::info("XQuota::FinishScan() -> ", s.users[i], " usage corrected from ", a.bytes, " bytes ",
+                             a.files, " files to ", s.bytes[i] + a.pending_bytes, " bytes ", s.files[i] + a.pending_files, " files");
+            }
+            a.bytes = s.bytes[i] + a.pending_bytes;
+            a.files = s.files[i] + a.pending_files;
+            a.pending_bytes = 0;
+            a.pending_files = 0;
+            a.scanning = false;
+            a.scan.reset();
+        }
+        compact = true;
+    }
+    Flush();
+    auto ms = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - s.start).count();
+    Logger::info("XQuota::FinishScan() -> usage of ", s.users.size(), " users rebuilt in ", ms, " ms");
+}
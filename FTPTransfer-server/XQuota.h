@@ -0,0 +1,82 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <utility>
+
+/**
+ * @class XQuota
+ * @brief 每个用户的存储配额（字节数与文件数）
+ *
+ * 用量不在每次 STOR 时遍历目录，而是由各命令的完成事件增量维护：STOR / APPE / STOU 关闭文件时记入大小变化，
+ * 分段上传在创建 name.part 与改写范围表时记入，DELE 与 RNTO 覆盖目标时扣除。每次变化追加一行到日志文件 quota_journal
+ * （"+ 名字 字节数 文件数"），启动时先读日志（"= 名字 字节数 文件数" 为快照）立即得到上次的用量，
+ * 再由 XIOPool 中的几个任务并行遍历各用户的根目录重建准确的用量；遍历期间发生在已读过的目录里的变化另记，
+ * 遍历完一起补上（还没读到的目录里的变化遍历自己会看到）。重建完成与日志过长时改写为快照。
+ * 配额 quota_bytes / quota_files 对所有用户生效，quota_file 按用户覆盖；只在配置了用户表时启用。
+ *
+ * 用量表由一把互斥锁保护，锁内不做文件 IO：日志行先放在内存里，由 XIOPool 中的任务写入与改写。
+ */
+class XQuota{
+public:
+    static XQuota* Get();
+
+    // 读取配置与日志，开始后台遍历（在 XUserStore::Init 之后调用一次）
+    void Init();
+
+    bool Enabled() const { return enabled; }
+
+    // 剩余额度，不限的一项为 LLONG_MAX；已超额时为负数
+    void Remaining(const std::string &user, long long &bytes, long long &files);
+
+    // 记入用量变化（线程安全，不做文件 IO）；path 为变化的文件的真实路径，重建用量期间据此判断遍历是否已算过它
+    void Charge(const std::string &user, const std::string &path, long long bytes, long long files);
+
+    // 用量与配额（SITE QUOTA），配额 0 表示不限；scanning 为还在重建用量
+    void Usage(const std::string &user, long long used[2], long long limit[2], bool &scanning);
+
+private:
+    XQuota(){}
+
+    struct Scan;
+    struct Account{
+        long long bytes = 0;
+        long long files = 0;
+        long long max_bytes = 0;
+        long long max_files = 0;
+        bool scanning = false;           // 正在遍历根目录
+        long long pending_bytes = 0;     // 遍历期间在已读过的目录里记入的变化
+        long long pending_files = 0;
+        std::shared_ptr<Scan> scan;      // 进行中的遍历与该用户在其中的序号
+        size_t scan_index = 0;
+    };
+
+    Account &Find(const std::string &user);   // 持有 mtx 时调用
+    void LoadLimits();
+    void LoadJournal();
+    void Flush();                             // 写入积累的日志行，需要时改写为快照（XIOPool 中，启动时在主线程）
+    void Rewrite(const std::string &snapshot);
+    void StartScan(const std::vector<std::pair<std::string, std::string>> &users);
+    static void RunScan(std::shared_ptr<Scan> s);
+    static bool Passed(Scan &s, size_t index, const std::string &path);
+    void FinishScan(Scan &s);
+
+    bool enabled = false;
+    long long default_bytes = 0;
+    long long default_files = 0;
+    std::map<std::string, std::pair<long long, long long>> overrides;   // quota_file 中的 名字 -> (字节数, 文件数)
+
+    std::mutex mtx;                      // 保护以下各项
+    bool started = false;                // 启动时的遍历已开始
+    std::map<std::string, Account> accounts;
+    std::string lines;                   // 还没写入日志的行
+    bool flush_pending = false;          // 已提交写日志的任务
+    bool compact = false;                // 下次写日志时改写为快照
+    long long journal_lines = 0;         // 日志中快照之后的行数
+
+    std::mutex journal_mtx;              // 串行化日志的写入与改写，只在写日志的任务中持有
+    std::string journal;
+    int journal_fd = -1;
+};
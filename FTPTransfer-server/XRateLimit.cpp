@@ -0,0 +1,218 @@
+#include "XRateLimit.h"
+#include "XMetrics.h"
+#include "XConfig.h"
+#include "testUtil.h"
+
+#include <event2/event.h>
+#include <event2/bufferevent.h>
+#include <algorithm>
+#include <climits>
+#include <sstream>
+
+using namespace std;
+
+#define XRATELIMIT_TICK_MS 500          // 各工作线程重新分配份额的间隔
+#define XRATELIMIT_BUCKET_MS 100        // 令牌桶补充间隔（越短越平滑）
+
+// 每个工作线程的限速状态（只由所属线程访问，不释放）
+struct XRateWorker{
+    event_base *base = nullptr;
+    event *tick = nullptr;
+    bufferevent_rate_limit_group *group = nullptr;
+    uint64_t group_rate = 0;            // 组当前的速率，0 表示不限
+    list<XRateSlot*> slots;
+};
+static thread_local XRateWorker *local_worker = nullptr;
+
+
+// 每 XRATELIMIT_BUCKET_MS 补充 rate 对应的份额，桶容量为一秒的量
+static ev_token_bucket_cfg *NewCfg(uint64_t rate){
+    rate = min<uint64_t>(rate, EV_RATE_LIMIT_MAX);
+    size_t per_tick = max<uint64_t>(rate / (1000 / XRATELIMIT_BUCKET_MS), 1);
+    size_t burst = max<uint64_t>(rate, per_tick);
+    timeval tick = {0, XRATELIMIT_BUCKET_MS * 1000};
+    return ev_token_bucket_cfg_new(per_tick, burst, per_tick, burst, &tick);
+}
+
+
+long long XRateLimit::ParseRate(const string &s){
+    if(s.empty()) return -1;
+    size_t pos = 0;
+    long long v;
+    try{
+        v = stoll(s, &pos);
+    }
+    catch(...){
+        return -1;
+    }
+    if(v < 0) return -1;
+    string unit = s.substr(pos);
+    if(unit.empty()) return v;
+    if(unit.size() != 1) return -1;
+    long long mult;
+    switch(unit[0]){
+        case 'k': case 'K': mult = 1024LL; break;
+        case 'm': case 'M': mult = 1024LL * 1024; break;
+        case 'g': case 'G': mult = 1024LL * 1024 * 1024; break;
+        default: return -1;
+    }
+    // 乘法溢出是未定义行为，超出范围的值按无效处理
+    if(v > LLONG_MAX / mult) return -1;
+    return v * mult;
+}
+
+
+void XRateLimit::Load(){
+    static const char *keys[] = {"rate_limit_global", "rate_limit_session", "rate_limit_user"};
+    long long v[3];
+    for(int i = 0; i < 3; i++){
+        string s = XConfig::Get()->GetString(keys[i], "0");
+        v[i] = ParseRate(s);
+        if(v[i] < 0){
+            Logger::warning("XRateLimit::Load() -> invalid ", keys[i], ": ", s, ", using 0 (unlimited)");
+            v[i] = 0;
+        }
+    }
+
+    static const char *scopes[] = {"scope=\"global\"", "scope=\"session\"", "scope=\"user\""};
+    XMetrics *m = XMetrics::Get();
+    for(int i = 0; i < 3; i++){
+        metric_rate[i] = m->Register(XMETRIC_GAUGE, "ftp_rate_limit_bytes_per_second",
+                                     "Configured data bandwidth cap, 0 means unlimited", scopes[i]);
+    }
+    metric_shaped = m->Register(XMETRIC_GAUGE, "ftp_shaped_transfers", "RETR/STOR transfers under the shaper");
+    SetRates(v[0], v[1], v[2]);
+}
+
+
+void XRateLimit::SetRates(long long global, long long session, long long user){
+    if(global >= 0) global_rate = global;
+    if(session >= 0) session_rate = session;
+    if(user >= 0) user_rate = user;
+    XMetrics::Set(metric_rate[0], (int64_t)global_rate.load());
+    XMetrics::Set(metric_rate[1], (int64_t)session_rate.load());
+    XMetrics::Set(metric_rate[2], (int64_t)user_rate.load());
+    Logger::info("XRateLimit -> global ", global_rate.load(), " B/s, session ", session_rate.load(),
+                 " B/s, user ", user_rate.load(), " B/s");
+}
+
+
+string XRateLimit::Describe(){
+    ostringstream os;
+    os << "global " << global_rate.load() << "\n"
+       << "session " << session_rate.load() << "\n"
+       << "user " << user_rate.load() << "\n"
+       << "active_transfers " << total_active.load() << "\n";
+    return os.str();
+}
+
+
+XRateWorker *XRateLimit::LocalWorker(bufferevent *bev){
+    if(!local_worker){
+        local_worker = new XRateWorker();
+        local_worker->base = bufferevent_get_base(bev);
+        local_worker->tick = event_new(local_worker->base, -1, EV_PERSIST, TickCB, this);
+        timeval tv = {XRATELIMIT_TICK_MS / 1000, (XRATELIMIT_TICK_MS % 1000) * 1000};
+        event_add(local_worker->tick, &tv);
+    }
+    return local_worker;
+}
+
+
+void XRateLimit::TickCB(evutil_socket_t, short, void *arg){
+    if(local_worker) ((XRateLimit *)arg)->Rebalance(local_worker);
+}
+
+
+uint64_t XRateLimit::UserShare(const string &user){
+    uint64_t rate = user_rate.load(std::memory_order_relaxed);
+    if(!rate) return 0;
+    int n = 1;
+    {
+        lock_guard<mutex> lock(user_mutex);
+        auto it = user_active.find(user);
+        if(it != user_active.end() && it->second > 1) n = it->second;
+    }
+    return max<uint64_t>(rate / n, 1);
+}
+
+
+void XRateLimit::Apply(XRateSlot &slot){
+    uint64_t rate = session_rate.load(std::memory_order_relaxed);
+    uint64_t share = UserShare(slot.user);
+    if(share && (!rate || share < rate)) rate = share;
+    if(rate == slot.rate) return;
+
+    ev_token_bucket_cfg *old = slot.cfg;
+    slot.cfg = rate ? NewCfg(rate) : nullptr;
+    bufferevent_set_rate_limit(slot.bev, slot.cfg);
+    if(old) ev_token_bucket_cfg_free(old);
+    slot.rate = rate;
+}
+
+
+void XRateLimit::Rebalance(XRateWorker *w){
+    // 全局速率按本线程活动传输数占全部传输数的比例分给本线程的组
+    uint64_t global = global_rate.load(std::memory_order_relaxed);
+    int total = total_active.load(std::memory_order_relaxed);
+    int mine = (int)w->slots.size();
+    uint64_t share = global;
+    if(global && total > 0 && mine > 0) share = max<uint64_t>(global * mine / total, 1);
+
+    if(share != w->group_rate && (share || w->group)){
+        ev_token_bucket_cfg *cfg = NewCfg(share ? share : EV_RATE_LIMIT_MAX);
+        if(!w->group){
+            w->group = bufferevent_rate_limit_group_new(w->base, cfg);
+            for(XRateSlot *s : w->slots) bufferevent_add_to_rate_limit_group(s->bev, w->group);
+        }
+        else{
+            bufferevent_rate_limit_group_set_cfg(w->group, cfg);     // 组会复制配置
+        }
+        ev_token_bucket_cfg_free(cfg);
+        w->group_rate = share;
+    }
+
+    for(XRateSlot *s : w->slots) Apply(*s);
+}
+
+
+void XRateLimit::Attach(XRateSlot &slot, bufferevent *bev, const string &user){
+    if(slot.worker) Detach(slot);
+    XRateWorker *w = LocalWorker(bev);
+    slot.bev = bev;
+    slot.user = user;
+    slot.rate = 0;
+    slot.worker = w;
+    slot.it = w->slots.insert(w->slots.end(), &slot);
+    {
+        lock_guard<mutex> lock(user_mutex);
+        user_active[user]++;
+    }
+    total_active++;
+    XMetrics::Add(metric_shaped, 1);
+    if(w->group) bufferevent_add_to_rate_limit_group(bev, w->group);
+    Rebalance(w);
+}
+
+
+void XRateLimit::Detach(XRateSlot &slot){
+    XRateWorker *w = slot.worker;
+    if(!w) return;
+    w->slots.erase(slot.it);
+    if(w->group) bufferevent_remove_from_rate_limit_group(slot.bev);
+    if(slot.cfg){
+        bufferevent_set_rate_limit(slot.bev, nullptr);
+        ev_token_bucket_cfg_free(slot.cfg);
+        slot.cfg = nullptr;
+    }
+    {
+        lock_guard<mutex> lock(user_mutex);
+        auto it = user_active.find(slot.user);
+        if(it != user_active.end() && --it->second <= 0) user_active.erase(it);
+    }
+    total_active--;
+    XMetrics::Add(metric_shaped, -1);
+    slot.worker = nullptr;
+    slot.bev = nullptr;
+    slot.rate = 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <stdint.h>
+#include <event2/util.h>
+
+struct bufferevent;
+struct ev_token_bucket_cfg;
+struct XRateWorker;
+
+/**
+ * @brief 一条被限速的数据连接（由 XFtpTask 持有）
+ */
+struct XRateSlot{
+    bufferevent *bev = nullptr;
+    std::string user;
+    uint64_t rate = 0;                          // 当前生效的单连接速率（字节/秒），0 表示不限
+    ev_token_bucket_cfg *cfg = nullptr;         // bev 引用该配置（libevent 不复制），随 slot 释放
+    XRateWorker *worker = nullptr;              // nullptr 表示未接入
+    std::list<XRateSlot*>::iterator it;
+};
+
+/**
+ * @class XRateLimit
+ * @brief RETR/STOR 数据连接带宽整形
+ *
+ * 三层令牌桶：
+ *  - 全局：每个工作线程一个 bufferevent_rate_limit_group，全局速率按各线程活动传输数的比例分配，
+ *    组内由 libevent 在成员之间平均分配，所以每个传输得到大致相同的份额，少数大量下载不会挤占其他传输；
+ *  - 单会话：每条数据连接自己的令牌桶；
+ *  - 单用户：用户的速率由其所有进行中的传输平分，再与单会话上限取小。
+ * 控制连接与目录列表不限速。libevent 的限速对象不加锁，所以只在所属工作线程中操作；
+ * 运行时修改（SetRates，管理端口调用）只写原子变量，各工作线程的定时器（XRATELIMIT_TICK_MS）读到后重新分配。
+ */
+class XRateLimit{
+public:
+    static XRateLimit* Get(){
+        static XRateLimit instance;
+        return &instance;
+    }
+
+    // 读取配置 rate_limit_global / rate_limit_session / rate_limit_user
+    void Load();
+
+    // 数据连接开始传输时接入（工作线程调用）
+    void Attach(XRateSlot &slot, bufferevent *bev, const std::string &user);
+
+    // 释放 bev 之前调用
+    void Detach(XRateSlot &slot);
+
+    // 运行时修改速率（字节/秒，0 为不限，负数表示不修改）
+    void SetRates(long long global, long long session, long long user);
+
+    // 当前设置与活动传输数，文本格式
+    std::string Describe();
+
+    // 解析 "10M"、"512k"、"1G" 之类的速率，单位字节/秒；无效或超出 long long 范围返回 -1
+    static long long ParseRate(const std::string &s);
+
+private:
+    XRateLimit(){}
+
+    XRateWorker *LocalWorker(bufferevent *bev);
+    static void TickCB(evutil_socket_t fd, short what, void *arg);
+    void Rebalance(XRateWorker *w);
+    void Apply(XRateSlot &slot);
+    uint64_t UserShare(const std::string &user);
+
+    std::atomic<uint64_t> global_rate{0};
+    std::atomic<uint64_t> session_rate{0};
+    std::atomic<uint64_t> user_rate{0};
+    std::atomic<int> total_active{0};           // 所有工作线程中接入的传输数
+
+    std::map<std::string, int> user_active;     // 每个用户进行中的传输数
+    std::mutex user_mutex;
+    int metric_rate[3] = {-1, -1, -1};
+    int metric_shaped = -1;
+};
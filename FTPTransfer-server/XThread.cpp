@@ -6,6 +6,8 @@
 
 #include "XThread.h"
 #include "XTask.h"
+#include "XMetrics.h"
+#include "XConfig.h"
 #include "testUtil.h"
 
 
@@ -13,12 +15,13 @@
 
 static void Notify_cb(evutil_socket_t fd, short event, void *arg){
     XThread *t = (XThread *)arg;
+    XCallbackScope scope(0, "Notify", &typeid(XThread));
     t->Notify(fd, event);
 }
 
 
 void XThread::Notify(evutil_socket_t fd, short event){
-    Logger::info("XThread::Notify() -> Thread_id ", id);
+    Logger::debug("XThread::Notify() -> Thread_id ", id);
 
     // 1. 读取管道中的数据
     char buf[1] = {0};
@@ -31,19 +34,43 @@ void XThread::Notify(evutil_socket_t fd, short event){
         Logger::info("XThread::Notify() -> Thread_id ", id,  " read() return 0");
         return;
     }
-    Logger::info("XThread::Notify() -> Thread_id ", id, " recv: ", buf);
+    Logger::debug("XThread::Notify() -> Thread_id ", id, " recv: ", buf[0]);
     if(buf[0] == 's'){
         Logger::info("XThread::Notify() -> Thread_id ", id, " : stop");
         event_base_loopbreak(base);  // 停止事件循环
         return;
     }
+    if(buf[0] == 'f'){
+        // 执行其他线程投递的回调
+        std::vector<std::function<void()>> fns;
+        posted_mutex.lock();
+        fns.swap(posted);
+        posted_mutex.unlock();
+        for(auto &fn : fns) fn();
+        return;
+    }
 
     // 2. 取出任务并执行
     std::shared_ptr<XFtpServerCMD> t = nullptr;
     t = connect_tasks.front();
     connect_tasks.pop();
     tasks_mutex.unlock();
-    t->Init();
+    if(t->Init()){
+        XMetrics::Add(metric_sessions, 1);
+        XMetrics::Add(metric_sessions_total, 1);
+    }
+}
+
+
+void XThread::ProbeCB(evutil_socket_t, short, void *arg){
+    XThread *t = (XThread *)arg;
+    uint64_t now = XMetrics::NowUs();
+    uint64_t expected = t->probe_last_us + t->probe_interval_us;
+    uint64_t lag = now > expected ? now - expected : 0;
+    t->probe_last_us = now;
+    XMetrics::Observe(t->metric_lag, lag);
+    XMetrics::Set(t->metric_lag_last, (int64_t)lag);
+    t->lag_last_us.store(lag, std::memory_order_relaxed);
 }
 
 
@@ -65,11 +92,20 @@ bool XThread::Start(){
 
 void XThread::Main(){
     Logger::info("XThread::Main() -> Thread_id ", id);
+    XWatchdog::Bind(&probe);
+    wheel.Bind();
+    pasv.Bind();
+    datapool.Bind();
+    probe_last_us = XMetrics::NowUs();
     int ret = event_base_dispatch(base);
 	if(ret == -1){
 	    Logger::error("XThread::Main() -> Thread_id ", id, ": event_base_dispatch failed");
 	}
     event_free(notify_event);
+    wheel.Stop();
+    pasv.Stop();
+    datapool.Stop();
+    if(probe_event) event_free(probe_event);
     event_base_free(base);
     Logger::info("XThread::Main() -> Thread_id ", id, " exit");
 }
@@ -87,6 +123,16 @@ bool XThread::Setup(){
     notify_recv_fd = fds[0];
     notify_send_fd = fds[1];
 
+    std::string label = "thread=\"" + std::to_string(id) + "\"";
+    metric_sessions = XMetrics::Get()->Register(XMETRIC_GAUGE, "ftp_sessions_active",
+                                                "Control connections owned by the worker", label);
+    metric_sessions_total = XMetrics::Get()->Register(XMETRIC_COUNTER, "ftp_sessions_total",
+                                                      "Control connections accepted by the worker", label);
+    metric_lag = XMetrics::Get()->Register(XMETRIC_HISTOGRAM, "ftp_worker_loop_lag_us",
+                                           "How late the worker's heartbeat timer fired", label);
+    metric_lag_last = XMetrics::Get()->Register(XMETRIC_GAUGE, "ftp_worker_loop_lag_last_us",
+                                                "Most recent heartbeat delay", label);
+
     event_config *ev_conf = event_config_new();
     event_config_set_flag(ev_conf, EVENT_BASE_FLAG_NOLOCK);
     this->base = event_base_new_with_config(ev_conf);
@@ -99,6 +145,37 @@ bool XThread::Setup(){
     notify_event = event_new(base, notify_recv_fd, EV_READ | EV_PERSIST, Notify_cb, this);
     event_add(notify_event, NULL);
 
+    // 心跳定时器：实际触发时间比预期晚多少，就是事件循环被阻塞了多久
+    probe.thread_id = id;
+    probe.metric_callback = XMetrics::Get()->Register(XMETRIC_HISTOGRAM, "ftp_worker_callback_us",
+                                                      "Time spent in a single event callback", label);
+    probe.metric_stalls = XMetrics::Get()->Register(XMETRIC_COUNTER, "ftp_worker_stalls_total",
+                                                    "Callbacks that exceeded stall_threshold_ms", label);
+    XWatchdog::Get()->Add(&probe);
+    int probe_ms = (int)XConfig::Get()->GetInt("loop_probe_ms", 100);
+    if(probe_ms > 0){
+        probe_interval_us = (uint64_t)probe_ms * 1000;
+        probe_event = event_new(base, -1, EV_PERSIST, ProbeCB, this);
+        timeval tv = {probe_ms / 1000, (probe_ms % 1000) * 1000};
+        event_add(probe_event, &tv);
+    }
+
+    // 超时时间轮：刻度越粗，重新计时越便宜，超时的精度也越低
+    if(!wheel.Start(base, (int)XConfig::Get()->GetInt("timer_tick_ms", 500))){
+        Logger::error("XThread::Setup() -> Thread_id ", id, ": timer wheel start failed");
+        return false;
+    }
+
+    // 被动模式端口：启动时全部 bind/listen，PASV 时只从空闲表中取
+    pasv.Setup(base, (int)XConfig::Get()->GetInt("pasv_port_min", 50000),
+               (int)XConfig::Get()->GetInt("pasv_port_max", 50999), id, count);
+
+    // 数据连接对象池：传输结束后回收 bufferevent / SSL 对象，下一次传输直接复用
+    if(!datapool.Setup(base, id, (int)XConfig::Get()->GetInt("data_pool_size", 32))){
+        Logger::error("XThread::Setup() -> Thread_id ", id, ": data connection pool start failed");
+        return false;
+    }
+
     return true;
 }
 
@@ -144,6 +221,20 @@ void XThread::AddTask(std::shared_ptr<XFtpServerCMD> t){
 }
 
 
+void XThread::Post(std::function<void()> fn){
+    posted_mutex.lock();
+    bool wake = posted.empty();
+    posted.push_back(std::move(fn));
+    posted_mutex.unlock();
+
+    if(!wake) return;     // 已有未处理的唤醒，回调会被一并执行
+    int re = write(notify_send_fd, "f", 1);
+    if(re <= 0){
+        Logger::error("XThread::Post() -> Thread_id ", id, ": write() error");
+    }
+}
+
+
 void XThread::Stop(){
     Logger::info("XThread::Stop() -> Thread_id ", id);
 
@@ -164,10 +255,12 @@ void XThread::clearConnectedTasks(XFtpServerCMD* task){
     
     for(auto it = active_tasks.begin(); it != active_tasks.end(); it++){
         if(it->get() == task){
-            active_tasks.erase(it);
+            // erase 会释放会话对象，先记日志
             Logger::info("XThread::clearConnectedTasks() -> Thread_id ", id, 
-                ": XFtpServerCMD ", task, " ip :", task->ip,
+                ": XFtpServerCMD ", task, " peer: ", task->peer, " ",
                 "removed from active_tasks");
+            active_tasks.erase(it);
+            XMetrics::Add(metric_sessions, -1);
             break;
         }
     }
@@ -4,9 +4,16 @@
 #include <list>               // C++标准库双向链表，用于存储任务队列
 #include <mutex>              // C++标准库互斥锁，用于线程同步
 #include <thread>             // C++标准库线程，用于多线程编程
+#include <vector>
+#include <atomic>
+#include <functional>         // std::function，跨线程投递的回调
 
 #include "XTask.h"
 #include "XFtpServerCMD.h"
+#include "XWatchdog.h"
+#include "XTimerWheel.h"
+#include "XPasvPool.h"
+#include "XDataPool.h"
 
 class XFtpServerCMD;                  // 前向声明，避免循环依赖
 struct event_base;            // libevent事件循环前向声明
@@ -65,6 +72,14 @@ public:
      */
     void AddTask(std::shared_ptr<XFtpServerCMD> task);
 
+    /**
+     * @brief 向本线程的事件循环投递回调
+     * 线程安全，可在任意线程（如XIOPool）调用；回调在本线程的事件循环中执行。
+     * 与新连接通知共用同一个管道，只在队列由空变为非空时写一次管道。
+     * @param fn 要执行的回调
+     */
+    void Post(std::function<void()> fn);
+
     /**
      * @brief 停止线程
      * 写入管道停止标志，通知线程退出事件循环
@@ -90,6 +105,12 @@ public:
     ~XThread();
 
     int id = 0;                        ///< 线程唯一标识符，用于调试和追踪
+    int count = 1;                     ///< 线程池中的工作线程数（被动端口按线程交错分配）
+
+    /**
+     * @brief 最近一次心跳测得的事件循环延迟（微秒），可在任意线程读取
+     */
+    uint64_t LoopLagUs() const { return lag_last_us.load(std::memory_order_relaxed); }
 
 private:
     std::thread *pthread = nullptr;                                              //< 线程对象，用于管理工作线程
@@ -100,4 +121,19 @@ private:
     std::list<std::shared_ptr<XFtpServerCMD>> active_tasks;                      //< 任务队列，存储正在处理的XTask对象指针
     std::mutex tasks_mutex;                   //< 任务队列互斥锁，保证线程安全访问
     struct event *notify_event;               // 通知事件对象
+    std::vector<std::function<void()>> posted;   //< 跨线程投递的回调队列
+    std::mutex posted_mutex;                      //< 回调队列互斥锁
+    int metric_sessions = -1;                     //< 活动会话数指标（XMetrics id）
+    int metric_sessions_total = -1;               //< 累计会话数指标
+    int metric_lag = -1;                          //< 事件循环延迟直方图
+    int metric_lag_last = -1;                     //< 最近一次探测到的延迟
+    struct event *probe_event = nullptr;          //< 心跳定时器，测量事件循环调度延迟
+    uint64_t probe_interval_us = 0;
+    uint64_t probe_last_us = 0;
+    std::atomic<uint64_t> lag_last_us{0};         //< 最近一次心跳延迟，供准入控制读取
+    XLoopProbe probe;                             //< 当前回调信息，供卡顿检测使用
+    XTimerWheel wheel;                            //< 会话空闲、数据连接与传输超时
+    XPasvPool pasv;                               //< 本线程的被动模式端口
+    XDataPool datapool;                           //< 可复用的数据连接对象
+    static void ProbeCB(evutil_socket_t fd, short what, void *arg);
 };
\ No newline at end of file
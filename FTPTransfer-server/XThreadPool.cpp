@@ -14,6 +14,7 @@ void XThreadPool::Init(int threadNum){
         Logger::info("XThreadPool::Init() create thread ", i);
         XThread* t = new XThread();
         t->id = i;
+        t->count = threadNum;
         if(!t->Start()){
             Logger::error("XThreadPool::Init() create thread failed");
             delete t;
@@ -17,6 +17,9 @@ public:
     void Init(int threadNum);
 
     void Dispatch(std::shared_ptr<XFtpServerCMD> task);
+
+    // 所有工作线程（Init 之后不再变化）
+    const std::vector<XThread*> &Threads() const { return threads; }
 private:
     int threadCount;
     int lastThread = -1;
@@ -0,0 +1,138 @@
+#include "XTimerWheel.h"
+#include "XMetrics.h"
+#include "testUtil.h"
+
+#include <event2/event.h>
+
+static thread_local XTimerWheel *current_wheel = nullptr;
+
+
+XTimerWheel::XTimerWheel(){
+    for(auto &s : slots) s.prev = s.next = &s;
+}
+
+
+XTimerWheel *XTimerWheel::Current(){
+    return current_wheel;
+}
+
+
+void XTimerWheel::Bind(){
+    current_wheel = this;
+}
+
+
+bool XTimerWheel::Start(event_base *base, int tick_ms){
+    if(tick_event) return false;
+    if(tick_ms <= 0) tick_ms = 1000;
+    tick_us = (uint64_t)tick_ms * 1000;
+    start_us = XMetrics::NowUs();
+    now_tick = 0;
+    tick_event = event_new(base, -1, EV_PERSIST, TickCB, this);
+    if(!tick_event) return false;
+    timeval tv = {tick_ms / 1000, (tick_ms % 1000) * 1000};
+    event_add(tick_event, &tv);
+    return true;
+}
+
+
+void XTimerWheel::Stop(){
+    if(tick_event){
+        event_free(tick_event);
+        tick_event = nullptr;
+    }
+    for(auto &s : slots){
+        while(s.next != &s){
+            XTimer *t = s.next;
+            Unlink(t);
+            t->wheel = nullptr;
+        }
+    }
+    count = 0;
+}
+
+
+void XTimerWheel::Unlink(XTimer *t){
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->prev = t->next = nullptr;
+}
+
+
+void XTimerWheel::Link(XTimer *t){
+    XTimer *head = &slots[t->deadline & (SLOTS - 1)];
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+
+void XTimerWheel::Arm(XTimer *t, uint64_t ms){
+    uint64_t ticks = (ms * 1000 + tick_us - 1) / tick_us;
+    // +1：当前刻度已经过去了一部分，保证至少等满 ms
+    uint64_t deadline = now_tick + (ticks ? ticks : 1) + 1;
+
+    if(t->wheel == this){
+        // 只延后：节点留在原槽，经过时再挪（见 Advance）
+        if(deadline >= t->deadline){
+            t->deadline = deadline;
+            return;
+        }
+        Unlink(t);          // 提前到期：挪到更早的槽
+    }
+    else{
+        Cancel(t);
+        t->wheel = this;
+        count++;
+    }
+    t->deadline = deadline;
+    Link(t);
+}
+
+
+void XTimerWheel::Cancel(XTimer *t){
+    if(!t->wheel) return;
+    Unlink(t);
+    t->wheel->count--;
+    t->wheel = nullptr;
+}
+
+
+void XTimerWheel::TickCB(evutil_socket_t, short, void *arg){
+    ((XTimerWheel *)arg)->Advance();
+}
+
+
+void XTimerWheel::Advance(){
+    uint64_t target = (XMetrics::NowUs() - start_us) / tick_us;
+    // 事件循环被阻塞过久时最多补走一圈，剩下的过期节点在下一次经过时处理
+    if(target > now_tick + SLOTS) now_tick = target - SLOTS;
+
+    while(now_tick < target){
+        now_tick++;
+        XTimer *head = &slots[now_tick & (SLOTS - 1)];
+        if(head->next == head) continue;
+
+        // 先把整个槽摘到本地链表：回调里可能启动/取消任意定时器，
+        // 没到期的节点重新挂回时也不会在本轮被再次遍历
+        XTimer pending;
+        pending.next = head->next;
+        pending.prev = head->prev;
+        pending.next->prev = &pending;
+        pending.prev->next = &pending;
+        head->prev = head->next = head;
+
+        while(pending.next != &pending){
+            XTimer *t = pending.next;
+            Unlink(t);
+            if(t->deadline > now_tick){
+                Link(t);            // 被延后过，或者还要再转几圈
+                continue;
+            }
+            t->wheel = nullptr;
+            count--;
+            if(t->fn) t->fn(t->arg);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <event2/util.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct event_base;
+struct event;
+class XTimerWheel;
+
+/**
+ * @brief 时间轮中的一个定时器（侵入式双向链表节点，由使用者持有，不分配内存）
+ */
+struct XTimer{
+    XTimer *prev = nullptr;
+    XTimer *next = nullptr;
+    uint64_t deadline = 0;              // 到期刻度
+    XTimerWheel *wheel = nullptr;       // 所在时间轮，nullptr 表示未启动
+    void (*fn)(void *arg) = nullptr;    // 到期回调（在所属工作线程中执行）
+    void *arg = nullptr;
+
+    bool Armed() const { return wheel != nullptr; }
+};
+
+/**
+ * @class XTimerWheel
+ * @brief 每个工作线程一个的哈希时间轮，用于会话空闲、连接与传输超时
+ *
+ * 超时按刻度（tick_ms）取整，落在 deadline % SLOTS 的槽中；超过一圈的超时在经过时重新挂到对应槽。
+ * 启动/取消都是 O(1) 的链表操作；延后到期时间（连接有活动时重新计时）只改 deadline，
+ * 节点留在原槽，等经过时再挪到新位置，所以频繁的重新计时只是一次赋值。
+ * 只能在所属线程中使用，不加锁。
+ */
+class XTimerWheel{
+public:
+    // 当前线程的时间轮，不在工作线程中时为 nullptr
+    static XTimerWheel *Current();
+
+    // 在 base 上启动刻度定时器（XThread::Setup 中调用）
+    bool Start(event_base *base, int tick_ms);
+
+    // 绑定到当前线程（XThread::Main 开始时调用）
+    void Bind();
+
+    // 停止刻度定时器，仍在轮中的定时器全部摘除（XThread::Main 退出前调用）
+    void Stop();
+
+    // 启动或重新计时，ms 毫秒后（按刻度向上取整）调用 t->fn
+    void Arm(XTimer *t, uint64_t ms);
+
+    // 取消定时器（未启动时什么都不做）
+    static void Cancel(XTimer *t);
+
+    // 轮中的定时器数量
+    size_t Size() const { return count; }
+
+    XTimerWheel();
+    XTimerWheel(const XTimerWheel &) = delete;
+    XTimerWheel &operator=(const XTimerWheel &) = delete;
+
+private:
+    static const uint32_t SLOTS = 512;      // 必须为 2 的幂
+
+    static void TickCB(evutil_socket_t fd, short what, void *arg);
+    void Advance();
+    void Link(XTimer *t);
+    static void Unlink(XTimer *t);
+
+    XTimer slots[SLOTS];                    // 每个槽的哨兵节点（循环链表）
+    uint64_t now_tick = 0;                  // 已处理到的刻度
+    uint64_t start_us = 0;
+    uint64_t tick_us = 0;
+    size_t count = 0;
+    struct event *tick_event = nullptr;
+};
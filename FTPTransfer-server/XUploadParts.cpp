@@ -0,0 +1,341 @@
+#include "XUploadParts.h"
+#include "XMetrics.h"
+#include "XQuota.h"
+#include "testUtil.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+#define XPART_MAGIC "XPART"
+#define XPART_VERSION 1
+
+static XMetricFamily ranges_total(XMETRIC_COUNTER, "ftp_upload_ranges_total",
+                                  "Ranged STOR transfers by outcome", "result");
+
+
+XPartFile::~XPartFile(){
+    if(fd >= 0) close(fd);
+    if(dir_fd >= 0) close(dir_fd);
+}
+
+
+XUploadParts* XUploadParts::Get(){
+    static XUploadParts parts;
+    return &parts;
+}
+
+
+// 预分配 size 字节：Linux 上真正分配磁盘块（空间不足在开始时就报错），其余平台只设置文件大小
+static int Preallocate(int fd, off_t size){
+    #ifdef __linux__
+    if(size > 0){
+        int rc = posix_fallocate(fd, 0, size);
+        if(rc != EOPNOTSUPP && rc != EINVAL) return rc;
+    }
+    #endif
+    return ftruncate(fd, size) == 0 ? 0 : errno;
+}
+
+
+// 并入 [s, e)，与重叠或相邻的范围合并
+static void Merge(map<off_t, off_t> &m, off_t s, off_t e){
+    auto it = m.upper_bound(s);
+    if(it != m.begin()){
+        auto p = std::prev(it);
+        if(p->second >= s){
+            s = p->first;
+            e = max(e, p->second);
+            m.erase(p);
+        }
+    }
+    while(it != m.end() && it->first <= e){
+        e = max(e, it->second);
+        it = m.erase(it);
+    }
+    m[s] = e;
+}
+
+
+off_t XUploadParts::Received(const XPartFile &f){
+    off_t n = 0;
+    for(auto &e : f.extents) n += e.second - e.first;
+    return n;
+}
+
+
+// 相对 dir_fd 打开 name，不跟随符号链接（名字里没有 /，只作用于这个目录）
+static int OpenAt(int dir_fd, const string &name, int flags){
+    return openat(dir_fd, name.c_str(), flags | O_NOFOLLOW | O_CLOEXEC, 0644);
+}
+
+
+bool XUploadParts::Load(int dir_fd, const string &name, off_t &total, map<off_t, off_t> &extents){
+    int fd = OpenAt(dir_fd, name + ".part.map", O_RDONLY);
+    FILE *in = fd >= 0 ? fdopen(fd, "r") : nullptr;
+    if(!in){
+        if(fd >= 0) close(fd);
+        return false;
+    }
+    char magic[8] = {0};
+    int version = 0;
+    long long t = -1;
+    bool ok = fscanf(in, "%7s %d %lld", magic, &version, &t) == 3 &&
+              strcmp(magic, XPART_MAGIC) == 0 && version == XPART_VERSION && t >= 0;
+    extents.clear();
+    long long s, e;
+    while(ok && fscanf(in, "%lld %lld", &s, &e) == 2){
+        if(s < 0 || e <= s || e > t){
+            ok = false;
+            break;
+        }
+        Merge(extents, s, e);
+    }
+    fclose(in);
+    if(!ok){
+        Logger::warning("XUploadParts::Load() -> ", name, ".part.map is corrupt, ignored");
+        extents.clear();
+        return false;
+    }
+    total = t;
+    return true;
+}
+
+
+// 目录中 name 的大小：不存在或不是普通文件时返回 -1
+static off_t SizeAt(int dir_fd, const string &name){
+    struct stat st;
+    if(fstatat(dir_fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) return -1;
+    return st.st_size;
+}
+
+
+bool XUploadParts::Save(XPartFile &f, string &err){
+    string file = f.name + ".part.map";
+    string tmp = file + ".tmp";
+    int fd = OpenAt(f.dir_fd, tmp, O_WRONLY | O_CREAT | O_TRUNC);
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : nullptr;
+    if(!out){
+        err = strerror(errno);
+        if(fd >= 0) close(fd);
+        return false;
+    }
+    fprintf(out, "%s %d %lld\n", XPART_MAGIC, XPART_VERSION, (long long)f.total);
+    for(auto &e : f.extents) fprintf(out, "%lld %lld\n", (long long)e.first, (long long)e.second);
+    // 范围表记录的数据已经落盘，表本身也先落盘再替换
+    bool ok = fflush(out) == 0 && fsync(fileno(out)) == 0;
+    if(!ok) err = strerror(errno);
+    off_t size = ok ? ftello(out) : -1;
+    if(fclose(out) != 0 && ok){
+        err = strerror(errno);
+        ok = false;
+    }
+    if(ok && renameat(f.dir_fd, tmp.c_str(), f.dir_fd, file.c_str()) != 0){
+        err = strerror(errno);
+        ok = false;
+    }
+    if(!ok){
+        unlinkat(f.dir_fd, tmp.c_str(), 0);
+        return false;
+    }
+    // 范围表替换了原来的（或新建），大小变化记入用量
+    XQuota::Get()->Charge(f.user, f.path + ".part.map", size - max<off_t>(f.map_size, 0), f.map_size < 0 ? 1 : 0);
+    f.map_size = size;
+    return true;
+}
+
+
+// 在 f 的锁内准备好数据文件：沿用磁盘上的进度或按 total 新建并预分配；成功返回空串，否则返回 FTP 应答
+string XUploadParts::Prepare(XPartFile &f, int dir_fd, off_t total){
+    if(f.committed) return "553 File already exists.\r\n";
+    if(f.fd < 0){
+        if(f.dir_fd < 0){
+            f.dir_fd = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+            if(f.dir_fd < 0){
+                Logger::error("XUploadParts::Prepare() -> cannot duplicate the directory fd, ", strerror(errno));
+                return "451 Local error in processing.\r\n";
+            }
+        }
+        string part = f.name + ".part";
+        f.map_size = SizeAt(f.dir_fd, f.name + ".part.map");
+        // 断线或重启后继续：范围表与数据文件都在且大小一致
+        if(Load(f.dir_fd, f.name, f.total, f.extents)){
+            f.fd = OpenAt(f.dir_fd, part, O_RDWR);
+            struct stat st;
+            if(f.fd < 0 || fstat(f.fd, &st) != 0 || st.st_size != f.total){
+                Logger::warning("XUploadParts::Prepare() -> ", f.path, ".part is missing or resized, starting over");
+                if(f.fd >= 0) close(f.fd);
+                f.fd = -1;
+                f.extents.clear();
+            }
+            else{
+                Logger::info("XUploadParts::Prepare() -> resuming ", f.path, ", ", Received(f), " of ", f.total, " bytes");
+            }
+        }
+        if(f.fd < 0){
+            if(total < 0) return "503 Send ALLO with the file size before a ranged STOR.\r\n";
+            struct stat st;
+            if(fstatat(f.dir_fd, f.name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0) return "553 File already exists.\r\n";
+            f.total = total;
+            off_t old = SizeAt(f.dir_fd, part);      // 重新开始时被截断的旧数据文件
+            f.fd = OpenAt(f.dir_fd, part, O_RDWR | O_CREAT | O_TRUNC);
+            if(f.fd < 0){
+                int err = errno;
+                Logger::error("XUploadParts::Prepare() -> cannot create ", f.path, ".part, ", strerror(err));
+                return err == EACCES || err == EPERM || err == ELOOP ? "550 Permission denied.\r\n" :
+                       err == ENOENT ? "550 Directory does not exist.\r\n" : "550 Cannot create file.\r\n";
+            }
+            int rc = Preallocate(f.fd, total);
+            string err;
+            if(rc != 0 || !Save(f, err)){
+                Logger::error("XUploadParts::Prepare() -> cannot prepare ", f.path, ".part, ", rc ? strerror(rc) : err);
+                close(f.fd);
+                f.fd = -1;
+                unlinkat(f.dir_fd, part.c_str(), 0);
+                if(old >= 0) XQuota::Get()->Charge(f.user, f.path + ".part", -old, -1);
+                return rc == ENOSPC ? "552 Storage allocation exceeded.\r\n" : "550 Cannot create file.\r\n";
+            }
+            // 预分配的数据文件整个算作用量（开始前已按 ALLO 声明的大小检查过配额）
+            XQuota::Get()->Charge(f.user, f.path + ".part", total - max<off_t>(old, 0), old < 0 ? 1 : 0);
+            Logger::info("XUploadParts::Prepare() -> new ranged upload ", f.path, ", ", total, " bytes");
+        }
+    }
+    if(total >= 0 && total != f.total){
+        return "501 Size does not match the upload in progress (" + to_string(f.total) + " bytes).\r\n";
+    }
+    return "";
+}
+
+
+shared_ptr<XPartFile> XUploadParts::Open(int dir_fd, const string &path, const string &name,
+                                         off_t total, const string &user, string &reply){
+    shared_ptr<XPartFile> f;
+    {
+        lock_guard<mutex> lock(parts_mutex);
+        auto it = parts.find(path);
+        if(it != parts.end()){
+            f = it->second;
+        }
+        else{
+            f = make_shared<XPartFile>();
+            f->path = path;
+            f->name = name;
+            f->user = user;
+            parts[path] = f;
+        }
+        f->writers++;
+    }
+    // 预分配与写范围表可能很慢，只持有这个上传自己的锁
+    {
+        lock_guard<mutex> lock(f->mtx);
+        reply = Prepare(*f, dir_fd, total);
+    }
+    if(!reply.empty()){
+        Release(f);
+        return nullptr;
+    }
+    return f;
+}
+
+
+XPartResult XUploadParts::Record(shared_ptr<XPartFile> f, off_t start, off_t end, off_t &received, string &err){
+    // 先让数据落盘，范围表里记录的部分断电后也一定在
+    bool synced = true;
+    if(end > start){
+        #ifdef __APPLE__
+        synced = fsync(f->fd) == 0;
+        #else
+        synced = fdatasync(f->fd) == 0;
+        #endif
+        if(!synced) err = strerror(errno);
+    }
+
+    XPartResult r;
+    {
+        lock_guard<mutex> lock(f->mtx);
+        r = f->committed ? XPART_COMMITTED : XPART_STORED;
+        if(!synced){
+            r = XPART_FAILED;
+        }
+        else if(end > start && !f->committed){
+            Merge(f->extents, start, end);
+            if(Received(*f) == f->total){
+                string part = f->name + ".part";
+                off_t replaced = SizeAt(f->dir_fd, f->name);    // 开始之后别人放上的同名文件
+                if(renameat(f->dir_fd, part.c_str(), f->dir_fd, f->name.c_str()) == 0){
+                    // name.part 改名为目标文件，用量不变；被替换的文件与删除的范围表扣除
+                    if(replaced >= 0) XQuota::Get()->Charge(f->user, f->path, -replaced, -1);
+                    if(unlinkat(f->dir_fd, (f->name + ".part.map").c_str(), 0) == 0 && f->map_size >= 0){
+                        XQuota::Get()->Charge(f->user, f->path + ".part.map", -f->map_size, -1);
+                        f->map_size = -1;
+                    }
+                    f->committed = true;
+                    r = XPART_COMMITTED;
+                    Logger::info("XUploadParts::Record() -> ", f->path, " assembled, ", f->total, " bytes");
+                }
+                else{
+                    err = strerror(errno);
+                    r = XPART_FAILED;
+                }
+            }
+            if(r == XPART_STORED && !Save(*f, err)) r = XPART_FAILED;
+        }
+        received = Received(*f);
+    }
+    static const char *results[] = {"stored", "committed", "failed"};
+    XMetrics::Add(ranges_total.Id(results[r]), 1);
+    Release(f);
+    return r;
+}
+
+
+void XUploadParts::Release(shared_ptr<XPartFile> f){
+    lock_guard<mutex> lock(parts_mutex);
+    Unref(f);
+}
+
+
+void XUploadParts::Unref(const shared_ptr<XPartFile> &f){
+    // 没有传输在写时从表中移除（范围表在磁盘上，下次 Open 时重新读取）
+    if(--f->writers > 0) return;
+    auto it = parts.find(f->path);
+    if(it != parts.end() && it->second == f) parts.erase(it);
+}
+
+
+bool XUploadParts::Describe(int dir_fd, const string &path, const string &name,
+                            off_t &total, off_t &received, string &ranges){
+    shared_ptr<XPartFile> f;
+    {
+        lock_guard<mutex> lock(parts_mutex);
+        auto it = parts.find(path);
+        if(it != parts.end()) f = it->second;
+    }
+    map<off_t, off_t> extents;
+    bool found = false;
+    if(f){
+        lock_guard<mutex> lock(f->mtx);
+        if(f->fd >= 0 && !f->committed){
+            total = f->total;
+            extents = f->extents;
+            found = true;
+        }
+    }
+    if(!found && !Load(dir_fd, name, total, extents)) return false;
+
+    received = 0;
+    ranges.clear();
+    for(auto &e : extents){
+        received += e.second - e.first;
+        if(!ranges.empty()) ranges += ",";
+        ranges += to_string(e.first) + "-" + to_string(e.second - 1);
+    }
+    if(ranges.empty()) ranges = "-";
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+
+// 一个进行中的分段上传：数据写入 name.part（预分配到总大小），已落盘的范围记在 name.part.map
+// 这几个文件都相对所在目录的 fd 按名字操作，不跟随符号链接，不会越出会话的根目录
+struct XPartFile{
+    std::string path;                    // 目标文件的真实路径（上传表的键，日志用）
+    std::string name;                    // 目标文件名（不含目录）
+    std::string user;                    // 开始上传的用户，分段文件的用量记在其名下
+    int dir_fd = -1;                     // 所在目录
+    int fd = -1;                         // name.part，各传输按偏移 pwrite
+    off_t total = 0;
+    std::map<off_t, off_t> extents;      // 已落盘的范围 start -> end（不含），相邻的合并
+    off_t map_size = -1;                 // 磁盘上 name.part.map 的大小（记入配额用量的部分），-1 表示没有
+    int writers = 0;                     // 正在写入的传输数（由 XUploadParts 的表锁保护）
+    bool committed = false;              // 已收齐并改名为目标文件
+    std::mutex mtx;                      // 保护 fd、total、extents、committed 与磁盘上的文件
+    ~XPartFile();
+};
+
+// Record 的结果
+enum XPartResult{
+    XPART_STORED = 0,                    // 范围已记录，文件还不完整
+    XPART_COMMITTED,                     // 收齐，已改名为目标文件
+    XPART_FAILED,
+};
+
+/**
+ * @class XUploadParts
+ * @brief 分段并行上传（ALLO + RANG + STOR）的服务端拼装
+ *
+ * 客户端用 ALLO 声明文件大小，之后在多条控制连接上各自 RANG + STOR 同一文件的不同范围。
+ * 同一目标文件的所有传输共用一个 XPartFile（name.part，按偏移 pwrite，互不影响）；
+ * 每个范围传输结束时先 fdatasync 再把实际写入的部分并入范围表并写回 name.part.map（临时文件 + rename），
+ * 范围表覆盖整个文件时 name.part 改名为目标文件。范围表在磁盘上，断线或重启后继续 RANG + STOR 缺的部分即可，
+ * SITE RANGES 查询已收到的范围。
+ *
+ * name.part 与范围表都是用户目录里实际占用的文件，创建与改写时就记入配额用量（XQuota），
+ * 改名为目标文件时文件数与大小都不变，之后的遍历也照常计算它们。
+ *
+ * 上传表在各工作线程与 XIOPool 之间共享，表锁只在查找与增减写入数时持有；预分配、落盘与改名只持有
+ * 所属上传自己的锁，一个上传的磁盘同步不会挡住别的上传。Open 与 Record 都会落盘，在 XIOPool 中调用。
+ */
+class XUploadParts{
+public:
+    static XUploadParts* Get();
+
+    // 开始写 path 的一个范围（阻塞，在 XIOPool 中调用）：已有进行中的上传（内存或 name.part.map）时沿用，
+    // 否则按 total 新建并预分配。dir_fd 为目标所在目录（调用者持有，需要时复制一份），name 为文件名；
+    // total 为 ALLO 声明的大小，-1 表示未声明，user 为当前用户；失败返回 nullptr，reply 为 FTP 应答
+    std::shared_ptr<XPartFile> Open(int dir_fd, const std::string &path, const std::string &name,
+                                    off_t total, const std::string &user, std::string &reply);
+
+    // 一个范围传输结束（阻塞，在 XIOPool 中调用）：[start, end) 已写入，落盘后记录，收齐时提交；
+    // 同时结束这次写入。received 为记录后已收到的字节数，err 为失败原因
+    XPartResult Record(std::shared_ptr<XPartFile> f, off_t start, off_t end, off_t &received, std::string &err);
+
+    // 结束一次没有写入数据的 Open
+    void Release(std::shared_ptr<XPartFile> f);
+
+    // 已收到的范围：返回 false 表示没有进行中的上传；ranges 为 "0-1023,4096-8191"（含两端），一段都没有时为 "-"
+    bool Describe(int dir_fd, const std::string &path, const std::string &name,
+                  off_t &total, off_t &received, std::string &ranges);
+
+    // 范围表已覆盖的字节数
+    static off_t Received(const XPartFile &f);
+
+private:
+    XUploadParts(){}
+    static bool Load(int dir_fd, const std::string &name, off_t &total, std::map<off_t, off_t> &extents);
+    static bool Save(XPartFile &f, std::string &err);
+    static std::string Prepare(XPartFile &f, int dir_fd, off_t total);
+    void Unref(const std::shared_ptr<XPartFile> &f);
+
+    std::mutex parts_mutex;              // 只保护 parts 与各上传的 writers
+    std::map<std::string, std::shared_ptr<XPartFile>> parts;   // 目标路径 -> 有传输在写的上传
+};
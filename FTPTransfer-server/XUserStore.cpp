@@ -0,0 +1,258 @@
+#include "XUserStore.h"
+#include "XConfig.h"
+#include "XMetrics.h"
+#include "testUtil.h"
+
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include <fstream>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// 生成散列的默认参数：scrypt N = 2^15，r = 8，p = 1（约 32MB 内存），盐 16 字节，散列 32 字节
+#define XUSER_SCRYPT_LN    15
+#define XUSER_SCRYPT_R     8
+#define XUSER_SCRYPT_P     1
+#define XUSER_SALT_LEN     16
+#define XUSER_HASH_LEN     32
+#define XUSER_CACHE_MAX    4096
+
+static XMetricFamily cache_lookups(XMETRIC_COUNTER, "ftp_auth_cache_lookups_total",
+                                   "Verified-credential cache lookups by result", "result");
+
+
+XUserStore* XUserStore::Get(){
+    static XUserStore store;
+    return &store;
+}
+
+
+static string B64Encode(const unsigned char *data, size_t len){
+    string out(4 * ((len + 2) / 3) + 1, '\0');
+    int n = EVP_EncodeBlock((unsigned char *)&out[0], data, (int)len);
+    out.resize(n);
+    while(!out.empty() && out.back() == '=') out.pop_back();
+    return out;
+}
+
+
+static bool B64Decode(string in, string &out){
+    while(in.size() % 4) in += '=';
+    size_t pad = 0;
+    for(size_t i = in.size(); i > 0 && in[i - 1] == '='; i--) pad++;
+    out.assign(3 * in.size() / 4, '\0');
+    int n = EVP_DecodeBlock((unsigned char *)&out[0], (const unsigned char *)in.data(), (int)in.size());
+    if(n < 0 || (size_t)n < pad) return false;
+    out.resize(n - pad);
+    return true;
+}
+
+
+static vector<string> Split(const string &s, char sep){
+    vector<string> parts;
+    size_t i = 0;
+    while(true){
+        size_t j = s.find(sep, i);
+        parts.push_back(s.substr(i, j == string::npos ? string::npos : j - i));
+        if(j == string::npos) break;
+        i = j + 1;
+    }
+    return parts;
+}
+
+
+// 按散列字符串中的算法与参数重算 password 的散列并比较
+static bool Check(const string &hash, const string &password){
+    vector<string> f = Split(hash, '$');
+    if(f.size() != 5 || !f[0].empty()) return false;
+    string salt, expect;
+    if(!B64Decode(f[3], salt) || !B64Decode(f[4], expect) || expect.empty() || expect.size() > 64) return false;
+    unsigned char out[64];
+    bool ok = false;
+    if(f[1] == "scrypt"){
+        int ln = 0, r = 0, p = 0;
+        if(sscanf(f[2].c_str(), "ln=%d,r=%d,p=%d", &ln, &r, &p) != 3 ||
+           ln < 1 || ln > 20 || r < 1 || r > 32 || p < 1 || p > 16) return false;
+        uint64_t N = 1ULL << ln;
+        uint64_t maxmem = 128ULL * r * (N + p) + (1 << 20);
+        ok = EVP_PBE_scrypt(password.data(), password.size(), (const unsigned char *)salt.data(), salt.size(),
+                            N, r, p, maxmem, out, expect.size()) == 1;
+    }
+    else if(f[1] == "pbkdf2-sha256"){
+        long iter = atol(f[2].c_str());
+        if(iter < 1 || iter > 10000000) return false;
+        ok = PKCS5_PBKDF2_HMAC(password.data(), (int)password.size(), (const unsigned char *)salt.data(),
+                               (int)salt.size(), (int)iter, EVP_sha256(), (int)expect.size(), out) == 1;
+    }
+    return ok && CRYPTO_memcmp(out, expect.data(), expect.size()) == 0;
+}
+
+
+string XUserStore::Hash(const string &password){
+    unsigned char salt[XUSER_SALT_LEN], out[XUSER_HASH_LEN];
+    if(RAND_bytes(salt, sizeof(salt)) != 1) return "";
+    if(EVP_PBE_scrypt(password.data(), password.size(), salt, sizeof(salt), 1ULL << XUSER_SCRYPT_LN,
+                      XUSER_SCRYPT_R, XUSER_SCRYPT_P, 64ULL << 20, out, sizeof(out)) != 1) return "";
+    char params[64];
+    snprintf(params, sizeof(params), "$scrypt$ln=%d,r=%d,p=%d$", XUSER_SCRYPT_LN, XUSER_SCRYPT_R, XUSER_SCRYPT_P);
+    return params + B64Encode(salt, sizeof(salt)) + "$" + B64Encode(out, sizeof(out));
+}
+
+
+bool XUserStore::Init(){
+    file = XConfig::Get()->GetString("users_file");
+    cache_ttl = chrono::seconds(max(0LL, XConfig::Get()->GetInt("auth_cache_ttl", 60)));
+    if(file.empty()){
+        // 开放模式没有按用户的根目录，必须显式给出，不猜测某个本机路径
+        default_root = XConfig::Get()->GetString("default_root");
+        while(default_root.size() > 1 && default_root.back() == '/') default_root.pop_back();
+        struct stat st;
+        if(default_root.empty() || default_root[0] != '/'){
+            Logger::error("XUserStore::Init() -> users_file not set, default_root must be an absolute directory");
+            return false;
+        }
+        if(stat(default_root.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)){
+            Logger::error("XUserStore::Init() -> default_root ", default_root, " is not a directory");
+            return false;
+        }
+        Logger::warning("XUserStore::Init() -> users_file not set, any USER/PASS is accepted, root ", default_root);
+        return true;
+    }
+    RAND_bytes(cache_key, sizeof(cache_key));
+    dummy = Hash("");
+    lock_guard<mutex> lock(users_mutex);
+    if(!Load()) Logger::error("XUserStore::Init() -> cannot read ", file, ", ", strerror(errno), "; no user can log in");
+    return true;
+}
+
+
+bool XUserStore::Load(){
+    struct stat st;
+    if(stat(file.c_str(), &st) != 0){
+        users.clear();
+        file_size = -1;
+        return false;
+    }
+    ifstream in(file);
+    if(!in) return false;
+    map<string, XUserInfo> loaded;
+    string line;
+    int lineno = 0;
+    while(getline(in, line)){
+        lineno++;
+        while(!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+        if(line.empty() || line[0] == '#') continue;
+        // 名字:散列:根目录（根目录可能含 :，取第二个 : 之后的全部）
+        size_t a = line.find(':');
+        size_t b = a == string::npos ? a : line.find(':', a + 1);
+        if(b == string::npos){
+            Logger::warning("XUserStore::Load() -> ", file, ":", lineno, " malformed, skipped");
+            continue;
+        }
+        XUserInfo u;
+        u.name = line.substr(0, a);
+        u.hash = line.substr(a + 1, b - a - 1);
+        u.root = line.substr(b + 1);
+        if(u.name.empty() || u.root.empty() || u.root[0] != '/'){
+            Logger::warning("XUserStore::Load() -> ", file, ":", lineno, " needs a name and an absolute root, skipped");
+            continue;
+        }
+        struct stat rs;
+        if(stat(u.root.c_str(), &rs) != 0 || !S_ISDIR(rs.st_mode)){
+            Logger::warning("XUserStore::Load() -> root of ", u.name, " is not a directory: ", u.root);
+        }
+        // 会话路径为 根目录 + 当前目录（以 / 开头），根目录本身不带结尾的 /
+        while(!u.root.empty() && u.root.back() == '/') u.root.pop_back();
+        loaded[u.name] = u;
+    }
+    users.swap(loaded);
+    file_mtime = st.st_mtime;
+    #ifdef __APPLE__
+    file_mtime_ns = st.st_mtimespec.tv_nsec;
+    #else
+    file_mtime_ns = st.st_mtim.tv_nsec;
+    #endif
+    file_size = st.st_size;
+    Logger::info("XUserStore::Load() -> ", users.size(), " users from ", file);
+    return true;
+}
+
+
+bool XUserStore::Find(const string &name, XUserInfo &u){
+    lock_guard<mutex> lock(users_mutex);
+    struct stat st;
+    if(stat(file.c_str(), &st) == 0){
+        #ifdef __APPLE__
+        long ns = st.st_mtimespec.tv_nsec;
+        #else
+        long ns = st.st_mtim.tv_nsec;
+        #endif
+        if(st.st_mtime != file_mtime || ns != file_mtime_ns || st.st_size != file_size) Load();
+    }
+    auto it = users.find(name);
+    if(it == users.end()) return false;
+    u = it->second;
+    return true;
+}
+
+
+vector<XUserInfo> XUserStore::List(){
+    lock_guard<mutex> lock(users_mutex);
+    vector<XUserInfo> out;
+    for(auto &u : users) out.push_back(u.second);
+    return out;
+}
+
+
+bool XUserStore::CacheHit(const XUserInfo &u, const string &password, string &mac){
+    // 散列也计入 HMAC：用户改了口令后旧的缓存自然失效
+    string msg = u.hash;
+    msg += '\0';
+    msg += password;
+    unsigned char out[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    HMAC(EVP_sha256(), cache_key, sizeof(cache_key), (const unsigned char *)msg.data(), msg.size(), out, &len);
+    OPENSSL_cleanse(&msg[0], msg.size());
+    mac.assign((const char *)out, len);
+
+    lock_guard<mutex> lock(cache_mutex);
+    auto it = cache.find(u.name);
+    bool hit = it != cache.end() && it->second.expires > chrono::steady_clock::now() &&
+               it->second.mac.size() == mac.size() && CRYPTO_memcmp(it->second.mac.data(), mac.data(), mac.size()) == 0;
+    XMetrics::Add(cache_lookups.Id(hit ? "hit" : "miss"), 1);
+    return hit;
+}
+
+
+void XUserStore::CacheStore(const XUserInfo &u, const string &mac){
+    lock_guard<mutex> lock(cache_mutex);
+    auto now = chrono::steady_clock::now();
+    if(cache.size() >= XUSER_CACHE_MAX){
+        for(auto it = cache.begin(); it != cache.end(); ){
+            if(it->second.expires <= now) it = cache.erase(it);
+            else ++it;
+        }
+        if(cache.size() >= XUSER_CACHE_MAX) cache.erase(cache.begin());
+    }
+    cache[u.name] = CacheEntry{mac, now + cache_ttl};
+}
+
+
+bool XUserStore::Verify(const XUserInfo &u, const string &password){
+    if(u.hash.empty()){
+        Check(dummy, password);
+        return false;
+    }
+    string mac;
+    bool caching = cache_ttl.count() > 0;
+    if(caching && CacheHit(u, password, mac)) return true;
+    if(!Check(u.hash, password)) return false;
+    if(caching) CacheStore(u, mac);
+    return true;
+}
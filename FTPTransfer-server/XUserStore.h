@@ -0,0 +1,75 @@
+#pragma once
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// 用户表中的一个用户
+struct XUserInfo{
+    std::string name;
+    std::string hash;                    // 口令散列（$scrypt$... 或 $pbkdf2-sha256$...）
+    std::string root;                    // 根目录（绝对路径，不带结尾的 /）
+};
+
+/**
+ * @class XUserStore
+ * @brief 本地用户表与口令校验
+ *
+ * users_file 每行一个用户 "名字:散列:根目录"，# 开头为注释；文件变化（mtime / 大小）后下次 USER 时重新读取。
+ * 散列为 scrypt（$scrypt$ln=15,r=8,p=1$<盐>$<散列>，base64 不补 =）或 PBKDF2-HMAC-SHA256
+ * （$pbkdf2-sha256$<轮数>$<盐>$<散列>），由 OpenSSL 计算；ftpSrv --hash-password 从标准输入读口令生成 scrypt 散列。
+ * 校验很慢（故意的），在 XIOPool 中进行；校验通过的 (用户, 口令) 以带进程随机密钥的 HMAC 缓存 auth_cache_ttl 秒，
+ * 断线重连风暴时不必每次重算。未配置 users_file 时为开放模式：任何用户名口令都能登录，根目录为 default_root。
+ */
+class XUserStore{
+public:
+    static XUserStore* Get();
+
+    // 读取配置与用户表（启动时调用一次）；开放模式下 default_root 未设置或不是目录时返回 false，服务器不启动
+    bool Init();
+
+    // 开放模式（未配置用户表）
+    bool OpenMode() const { return file.empty(); }
+
+    // 开放模式下所有会话的根目录（default_root，不带结尾的 /）
+    const std::string &DefaultRoot() const { return default_root; }
+
+    // 查找用户；用户表有变化时先重新读取
+    bool Find(const std::string &name, XUserInfo &u);
+
+    // 用户表中的所有用户
+    std::vector<XUserInfo> List();
+
+    // 校验口令（阻塞，在 XIOPool 中调用）；u 为空用户时按默认参数空算一次，不暴露用户是否存在
+    bool Verify(const XUserInfo &u, const std::string &password);
+
+    // 按默认参数生成 scrypt 散列
+    static std::string Hash(const std::string &password);
+
+private:
+    XUserStore(){}
+    bool Load();
+    bool CacheHit(const XUserInfo &u, const std::string &password, std::string &mac);
+    void CacheStore(const XUserInfo &u, const std::string &mac);
+
+    std::string file;
+    std::string default_root;
+    std::chrono::seconds cache_ttl{60};
+    std::string dummy;                   // 不存在的用户校验用的散列
+    unsigned char cache_key[32] = {0};   // 缓存 HMAC 的进程随机密钥
+
+    std::mutex users_mutex;
+    std::map<std::string, XUserInfo> users;
+    time_t file_mtime = 0;
+    long file_mtime_ns = 0;
+    off_t file_size = -1;
+
+    struct CacheEntry{
+        std::string mac;                 // HMAC(cache_key, 散列 \0 口令)
+        std::chrono::steady_clock::time_point expires;
+    };
+    std::mutex cache_mutex;
+    std::map<std::string, CacheEntry> cache;
+};
@@ -0,0 +1,346 @@
+#include "XVfs.h"
+#include "XMetrics.h"
+#include "testUtil.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+#endif
+
+using namespace std;
+
+#define XVFS_CACHE_MAX     16           // 每个会话缓存的目录 fd 数
+#define XVFS_CACHE_TTL_MS  2000         // 目录 fd 最长使用多久后重新打开（外部改动目录树时的兜底）
+#define XVFS_RETRIES       4            // openat2 因并发改名返回 EAGAIN 时的重试次数
+
+#ifdef __linux__
+#define XVFS_DIR_FLAGS (O_PATH | O_DIRECTORY)
+#else
+#define XVFS_DIR_FLAGS (O_RDONLY | O_DIRECTORY)
+#endif
+
+static XMetricFamily dir_lookups(XMETRIC_COUNTER, "ftp_vfs_dir_lookups_total",
+                                 "Directory fd lookups in the per-session path cache by result", "result");
+
+atomic<uint64_t> XVfs::generation{0};
+
+
+// 相对 dirfd 打开 rel，解析不越出 dirfd；openat2 不可用时退回 openat
+static int OpenBeneath(int dirfd, const char *rel, int flags, mode_t mode){
+    flags |= O_CLOEXEC;
+    #if defined(__linux__) && defined(SYS_openat2)
+    static atomic<bool> unsupported{false};
+    if(!unsupported.load(memory_order_relaxed)){
+        struct open_how how;
+        memset(&how, 0, sizeof(how));
+        how.flags = (uint64_t)flags;
+        how.mode = (flags & O_CREAT) ? mode : 0;
+        how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+        int fd = -1;
+        for(int i = 0; i < XVFS_RETRIES; i++){
+            fd = (int)syscall(SYS_openat2, dirfd, rel, &how, sizeof(how));
+            if(fd >= 0 || errno != EAGAIN) break;
+        }
+        if(fd >= 0 || errno != ENOSYS) return fd;
+        unsupported = true;
+        Logger::warning("XVfs -> openat2 is not supported by the kernel, symlinks are no longer confined to the root");
+    }
+    #endif
+    return openat(dirfd, rel, flags, mode);
+}
+
+
+// "/a/b/c" -> "/a/b" 与 "c"；"/" -> "/" 与 "."
+static void SplitPath(const string &vpath, string &dir, string &name){
+    size_t pos = vpath.rfind('/');
+    dir = pos == 0 || pos == string::npos ? "/" : vpath.substr(0, pos);
+    name = pos == string::npos ? vpath : vpath.substr(pos + 1);
+    if(name.empty()) name = ".";
+}
+
+
+XVfs::~XVfs(){
+    Clear();
+}
+
+
+void XVfs::Clear(){
+    if(root_fd >= 0) close(root_fd);
+    root_fd = -1;
+    if(cwd.fd >= 0) close(cwd.fd);
+    cwd = Entry();
+    for(auto &e : cache) close(e.fd);
+    cache.clear();
+}
+
+
+void XVfs::SetRoot(const string &r){
+    Clear();
+    root = r;
+    while(!root.empty() && root.back() == '/') root.pop_back();
+}
+
+
+void XVfs::Invalidate(){
+    generation.fetch_add(1, memory_order_relaxed);
+}
+
+
+string XVfs::Normalize(const string &cwd, const string &arg){
+    string path = !arg.empty() && arg[0] == '/' ? arg : cwd + "/" + arg;
+    vector<string> parts;
+    size_t i = 0;
+    while(i <= path.size()){
+        size_t j = path.find('/', i);
+        if(j == string::npos) j = path.size();
+        string seg = path.substr(i, j - i);
+        if(seg == ".."){
+            if(!parts.empty()) parts.pop_back();
+        }
+        else if(!seg.empty() && seg != "."){
+            parts.push_back(seg);
+        }
+        i = j + 1;
+    }
+    string out;
+    for(auto &p : parts) out += "/" + p;
+    return out.empty() ? "/" : out;
+}
+
+
+string XVfs::RealPath(const string &vpath) const{
+    if(vpath == "/") return root.empty() ? "/" : root;
+    return root + vpath;
+}
+
+
+bool XVfs::Valid(const Entry &e) const{
+    return e.fd >= 0 && e.gen == generation.load(memory_order_relaxed) &&
+           chrono::steady_clock::now() - e.opened < chrono::milliseconds(XVFS_CACHE_TTL_MS);
+}
+
+
+int XVfs::RootFd(int &err){
+    if(root_fd < 0){
+        root_fd = open(root.empty() ? "/" : root.c_str(), XVFS_DIR_FLAGS | O_CLOEXEC);
+        if(root_fd < 0){
+            err = errno;
+            Logger::error("XVfs::RootFd() -> cannot open root ", root, ", ", strerror(err));
+        }
+    }
+    return root_fd;
+}
+
+
+int XVfs::DirFd(const string &vdir, int &err){
+    if(vdir == "/") return RootFd(err);
+    if(cwd.vpath == vdir && Valid(cwd)){
+        XMetrics::Add(dir_lookups.Id("hit"), 1);
+        return cwd.fd;
+    }
+    for(auto it = cache.begin(); it != cache.end(); ++it){
+        if(it->vpath != vdir) continue;
+        if(Valid(*it)){
+            cache.splice(cache.begin(), cache, it);
+            XMetrics::Add(dir_lookups.Id("hit"), 1);
+            return cache.front().fd;
+        }
+        close(it->fd);
+        cache.erase(it);
+        break;
+    }
+
+    // 未命中：从最近的已缓存祖先目录出发，只解析剩下的几段
+    int base = -1;
+    size_t baselen = 0;
+    auto ancestor = [&](const Entry &e){
+        return e.vpath.size() > baselen && vdir.size() > e.vpath.size() && vdir[e.vpath.size()] == '/' &&
+               vdir.compare(0, e.vpath.size(), e.vpath) == 0 && Valid(e);
+    };
+    if(ancestor(cwd)){
+        base = cwd.fd;
+        baselen = cwd.vpath.size();
+    }
+    for(auto &e : cache){
+        if(ancestor(e)){
+            base = e.fd;
+            baselen = e.vpath.size();
+        }
+    }
+    if(base < 0 && (base = RootFd(err)) < 0) return -1;
+
+    int fd = OpenBeneath(base, vdir.c_str() + baselen + 1, XVFS_DIR_FLAGS, 0);
+    if(fd < 0 && errno == EXDEV && baselen > 0){
+        // 中间的符号链接指向祖先目录之外，但可能仍在根目录之内
+        int rfd = RootFd(err);
+        if(rfd < 0) return -1;
+        fd = OpenBeneath(rfd, vdir.c_str() + 1, XVFS_DIR_FLAGS, 0);
+    }
+    if(fd < 0){
+        err = errno;
+        if(err == EXDEV){
+            Logger::warning("XVfs::DirFd() -> ", vdir, " resolves outside the root ", root);
+            err = EACCES;
+        }
+        return -1;
+    }
+    XMetrics::Add(dir_lookups.Id("miss"), 1);
+
+    Entry e;
+    e.vpath = vdir;
+    e.fd = fd;
+    e.gen = generation.load(memory_order_relaxed);
+    e.opened = chrono::steady_clock::now();
+    cache.push_front(e);
+    if(cache.size() > XVFS_CACHE_MAX){
+        close(cache.back().fd);
+        cache.pop_back();
+    }
+    return fd;
+}
+
+
+int XVfs::Open(const string &vpath, int flags, mode_t mode, int &err){
+    string dir, name;
+    SplitPath(vpath, dir, name);
+    int dfd = DirFd(dir, err);
+    if(dfd < 0) return -1;
+    int fd = OpenBeneath(dfd, name.c_str(), flags, mode);
+    if(fd < 0 && errno == EXDEV && dir != "/"){
+        int rfd = RootFd(err);
+        if(rfd < 0) return -1;
+        fd = OpenBeneath(rfd, vpath.c_str() + 1, flags, mode);
+    }
+    if(fd < 0){
+        err = errno;
+        if(err == EXDEV){
+            Logger::warning("XVfs::Open() -> ", vpath, " resolves outside the root ", root);
+            err = EACCES;
+        }
+    }
+    return fd;
+}
+
+
+bool XVfs::Stat(const string &vpath, struct stat &st, int &err){
+    string dir, name;
+    SplitPath(vpath, dir, name);
+    int dfd = DirFd(dir, err);
+    if(dfd < 0) return false;
+    #ifdef __linux__
+    // 最后一段不是符号链接时 fstatat 一次即可（名字里没有 /，不会走出父目录）
+    if(fstatat(dfd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0){
+        err = errno;
+        return false;
+    }
+    if(!S_ISLNK(st.st_mode)) return true;
+    int fd = Open(vpath, O_PATH, 0, err);
+    if(fd < 0) return false;
+    bool ok = fstat(fd, &st) == 0;
+    if(!ok) err = errno;
+    close(fd);
+    return ok;
+    #else
+    if(fstatat(dfd, name.c_str(), &st, 0) != 0){
+        err = errno;
+        return false;
+    }
+    return true;
+    #endif
+}
+
+
+bool XVfs::Lstat(const string &vpath, struct stat &st, int &err){
+    string dir, name;
+    SplitPath(vpath, dir, name);
+    int dfd = DirFd(dir, err);
+    if(dfd < 0) return false;
+    if(fstatat(dfd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0){
+        err = errno;
+        return false;
+    }
+    return true;
+}
+
+
+int XVfs::OpenDir(const string &vdir, int &err){
+    int dfd = DirFd(vdir, err);
+    if(dfd < 0) return -1;
+    // 缓存中的 fd 随时可能被淘汰，给调用者一份自己的
+    int fd = fcntl(dfd, F_DUPFD_CLOEXEC, 0);
+    if(fd < 0) err = errno;
+    return fd;
+}
+
+
+bool XVfs::Unlink(const string &vpath, int &err){
+    if(vpath == "/"){
+        err = EISDIR;
+        return false;
+    }
+    string dir, name;
+    SplitPath(vpath, dir, name);
+    int dfd = DirFd(dir, err);
+    if(dfd < 0) return false;
+    // 名字里没有 /，只作用于已在根目录之下解析好的父目录
+    if(unlinkat(dfd, name.c_str(), 0) != 0){
+        err = errno;
+        return false;
+    }
+    return true;
+}
+
+
+bool XVfs::Rename(const string &from, const string &to, int &err){
+    if(from == "/" || to == "/"){
+        err = EBUSY;
+        return false;
+    }
+    string fdir, fname, tdir, tname;
+    SplitPath(from, fdir, fname);
+    SplitPath(to, tdir, tname);
+    int ffd = DirFd(fdir, err);
+    if(ffd < 0) return false;
+    int tfd = DirFd(tdir, err);
+    if(tfd < 0) return false;
+    if(renameat(ffd, fname.c_str(), tfd, tname.c_str()) != 0){
+        err = errno;
+        return false;
+    }
+    // 改名的可能是目录，缓存中以旧路径打开的目录 fd 不能再用
+    Invalidate();
+    return true;
+}
+
+
+bool XVfs::Chdir(const string &vpath, int &err){
+    if(cwd.vpath == vpath && (vpath == "/" || Valid(cwd))) return true;
+    Entry next;
+    if(vpath != "/"){
+        if(DirFd(vpath, err) < 0) return false;
+        // DirFd 把目录放在缓存最前面，移出来作为当前目录
+        next = cache.front();
+        cache.pop_front();
+    }
+    else{
+        next.vpath = "/";
+    }
+    // 原来的当前目录还有效时放回缓存，CDUP 之后再回来不用重新打开
+    if(Valid(cwd) && cwd.vpath != vpath){
+        cache.push_front(cwd);
+        if(cache.size() > XVFS_CACHE_MAX){
+            close(cache.back().fd);
+            cache.pop_back();
+        }
+    }
+    else if(cwd.fd >= 0){
+        close(cwd.fd);
+    }
+    cwd = next;
+    return true;
+}
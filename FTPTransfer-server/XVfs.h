@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/**
+ * @class XVfs
+ * @brief 会话的虚拟文件系统：把客户端路径解析到根目录之下
+ *
+ * 客户端看到的路径（虚拟路径）先按词法规范化为以 / 开头的绝对路径（折叠 . 与 ..，.. 不会越过 /），
+ * 再相对会话持有的目录 fd 打开：根目录与当前目录各持一个，另有一个按虚拟目录路径索引的小 LRU 缓存。
+ * 打开文件时从父目录的 fd 出发，内核只解析最后一段；缓存未命中的目录从最近的已缓存祖先出发。
+ * Linux 上用 openat2(RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS) 解析，指向根目录之外的符号链接也无法逃出；
+ * 内核不支持 openat2 或其他平台上退回 openat，只有词法上的保护。
+ *
+ * 目录 fd 以全局代数与存活时间校验：改名、删除目录的命令调用 Invalidate() 使所有会话的缓存失效，
+ * 外部对目录树的改动最多在 XVFS_CACHE_TTL_MS 内看不到。只在会话所在的工作线程使用，不加锁。
+ */
+class XVfs{
+public:
+    XVfs(){}
+    ~XVfs();
+    XVfs(const XVfs &) = delete;
+    XVfs &operator=(const XVfs &) = delete;
+
+    // 设置根目录（绝对路径），关闭已打开的目录 fd；登录时调用
+    void SetRoot(const std::string &root);
+
+    // 在当前目录 cwd 下解析 arg，得到规范化的虚拟路径（"/" 或 "/a/b"，不带结尾的 /）
+    static std::string Normalize(const std::string &cwd, const std::string &arg);
+
+    // 虚拟路径对应的真实路径（需要按路径名工作的模块使用，例如目录列表缓存与摘要计算）
+    std::string RealPath(const std::string &vpath) const;
+
+    // 打开虚拟路径（flags/mode 同 open，自动加 O_CLOEXEC）；失败返回 -1，err 为 errno，越出根目录时为 EACCES
+    int Open(const std::string &vpath, int flags, mode_t mode, int &err);
+
+    // stat 虚拟路径（跟随根目录之内的符号链接）；失败返回 false，err 为 errno
+    bool Stat(const std::string &vpath, struct stat &st, int &err);
+
+    // lstat 虚拟路径：最后一段是符号链接时返回链接本身（删除、改名按链接本身计算）
+    bool Lstat(const std::string &vpath, struct stat &st, int &err);
+
+    // 切换当前目录：打开并持有目录 fd；失败返回 false，err 为 errno（不是目录时为 ENOTDIR）
+    bool Chdir(const std::string &vpath, int &err);
+
+    // 打开虚拟目录，返回调用者持有的目录 fd（Linux 上为 O_PATH）；供离开控制连接、按名字在目录中操作的模块使用
+    int OpenDir(const std::string &vdir, int &err);
+
+    // 删除文件（不删目录）；失败返回 false，err 为 errno
+    bool Unlink(const std::string &vpath, int &err);
+
+    // 改名（目标已存在时替换）；成功后所有会话的目录 fd 缓存失效
+    bool Rename(const std::string &from, const std::string &to, int &err);
+
+    // 目录树有改名或删除，所有会话的目录 fd 缓存失效
+    static void Invalidate();
+
+private:
+    struct Entry{
+        std::string vpath;                // 虚拟目录路径
+        int fd = -1;
+        uint64_t gen = 0;
+        std::chrono::steady_clock::time_point opened;
+    };
+
+    int RootFd(int &err);
+    int DirFd(const std::string &vdir, int &err);
+    bool Valid(const Entry &e) const;
+    void Clear();
+
+    std::string root;                     // 根目录，不带结尾的 /（根为 / 时为空串）
+    int root_fd = -1;
+    Entry cwd;                            // 当前目录
+    std::list<Entry> cache;               // 最近使用的在前
+
+    static std::atomic<uint64_t> generation;
+};
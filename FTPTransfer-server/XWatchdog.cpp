@@ -0,0 +1,170 @@
+#include "XWatchdog.h"
+#include "XMetrics.h"
+#include "testUtil.h"
+
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <chrono>
+#include <cxxabi.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <execinfo.h>
+#define XWATCHDOG_HAVE_BACKTRACE 1
+#endif
+
+using namespace std;
+
+#define XWATCHDOG_STACK_SIGNAL SIGUSR2      // 请求卡住的线程打印调用栈
+#define XWATCHDOG_STACK_DEPTH 64
+
+static thread_local XLoopProbe *current_probe = nullptr;
+
+
+XCallbackScope::XCallbackScope(uint32_t session, const char *callback, const std::type_info *type){
+    XLoopProbe *p = current_probe;
+    if(!p || p->depth++ > 0) return;
+    probe = p;
+    p->session.store(session, std::memory_order_relaxed);
+    p->callback.store(callback, std::memory_order_relaxed);
+    p->type.store(type, std::memory_order_relaxed);
+    p->start_us.store(XMetrics::NowUs(), std::memory_order_release);
+}
+
+
+XCallbackScope::~XCallbackScope(){
+    XLoopProbe *p = current_probe;
+    if(!p) return;
+    p->depth--;
+    if(!probe) return;
+
+    uint64_t start = p->start_us.load(std::memory_order_relaxed);
+    uint64_t elapsed = XMetrics::NowUs() - start;
+    p->start_us.store(0, std::memory_order_release);
+    XMetrics::Observe(p->metric_callback, elapsed);
+
+    uint64_t threshold = XWatchdog::Get()->ThresholdUs();
+    if(threshold && elapsed >= threshold){
+        XMetrics::Add(p->metric_stalls, 1);
+        Logger::warning("XWatchdog -> Thread_id ", p->thread_id, " stalled ", elapsed / 1000, "ms in ",
+                        XWatchdog::TypeName(p->type.load(std::memory_order_relaxed)), "::",
+                        p->callback.load(std::memory_order_relaxed),
+                        ", session ", p->session.load(std::memory_order_relaxed));
+    }
+}
+
+
+void XCallbackScope::Tag(const char *callback, const std::type_info *type){
+    XLoopProbe *p = current_probe;
+    if(!p || p->depth == 0) return;
+    p->callback.store(callback, std::memory_order_relaxed);
+    p->type.store(type, std::memory_order_relaxed);
+}
+
+
+void XWatchdog::Bind(XLoopProbe *probe){
+    probe->native = pthread_self();
+    current_probe = probe;
+}
+
+
+void XWatchdog::Add(XLoopProbe *probe){
+    lock_guard<mutex> lock(probes_mutex);
+    probes.push_back(probe);
+}
+
+
+string XWatchdog::TypeName(const std::type_info *type){
+    if(!type) return "?";
+    int status = 0;
+    char *name = abi::__cxa_demangle(type->name(), nullptr, nullptr, &status);
+    if(status != 0 || !name) return type->name();
+    string s = name;
+    free(name);
+    return s;
+}
+
+
+#ifdef XWATCHDOG_HAVE_BACKTRACE
+// 信号处理函数：只使用 write/backtrace_symbols_fd，不分配内存、不加锁
+static void StackSignal(int){
+    static const char head[] = "[WATCHDOG] stack of Thread_id ";
+    char num[16];
+    int tid = current_probe ? current_probe->thread_id : -1;
+    int n = sizeof(num);
+    num[--n] = '\n';
+    num[--n] = ':';
+    unsigned int v = tid < 0 ? 0 : tid;
+    do{ num[--n] = '0' + v % 10; v /= 10; }while(v && n > 0);
+    if(write(STDERR_FILENO, head, sizeof(head) - 1) < 0){}
+    if(write(STDERR_FILENO, num + n, sizeof(num) - n) < 0){}
+    void *frames[XWATCHDOG_STACK_DEPTH];
+    int depth = backtrace(frames, XWATCHDOG_STACK_DEPTH);
+    backtrace_symbols_fd(frames, depth, STDERR_FILENO);
+}
+#endif
+
+
+void XWatchdog::Start(bool dump){
+    if(watcher || !ThresholdUs()) return;
+    dump_stack = dump;
+    #ifdef XWATCHDOG_HAVE_BACKTRACE
+    if(dump_stack){
+        // 预先调用一次，让 backtrace 在正常上下文中完成动态库加载
+        void *frames[1];
+        backtrace(frames, 1);
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = StackSignal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(XWATCHDOG_STACK_SIGNAL, &sa, nullptr);
+    }
+    #else
+    dump_stack = false;
+    #endif
+    watcher = new std::thread(&XWatchdog::Main, this);
+    Logger::info("XWatchdog::Start() -> threshold ", ThresholdUs() / 1000, "ms, stack dump ",
+                 dump_stack ? "on" : "off");
+}
+
+
+void XWatchdog::Report(XLoopProbe *p, uint64_t start, uint64_t now){
+    Logger::warning("XWatchdog -> Thread_id ", p->thread_id, " blocked for ", (now - start) / 1000,
+                    "ms (still running) in ", TypeName(p->type.load(std::memory_order_relaxed)), "::",
+                    p->callback.load(std::memory_order_relaxed),
+                    ", session ", p->session.load(std::memory_order_relaxed));
+    #ifdef XWATCHDOG_HAVE_BACKTRACE
+    if(dump_stack) pthread_kill(p->native, XWATCHDOG_STACK_SIGNAL);
+    #endif
+}
+
+
+void XWatchdog::Main(){
+    while(!stop){
+        uint64_t threshold = ThresholdUs();
+        std::this_thread::sleep_for(std::chrono::microseconds(threshold / 2));
+        if(stop) break;
+
+        uint64_t now = XMetrics::NowUs();
+        lock_guard<mutex> lock(probes_mutex);
+        for(XLoopProbe *p : probes){
+            uint64_t start = p->start_us.load(std::memory_order_acquire);
+            if(start == 0 || now - start < threshold) continue;
+            // 同一次卡顿只报告一次
+            if(p->reported.exchange(start, std::memory_order_relaxed) == start) continue;
+            Report(p, start, now);
+        }
+    }
+}
+
+
+XWatchdog::~XWatchdog(){
+    stop = true;
+    if(watcher){
+        if(watcher->joinable()) watcher->join();
+        delete watcher;
+        watcher = nullptr;
+    }
+}
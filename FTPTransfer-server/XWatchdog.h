@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include <typeinfo>
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * @brief 工作线程当前执行的回调，供卡顿检测读取
+ *
+ * 由所属工作线程写入（relaxed 原子写），看门狗线程读取。
+ * start_us 为 0 表示事件循环空闲（在 epoll/kqueue 中等待）。
+ */
+struct XLoopProbe{
+    int thread_id = -1;
+    pthread_t native;
+    std::atomic<uint64_t> start_us{0};            // 当前回调开始时间（XMetrics::NowUs）
+    std::atomic<uint32_t> session{0};             // 当前回调所属会话
+    std::atomic<const char*> callback{nullptr};   // 回调种类：Read / Write / Event / Notify
+    std::atomic<const std::type_info*> type{nullptr};   // 处理该回调的对象类型（XFtpRETR 等）
+    std::atomic<uint64_t> reported{0};            // 看门狗已报告过的 start_us，避免重复报告
+    int depth = 0;                                // 回调嵌套深度（只由所属线程访问）
+
+    int metric_callback = -1;                     // 回调耗时直方图
+    int metric_stalls = -1;                       // 卡顿次数
+};
+
+/**
+ * @brief 标记一段回调的作用域（构造时记录开始，析构时统计耗时并检测卡顿）
+ *
+ * 只有最外层作用域生效；不在工作线程中（XThread::Current() 为空）时什么都不做。
+ */
+class XCallbackScope{
+public:
+    XCallbackScope(uint32_t session, const char *callback, const std::type_info *type);
+    ~XCallbackScope();
+
+    // 在回调内部细化当前正在执行的处理函数（如命令分发到具体处理器），报告时更准确
+    static void Tag(const char *callback, const std::type_info *type);
+private:
+    XLoopProbe *probe = nullptr;
+};
+
+/**
+ * @class XWatchdog
+ * @brief 事件循环卡顿检测
+ *
+ * 回调结束时若耗时超过阈值，记录会话、回调类型与耗时（XCallbackScope）；
+ * 可选的看门狗线程定期检查正在执行的回调，在卡顿尚未结束时就给出报告，
+ * 并可向卡住的线程发送信号，在信号处理函数中把调用栈写到标准错误输出。
+ */
+class XWatchdog{
+public:
+    static XWatchdog* Get(){
+        static XWatchdog instance;
+        return &instance;
+    }
+
+    // 卡顿阈值（微秒），0 表示不检测
+    uint64_t ThresholdUs() const { return threshold_us.load(std::memory_order_relaxed); }
+    void SetThreshold(int ms){ threshold_us = ms > 0 ? (uint64_t)ms * 1000 : 0; }
+
+    // 登记工作线程的探针（XThread::Setup 中调用）
+    void Add(XLoopProbe *probe);
+
+    // 把探针绑定到当前线程（XThread::Main 开始时调用）
+    static void Bind(XLoopProbe *probe);
+
+    // 启动看门狗线程；dump_stack 为 true 时对卡住的线程采样调用栈
+    void Start(bool dump_stack);
+
+    // 把 type_info 转成可读的类名
+    static std::string TypeName(const std::type_info *type);
+
+private:
+    XWatchdog(){}
+    ~XWatchdog();
+    void Main();
+    void Report(XLoopProbe *probe, uint64_t start, uint64_t now);
+
+    std::atomic<uint64_t> threshold_us{0};
+    std::vector<XLoopProbe*> probes;
+    std::mutex probes_mutex;
+    bool dump_stack = false;
+    std::atomic<bool> stop{false};
+    std::thread *watcher = nullptr;
+};
@@ -0,0 +1,215 @@
+#include "XXferLog.h"
+#include "XLog.h"
+#include "testUtil.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <chrono>
+
+using namespace std;
+
+#define XXFERLOG_FLUSH_MS 500          // 批量写出间隔
+
+static thread_local XLogRing *local_ring = nullptr;
+
+
+XXferLog* XXferLog::Get(){
+    // 不析构：atexit 中 Shutdown 之后仍可能有工作线程调用 Record
+    static XXferLog *instance = new XXferLog();
+    return instance;
+}
+
+
+bool XXferLog::Open(const string &f, const string &format, long long max, int k){
+    if(writer) return false;
+    file = f;
+    json = (format == "json");
+    max_size = max;
+    keep = k > 0 ? k : 1;
+
+    fd = open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd < 0) return false;
+    struct stat st;
+    size = fstat(fd, &st) == 0 ? st.st_size : 0;
+
+    enabled = true;
+    writer = new std::thread(&XXferLog::Main, this);
+    atexit([]{ XXferLog::Get()->Shutdown(); });
+    return true;
+}
+
+
+XLogRing *XXferLog::LocalRing(){
+    if(!local_ring){
+        auto ring = make_shared<XLogRing>();
+        local_ring = ring.get();
+        lock_guard<mutex> lock(rings_mutex);
+        rings.push_back(ring);
+    }
+    return local_ring;
+}
+
+
+// JSON 字符串转义
+static void AppendJson(string &out, const string *s){
+    out += '"';
+    if(s){
+        for(unsigned char c : *s){
+            if(c == '"' || c == '\\'){ out += '\\'; out += c; }
+            else if(c < 0x20){
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                out += esc;
+            }
+            else out += c;
+        }
+    }
+    out += '"';
+}
+
+
+// xferlog 字段以空格分隔，文件名中的空白替换为 '_'
+static void AppendField(string &out, const string *s){
+    if(!s || s->empty()){ out += '*'; return; }
+    for(char c : *s) out += (c == ' ' || c == '\t' || c == '\n' || c == '\r') ? '_' : c;
+}
+
+
+void XXferLog::Record(const XXferRecord &r){
+    if(!Enabled()) return;
+    if(!json && !r.direction) return;           // xferlog 只有上传/下载两个方向
+
+    // 记录格式：[int64 时间戳(微秒)][文本...\n]，时间前缀由写线程格式化
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    int64_t now_us = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    static thread_local string line;
+    line.assign((const char *)&now_us, sizeof(now_us));
+    char num[160];
+    if(json){
+        double secs = r.duration_us / 1e6;
+        snprintf(num, sizeof(num), "\"session\":%u,\"cmd\":\"%s\",\"user\":", r.session, r.cmd);
+        line += num;
+        AppendJson(line, r.user);
+        line += ",\"peer\":";
+        AppendJson(line, r.peer);
+        line += ",\"path\":";
+        AppendJson(line, r.path);
+        snprintf(num, sizeof(num), ",\"bytes\":%llu,\"duration_ms\":%.3f,\"bytes_per_sec\":%llu,"
+                 "\"tls\":%s,\"code\":%d}\n",
+                 (unsigned long long)r.bytes, r.duration_us / 1e3,
+                 (unsigned long long)(secs > 0 ? r.bytes / secs : 0),
+                 r.tls ? "true" : "false", r.code);
+        line += num;
+    }
+    else{
+        // transfer-time remote-host file-size filename transfer-type special-action-flag
+        // direction access-mode username service-name authentication-method authenticated-user-id completion-status
+        snprintf(num, sizeof(num), "%llu ", (unsigned long long)((r.duration_us + 500000) / 1000000));
+        line += num;
+        AppendField(line, r.peer);
+        snprintf(num, sizeof(num), " %llu ", (unsigned long long)r.bytes);
+        line += num;
+        AppendField(line, r.path);
+        line += r.direction == 'o' ? " b _ o r " : " b _ i r ";
+        AppendField(line, r.user);
+        line += r.tls ? " ftps 0 * " : " ftp 0 * ";
+        line += r.code == 226 ? "c\n" : "i\n";
+    }
+    LocalRing()->Push(line.data(), (uint32_t)line.size());
+}
+
+
+string XXferLog::Prefix(int64_t ts_us){
+    time_t sec = ts_us / 1000000;
+    struct tm tm;
+    char buf[64];
+    if(json){
+        gmtime_r(&sec, &tm);
+        size_t n = strftime(buf, sizeof(buf), "{\"time\":\"%Y-%m-%dT%H:%M:%S", &tm);
+        snprintf(buf + n, sizeof(buf) - n, ".%03dZ\",", (int)(ts_us / 1000 % 1000));
+    }
+    else{
+        // 与 ctime 相同的格式：Mon Oct 19 10:47:31 2026
+        localtime_r(&sec, &tm);
+        strftime(buf, sizeof(buf), "%a %b %e %H:%M:%S %Y ", &tm);
+    }
+    return buf;
+}
+
+
+void XXferLog::Rotate(){
+    close(fd);
+    for(int i = keep - 1; i >= 1; i--){
+        string from = file + "." + to_string(i);
+        string to = file + "." + to_string(i + 1);
+        rename(from.c_str(), to.c_str());
+    }
+    rename(file.c_str(), (file + ".1").c_str());
+    fd = open(file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    size = 0;
+    if(fd < 0) Logger::error("XXferLog::Rotate() -> cannot reopen ", file, ": ", strerror(errno));
+}
+
+
+void XXferLog::Flush(){
+    lock_guard<mutex> flush_lock(flush_mutex);
+    vector<shared_ptr<XLogRing>> snapshot;
+    {
+        lock_guard<mutex> lock(rings_mutex);
+        snapshot = rings;
+    }
+
+    string raw, out;
+    uint64_t lost = 0;
+    for(auto &r : snapshot){
+        r->Drain(raw);
+        lost += r->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    if(lost > 0) Logger::warning("XXferLog -> ", lost, " transfer records dropped (ring full)");
+    if(raw.empty() || fd < 0) return;
+
+    size_t pos = 0;
+    while(pos + sizeof(int64_t) < raw.size()){
+        int64_t ts;
+        memcpy(&ts, raw.data() + pos, sizeof(ts));
+        size_t eol = raw.find('\n', pos + sizeof(ts));
+        if(eol == string::npos) break;
+        out += Prefix(ts);
+        out.append(raw, pos + sizeof(ts), eol + 1 - pos - sizeof(ts));
+        pos = eol + 1;
+    }
+
+    if(max_size > 0 && size > 0 && size + (long long)out.size() > max_size) Rotate();
+    size_t off = 0;
+    while(fd >= 0 && off < out.size()){
+        ssize_t n = write(fd, out.data() + off, out.size() - off);
+        if(n <= 0) break;
+        off += n;
+    }
+    size += off;
+}
+
+
+void XXferLog::Main(){
+    while(!stop){
+        std::this_thread::sleep_for(std::chrono::milliseconds(XXFERLOG_FLUSH_MS));
+        Flush();
+    }
+}
+
+
+void XXferLog::Shutdown(){
+    if(stop.exchange(true)) return;
+    if(writer){
+        if(writer->joinable()) writer->join();
+        delete writer;
+        writer = nullptr;
+    }
+    Flush();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+struct XLogRing;
+
+// 一次传输的记录内容（RETR/STOR/LIST 结束时填写）
+struct XXferRecord{
+    uint32_t session = 0;
+    const char *cmd = "";            // 实际的命令："RETR" / "STOR" / "APPE" / "STOU" / "LIST" / "MLSD"
+    char direction = 0;              // xferlog 的方向：'o' 下载、'i' 上传，0 表示目录列表（xferlog 格式不记录）
+    const std::string *user = nullptr;
+    const std::string *peer = nullptr;
+    const std::string *path = nullptr;
+    uint64_t bytes = 0;
+    uint64_t duration_us = 0;
+    bool tls = false;
+    int code = 0;                    // 返回给客户端的结果码，226 表示完成
+};
+
+/**
+ * @class XXferLog
+ * @brief 传输日志（每次传输一条记录），格式为 xferlog 或 JSON Lines
+ *
+ * 工作线程只在本线程的环形缓冲区里格式化记录（不做系统调用），
+ * 后台线程定期批量写入文件，并在文件超过大小上限时轮转（file -> file.1 -> file.2 ...）。
+ * xferlog 格式兼容 wu-ftpd/vsftpd，只记录下载与上传（RETR / STOR / APPE / STOU）；JSON 格式同时记录目录列表。
+ */
+class XXferLog{
+public:
+    static XXferLog* Get();
+
+    static bool Enabled(){ return enabled.load(std::memory_order_relaxed); }
+
+    // 打开日志文件；format 为 "xferlog" 或 "json"；max_size 为 0 时不轮转
+    bool Open(const std::string &file, const std::string &format, long long max_size, int keep);
+
+    // 记录一次传输（工作线程调用）
+    void Record(const XXferRecord &r);
+
+    // 停止后台线程并写出剩余记录（atexit 调用）
+    void Shutdown();
+
+private:
+    XXferLog(){}
+    XLogRing *LocalRing();
+    void Main();
+    void Flush();
+    void Rotate();
+    std::string Prefix(int64_t ts_us);
+
+    static inline std::atomic<bool> enabled{false};
+
+    bool json = false;
+    std::string file;
+    long long max_size = 0;
+    int keep = 0;
+    int fd = -1;
+    long long size = 0;
+
+    std::vector<std::shared_ptr<XLogRing>> rings;
+    std::mutex rings_mutex;
+    std::mutex flush_mutex;
+    std::atomic<bool> stop{false};
+    std::thread *writer = nullptr;
+};
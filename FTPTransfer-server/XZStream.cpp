@@ -0,0 +1,368 @@
+#include "XZStream.h"
+#include "XFtpTask.h"
+#include "XMetrics.h"
+#include "testUtil.h"
+
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <algorithm>
+#include <string.h>
+
+using namespace std;
+
+#define XZ_WINDOW_BYTES (1024 * 1024)      // 自适应每评估一次的原始数据量
+#define XZ_BUSY_HIGH 0.8                   // 压缩耗时占比高于此值降级
+#define XZ_BUSY_LOW 0.4                    // 低于此值升级
+#define XZ_LAG_HIGH_US 20000               // 工作线程事件循环延迟高于此值降级
+#define XZ_INFLATE_SLICE (4 * 1024 * 1024) // 解压时每次调用最多解出的字节数
+
+static const char *engines[XZ_ENGINES] = {"deflate", "zstd"};
+
+static XMetricFamily level_changes(XMETRIC_COUNTER, "ftp_mode_z_level_changes_total",
+                                   "Adaptive MODE Z level adjustments", "direction");
+
+
+XZStream::~XZStream(){
+    if(zs){
+        if(zs_deflate) deflateEnd(zs);
+        else inflateEnd(zs);
+        delete zs;
+    }
+    #ifdef HAVE_ZSTD
+    ZSTD_freeCCtx(cctx);
+    ZSTD_freeDCtx(dctx);
+    #endif
+}
+
+
+bool XZStream::Available(int engine){
+    if(engine == XZ_DEFLATE) return true;
+    #ifdef HAVE_ZSTD
+    if(engine == XZ_ZSTD) return true;
+    #endif
+    return false;
+}
+
+
+int XZStream::ParseEngine(const string &name){
+    string n = name;
+    std::transform(n.begin(), n.end(), n.begin(), ::tolower);
+    for(int i = 0; i < XZ_ENGINES; i++){
+        if(n == engines[i]) return i;
+    }
+    return -1;
+}
+
+
+const char *XZStream::EngineName(int engine){
+    return (engine >= 0 && engine < XZ_ENGINES) ? engines[engine] : "";
+}
+
+
+int XZStream::MaxLevel(int engine){
+    return engine == XZ_ZSTD ? 19 : 9;
+}
+
+
+bool XZStream::Init(int e, bool comp, int lvl){
+    if(!Available(e)) return false;
+    engine = e;
+    compress = comp;
+    finished = false;
+    held.clear();
+    held_pos = 0;
+    more = false;
+    adaptive = comp && lvl <= 0;
+    // 自适应从各自的默认级别开始
+    level = lvl > 0 ? min(lvl, MaxLevel(e)) : (e == XZ_ZSTD ? 3 : 6);
+    raw_bytes = wire_bytes = 0;
+    win_start_us = XMetrics::NowUs();
+    win_cpu_us = win_raw = 0;
+
+    if(e == XZ_DEFLATE){
+        // 同方向的上下文直接 reset 复用
+        if(zs && zs_deflate != comp){
+            if(zs_deflate) deflateEnd(zs);
+            else inflateEnd(zs);
+            delete zs;
+            zs = nullptr;
+        }
+        if(zs){
+            int rc = comp ? deflateReset(zs) : inflateReset(zs);
+            if(rc == Z_OK && comp) rc = deflateParams(zs, level, Z_DEFAULT_STRATEGY);
+            return rc == Z_OK;
+        }
+        zs = new z_stream;
+        memset(zs, 0, sizeof(*zs));
+        zs_deflate = comp;
+        int rc = comp ? deflateInit(zs, level) : inflateInit(zs);
+        if(rc != Z_OK){
+            delete zs;
+            zs = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    #ifdef HAVE_ZSTD
+    if(comp){
+        if(!cctx) cctx = ZSTD_createCCtx();
+        if(!cctx) return false;
+        ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+    }
+    else{
+        if(!dctx) dctx = ZSTD_createDCtx();
+        if(!dctx) return false;
+        ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+    }
+    return true;
+    #else
+    return false;
+    #endif
+}
+
+
+bool XZStream::Write(const void *data, size_t len, const Sink &sink, uint64_t lag_us){
+    if(len == 0) return true;
+    raw_bytes += compress ? len : 0;
+    wire_bytes += compress ? 0 : len;
+    if(!compress){
+        // 上次留下的还没解完时只追加，由 Resume 按顺序处理
+        if(Held()){
+            held.append((const char *)data, len);
+            return true;
+        }
+        size_t used = 0;
+        if(!Decompress(data, len, sink, used)) return false;
+        if(used < len){
+            held.assign((const char *)data + used, len - used);
+            held_pos = 0;
+        }
+        return true;
+    }
+
+    uint64_t t0 = adaptive ? XMetrics::NowUs() : 0;
+    bool ok;
+    #ifdef HAVE_ZSTD
+    if(engine == XZ_ZSTD) ok = ZstdCompress(data, len, false, sink);
+    else
+    #endif
+    ok = Deflate((const unsigned char *)data, len, Z_NO_FLUSH, sink);
+
+    if(ok && adaptive){
+        win_raw += len;
+        win_cpu_us += XMetrics::NowUs() - t0;
+        if(win_raw >= XZ_WINDOW_BYTES) Adapt(win_cpu_us, lag_us);
+    }
+    return ok;
+}
+
+
+bool XZStream::Resume(const Sink &sink){
+    if(compress || !Held()) return true;
+    size_t used = 0;
+    if(!Decompress(held.data() + held_pos, held.size() - held_pos, sink, used)) return false;
+    held_pos += used;
+    if(held_pos == held.size()){
+        held.clear();
+        held_pos = 0;
+    }
+    return true;
+}
+
+
+bool XZStream::Decompress(const void *in, size_t len, const Sink &sink, size_t &used){
+    more = false;
+    #ifdef HAVE_ZSTD
+    if(engine == XZ_ZSTD) return ZstdDecompress(in, len, sink, used);
+    #endif
+    return Inflate((const unsigned char *)in, len, sink, used);
+}
+
+
+bool XZStream::Finish(const Sink &sink){
+    if(!compress) return finished;
+    if(finished) return true;
+    finished = true;
+    #ifdef HAVE_ZSTD
+    if(engine == XZ_ZSTD) return ZstdCompress(nullptr, 0, true, sink);
+    #endif
+    return Deflate(nullptr, 0, Z_FINISH, sink);
+}
+
+
+void XZStream::Adapt(uint64_t cpu_us, uint64_t lag_us){
+    uint64_t now = XMetrics::NowUs();
+    double busy = now > win_start_us ? (double)cpu_us / (double)(now - win_start_us) : 1.0;
+    win_start_us = now;
+    win_cpu_us = win_raw = 0;
+
+    // 压缩跟不上（大部分时间都在压缩）或线程上其他会话已在排队：降级；大部分时间在等网络：升级
+    int next = level;
+    if((busy > XZ_BUSY_HIGH || lag_us > XZ_LAG_HIGH_US) && level > 1) next = level - 1;
+    else if(busy < XZ_BUSY_LOW && lag_us <= XZ_LAG_HIGH_US && level < MaxLevel(engine)) next = level + 1;
+    if(next == level) return;
+    XMetrics::Add(level_changes.Id(next > level ? "up" : "down"), 1);
+    Logger::debug("XZStream::Adapt() -> busy ", busy, ", lag ", lag_us, "us, level ", level, " -> ", next);
+    level = next;
+
+    #ifdef HAVE_ZSTD
+    // 压缩过程中允许修改级别，从下一块开始生效
+    if(engine == XZ_ZSTD){
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+        return;
+    }
+    #endif
+    // deflateParams 需要先把已有输入按旧级别压完，下一次 Deflate 时生效
+    pending_level = true;
+}
+
+
+void XZStream::SetLevel(int lvl, const Sink &sink){
+    // 输出空间不足时 deflateParams 返回 Z_BUF_ERROR，写出后重试
+    for(int i = 0; i < 64; i++){
+        zs->next_out = out;
+        zs->avail_out = sizeof(out);
+        int rc = deflateParams(zs, lvl, Z_DEFAULT_STRATEGY);
+        size_t n = sizeof(out) - zs->avail_out;
+        if(n){
+            wire_bytes += n;
+            if(!sink((const char *)out, n)) return;
+        }
+        if(rc != Z_BUF_ERROR) return;
+    }
+}
+
+
+bool XZStream::Deflate(const unsigned char *in, size_t len, int flush, const Sink &sink){
+    if(!zs) return false;
+    if(pending_level){
+        pending_level = false;
+        SetLevel(level, sink);
+    }
+    zs->next_in = (Bytef *)in;
+    zs->avail_in = 0;
+    size_t left = len;
+    while(true){
+        // avail_in 是 uInt，大块分段喂入
+        if(zs->avail_in == 0 && left > 0){
+            uInt n = (uInt)min<size_t>(left, 1u << 30);
+            zs->avail_in = n;
+            left -= n;
+        }
+        zs->next_out = out;
+        zs->avail_out = sizeof(out);
+        int rc = deflate(zs, left > 0 ? Z_NO_FLUSH : flush);
+        if(rc == Z_STREAM_ERROR) return false;
+        size_t n = sizeof(out) - zs->avail_out;
+        if(n){
+            wire_bytes += n;
+            if(!sink((const char *)out, n)) return false;
+        }
+        if(flush == Z_FINISH){
+            if(rc == Z_STREAM_END) return true;
+            continue;
+        }
+        // 输出区没有写满说明输入已全部消化
+        if(zs->avail_in == 0 && left == 0 && zs->avail_out != 0) return true;
+    }
+}
+
+
+bool XZStream::Inflate(const unsigned char *in, size_t len, const Sink &sink, size_t &used){
+    if(!zs) return false;
+    used = len;
+    if(finished){
+        // 流结尾之后的数据不属于文件
+        Logger::warning("XZStream::Inflate() -> ", len, " bytes after end of stream ignored");
+        return true;
+    }
+    size_t produced = 0;
+    zs->next_in = (Bytef *)in;
+    zs->avail_in = 0;
+    size_t left = len;
+    while(true){
+        if(zs->avail_in == 0 && left > 0){
+            uInt n = (uInt)min<size_t>(left, 1u << 30);
+            zs->avail_in = n;
+            left -= n;
+        }
+        zs->next_out = out;
+        zs->avail_out = sizeof(out);
+        int rc = inflate(zs, Z_NO_FLUSH);
+        if(rc == Z_NEED_DICT || rc == Z_DATA_ERROR || rc == Z_MEM_ERROR || rc == Z_STREAM_ERROR){
+            Logger::error("XZStream::Inflate() -> ", zs->msg ? zs->msg : "inflate error");
+            return false;
+        }
+        size_t n = sizeof(out) - zs->avail_out;
+        if(n){
+            raw_bytes += n;
+            produced += n;
+            if(!sink((const char *)out, n)) return false;
+        }
+        if(rc == Z_STREAM_END){
+            finished = true;
+            return true;
+        }
+        if(zs->avail_in == 0 && left == 0 && zs->avail_out != 0) return true;
+        // 解出的数据到上限：输出区写满时解码器里可能还有数据，留给 Resume
+        if(produced >= XZ_INFLATE_SLICE){
+            used = len - left - zs->avail_in;
+            more = zs->avail_out == 0;
+            return true;
+        }
+    }
+}
+
+
+#ifdef HAVE_ZSTD
+bool XZStream::ZstdCompress(const void *in, size_t len, bool end, const Sink &sink){
+    ZSTD_inBuffer input = {in, len, 0};
+    while(true){
+        ZSTD_outBuffer output = {out, sizeof(out), 0};
+        size_t rc = ZSTD_compressStream2(cctx, &output, &input, end ? ZSTD_e_end : ZSTD_e_continue);
+        if(ZSTD_isError(rc)){
+            Logger::error("XZStream::ZstdCompress() -> ", ZSTD_getErrorName(rc));
+            return false;
+        }
+        if(output.pos){
+            wire_bytes += output.pos;
+            if(!sink((const char *)out, output.pos)) return false;
+        }
+        if(end ? rc == 0 : input.pos == input.size) return true;
+    }
+}
+
+
+bool XZStream::ZstdDecompress(const void *in, size_t len, const Sink &sink, size_t &used){
+    ZSTD_inBuffer input = {in, len, 0};
+    size_t produced = 0;
+    used = len;
+    while(true){
+        ZSTD_outBuffer output = {out, sizeof(out), 0};
+        size_t rc = ZSTD_decompressStream(dctx, &output, &input);
+        if(ZSTD_isError(rc)){
+            Logger::error("XZStream::ZstdDecompress() -> ", ZSTD_getErrorName(rc));
+            return false;
+        }
+        if(output.pos){
+            raw_bytes += output.pos;
+            produced += output.pos;
+            if(!sink((const char *)out, output.pos)) return false;
+        }
+        // 输入用完后，输出区写满说明解码器里还有数据
+        if(input.pos < input.size || output.pos == output.size){
+            if(produced < XZ_INFLATE_SLICE) continue;
+            used = input.pos;
+            more = output.pos == output.size;
+            return true;
+        }
+        // 0 表示一帧结束（之后的数据是下一帧）
+        finished = rc == 0;
+        return true;
+    }
+}
+#endif
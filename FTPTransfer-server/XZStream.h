@@ -0,0 +1,98 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct z_stream_s z_stream;
+#ifdef HAVE_ZSTD
+typedef struct ZSTD_CCtx_s ZSTD_CCtx;
+typedef struct ZSTD_DCtx_s ZSTD_DCtx;
+#endif
+
+/**
+ * @class XZStream
+ * @brief MODE Z 的流式压缩/解压阶段，位于文件读写与数据连接 bufferevent 之间
+ *
+ * deflate 为 zlib 格式（RFC 1950，与 MODE Z 草案及 FileZilla / lftp 一致）；
+ * 编译时定义 HAVE_ZSTD 后可通过 OPTS MODE Z ENGINE zstd 改用 zstd 帧。
+ * 压缩级别为 0 时自适应：每压缩约 1MB 原始数据评估一次，压缩耗时占墙钟时间的比例高
+ * （CPU 跟不上网络）或工作线程事件循环延迟高时降级，大部分时间在等网络时升级。
+ * 解压时每次 Write / Resume 最多解出约 4MB：高压缩比的小块输入不会在一次回调里写出大量数据、
+ * 阻塞工作线程，没消化的输入留在对象里（Held），调用者让出事件循环后用 Resume 继续。
+ * 对象随命令处理器复用，再次 Init 时只重置上下文不重新分配。
+ */
+class XZStream{
+public:
+    // 输出回调：压缩时写入数据连接，解压时写入文件；返回 false 中止
+    typedef std::function<bool(const char *data, size_t len)> Sink;
+
+    XZStream(){}
+    XZStream(const XZStream &) = delete;
+    XZStream &operator=(const XZStream &) = delete;
+    ~XZStream();
+
+    // engine 为 XZEngine；level 为 0 表示自适应
+    bool Init(int engine, bool compress, int level);
+
+    // 压缩/解压一段数据；lag_us 为当前工作线程的事件循环延迟（自适应用）
+    // 解压时输出到上限即返回，剩下的输入留到 Resume
+    bool Write(const void *data, size_t len, const Sink &sink, uint64_t lag_us = 0);
+
+    // 解压：上次 Write / Resume 到上限后还有没解完的数据；Resume 继续解出下一片（同样有上限）
+    bool Held() const { return more || held_pos < held.size(); }
+    bool Resume(const Sink &sink);
+
+    // 压缩：写出流结尾（只写一次，之后直接返回 true）；解压：检查是否收到完整的流
+    bool Finish(const Sink &sink);
+
+    bool Compressing() const { return compress; }
+    bool Finished() const { return finished; }
+    int Engine() const { return engine; }
+    int Level() const { return level; }
+    uint64_t RawBytes() const { return raw_bytes; }     // 文件侧字节数
+    uint64_t WireBytes() const { return wire_bytes; }   // 数据连接侧字节数
+
+    static bool Available(int engine);
+    static int ParseEngine(const std::string &name);
+    static const char *EngineName(int engine);
+    static int MaxLevel(int engine);
+
+private:
+    bool Deflate(const unsigned char *in, size_t len, int flush, const Sink &sink);
+    // 解压 in 的开头一部分，used 为消化的输入字节数
+    bool Inflate(const unsigned char *in, size_t len, const Sink &sink, size_t &used);
+    bool Decompress(const void *in, size_t len, const Sink &sink, size_t &used);
+    #ifdef HAVE_ZSTD
+    bool ZstdCompress(const void *in, size_t len, bool end, const Sink &sink);
+    bool ZstdDecompress(const void *in, size_t len, const Sink &sink, size_t &used);
+    #endif
+    void Adapt(uint64_t cpu_us, uint64_t lag_us);
+    void SetLevel(int lvl, const Sink &sink);
+
+    int engine = -1;
+    bool compress = true;
+    bool adaptive = false;
+    bool finished = false;           // 压缩：已写出结尾；解压：已收到流结尾
+    int level = 0;
+    bool pending_level = false;      // deflate 级别已调整，下一次 Deflate 前生效
+
+    z_stream *zs = nullptr;
+    bool zs_deflate = false;         // zs 当前是 deflate 还是 inflate 上下文
+    #ifdef HAVE_ZSTD
+    ZSTD_CCtx *cctx = nullptr;
+    ZSTD_DCtx *dctx = nullptr;
+    #endif
+    unsigned char out[256 * 1024];
+    std::string held;                // 解压到上限时没消化的输入
+    size_t held_pos = 0;
+    bool more = false;               // 解压到上限时解码器里可能还有输出
+
+    uint64_t raw_bytes = 0;
+    uint64_t wire_bytes = 0;
+
+    // 自适应窗口
+    uint64_t win_start_us = 0;
+    uint64_t win_cpu_us = 0;
+    uint64_t win_raw = 0;
+};
@@ -4,6 +4,8 @@
 #include <string>           // C++字符串类
 #include <fstream>          // 文件流（当前未使用）
 #include <unistd.h>         // POSIX API：getpid()等
+#include <errno.h>          // errno
+#include <iostream>         // --hash-password 读写标准输入输出
 
 // libevent相关头文件
 #include <event2/event.h>           // 核心事件处理
@@ -26,9 +28,21 @@ SSL_CTX *ssl_ctx = nullptr;   // SSL上下文
 
 // 项目自定义头文件
 #include "XThreadPool.h"
+#include "XIOPool.h"
+#include "XQuota.h"
 #include "XThread.h"
 #include "XTask.h"
 #include "XFtpFactory.h"
+#include "XConfig.h"
+#include "XAdmin.h"
+#include "XWatchdog.h"
+#include "XXferLog.h"
+#include "XAdmission.h"
+#include "XRateLimit.h"
+#include "XNetAddr.h"
+#include "XHashIndex.h"
+#include "XPrecompress.h"
+#include "XUserStore.h"
 #include "testUtil.h"
 
 #define SPORT 21            // FTP默认控制端口
@@ -58,9 +72,25 @@ void listen_cb(struct evconnlistener *evl, evutil_socket_t fd,
                 struct sockaddr *addr, int socklen, void *arg)
 {
     Logger::info("Main Thread: New connection");
-    // sockaddr_in *sin = (sockaddr_in *)addr; // 当前未使用
+
+    // 对端地址（准入控制与传输日志使用）；双栈监听下 IPv4 客户端是 v4-mapped 地址，先还原
+    sockaddr_storage peer;
+    XNetAddr::Normalize(addr, &peer);
+    string host = XNetAddr::Host((sockaddr *)&peer);
+
+    // 准入控制：拒绝的连接不创建会话，直接回 421 关闭
+    XAdmitResult admit = XAdmission::Get()->Admit(host);
+    if(admit != XADMIT_OK){
+        Logger::warning("Main Thread: reject connection from ", host, " (", XAdmission::ReasonName(admit), ")");
+        XAdmission::Reject(fd, admit);
+        return;
+    }
+
     std::shared_ptr<XFtpServerCMD>cmdTask = XFtpFactory::Get()->CreateTask();
     cmdTask->sock = fd;
+    cmdTask->peer = host;
+    cmdTask->peerAddr = peer;
+    cmdTask->admitted = true;
 
     XThreadPoolGet->Dispatch(cmdTask);
 }
@@ -71,7 +101,49 @@ void clear(event_base *base, evconnlistener *evl){
 }
 
 
-int main(){
+int main(int argc, char *argv[]){
+    // ftpSrv --hash-password：从标准输入读一行口令，输出用户表（users_file）中使用的散列
+    if(argc > 1 && string(argv[1]) == "--hash-password"){
+        string password;
+        if(!getline(std::cin, password)) return 1;
+        if(!password.empty() && password.back() == '\r') password.pop_back();
+        string hash = XUserStore::Hash(password);
+        if(hash.empty()) return 1;
+        std::cout << hash << std::endl;
+        return 0;
+    }
+
+    // 加载配置（ftpSrv.conf 不存在时使用默认值）
+    XConfig::Get()->Load("ftpSrv.conf");
+    string level = XConfig::Get()->GetString("log_level", "info");
+    if(XLog::ParseLevel(level) < 0){
+        Logger::warning("Main Thread -> invalid log_level: ", level, ", using info");
+    }
+    else{
+        Logger::SetLevel(XLog::ParseLevel(level));
+    }
+    string xferlog = XConfig::Get()->GetString("xferlog_file");
+    if(!xferlog.empty()){
+        string format = XConfig::Get()->GetString("xferlog_format", "xferlog");
+        if(format != "xferlog" && format != "json"){
+            Logger::warning("Main Thread -> invalid xferlog_format: ", format, ", using xferlog");
+            format = "xferlog";
+        }
+        long long max_size = XConfig::Get()->GetInt("xferlog_max_size", 64 * 1024 * 1024);
+        int keep = XConfig::Get()->GetInt("xferlog_keep", 5);
+        if(XXferLog::Get()->Open(xferlog, format, max_size, keep)){
+            Logger::info("Main Thread -> transfer log: ", xferlog, " (", format, ")");
+        }
+        else{
+            Logger::error("Main Thread -> cannot open transfer log: ", xferlog, ", ", strerror(errno));
+        }
+    }
+    string trace = XConfig::Get()->GetString("trace_file");
+    if(!trace.empty()){
+        if(XLog::Get()->OpenTrace(trace)) Logger::info("Main Thread -> binary trace: ", trace);
+        else Logger::error("Main Thread -> cannot open trace file: ", trace, ", ", strerror(errno));
+    }
+
     // 初始化OpenSSL
     #ifndef OPENSSL_NO_SSL_INCLUDES
     SSL_library_init();            // 初始化OpenSSL库
@@ -125,8 +197,15 @@ int main(){
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
+    // 卡顿检测：回调耗时超过阈值时记录；可选看门狗线程在卡顿进行中就报告并打印调用栈
+    XWatchdog::Get()->SetThreshold((int)XConfig::Get()->GetInt("stall_threshold_ms", 100));
+    if(XConfig::Get()->GetBool("stall_watchdog", false)){
+        XWatchdog::Get()->Start(XConfig::Get()->GetBool("stall_stack_dump", false));
+    }
+
     // 1. 初始化线程池
     XThreadPoolGet->Init(20);
+    XIOPool::Get()->Init(4);     // 阻塞型任务（目录遍历等）线程池
 
     // 2. 初始化libevent事件循环基座
     event_base *base = event_base_new();
@@ -136,25 +215,55 @@ int main(){
     }
     global_base = base;
 
-    // 3. 网络地址配置
-    sockaddr_in sin;
-    memset(&sin, 0, sizeof(sin));
-    sin.sin_family = AF_INET;
-    sin.sin_addr.s_addr = htonl(INADDR_ANY);
-    sin.sin_port = htons(SPORT);
+    // 管理端口（/metrics），与监听器共用主线程的事件循环
+    XAdmin::Get()->Start(base, XConfig::Get()->GetString("admin_addr", "127.0.0.1"),
+                         (int)XConfig::Get()->GetInt("admin_port", 0));
+
+    // RETR/STOR 带宽整形（全局 / 单会话 / 单用户），可通过管理端口 /ratelimit 运行时调整
+    XRateLimit::Get()->Load();
+
+    // 文件摘要索引：HASH/XCRC 等对未变化的文件直接返回上次的结果，STOR 时边收边算
+    string hash_index = XConfig::Get()->GetString("hash_index_file");
+    if(!hash_index.empty()){
+        XHashIndex::Get()->Open(hash_index, (int)XConfig::Get()->GetInt("hash_index_entries", 65536));
+    }
+
+    // MODE Z 下载的预压缩版本（.zst/.gz 兄弟文件、热门文件在缓存目录中生成的版本）
+    XPrecompress::Get()->Init();
+
+    // 用户表（users_file），未配置时为开放模式（根目录为 default_root）
+    if(!XUserStore::Get()->Init()){
+        return -1;
+    }
+
+    // 每个用户的存储配额：先读用量日志，再在后台遍历各用户根目录重建
+    XQuota::Get()->Init();
+
+    // 连接准入控制（连接数、accept 速率、过载时拒绝新连接）
+    XAdmission::Get()->Start(base);
+
+    // 3. 创建监听 socket：默认双栈 [::]（IPv4 客户端以 v4-mapped 地址连入），listen_addr 可指定单个地址
+    string listen_addr = XConfig::Get()->GetString("listen_addr", "");
+    evutil_socket_t listen_fd = XNetAddr::Listen(listen_addr, SPORT, XAdmission::Get()->Backlog());
+    if(listen_fd < 0){
+        Logger::error("Main Thread -> cannot listen on ", listen_addr.empty() ? "[::]" : listen_addr, ":", SPORT,
+                      ", ", strerror(errno));
+        clear(base, nullptr);
+        return -1;
+    }
 
     // 4. 创建监听器
-    evconnlistener *evl = evconnlistener_new_bind(
+    evconnlistener *evl = evconnlistener_new(
         base,                                        // libevent事件循环基座
         listen_cb,                                   // 接收到连接的回调函数
         base,                                        // 回调函数的参数arg
-        LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE,   // 监听器选项：监听器关闭时释放资源，端口可重用
-        10,                                          // 监听器队列大小
-        (struct sockaddr *)&sin,                     // 监听地址
-        sizeof(sin)
+        LEV_OPT_CLOSE_ON_FREE,                       // 监听器选项：监听器关闭时释放资源（socket 已设置端口可重用）
+        0,                                           // socket 已在监听（队列长度为 listen_backlog）
+        listen_fd
     );
     if(evl == NULL){
-        Logger::error("Main Thread -> evconnlistener_new_bind error");
+        Logger::error("Main Thread -> evconnlistener_new error");
+        evutil_closesocket(listen_fd);
         clear(base, evl);
         return -1;
     }
@@ -167,6 +276,9 @@ int main(){
     Logger::info("Main Thread -> Thread_id: ", getpid());
     event_base_dispatch(base);
     Logger::info("Main Thread -> event_base_dispatch exit");
+    XAdmin::Get()->Stop();
+    XAdmission::Get()->Stop();
+    XHashIndex::Get()->Close();
     SSL_CTX_free(ssl_ctx);
     Logger::info("Main Thread -> SSL_CTX_free called");
     clear(base, evl);
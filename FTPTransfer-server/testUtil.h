@@ -1,37 +1,68 @@
 #pragma once
 
 #include <iostream>
+#include "XLog.h"
+#include "XLogEvents.h"
 using namespace std;
 
 #ifdef TEST
 #define testout(msg) cout << msg << endl << flush
-#else 
-#define testout(msg) 
+#else
+#define testout(msg)
 #endif
 
+// 日志接口：先检查级别再格式化，写入本线程的无锁环形缓冲区，由 XLog 后台线程批量输出
 class Logger{
 public:
+    // 运行时设置最低输出级别（XLOG_DEBUG/XLOG_INFO/XLOG_WARNING/XLOG_ERROR/XLOG_OFF）
+    static void SetLevel(int level){ XLog::SetLevel(level); }
+
+    // 级别是否输出（编译期与运行时）。参数在调用 Logger 之前就已求值，级别被关掉时格式化省掉了，
+    // 参数本身的计算（strerror、拼接字符串等）却省不掉；这类调用先用它检查：
+    // if(Logger::Enabled<XLOG_DEBUG>()) Logger::debug(..., strerror(errno));
+    template <int LEVEL>
+    static bool Enabled(){
+        if constexpr (LEVEL >= XLOG_MIN_LEVEL) return XLog::Enabled(LEVEL);
+        else return false;
+    }
+
     template <typename ...Args>
     static void info(Args&& ...args){
-        cout << "[INFO] ";
-        (cout << ... << args) << endl << flush;
+        Write<XLOG_INFO>("[INFO] ", std::forward<Args>(args)...);
     }
 
     template <typename ...Args>
     static void error(Args&& ...args){
-        cout << "[ERROR] ";
-        (cout << ... << args) << endl << flush;
+        Write<XLOG_ERROR>("[ERROR] ", std::forward<Args>(args)...);
     }
 
     template <typename ...Args>
     static void debug(Args&& ...args){
-        cout << "[DEBUG] ";
-        (cout << ... << args) << endl << flush;
+        Write<XLOG_DEBUG>("[DEBUG] ", std::forward<Args>(args)...);
     }
 
     template <typename ...Args>
     static void warning(Args&& ...args){
-        cout << "[DEBUG] ";
-        (cout << ... << args) << endl << flush;
+        Write<XLOG_WARNING>("[WARNING] ", std::forward<Args>(args)...);
+    }
+
+    // 二进制跟踪记录，参数均按 int64 保存，见 XLogEvents.h
+    template <typename ...Args>
+    static void trace(XLogTraceEvent event, uint32_t session, Args ...args){
+        if(!XLog::TraceEnabled()) return;
+        int64_t argv[sizeof...(Args) + 1] = {static_cast<int64_t>(args)...};
+        XLog::Get()->Trace(event, session, argv, sizeof...(Args));
+    }
+
+private:
+    template <int LEVEL, typename ...Args>
+    static void Write(const char *tag, Args&& ...args){
+        if constexpr (LEVEL >= XLOG_MIN_LEVEL){
+            if(!XLog::Enabled(LEVEL)) return;
+            std::ostream &os = XLog::Get()->Begin();
+            os << tag;
+            (os << ... << args);
+            XLog::Get()->Commit();
+        }
     }
 };
@@ -0,0 +1,124 @@
+// 二进制跟踪日志解码工具
+// 用法：xlogdump <trace_file> [-s session] [-e event]
+// 输出：时间 线程 会话 事件 参数...，每条记录一行
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "XLogEvents.h"
+
+using namespace std;
+
+struct EventInfo{
+    const char *name;
+    const char *args;
+};
+
+static const EventInfo events[] = {
+#define XLOG_TRACE_INFO(name, text, args) {text, args},
+    XLOG_TRACE_EVENTS(XLOG_TRACE_INFO)
+#undef XLOG_TRACE_INFO
+};
+
+
+static void PrintArg(const string &spec, int64_t v){
+    size_t colon = spec.find(':');
+    string name = spec.substr(0, colon);
+    char type = colon == string::npos ? 'd' : spec[colon + 1];
+    if(type == 'x'){
+        printf(" %s=0x%llx", name.c_str(), (unsigned long long)v);
+    }
+    else if(type == 'c'){
+        char s[9] = {0};
+        memcpy(s, &v, 8);
+        printf(" %s=%s", name.c_str(), s);
+    }
+    else{
+        printf(" %s=%lld", name.c_str(), (long long)v);
+    }
+}
+
+
+int main(int argc, char *argv[]){
+    if(argc < 2){
+        fprintf(stderr, "usage: %s <trace_file> [-s session] [-e event]\n", argv[0]);
+        return 1;
+    }
+    long long only_session = -1;
+    string only_event;
+    for(int i = 2; i + 1 < argc; i += 2){
+        if(strcmp(argv[i], "-s") == 0) only_session = atoll(argv[i + 1]);
+        else if(strcmp(argv[i], "-e") == 0) only_event = argv[i + 1];
+    }
+
+    FILE *fp = fopen(argv[1], "rb");
+    if(!fp){
+        perror(argv[1]);
+        return 1;
+    }
+
+    XLogTraceFileHeader hdr;
+    if(fread(&hdr, sizeof(hdr), 1, fp) != 1 || memcmp(hdr.magic, XLOG_TRACE_MAGIC, 8) != 0){
+        fprintf(stderr, "%s: not a trace file\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+    if(hdr.endian != 0x01020304 || hdr.version != 1){
+        fprintf(stderr, "%s: unsupported version or byte order\n", argv[1]);
+        fclose(fp);
+        return 1;
+    }
+
+    XLogTraceRecord rec;
+    int64_t args[255];
+    size_t count = 0;
+    while(fread(&rec, sizeof(rec), 1, fp) == 1){
+        if(rec.argc > 0 && fread(args, 8, rec.argc, fp) != rec.argc){
+            fprintf(stderr, "truncated record at #%zu\n", count);
+            break;
+        }
+        count++;
+
+        const EventInfo *info = rec.event < XTRACE_EVENT_COUNT ? &events[rec.event] : nullptr;
+        if(only_session >= 0 && rec.session != only_session) continue;
+        if(!only_event.empty() && (!info || only_event != info->name)) continue;
+
+        time_t sec = rec.ts_ns / 1000000000ull;
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+        printf("%s.%06llu t%u s%u ", stamp,
+               (unsigned long long)(rec.ts_ns % 1000000000ull) / 1000, rec.thread, rec.session);
+
+        if(!info){
+            printf("event#%u", rec.event);
+            for(int i = 0; i < rec.argc; i++) printf(" %lld", (long long)args[i]);
+            printf("\n");
+            continue;
+        }
+
+        printf("%s", info->name);
+        // 按事件表中的参数说明逐个输出，多余的参数按十进制输出
+        string specs = info->args;
+        size_t pos = 0;
+        for(int i = 0; i < rec.argc; i++){
+            string spec;
+            if(pos < specs.size()){
+                size_t comma = specs.find(',', pos);
+                spec = specs.substr(pos, comma == string::npos ? string::npos : comma - pos);
+                pos = comma == string::npos ? specs.size() : comma + 1;
+            }
+            else{
+                spec = "arg" + to_string(i);
+            }
+            PrintArg(spec, args[i]);
+        }
+        printf("\n");
+    }
+    fclose(fp);
+    return 0;
+}